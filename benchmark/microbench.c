@@ -0,0 +1,558 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020 Redis Labs
+ *
+ * RedisRaft is dual licensed under the GNU Affero General Public License version 3
+ * (AGPLv3) or the Redis Source Available License (RSAL).
+ */
+
+/* Microbenchmarks of hot functions, run by 'make bench'.
+ *
+ * Every benchmark runs a number of iterations of a single operation and
+ * reports the time per operation; only the operation itself is timed, not
+ * its setup.  Results can also be written as JSON, to compare builds.
+ *
+ * Usage: microbench [-f <filter>] [-s <scale>] [-j <json-file>]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_premble.h"
+#include "../redisraft.h"
+
+#define LOGNAME "bench.log.db"
+#define DBID "01234567890123456789012345678901"
+#define VALUE_SIZE 100
+
+/* Redis symbols to keep linker happy */
+void *rdbLoad;
+void *rdbSave;
+
+static volatile unsigned long sink;     /* Keeps results from being optimized out */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ----------------------------------- Helpers ----------------------------------- */
+
+static void makeSetCommand(RaftRedisCommandArray *cmds, long n)
+{
+    char key[32];
+    char value[VALUE_SIZE];
+
+    snprintf(key, sizeof(key), "key:%ld", n);
+    memset(value, 'x', sizeof(value));
+
+    RaftRedisCommand *cmd = RaftRedisCommandArrayExtend(cmds);
+    cmd->argc = 3;
+    cmd->argv = RedisModule_Alloc(sizeof(RedisModuleString *) * 3);
+    cmd->argv[0] = RedisModule_CreateString(NULL, "SET", 3);
+    cmd->argv[1] = RedisModule_CreateString(NULL, key, strlen(key));
+    cmd->argv[2] = RedisModule_CreateString(NULL, value, sizeof(value));
+}
+
+static raft_entry_t *makeEntry(long n)
+{
+    RaftRedisCommandArray cmds = { 0 };
+
+    makeSetCommand(&cmds, n);
+    raft_entry_t *e = RaftRedisCommandArraySerialize(&cmds);
+    e->id = n;
+    e->term = 1;
+    e->type = RAFT_LOGTYPE_NORMAL;
+    RaftRedisCommandArrayFree(&cmds);
+
+    return e;
+}
+
+static RaftLog *createLog(bool fsync)
+{
+    RedisRaftConfig cfg = {
+        .id = 1,
+        .raft_log_fsync = fsync,
+        .raft_log_segment_size = REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE
+    };
+
+    RaftLogRemoveFiles(LOGNAME);
+    RaftLog *log = RaftLogCreate(LOGNAME, DBID, 1, 0, 1, -1, &cfg);
+    if (!log) {
+        fprintf(stderr, "Failed to create log %s\n", LOGNAME);
+        exit(1);
+    }
+
+    return log;
+}
+
+static void destroyLog(RaftLog *log)
+{
+    RaftLogClose(log);
+    RaftLogRemoveFiles(LOGNAME);
+}
+
+static RaftLog *createFilledLog(long iters)
+{
+    RaftLog *log = createLog(false);
+    long i;
+
+    for (i = 1; i <= iters; i++) {
+        raft_entry_t *e = makeEntry(i);
+        RaftLogAppendNoSync(log, e);
+        raft_entry_release(e);
+    }
+    RaftLogSync(log);
+
+    return log;
+}
+
+/* ---------------------------------- Benchmarks ---------------------------------- */
+
+/* Every benchmark runs the specified number of iterations and returns the
+ * time they took, in nsec.
+ */
+
+static uint64_t benchSerialize(long iters)
+{
+    RaftRedisCommandArray cmds = { 0 };
+    long i;
+
+    makeSetCommand(&cmds, 1);
+
+    uint64_t start = now_ns();
+    for (i = 0; i < iters; i++) {
+        raft_entry_t *e = RaftRedisCommandArraySerialize(&cmds);
+        sink += e->data_len;
+        raft_entry_release(e);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    RaftRedisCommandArrayFree(&cmds);
+    return elapsed;
+}
+
+static uint64_t benchDeserialize(long iters)
+{
+    raft_entry_t *e = makeEntry(1);
+    long i;
+
+    uint64_t start = now_ns();
+    for (i = 0; i < iters; i++) {
+        RaftRedisCommandArray cmds = { 0 };
+        if (RaftRedisCommandArrayDeserialize(&cmds, e->data, e->data_len) != RR_OK) {
+            abort();
+        }
+        sink += cmds.len;
+        RaftRedisCommandArrayFree(&cmds);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    raft_entry_release(e);
+    return elapsed;
+}
+
+static uint64_t benchDecodeView(long iters)
+{
+    raft_entry_t *e = makeEntry(1);
+    long i;
+
+    uint64_t start = now_ns();
+    for (i = 0; i < iters; i++) {
+        RaftRedisCommandArrayView view = { 0 };
+        if (RaftRedisCommandArrayViewDecode(&view, e->data, e->data_len) != RR_OK) {
+            abort();
+        }
+        sink += view.len;
+        RaftRedisCommandArrayViewFree(&view);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    raft_entry_release(e);
+    return elapsed;
+}
+
+static uint64_t benchEntryCacheAppend(long iters)
+{
+    EntryCache *cache = EntryCacheNew(1024);
+    raft_entry_t *e = makeEntry(1);
+    long i;
+
+    uint64_t start = now_ns();
+    for (i = 1; i <= iters; i++) {
+        EntryCacheAppend(cache, e, i);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    raft_entry_release(e);
+    EntryCacheFree(cache);
+    return elapsed;
+}
+
+static uint64_t benchEntryCacheGet(long iters)
+{
+    EntryCache *cache = EntryCacheNew(1024);
+    raft_entry_t *e = makeEntry(1);
+    long i;
+
+    for (i = 1; i <= iters; i++) {
+        EntryCacheAppend(cache, e, i);
+    }
+    raft_entry_release(e);
+
+    uint64_t start = now_ns();
+    for (i = 1; i <= iters; i++) {
+        e = EntryCacheGet(cache, i);
+        sink += e->data_len;
+        raft_entry_release(e);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    EntryCacheFree(cache);
+    return elapsed;
+}
+
+/* Evicts all entries, one at a time */
+static uint64_t benchEntryCacheCompact(long iters)
+{
+    EntryCache *cache = EntryCacheNew(1024);
+    raft_entry_t *e = makeEntry(1);
+    long i;
+
+    for (i = 1; i <= iters; i++) {
+        EntryCacheAppend(cache, e, i);
+    }
+    raft_entry_release(e);
+
+    size_t entry_size = cache->entries_memsize / cache->len;
+
+    uint64_t start = now_ns();
+    for (i = 1; i <= iters; i++) {
+        sink += EntryCacheCompact(cache, (iters - i) * entry_size);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    EntryCacheFree(cache);
+    return elapsed;
+}
+
+static uint64_t benchLogAppend(long iters, bool fsync)
+{
+    RaftLog *log = createLog(fsync);
+    raft_entry_t *e = makeEntry(1);
+    long i;
+
+    uint64_t start = now_ns();
+    for (i = 0; i < iters; i++) {
+        if (RaftLogAppend(log, e) != RR_OK) {
+            abort();
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    raft_entry_release(e);
+    destroyLog(log);
+    return elapsed;
+}
+
+static uint64_t benchLogAppendNoFsync(long iters)
+{
+    return benchLogAppend(iters, false);
+}
+
+static uint64_t benchLogAppendFsync(long iters)
+{
+    return benchLogAppend(iters, true);
+}
+
+static uint64_t benchLogGet(long iters, bool random)
+{
+    RaftLog *log = createFilledLog(iters);
+    raft_index_t *idx = malloc(sizeof(raft_index_t) * iters);
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        idx[i] = random ? 1 + rand() % iters : i + 1;
+    }
+
+    uint64_t start = now_ns();
+    for (i = 0; i < iters; i++) {
+        raft_entry_t *e = RaftLogGet(log, idx[i]);
+        if (!e) {
+            abort();
+        }
+        sink += e->data_len;
+        raft_entry_release(e);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    free(idx);
+    destroyLog(log);
+    return elapsed;
+}
+
+static uint64_t benchLogGetSequential(long iters)
+{
+    return benchLogGet(iters, false);
+}
+
+static uint64_t benchLogGetRandom(long iters)
+{
+    return benchLogGet(iters, true);
+}
+
+static uint64_t benchLogCursorSequential(long iters)
+{
+    RaftLog *log = createFilledLog(iters);
+    RaftLogCursor *cursor = RaftLogCursorNew(log);
+    long i;
+
+    uint64_t start = now_ns();
+    for (i = 1; i <= iters; i++) {
+        raft_entry_t *e = RaftLogCursorGet(cursor, i);
+        if (!e) {
+            abort();
+        }
+        sink += e->data_len;
+        raft_entry_release(e);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    RaftLogCursorFree(cursor);
+    destroyLog(log);
+    return elapsed;
+}
+
+/* Catching up a follower: the whole log is read in AppendEntries batches
+ * through the log implementation, with nothing cached in memory.
+ */
+#define CATCHUP_BATCH_SIZE 64
+
+static uint64_t benchLogCatchup(long iters)
+{
+    RedisRaftConfig config = {
+        .append_entries_max_bytes = REDIS_RAFT_DEFAULT_APPEND_ENTRIES_MAX_BYTES
+    };
+    RedisRaftCtx rr = {
+        .config = &config,
+        .log = createFilledLog(iters),
+        .logcache = EntryCacheNew(1024)
+    };
+    raft_entry_t *entries[CATCHUP_BATCH_SIZE];
+    raft_index_t idx = 1;
+
+    uint64_t start = now_ns();
+    while (idx <= iters) {
+        int n = RaftLogImpl.get_batch(&rr, idx, CATCHUP_BATCH_SIZE, entries);
+        if (n <= 0) {
+            abort();
+        }
+        for (int i = 0; i < n; i++) {
+            sink += entries[i]->data_len;
+            raft_entry_release(entries[i]);
+        }
+        idx += n;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    EntryCacheFree(rr.logcache);
+    destroyLog(rr.log);
+    return elapsed;
+}
+
+static uint64_t benchKeyHashSlot(long iters)
+{
+    char keys[1024][32];
+    int lens[1024];
+    long i;
+
+    for (i = 0; i < 1024; i++) {
+        /* Every 8th key uses a hash tag */
+        lens[i] = snprintf(keys[i], sizeof(keys[i]), i % 8 ? "key:%ld" : "{user%ld}:key", i);
+    }
+
+    uint64_t start = now_ns();
+    for (i = 0; i < iters; i++) {
+        sink += keyHashSlot(keys[i % 1024], lens[i % 1024]);
+    }
+    return now_ns() - start;
+}
+
+/* A producer thread submits requests while the loop thread drains them, as
+ * the Redis and Raft threads do.  Client disconnect requests are used since
+ * their handler does no more than free them.
+ */
+typedef struct RqueueBench {
+    RedisRaftCtx rr;
+    RedisRaftConfig config;
+    uv_async_t done_sig;
+    long iters;
+} RqueueBench;
+
+/* Module dictionaries are only created by RedisRaftInit() */
+static int benchDictDelC(RedisModuleDict *d, void *key, size_t keylen, void *oldval)
+{
+    return REDISMODULE_ERR;
+}
+
+static void *rqueueProducer(void *arg)
+{
+    RqueueBench *b = arg;
+
+    for (long i = 0; i < b->iters; i++) {
+        RaftReq *req = RaftReqInit(NULL, RR_CLIENT_DISCONNECT);
+        req->r.client_disconnect.client_id = i;
+        RaftReqSubmit(&b->rr, req);
+    }
+
+    uv_async_send(&b->done_sig);
+    return NULL;
+}
+
+static void rqueueDone(uv_async_t *handle)
+{
+    RqueueBench *b = uv_handle_get_data((uv_handle_t *) handle);
+
+    /* Drain whatever was submitted after the last signal was handled */
+    RaftReqHandleQueue(&b->rr.rqueue_sig);
+
+    uv_close((uv_handle_t *) &b->rr.rqueue_sig, NULL);
+    uv_close((uv_handle_t *) &b->done_sig, NULL);
+}
+
+static uint64_t benchRqueueSubmitDrain(long iters)
+{
+    RqueueBench b = { .iters = iters };
+    uv_loop_t loop;
+    pthread_t producer;
+
+    RedisModule_DictDelC = benchDictDelC;
+
+    b.rr.config = &b.config;
+    STAILQ_INIT(&b.rr.rqueue);
+    uv_mutex_init(&b.rr.rqueue_mutex);
+
+    uv_loop_init(&loop);
+    uv_async_init(&loop, &b.rr.rqueue_sig, RaftReqHandleQueue);
+    uv_handle_set_data((uv_handle_t *) &b.rr.rqueue_sig, &b.rr);
+    uv_async_init(&loop, &b.done_sig, rqueueDone);
+    uv_handle_set_data((uv_handle_t *) &b.done_sig, &b);
+
+    uint64_t start = now_ns();
+    pthread_create(&producer, NULL, rqueueProducer, &b);
+    uv_run(&loop, UV_RUN_DEFAULT);
+    uint64_t elapsed = now_ns() - start;
+
+    pthread_join(producer, NULL);
+    uv_loop_close(&loop);
+    uv_mutex_destroy(&b.rr.rqueue_mutex);
+    return elapsed;
+}
+
+typedef struct Benchmark {
+    const char *name;
+    uint64_t (*func)(long iters);
+    long iters;
+} Benchmark;
+
+static Benchmark benchmarks[] = {
+    { "serialize",              benchSerialize,         1000000 },
+    { "deserialize",            benchDeserialize,       1000000 },
+    { "decode_view",            benchDecodeView,        1000000 },
+    { "entrycache_append",      benchEntryCacheAppend,  1000000 },
+    { "entrycache_get",         benchEntryCacheGet,     1000000 },
+    { "entrycache_compact",     benchEntryCacheCompact, 1000000 },
+    { "log_append_nofsync",     benchLogAppendNoFsync,  200000 },
+    { "log_append_fsync",       benchLogAppendFsync,    1000 },
+    { "log_get_sequential",     benchLogGetSequential,  200000 },
+    { "log_get_random",         benchLogGetRandom,      200000 },
+    { "log_cursor_sequential",  benchLogCursorSequential, 200000 },
+    { "log_catchup",            benchLogCatchup,        200000 },
+    { "key_hash_slot",          benchKeyHashSlot,       10000000 },
+    { "rqueue_submit_drain",    benchRqueueSubmitDrain, 1000000 },
+    { NULL }
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-f <filter>] [-s <scale>] [-j <json-file>]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filter = NULL;
+    const char *json_file = NULL;
+    double scale = 1.0;
+    FILE *json = NULL;
+    int opt;
+    int n = 0;
+
+    while ((opt = getopt(argc, argv, "f:s:j:")) != -1) {
+        switch (opt) {
+            case 'f':
+                filter = optarg;
+                break;
+            case 's':
+                scale = strtod(optarg, NULL);
+                if (scale <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'j':
+                json_file = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (json_file && !(json = fopen(json_file, "w"))) {
+        perror(json_file);
+        return 1;
+    }
+
+    srand(1);
+    printf("%-24s %12s %12s %14s\n", "benchmark", "iterations", "ns/op", "ops/sec");
+
+    if (json) {
+        fprintf(json, "[\n");
+    }
+    for (Benchmark *b = benchmarks; b->name; b++) {
+        if (filter && !strstr(b->name, filter)) {
+            continue;
+        }
+
+        long iters = b->iters * scale;
+        if (iters < 1) {
+            iters = 1;
+        }
+
+        uint64_t elapsed = b->func(iters);
+        double ns_per_op = (double) elapsed / iters;
+
+        printf("%-24s %12ld %12.1f %14.0f\n", b->name, iters, ns_per_op,
+               ns_per_op > 0 ? 1e9 / ns_per_op : 0);
+        fflush(stdout);
+
+        if (json) {
+            fprintf(json, "%s  {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f}",
+                    n ? ",\n" : "", b->name, iters, ns_per_op);
+        }
+        n++;
+    }
+    if (json) {
+        fprintf(json, "\n]\n");
+        fclose(json);
+    }
+
+    return 0;
+}
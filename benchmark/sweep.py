@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+"""
+This file is part of RedisRaft.
+
+Copyright (c) 2020 Redis Labs
+
+RedisRaft is dual licensed under the GNU Affero General Public License version 3
+(AGPLv3) or the Redis Source Available License (RSAL).
+
+Runs memtier_benchmark against a RedisRaft cluster started by
+redisraft_cluster.sh. It sweeps pipeline depth, value size, fsync mode and
+follower proxying, and writes throughput and p50/p99/p999 latencies to a
+JSON file. If a baseline file from an earlier run is given, the two runs are
+compared.
+
+Example:
+
+    python3 benchmark/sweep.py --output new.json --baseline old.json
+"""
+
+import argparse
+import json
+import os
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCHMARK_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT_DIR = os.path.dirname(BENCHMARK_DIR)
+
+
+def parse_list(value):
+    return [v.strip() for v in value.split(',') if v.strip()]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='RedisRaft memtier sweep')
+    parser.add_argument('--redis', default='../redis/src/redis-server',
+                        help='redis-server executable')
+    parser.add_argument('--raftmodule',
+                        default=os.path.join(ROOT_DIR, 'redisraft.so'),
+                        help='RedisRaft module')
+    parser.add_argument('--memtier',
+                        default='../memtier_benchmark/memtier_benchmark',
+                        help='memtier_benchmark executable')
+    parser.add_argument('--nodes', type=int, default=3)
+    parser.add_argument('--port', type=int, default=5001)
+    parser.add_argument('--threads', type=int, default=1)
+    parser.add_argument('--clients', type=int, default=50)
+    parser.add_argument('--test-time', type=int, default=10)
+    parser.add_argument('--ratio', default='1:1',
+                        help='memtier set:get ratio')
+    parser.add_argument('--pipeline', type=parse_list, default=['1', '16'],
+                        help='comma separated pipeline depths')
+    parser.add_argument('--data-size', type=parse_list,
+                        default=['32', '1024'],
+                        help='comma separated value sizes')
+    parser.add_argument('--fsync', type=parse_list, default=['yes', 'no'],
+                        help='comma separated raft-log-fsync values')
+    parser.add_argument('--follower-proxy', type=parse_list,
+                        default=['no', 'yes'],
+                        help='comma separated values; with yes, memtier '
+                             'connects to a follower that proxies to the '
+                             'leader')
+    parser.add_argument('--modulearg', action='append', default=[],
+                        help='additional module argument')
+    parser.add_argument('--output', default='sweep.json',
+                        help='JSON results file')
+    parser.add_argument('--baseline', help='JSON results file to compare to')
+    return parser.parse_args()
+
+
+def redis_cli(port, *args):
+    try:
+        return subprocess.check_output(
+            ['redis-cli', '-p', str(port)] + list(args),
+            stderr=subprocess.DEVNULL, timeout=5).decode()
+    except (subprocess.SubprocessError, OSError):
+        return ''
+
+
+def wait_for_cluster(args):
+    """
+    Waits until every node is up and a member of the cluster.
+    """
+    for _ in range(100):
+        ready = 0
+        for n in range(args.nodes):
+            info = redis_cli(args.port + n, 'RAFT.INFO')
+            if 'state:up' in info and \
+                    'num_voting_nodes:{}'.format(args.nodes) in info:
+                ready += 1
+        if ready == args.nodes:
+            return
+        time.sleep(0.2)
+    raise RuntimeError('cluster did not come up')
+
+
+def start_cluster(args, workdir, fsync, follower_proxy):
+    cmd = [os.path.join(BENCHMARK_DIR, 'redisraft_cluster.sh'),
+           '--redis', os.path.abspath(args.redis),
+           '--raftmodule', os.path.abspath(args.raftmodule),
+           '--modulearg', 'raft-log-fsync={}'.format(fsync),
+           '--modulearg', 'follower-proxy={}'.format(follower_proxy),
+           '--modulearg', 'raftize-all-commands=yes',
+           '--nodes', str(args.nodes),
+           '--port', str(args.port)]
+    for arg in args.modulearg:
+        cmd += ['--modulearg', arg]
+
+    # The script waits until killed; run it in its own process group so
+    # it's stopped along with the servers it started.
+    proc = subprocess.Popen(cmd, cwd=workdir, start_new_session=True,
+                            stdout=subprocess.DEVNULL)
+    try:
+        wait_for_cluster(args)
+    except RuntimeError:
+        stop_cluster(proc)
+        raise
+    return proc
+
+
+def stop_cluster(proc):
+    try:
+        os.killpg(proc.pid, signal.SIGTERM)
+    except ProcessLookupError:
+        pass
+    proc.wait()
+
+
+def percentile(stats, name):
+    # memtier reports percentiles as e.g. "p99.90"
+    for key, value in stats.get('Percentile Latencies', {}).items():
+        if key.startswith('p') and float(key[1:]) == name:
+            return value
+    return None
+
+
+def run_memtier(args, workdir, port, pipeline, data_size):
+    out = os.path.join(workdir, 'memtier.json')
+    cmd = [args.memtier,
+           '--server', '127.0.0.1',
+           '--port', str(port),
+           '--threads', str(args.threads),
+           '--clients', str(args.clients),
+           '--test-time', str(args.test_time),
+           '--ratio', args.ratio,
+           '--pipeline', str(pipeline),
+           '--data-size', str(data_size),
+           '--print-percentiles', '50,99,99.9',
+           '--hide-histogram',
+           '--json-out-file', out]
+    subprocess.check_call(cmd, stdout=subprocess.DEVNULL)
+
+    with open(out) as f:
+        totals = json.load(f)['ALL STATS']['Totals']
+    return {
+        'ops_sec': totals.get('Ops/sec'),
+        'p50_msec': percentile(totals, 50),
+        'p99_msec': percentile(totals, 99),
+        'p999_msec': percentile(totals, 99.9),
+    }
+
+
+def result_key(result):
+    return (result['fsync'], result['follower_proxy'],
+            result['pipeline'], result['data_size'])
+
+
+def compare(results, baseline_file):
+    with open(baseline_file) as f:
+        baseline = {result_key(r): r for r in json.load(f)['results']}
+
+    def delta(new, old):
+        if not new or not old:
+            return '-'
+        return '{:+.1f}%'.format((new - old) * 100.0 / old)
+
+    print('{:6} {:6} {:>8} {:>8} {:>10} {:>10} {:>10} {:>10}'.format(
+        'fsync', 'proxy', 'pipeline', 'size', 'ops/sec', 'p50', 'p99', 'p999'))
+    for r in results:
+        old = baseline.get(result_key(r))
+        if not old:
+            continue
+        print('{:6} {:6} {:>8} {:>8} {:>10} {:>10} {:>10} {:>10}'.format(
+            r['fsync'], r['follower_proxy'], r['pipeline'], r['data_size'],
+            delta(r['ops_sec'], old['ops_sec']),
+            delta(r['p50_msec'], old['p50_msec']),
+            delta(r['p99_msec'], old['p99_msec']),
+            delta(r['p999_msec'], old['p999_msec'])))
+
+
+def main():
+    args = parse_args()
+    if not shutil.which('redis-cli'):
+        sys.exit('Error: redis-cli not found')
+
+    workdir = tempfile.mkdtemp(prefix='redisraft-sweep-')
+    results = []
+    try:
+        for fsync in args.fsync:
+            for follower_proxy in args.follower_proxy:
+                proc = start_cluster(args, workdir, fsync, follower_proxy)
+                port = args.port + 1 if follower_proxy == 'yes' else args.port
+                try:
+                    for pipeline in args.pipeline:
+                        for data_size in args.data_size:
+                            result = {
+                                'fsync': fsync,
+                                'follower_proxy': follower_proxy,
+                                'pipeline': int(pipeline),
+                                'data_size': int(data_size),
+                            }
+                            result.update(run_memtier(args, workdir, port,
+                                                      pipeline, data_size))
+                            print(json.dumps(result))
+                            results.append(result)
+                finally:
+                    stop_cluster(proc)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    with open(args.output, 'w') as f:
+        json.dump({
+            'config': {
+                'nodes': args.nodes,
+                'threads': args.threads,
+                'clients': args.clients,
+                'test_time': args.test_time,
+                'ratio': args.ratio,
+                'modulearg': args.modulearg,
+            },
+            'results': results
+        }, f, indent=2)
+
+    if args.baseline:
+        compare(results, args.baseline)
+
+
+if __name__ == '__main__':
+    main()
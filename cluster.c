@@ -411,6 +411,79 @@ static void establishShardGroupConn(Connection *conn)
     sg->use_conn_addr = false;
 }
 
+/* Returns the number of shardgroup leaders known to run on host, counting
+ * the local leader (which is us) as well.
+ */
+static int countHostLeaders(RedisRaftCtx *rr, const char *host)
+{
+    ShardingInfo *si = rr->sharding_info;
+    int count = !strcmp(rr->config->addr.host, host);
+
+    for (int i = 1; i < si->shard_groups_num; i++) {
+        ShardGroup *sg = si->shard_groups[i];
+        if (sg->nodes_num && sg->leader_known && !strcmp(sg->nodes[0].addr.host, host)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Spreads leaders across hosts: if this host runs at least two more
+ * shardgroup leaders than the host of one of our followers, leadership is
+ * transferred to that follower.  Leaders of other shardgroups are only known
+ * as of their last update, so the balancing is approximate; every leader
+ * runs the same logic, so it converges over a few intervals.
+ */
+static void balanceLeaders(RedisRaftCtx *rr)
+{
+    long long mstime = RedisModule_Milliseconds();
+
+    if (!rr->config->leader_balance_interval ||
+        mstime - rr->last_leader_balance < rr->config->leader_balance_interval) {
+        return;
+    }
+    rr->last_leader_balance = mstime;
+
+    if (rr->transfer_req || raft_get_transfer_leader(rr->raft) != RAFT_NODE_ID_NONE) {
+        return;
+    }
+
+    int my_count = countHostLeaders(rr, rr->config->addr.host);
+    raft_node_t *target = NULL;
+    int target_count = my_count - 1;
+
+    for (int i = 0; i < raft_get_num_nodes(rr->raft); i++) {
+        raft_node_t *raft_node = raft_get_node_from_idx(rr->raft, i);
+        Node *node = raft_node_get_udata(raft_node);
+
+        if (!node || !raft_node_is_voting(raft_node) || !raft_node_is_active(raft_node) ||
+            !strcmp(node->addr.host, rr->config->addr.host)) {
+            continue;
+        }
+
+        int count = countHostLeaders(rr, node->addr.host);
+        if (count < target_count) {
+            target = raft_node;
+            target_count = count;
+        }
+    }
+
+    if (!target) {
+        return;
+    }
+
+    raft_node_id_t target_id = raft_node_get_id(target);
+    int ret = raft_transfer_leader(rr->raft, target_id, rr->config->election_timeout);
+    if (ret != 0) {
+        LOG_DEBUG("Leader balancing: failed to transfer leadership to node %d: %d", target_id, ret);
+        return;
+    }
+
+    LOG_INFO("Leader balancing: transferring leadership to node %d (%d leaders on this host, %d on target)",
+             target_id, my_count, target_count);
+}
+
 /* Called periodically by the main loop when cluster mode is enabled.
  *
  * Currently we use this to iterate all shardgroups and trigger an
@@ -437,12 +510,81 @@ void ClusterPeriodicCall(RedisRaftCtx *rr)
 
         sendShardGroupRequest(sg->conn);
     }
+
+    balanceLeaders(rr);
 }
 
 /* -----------------------------------------------------------------------------
  * ShardingInfo Handling
  * -------------------------------------------------------------------------- */
 
+/* Returns the shardgroup a hash slot was assigned to by its slot range, or 0.
+ */
+static int getShardGroupRangeOwner(ShardingInfo *si, int slot)
+{
+    for (int i = 0; i < si->shard_groups_num; i++) {
+        ShardGroup *sg = si->shard_groups[i];
+        if (slot >= sg->start_slot && slot <= sg->end_slot) {
+            return sg->id;
+        }
+    }
+
+    return 0;
+}
+
+/* Slot migration changes mappings after shardgroups are added, and is saved
+ * following the shardgroups as a list of all slots that are either no longer
+ * owned by the shardgroup whose range they're in, or are being migrated.
+ */
+static void saveSlotConfig(RedisModuleIO *rdb, ShardingInfo *si)
+{
+    unsigned int num = 0;
+
+    for (int i = 0; i < REDIS_RAFT_HASH_SLOTS; i++) {
+        if (si->slot_state[i] != SLOT_STABLE ||
+            si->hash_slots_map[i] != getShardGroupRangeOwner(si, i)) {
+            num++;
+        }
+    }
+
+    RedisModule_SaveUnsigned(rdb, num);
+    for (int i = 0; i < REDIS_RAFT_HASH_SLOTS && num > 0; i++) {
+        if (si->slot_state[i] != SLOT_STABLE ||
+            si->hash_slots_map[i] != getShardGroupRangeOwner(si, i)) {
+            RedisModule_SaveUnsigned(rdb, i);
+            RedisModule_SaveUnsigned(rdb, si->hash_slots_map[i]);
+            RedisModule_SaveUnsigned(rdb, si->slot_state[i]);
+            RedisModule_SaveUnsigned(rdb, si->slot_peer[i]);
+            num--;
+        }
+    }
+}
+
+/* Load slot configuration written by saveSlotConfig().  If si is NULL, it is
+ * read but ignored.
+ */
+static void loadSlotConfig(RedisModuleIO *rdb, ShardingInfo *si)
+{
+    unsigned int num = RedisModule_LoadUnsigned(rdb);
+
+    for (unsigned int i = 0; i < num; i++) {
+        int slot = RedisModule_LoadUnsigned(rdb);
+        int sgid = RedisModule_LoadUnsigned(rdb);
+        int state = RedisModule_LoadUnsigned(rdb);
+        int peer = RedisModule_LoadUnsigned(rdb);
+
+        if (!si) {
+            continue;
+        }
+
+        RedisModule_Assert(slot >= 0 && slot < REDIS_RAFT_HASH_SLOTS);
+        RedisModule_Assert(sgid <= si->shard_groups_num && peer <= si->shard_groups_num);
+        si->hash_slots_map[slot] = sgid;
+        si->slot_state[slot] = state;
+        si->slot_peer[slot] = peer;
+    }
+}
+
 /* Save ShardingInfo to RDB during snapshotting. This gets invoked by rdbSaveSnapshotInfo
  * which uses a pseudo key to get triggered.
  *
@@ -454,8 +596,9 @@ void ShardingInfoRDBSave(RedisModuleIO *rdb)
     RedisRaftCtx *rr = &redis_raft;
     ShardingInfo *si = rr->sharding_info;
 
-    /* If no ShardingInfo, write a zero count and abort. */
+    /* If no ShardingInfo, write zero counts and abort. */
     if (!si) {
+        RedisModule_SaveUnsigned(rdb, 0);
         RedisModule_SaveUnsigned(rdb, 0);
         return;
     }
@@ -476,6 +619,8 @@ void ShardingInfoRDBSave(RedisModuleIO *rdb)
             RedisModule_SaveUnsigned(rdb, n->addr.port);
         }
     }
+
+    saveSlotConfig(rdb, si);
 }
 
 /* Load ShardingInfo from RDB. This gets invoked by rdbLoadSnapshotInfo which uses a
@@ -492,7 +637,7 @@ void ShardingInfoRDBSave(RedisModuleIO *rdb)
  * modern Module API capabilities that can let us avoid piggybacking on keys.
  */
 
-void ShardingInfoRDBLoad(RedisModuleIO *rdb)
+void ShardingInfoRDBLoad(RedisModuleIO *rdb, int encver)
 {
     RedisRaftCtx *rr = &redis_raft;
     ShardingInfo *si = rr->sharding_info;
@@ -508,6 +653,9 @@ void ShardingInfoRDBLoad(RedisModuleIO *rdb)
         if (si)
             ShardingInfoReset(rr);
 
+        if (encver >= 2)
+            loadSlotConfig(rdb, si);
+
         return;
     }
 
@@ -557,6 +705,10 @@ void ShardingInfoRDBLoad(RedisModuleIO *rdb)
 
         ShardGroupFree(&sg);
     }
+
+    /* Slot configuration refers to the shardgroups, so it comes last */
+    if (encver >= 2)
+        loadSlotConfig(rdb, si);
 }
 
 /* Validate a new shardgroup and make sure there are no conflicts with
@@ -589,6 +741,9 @@ RRStatus ShardingInfoValidateShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg)
 }
 
 /* Update an existing ShardGroup in the active ShardingInfo.
+ *
+ * Updates are produced by shardgroup synchronization, which lists the
+ * shardgroup's leader first; so from now on we know where to redirect.
  *
  * FIXME: We currently only handle updating nodes but don't support remapping
  *        hash slots.
@@ -606,6 +761,9 @@ RRStatus ShardingInfoUpdateShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg)
     sg->nodes_num = new_sg->nodes_num;
     sg->nodes = RedisModule_Realloc(sg->nodes, sizeof(ShardGroupNode) * sg->nodes_num);
     memcpy(sg->nodes, new_sg->nodes, sizeof(ShardGroupNode) * sg->nodes_num);
+    sg->leader_known = true;
+
+    ShardingInfoTopologyChanged(rr);
 
     return RR_OK;
 }
@@ -631,6 +789,7 @@ RRStatus ShardingInfoAddShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg)
     sg->end_slot = new_sg->end_slot;
     sg->nodes_num = new_sg->nodes_num;
     sg->next_redir = 0;
+    sg->leader_known = false;
     sg->use_conn_addr = false;
     sg->node_conn_idx = 0;
     sg->conn = NULL;
@@ -649,6 +808,8 @@ RRStatus ShardingInfoAddShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg)
         sg->conn = ConnCreate(rr, sg, establishShardGroupConn, NULL);
     }
 
+    ShardingInfoTopologyChanged(rr);
+
     return RR_OK;
 }
 
@@ -746,8 +907,13 @@ void ShardingInfoReset(RedisRaftCtx *rr)
     si->shard_groups_num = 0;
 
     /* Reset array */
-    for (int i = 0; i < REDIS_RAFT_HASH_SLOTS; i++)
+    for (int i = 0; i < REDIS_RAFT_HASH_SLOTS; i++) {
         si->hash_slots_map[i] = 0;
+        si->slot_state[i] = SLOT_STABLE;
+        si->slot_peer[i] = 0;
+    }
+    si->migrate_slot = -1;
+    si->migrate_cursor = 0;
 
     /* Add our local mapping */
     ShardGroup sg = {
@@ -794,43 +960,97 @@ RedisModuleCallReply *execCommandGetKeys(RedisRaftCtx *rr, RaftRedisCommand *cmd
     return reply;
 }
 
-/* Compute the hash slot for a RaftRedisCommandArray list of commands and update
- * the entry.
- *
- * FIXME: This is a LEGACY VERSION based on 'COMMAND GETKEYS', which is here only
- * to allow running on Redis versions older than 6.0.9.
+/* Called for every key of a command by iterateCommandKeys() */
+typedef RRStatus (*CommandKeyFunc)(void *privdata, const char *key, size_t key_len);
+
+/* Adds the hash slot of the specified key to *slot, which holds the hash slot
+ * of previous keys or -1.  Returns RR_ERROR on a cross-slot violation.
  */
 
-static RRStatus legacy_computeHashSlot(RedisRaftCtx *rr, RaftReq *req)
+static RRStatus addKeyHashSlot(void *privdata, const char *key, size_t key_len)
 {
-    int slot = -1;
+    int *slot = privdata;
+    int thisslot = keyHashSlot(key, key_len);
 
-    RaftRedisCommandArray *cmds = &req->r.redis.cmds;
-    for (int i = 0; i < cmds->len; i++) {
-        RaftRedisCommand *cmd = cmds->commands[i];
+    if (*slot == -1) {
+        /* First key */
+        *slot = thisslot;
+    } else if (*slot != thisslot) {
+        return RR_ERROR;
+    }
+
+    return RR_OK;
+}
 
-        /* Iterate command keys */
+/* Calls fn for every key of a command, as reported by Redis.
+ *
+ * FIXME: The LEGACY VERSION based on 'COMMAND GETKEYS' is here only to allow
+ * running on Redis versions older than 6.0.9.
+ */
+
+static RRStatus iterateRedisCommandKeys(RedisRaftCtx *rr, RaftRedisCommand *cmd,
+                                        CommandKeyFunc fn, void *privdata)
+{
+    RRStatus ret = RR_OK;
+
+    if (RedisModule_GetCommandKeys == NULL) {
         RedisModuleCallReply *reply = execCommandGetKeys(rr, cmd);
-        for (int j = 0; j < RedisModule_CallReplyLength(reply); j++) {
+        for (int j = 0; ret == RR_OK && j < RedisModule_CallReplyLength(reply); j++) {
             size_t key_len;
             const char *key = RedisModule_CallReplyStringPtr(
                     RedisModule_CallReplyArrayElement(reply, j), &key_len);
-            int thisslot = keyHashSlot(key, key_len);
-
-            if (slot == -1) {
-                /* First key */
-                slot = thisslot;
-            } else {
-                if (slot != thisslot) {
-                    RedisModule_FreeCallReply(reply);
-                    return RR_ERROR;
-                }
-            }
+            ret = fn(privdata, key, key_len);
         }
         RedisModule_FreeCallReply(reply);
+        return ret;
     }
 
-    req->r.redis.hash_slot = slot;
+    int num_keys = 0;
+    int *keyindex = RedisModule_GetCommandKeys(rr->ctx, cmd->argv, cmd->argc, &num_keys);
+    for (int j = 0; ret == RR_OK && j < num_keys; j++) {
+        size_t key_len;
+        const char *key = RedisModule_StringPtrLen(cmd->argv[keyindex[j]], &key_len);
+        ret = fn(privdata, key, key_len);
+    }
+    RedisModule_Free(keyindex);
+
+    return ret;
+}
+
+/* Calls fn for every key of a RaftRedisCommandArray list of commands, until
+ * it returns an error.
+ *
+ * Key positions are taken from the command descriptor table, so Redis is only
+ * consulted for unknown commands and commands with movable keys.
+ */
+
+static RRStatus iterateCommandKeys(RedisRaftCtx *rr, RaftRedisCommandArray *cmds,
+                                   CommandKeyFunc fn, void *privdata)
+{
+    for (int i = 0; i < cmds->len; i++) {
+        RaftRedisCommand *cmd = cmds->commands[i];
+        const CommandSpec *spec = CommandSpecGet(cmd->argv[0]);
+
+        if (!spec || (spec->flags & CMD_SPEC_MOVABLE_KEYS)) {
+            if (iterateRedisCommandKeys(rr, cmd, fn, privdata) != RR_OK) {
+                return RR_ERROR;
+            }
+            continue;
+        }
+
+        int first, last;
+        if (!CommandSpecGetKeyRange(spec, cmd->argc, &first, &last)) {
+            continue;
+        }
+
+        for (int j = first; j <= last; j += spec->key_step) {
+            size_t key_len;
+            const char *key = RedisModule_StringPtrLen(cmd->argv[j], &key_len);
+            if (fn(privdata, key, key_len) != RR_OK) {
+                return RR_ERROR;
+            }
+        }
+    }
 
     return RR_OK;
 }
@@ -843,171 +1063,393 @@ RRStatus computeHashSlot(RedisRaftCtx *rr, RaftReq *req)
 {
     int slot = -1;
 
-    if (RedisModule_GetCommandKeys == NULL)
-        return legacy_computeHashSlot(rr, req);
+    if (iterateCommandKeys(rr, &req->r.redis.cmds, addKeyHashSlot, &slot) != RR_OK) {
+        return RR_ERROR;
+    }
 
-    RaftRedisCommandArray *cmds = &req->r.redis.cmds;
-    for (int i = 0; i < cmds->len; i++) {
-        RaftRedisCommand *cmd = cmds->commands[i];
+    req->r.redis.hash_slot = slot;
 
-        /* Iterate command keys */
-        int num_keys = 0;
-        int *keyindex = RedisModule_GetCommandKeys(rr->ctx, cmd->argv, cmd->argc, &num_keys);
-        for (int j = 0; j < num_keys; j++) {
-            size_t key_len;
-            const char *key = RedisModule_StringPtrLen(cmd->argv[keyindex[j]], &key_len);
-            int thisslot = keyHashSlot(key, key_len);
+    return RR_OK;
+}
 
-            if (slot == -1) {
-                /* First key */
-                slot = thisslot;
-            } else {
-                if (slot != thisslot) {
-                    RedisModule_Free(keyindex);
-                    return RR_ERROR;
-                }
-            }
-        }
+/* -----------------------------------------------------------------------------
+ * Topology replies
+ * -------------------------------------------------------------------------- */
+
+/* CLUSTER SLOTS and CLUSTER NODES replies are built into a TopologyReply
+ * once per topology epoch, and replayed from it until the epoch (or the
+ * local leader) changes.  This keeps clients that refresh their topology
+ * after every -MOVED from repeatedly walking all shardgroups and nodes.
+ */
+
+static TopologyReply *topologyReplyCreate(void)
+{
+    return RedisModule_Calloc(1, sizeof(TopologyReply));
+}
+
+static void topologyReplyClear(TopologyReply *tr)
+{
+    tr->elems_num = 0;
+    tr->buf_len = 0;
+}
+
+/* Appends an element and returns its index, so array lengths can be set
+ * when known.
+ */
+static int topologyReplyAdd(TopologyReply *tr, enum TopologyReplyElemType type, long long value)
+{
+    if (tr->elems_num == tr->elems_size) {
+        tr->elems_size = tr->elems_size ? tr->elems_size * 2 : 64;
+        tr->elems = RedisModule_Realloc(tr->elems, tr->elems_size * sizeof(TopologyReplyElem));
+    }
+
+    TopologyReplyElem *elem = &tr->elems[tr->elems_num];
+    elem->type = type;
+    elem->value = value;
+    elem->len = 0;
+
+    return tr->elems_num++;
+}
 
-        RedisModule_Free(keyindex);
+static void topologyReplyAddString(TopologyReply *tr, const char *str, size_t len)
+{
+    if (tr->buf_len + len > tr->buf_size) {
+        while (tr->buf_len + len > tr->buf_size) {
+            tr->buf_size = tr->buf_size ? tr->buf_size * 2 : 1024;
+        }
+        tr->buf = RedisModule_Realloc(tr->buf, tr->buf_size);
     }
 
-    req->r.redis.hash_slot = slot;
+    int idx = topologyReplyAdd(tr, TOPOLOGY_REPLY_STRING, tr->buf_len);
+    tr->elems[idx].len = len;
+    memcpy(tr->buf + tr->buf_len, str, len);
+    tr->buf_len += len;
+}
 
+static void topologyReplySend(TopologyReply *tr, RedisModuleCtx *ctx)
+{
+    for (int i = 0; i < tr->elems_num; i++) {
+        TopologyReplyElem *elem = &tr->elems[i];
+
+        switch (elem->type) {
+            case TOPOLOGY_REPLY_ARRAY:
+                RedisModule_ReplyWithArray(ctx, elem->value);
+                break;
+            case TOPOLOGY_REPLY_INTEGER:
+                RedisModule_ReplyWithLongLong(ctx, elem->value);
+                break;
+            case TOPOLOGY_REPLY_STRING:
+                RedisModule_ReplyWithStringBuffer(ctx, tr->buf + elem->value, elem->len);
+                break;
+        }
+    }
+}
 
-    return RR_OK;
+/* Increments the topology epoch, which invalidates cached topology replies.
+ * Called whenever shardgroups, cluster membership or our own state change;
+ * leadership changes observed as a follower are detected separately, as
+ * replies are also bound to the leader they were built for.
+ */
+void ShardingInfoTopologyChanged(RedisRaftCtx *rr)
+{
+    if (rr->sharding_info) {
+        rr->sharding_info->epoch++;
+    }
+}
+
+static bool topologyReplyValid(RedisRaftCtx *rr, TopologyReply *tr)
+{
+    return tr->elems_num > 0 &&
+           tr->epoch == rr->sharding_info->epoch &&
+           tr->leader_id == raft_get_current_leader(rr->raft);
 }
 
-/* Produces a CLUSTER SLOTS compatible reply entry for the specified local cluster node.
+/* Returns the address of a local cluster node, or NULL if unknown.
+ *
+ * Stale nodes should not exist but we prefer to be defensive.
+ * Our own node doesn't have a connection so we don't expect a Node object.
  */
-static int addClusterSlotNodeReply(RedisRaftCtx *rr, RedisModuleCtx *ctx, raft_node_t *raft_node)
+static NodeAddr *getRaftNodeAddr(RedisRaftCtx *rr, raft_node_t *raft_node)
 {
     Node *node = raft_node_get_udata(raft_node);
-    NodeAddr *addr;
-    char node_id[RAFT_SHARDGROUP_NODEID_LEN+1];
 
-    /* Stale nodes should not exist but we prefer to be defensive.
-     * Our own node doesn't have a connection so we don't expect a Node object.
-     */
     if (node) {
-        addr = &node->addr;
+        return &node->addr;
     } else if (raft_get_my_node(rr->raft) == raft_node) {
-        addr = &rr->config->addr;
-    } else {
-        return 0;
+        return &rr->config->addr;
     }
 
-    /* Create a three-element reply:
-     * 1) Address
-     * 2) Port
-     * 3) Node ID
-     */
+    return NULL;
+}
+
+static void getRaftNodeId(RedisRaftCtx *rr, raft_node_t *raft_node, char *node_id)
+{
+    snprintf(node_id, RAFT_SHARDGROUP_NODEID_LEN + 1, "%.32s%08x",
+             rr->log->dbid, raft_node_get_id(raft_node));
+}
+
+/* Produces a CLUSTER SLOTS compatible reply entry for the specified node:
+ *
+ * 1) Address
+ * 2) Port
+ * 3) Node ID
+ */
+static void addClusterSlotsNodeEntry(TopologyReply *tr, NodeAddr *addr, const char *node_id)
+{
+    topologyReplyAdd(tr, TOPOLOGY_REPLY_ARRAY, 3);
+    topologyReplyAddString(tr, addr->host, strlen(addr->host));
+    topologyReplyAdd(tr, TOPOLOGY_REPLY_INTEGER, addr->port);
+    topologyReplyAddString(tr, node_id, strlen(node_id));
+}
+
+/* Finds the next range of consecutive hash slots mapped to shardgroup sgid,
+ * following the range that ended at *end_slot (or -1 to find the first one).
+ *
+ * Slots are normally mapped in the single range a shardgroup was created
+ * with, but slot migration may split it.
+ */
+static bool nextShardGroupSlotRange(ShardingInfo *si, int sgid, int *start_slot, int *end_slot)
+{
+    int i = *end_slot + 1;
 
-    RedisModule_ReplyWithArray(ctx, 3);
-    RedisModule_ReplyWithCString(ctx, addr->host);
-    RedisModule_ReplyWithLongLong(ctx, addr->port);
+    while (i < REDIS_RAFT_HASH_SLOTS && si->hash_slots_map[i] != sgid) {
+        i++;
+    }
+    if (i == REDIS_RAFT_HASH_SLOTS) {
+        return false;
+    }
 
-    snprintf(node_id, sizeof(node_id), "%.32s%08x", rr->log->dbid, raft_node_get_id(raft_node));
-    RedisModule_ReplyWithCString(ctx, node_id);
+    *start_slot = i;
+    while (i < REDIS_RAFT_HASH_SLOTS && si->hash_slots_map[i] == sgid) {
+        i++;
+    }
+    *end_slot = i - 1;
 
-    return 1;
+    return true;
 }
 
-/* Produce a CLUSTER SLOTS compatible reply entry for the specified shardgroup node.
+/* Adds the CLUSTER SLOTS node entries of a shardgroup and returns their
+ * number.
  */
-static int addClusterSlotShardGroupNodeReply(RedisRaftCtx *rr, RedisModuleCtx *ctx, ShardGroupNode *sgn)
+static int addClusterSlotsNodes(RedisRaftCtx *rr, TopologyReply *tr, ShardGroup *sg,
+                                raft_node_t *leader_node)
 {
-    UNUSED(rr);
+    char node_id[RAFT_SHARDGROUP_NODEID_LEN+1];
+    int num = 0;
+
+    if (sg->id != 1) {
+        /* Remote cluster: we simply dump what the ShardGroup configuration
+         * tells us.
+         */
+        for (int j = 0; j < sg->nodes_num; j++) {
+            addClusterSlotsNodeEntry(tr, &sg->nodes[j].addr, sg->nodes[j].node_id);
+        }
+        return sg->nodes_num;
+    }
 
-    /* Create a three-element reply:
-     * 1) Address
-     * 2) Port
-     * 3) Node ID
+    /* Local cluster's ShardGroup: we list the leader node first, followed by
+     * all cluster nodes we know. This information does not come from the
+     * ShardGroup.
      */
+    NodeAddr *addr = getRaftNodeAddr(rr, leader_node);
+    if (addr) {
+        getRaftNodeId(rr, leader_node, node_id);
+        addClusterSlotsNodeEntry(tr, addr, node_id);
+        num++;
+    }
+
+    for (int j = 0; j < raft_get_num_nodes(rr->raft); j++) {
+        raft_node_t *raft_node = raft_get_node_from_idx(rr->raft, j);
+        if (raft_node == leader_node || !raft_node_is_active(raft_node) ||
+            !(addr = getRaftNodeAddr(rr, raft_node))) {
+            continue;
+        }
 
-    RedisModule_ReplyWithArray(ctx, 3);
-    RedisModule_ReplyWithCString(ctx, sgn->addr.host);
-    RedisModule_ReplyWithLongLong(ctx, sgn->addr.port);
-    RedisModule_ReplyWithCString(ctx, sgn->node_id);
+        getRaftNodeId(rr, raft_node, node_id);
+        addClusterSlotsNodeEntry(tr, addr, node_id);
+        num++;
+    }
 
-    return 1;
+    return num;
 }
 
 /* Produce a CLUSTER SLOTS compatible reply, including:
  *
- * 1. Local cluster's slot range and nodes.
+ * 1. Local cluster's slot ranges and nodes.
  * 2. All configured shardgroups with their slot ranges and nodes.
  */
 
-static void addClusterSlotsReply(RedisRaftCtx *rr, RaftReq *req)
+static void buildClusterSlotsReply(RedisRaftCtx *rr, TopologyReply *tr, raft_node_t *leader_node)
 {
-    int alen;
+    ShardingInfo *si = rr->sharding_info;
+    int ranges_idx = topologyReplyAdd(tr, TOPOLOGY_REPLY_ARRAY, 0);
+    int ranges_num = 0;
 
-    /* Make sure we have a leader, or return a -CLUSTERDOWN message */
-    raft_node_t *leader_node = raft_get_current_leader_node(rr->raft);
-    if (!leader_node) {
-        RedisModule_ReplyWithError(req->ctx,
-                "CLUSTERDOWN No raft leader");
-        return;
+    for (int i = 0; i < si->shard_groups_num; i++) {
+        ShardGroup *sg = si->shard_groups[i];
+        int start_slot, end_slot = -1;
+
+        while (nextShardGroupSlotRange(si, sg->id, &start_slot, &end_slot)) {
+            int idx = topologyReplyAdd(tr, TOPOLOGY_REPLY_ARRAY, 0);
+            topologyReplyAdd(tr, TOPOLOGY_REPLY_INTEGER, start_slot);
+            topologyReplyAdd(tr, TOPOLOGY_REPLY_INTEGER, end_slot);
+            tr->elems[idx].value = 2 + addClusterSlotsNodes(rr, tr, sg, leader_node);
+            ranges_num++;
+        }
+    }
+
+    tr->elems[ranges_idx].value = ranges_num;
+}
+
+/* Appends the slots of a shardgroup to a CLUSTER NODES master line.  For the
+ * local shardgroup, slots being migrated are also listed the way Redis Cluster
+ * does: [slot->-target-node-id] and [slot-<-source-node-id].
+ */
+static char *catShardGroupSlots(char *s, size_t *slen, ShardingInfo *si, ShardGroup *sg)
+{
+    int start_slot, end_slot = -1;
+
+    while (nextShardGroupSlotRange(si, sg->id, &start_slot, &end_slot)) {
+        if (start_slot == end_slot) {
+            s = catsnprintf(s, slen, " %d", start_slot);
+        } else {
+            s = catsnprintf(s, slen, " %d-%d", start_slot, end_slot);
+        }
+    }
+
+    if (sg->id != 1) {
+        return s;
+    }
+
+    for (int i = 0; i < REDIS_RAFT_HASH_SLOTS; i++) {
+        if (si->slot_state[i] == SLOT_STABLE) {
+            continue;
+        }
+
+        ShardGroup *peer = si->shard_groups[si->slot_peer[i] - 1];
+        if (!peer->nodes_num) {
+            continue;
+        }
+
+        s = catsnprintf(s, slen, " [%d-%s-%s]", i,
+                        si->slot_state[i] == SLOT_MIGRATING ? ">" : "<",
+                        peer->nodes[0].node_id);
+    }
+
+    return s;
+}
+
+/* Appends a CLUSTER NODES line for a node.  A NULL master_id indicates a
+ * master, which lists the shardgroup's slots.
+ */
+static char *catClusterNodesLine(char *s, size_t *slen, RedisRaftCtx *rr, const char *node_id,
+                                 NodeAddr *addr, bool myself, const char *master_id, ShardGroup *sg)
+{
+    s = catsnprintf(s, slen, "%s %s:%u@0 %s%s %s 0 0 %llu connected",
+                    node_id, addr->host, addr->port,
+                    myself ? "myself," : "",
+                    master_id ? "slave" : "master",
+                    master_id ? master_id : "-",
+                    rr->sharding_info->epoch);
+
+    if (!master_id) {
+        s = catShardGroupSlots(s, slen, rr->sharding_info, sg);
     }
 
+    return catsnprintf(s, slen, "\n");
+}
+
+/* Produce a CLUSTER NODES compatible reply.  The leader of every shardgroup
+ * (or, for remote shardgroups, the first node listed) is reported as a
+ * master and other nodes as its replicas, consistently with CLUSTER SLOTS.
+ */
+static void buildClusterNodesReply(RedisRaftCtx *rr, TopologyReply *tr, raft_node_t *leader_node)
+{
     ShardingInfo *si = rr->sharding_info;
-    RedisModule_ReplyWithArray(req->ctx, si->shard_groups_num);
+    raft_node_t *my_node = raft_get_my_node(rr->raft);
+    char leader_id[RAFT_SHARDGROUP_NODEID_LEN+1];
+    char node_id[RAFT_SHARDGROUP_NODEID_LEN+1];
+    size_t slen = 1024;
+    char *s = RedisModule_Calloc(1, slen);
 
     for (int i = 0; i < si->shard_groups_num; i++) {
         ShardGroup *sg = si->shard_groups[i];
 
-        /* Dump Raft nodes now. Leader (master) first, followed by others */
-        RedisModule_ReplyWithArray(req->ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-
-        RedisModule_ReplyWithLongLong(req->ctx, sg->start_slot);    /* Start slot */
-        RedisModule_ReplyWithLongLong(req->ctx, sg->end_slot);      /* End slot */
-        alen = 2;
-
         if (i == 0) {
-            /* Local cluster's ShardGroup: we list the leader node first,
-             * followed by all cluster nodes we know. This information does not
-             * come from the ShardGroup.
-             */
+            NodeAddr *addr = getRaftNodeAddr(rr, leader_node);
+            getRaftNodeId(rr, leader_node, leader_id);
+            if (addr) {
+                s = catClusterNodesLine(s, &slen, rr, leader_id, addr,
+                                        leader_node == my_node, NULL, sg);
+            }
 
-            alen += addClusterSlotNodeReply(rr, req->ctx, leader_node);
             for (int j = 0; j < raft_get_num_nodes(rr->raft); j++) {
                 raft_node_t *raft_node = raft_get_node_from_idx(rr->raft, j);
-                if (raft_node_get_id(raft_node) == raft_get_current_leader(rr->raft) ||
-                        !raft_node_is_active(raft_node)) {
+                if (raft_node == leader_node || !raft_node_is_active(raft_node) ||
+                    !(addr = getRaftNodeAddr(rr, raft_node))) {
                     continue;
                 }
 
-                alen += addClusterSlotNodeReply(rr, req->ctx, raft_node);
+                getRaftNodeId(rr, raft_node, node_id);
+                s = catClusterNodesLine(s, &slen, rr, node_id, addr,
+                                        raft_node == my_node, leader_id, sg);
             }
-            RedisModule_ReplySetArrayLength(req->ctx, alen);
         } else {
-            /* Remote cluster: we simply dump what the ShardGroup configuration
-             * tells us.
-             */
-
             for (int j = 0; j < sg->nodes_num; j++) {
-                alen += addClusterSlotShardGroupNodeReply(rr, req->ctx, &sg->nodes[j]);
+                s = catClusterNodesLine(s, &slen, rr, sg->nodes[j].node_id, &sg->nodes[j].addr,
+                                        false, j ? sg->nodes[0].node_id : NULL, sg);
             }
-
-            RedisModule_ReplySetArrayLength(req->ctx, alen);
         }
     }
+
+    topologyReplyAddString(tr, s, strlen(s));
+    RedisModule_Free(s);
 }
 
-/* Process CLUSTER commands, as intercepted earlier by the Raft module.
- *
- * Currently only supporting CLUSTER SLOTS.
+typedef void (*TopologyReplyBuildFunc)(RedisRaftCtx *rr, TopologyReply *tr, raft_node_t *leader_node);
+
+/* Replies with a cached topology reply, rebuilding it first if the topology
+ * has changed since it was built.
  */
-void handleClusterCommand(RedisRaftCtx *rr, RaftReq *req)
+static void addTopologyReply(RedisRaftCtx *rr, RaftReq *req, TopologyReply **cache,
+                             TopologyReplyBuildFunc build)
 {
-    RaftRedisCommand *cmd = req->r.redis.cmds.commands[0];
-
-    if (cmd->argc < 2) {
-        /* Note: we can't use RM_WrongArity here because our req->ctx is a thread-safe context
-         * with a synthetic client that no longer has the original argv.
-         */
-        RedisModule_ReplyWithError(req->ctx, "ERR wrong number of arguments for 'cluster' command");
+    /* Make sure we have a leader, or return a -CLUSTERDOWN message */
+    raft_node_t *leader_node = raft_get_current_leader_node(rr->raft);
+    if (!leader_node) {
+        RedisModule_ReplyWithError(req->ctx,
+                "CLUSTERDOWN No raft leader");
+        return;
+    }
+
+    if (!*cache) {
+        *cache = topologyReplyCreate();
+    }
+
+    TopologyReply *tr = *cache;
+    if (!topologyReplyValid(rr, tr)) {
+        topologyReplyClear(tr);
+        build(rr, tr, leader_node);
+        tr->epoch = rr->sharding_info->epoch;
+        tr->leader_id = raft_node_get_id(leader_node);
+    }
+
+    topologyReplySend(tr, req->ctx);
+}
+
+/* Process CLUSTER commands, as intercepted earlier by the Raft module.
+ *
+ * Currently only supporting CLUSTER SLOTS and CLUSTER NODES.
+ */
+void handleClusterCommand(RedisRaftCtx *rr, RaftReq *req)
+{
+    RaftRedisCommand *cmd = req->r.redis.cmds.commands[0];
+
+    if (cmd->argc < 2) {
+        /* Note: we can't use RM_WrongArity here because our req->ctx is a thread-safe context
+         * with a synthetic client that no longer has the original argv.
+         */
+        RedisModule_ReplyWithError(req->ctx, "ERR wrong number of arguments for 'cluster' command");
         goto exit;
     }
 
@@ -1020,7 +1462,10 @@ void handleClusterCommand(RedisRaftCtx *rr, RaftReq *req)
     const char *cmd_str = RedisModule_StringPtrLen(cmd->argv[1], &cmd_len);
 
     if (cmd_len == 5 && !strncasecmp(cmd_str, "SLOTS", 5) && cmd->argc == 2) {
-        addClusterSlotsReply(rr, req);
+        addTopologyReply(rr, req, &rr->sharding_info->slots_reply, buildClusterSlotsReply);
+        goto exit;
+    } else if (cmd_len == 5 && !strncasecmp(cmd_str, "NODES", 5) && cmd->argc == 2) {
+        addTopologyReply(rr, req, &rr->sharding_info->nodes_reply, buildClusterNodesReply);
         goto exit;
     } else {
         RedisModule_ReplyWithError(req->ctx,
@@ -1225,3 +1670,673 @@ exit:
     RaftReqFree(req);
 
 }
+
+/* -----------------------------------------------------------------------------
+ * Slot Migration
+ * -------------------------------------------------------------------------- */
+
+/* A hash slot is migrated from a source shardgroup to a target shardgroup
+ * using RAFT.SHARDGROUP commands, as follows:
+ *
+ * 1. SETSLOT <slot> IMPORTING <source-node-id> on the target.
+ * 2. SETSLOT <slot> MIGRATING <target-node-id> on the source, after which
+ *    commands that access keys no longer present on the source are redirected
+ *    to the target with -ASK.
+ * 3. MIGRATE <slot> [count] on the source, repeatedly until it reports all
+ *    keys were migrated.  Every call moves a batch of keys using
+ *    RAFT.SHARDGROUP IMPORT, and then deletes them locally.
+ * 4. SETSLOT <slot> NODE <target-node-id> on the target and then on the
+ *    source, which atomically flip slot ownership in each cluster.
+ *
+ * All slot configuration changes are committed as RAFT_LOGTYPE_SLOT_CONFIG
+ * entries, so they're applied consistently by all nodes of a cluster.
+ */
+
+#define MIGRATE_SCAN_COUNT      100     /* SCAN COUNT argument */
+#define MIGRATE_SCAN_ITERATIONS 100     /* Max. SCAN calls for a batch */
+
+/* Serialize a SlotConfig as a RAFT_LOGTYPE_SLOT_CONFIG payload:
+ * <slot>:<action>:<sgid>
+ */
+static int slotConfigSerialize(SlotConfig *cfg, char *buf, size_t buf_size)
+{
+    return snprintf(buf, buf_size, "%d:%d:%u", cfg->slot, cfg->action, cfg->sgid);
+}
+
+RRStatus SlotConfigParse(const char *buf, size_t buf_len, SlotConfig *cfg)
+{
+    char str[64];
+    int action;
+
+    if (buf_len >= sizeof(str)) {
+        return RR_ERROR;
+    }
+    memcpy(str, buf, buf_len);
+    str[buf_len] = '\0';
+
+    if (sscanf(str, "%d:%d:%u", &cfg->slot, &action, &cfg->sgid) != 3 ||
+        cfg->slot < 0 || cfg->slot > REDIS_RAFT_HASH_SLOTS - 1 ||
+        action < SLOT_CONFIG_STABLE || action > SLOT_CONFIG_NODE) {
+        return RR_ERROR;
+    }
+    cfg->action = action;
+
+    return RR_OK;
+}
+
+/* Applies a slot configuration change, when the RAFT_LOGTYPE_SLOT_CONFIG
+ * entry is applied.
+ */
+RRStatus ShardingInfoSetSlot(RedisRaftCtx *rr, SlotConfig *cfg)
+{
+    ShardingInfo *si = rr->sharding_info;
+    int slot = cfg->slot;
+
+    if (cfg->action != SLOT_CONFIG_STABLE &&
+        (cfg->sgid < 1 || cfg->sgid > si->shard_groups_num)) {
+        LOG_ERROR("Invalid slot configuration: slot %d, unknown shardgroup %u",
+                  slot, cfg->sgid);
+        return RR_ERROR;
+    }
+
+    switch (cfg->action) {
+        case SLOT_CONFIG_MIGRATING:
+            si->slot_state[slot] = SLOT_MIGRATING;
+            si->slot_peer[slot] = cfg->sgid;
+
+            /* Entries already in the log were accepted while the slot was
+             * stable, and may still write keys we need to migrate.
+             */
+            if (rr->raft) {
+                si->migrate_barrier_idx = raft_get_current_idx(rr->raft);
+            }
+            break;
+        case SLOT_CONFIG_IMPORTING:
+            si->slot_state[slot] = SLOT_IMPORTING;
+            si->slot_peer[slot] = cfg->sgid;
+            break;
+        case SLOT_CONFIG_NODE:
+            si->hash_slots_map[slot] = cfg->sgid;
+            /* Fall through */
+        case SLOT_CONFIG_STABLE:
+            si->slot_state[slot] = SLOT_STABLE;
+            si->slot_peer[slot] = 0;
+            break;
+    }
+
+    if (si->migrate_slot == slot) {
+        si->migrate_slot = -1;
+        si->migrate_cursor = 0;
+    }
+
+    LOG_VERBOSE("Slot %d: owner %d, state %d, peer %d", slot,
+                si->hash_slots_map[slot], si->slot_state[slot], si->slot_peer[slot]);
+
+    ShardingInfoTopologyChanged(rr);
+
+    return RR_OK;
+}
+
+/* Returns the shardgroup a node belongs to, or 0 if unknown.  Node ids begin
+ * with the dbid of their cluster, so all nodes of a shardgroup are matched
+ * even if not all of them are known yet.
+ */
+static int getNodeShardGroup(RedisRaftCtx *rr, const char *node_id)
+{
+    ShardingInfo *si = rr->sharding_info;
+
+    if (rr->log && !strncmp(node_id, rr->log->dbid, RAFT_DBID_LEN)) {
+        return 1;
+    }
+
+    for (int i = 1; i < si->shard_groups_num; i++) {
+        ShardGroup *sg = si->shard_groups[i];
+        for (int j = 0; j < sg->nodes_num; j++) {
+            if (!strncmp(node_id, sg->nodes[j].node_id, RAFT_DBID_LEN)) {
+                return sg->id;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Handle RAFT.SHARDGROUP SETSLOT: validate the change and append it to the
+ * log.  The reply is sent when it is applied.
+ */
+void handleShardGroupSetSlot(RedisRaftCtx *rr, RaftReq *req)
+{
+    SlotConfig *cfg = &req->r.shardgroup_setslot.cfg;
+    ShardingInfo *si = rr->sharding_info;
+
+    /* Must be done on a leader */
+    if (checkRaftState(rr, req) == RR_ERROR ||
+        checkLeader(rr, req, NULL) == RR_ERROR) {
+        goto exit;
+    }
+
+    if (!rr->config->cluster_mode) {
+        RedisModule_ReplyWithError(req->ctx, "ERR not operating in Redis Cluster compatible mode");
+        goto exit;
+    }
+
+    if (cfg->action != SLOT_CONFIG_STABLE) {
+        cfg->sgid = getNodeShardGroup(rr, req->r.shardgroup_setslot.node_id);
+        if (!cfg->sgid) {
+            RedisModule_ReplyWithError(req->ctx, "ERR unknown node id");
+            goto exit;
+        }
+    }
+
+    int owner = si->hash_slots_map[cfg->slot];
+    if (cfg->action == SLOT_CONFIG_MIGRATING && (owner != 1 || cfg->sgid == 1)) {
+        RedisModule_ReplyWithError(req->ctx, "ERR slot is not owned by this shardgroup, or target is local");
+        goto exit;
+    }
+    if (cfg->action == SLOT_CONFIG_IMPORTING && (owner != cfg->sgid || cfg->sgid == 1)) {
+        RedisModule_ReplyWithError(req->ctx, "ERR slot is not owned by the source shardgroup");
+        goto exit;
+    }
+
+    char payload[64];
+    int payload_len = slotConfigSerialize(cfg, payload, sizeof(payload));
+
+    raft_entry_t *entry = raft_entry_new(payload_len);
+    entry->type = RAFT_LOGTYPE_SLOT_CONFIG;
+    entry->id = rand();
+    entry->user_data = req;
+    memcpy(entry->data, payload, payload_len);
+
+    msg_entry_response_t response;
+    int e = raft_recv_entry(rr->raft, entry, &response);
+    raft_entry_release(entry);
+
+    if (e != 0) {
+        replyRaftError(req->ctx, e);
+        goto exit;
+    }
+
+    return;
+
+exit:
+    RaftReqFree(req);
+}
+
+/* The state we track when performing a RAFT.SHARDGROUP MIGRATE operation.
+ * Like ShardGroupLinkState, it lives until the batch of keys is imported
+ * by the target shardgroup and a reply is returned to the user.
+ */
+typedef struct SlotMigrationState {
+    NodeAddrListElement *addr;          /* Target shardgroup addresses to try */
+    NodeAddrListElement *addr_iter;     /* Current iterator in list */
+    Connection *conn;                   /* Connection we use */
+    RaftReq *req;                       /* Original RaftReq, so we can return a reply */
+    int slot;
+    bool done;                          /* Last batch of keys */
+    int argc;                           /* RAFT.SHARDGROUP IMPORT arguments */
+    char **argv;
+    size_t *argvlen;
+} SlotMigrationState;
+
+/* IMPORT arguments: RAFT.SHARDGROUP IMPORT <slot> followed by triplets */
+#define MIGRATE_IMPORT_ARGS     3
+#define migrateKeysNum(state)   (((state)->argc - MIGRATE_IMPORT_ARGS) / 3)
+
+static void migrateFree(void *privdata)
+{
+    SlotMigrationState *state = privdata;
+
+    NodeAddrListFree(state->addr);
+    if (state->req) {
+        RedisModule_ReplyWithError(state->req->ctx, "ERR migration failed, please consult the logs.");
+        RaftReqFree(state->req);
+        state->req = NULL;
+    }
+
+    for (int i = 0; i < state->argc; i++) {
+        RedisModule_Free(state->argv[i]);
+    }
+    RedisModule_Free(state->argv);
+    RedisModule_Free(state->argvlen);
+    RedisModule_Free(state);
+}
+
+static void migrateAddArg(SlotMigrationState *state, const char *buf, size_t len)
+{
+    state->argv = RedisModule_Realloc(state->argv, sizeof(char *) * (state->argc + 1));
+    state->argvlen = RedisModule_Realloc(state->argvlen, sizeof(size_t) * (state->argc + 1));
+
+    state->argv[state->argc] = RedisModule_Alloc(len + 1);
+    memcpy(state->argv[state->argc], buf, len);
+    state->argv[state->argc][len] = '\0';
+    state->argvlen[state->argc] = len;
+    state->argc++;
+}
+
+/* Calls a read only command, with the module context locked by the caller. */
+static RedisModuleCallReply *migrateCall(RedisRaftCtx *rr, const char *cmd, const char *fmt,
+                                         const char *key, size_t key_len)
+{
+    enterRedisModuleCall();
+    RedisModuleCallReply *reply = RedisModule_Call(rr->ctx, cmd, fmt, key, key_len);
+    exitRedisModuleCall();
+
+    return reply;
+}
+
+/* Adds a key of the migrated slot to the IMPORT command as a key, TTL and
+ * DUMP payload triplet.  Keys that are gone by now are skipped.
+ */
+static void migrateAddKey(RedisRaftCtx *rr, SlotMigrationState *state,
+                          const char *key, size_t key_len)
+{
+    RedisModuleCallReply *dump = migrateCall(rr, "DUMP", "b", key, key_len);
+    RedisModuleCallReply *pttl = migrateCall(rr, "PTTL", "b", key, key_len);
+
+    if (dump && pttl && RedisModule_CallReplyType(dump) == REDISMODULE_REPLY_STRING &&
+        RedisModule_CallReplyType(pttl) == REDISMODULE_REPLY_INTEGER &&
+        RedisModule_CallReplyInteger(pttl) != -2) {
+        long long ttl = RedisModule_CallReplyInteger(pttl);
+        char ttl_str[32];
+        size_t payload_len;
+        const char *payload = RedisModule_CallReplyStringPtr(dump, &payload_len);
+
+        migrateAddArg(state, key, key_len);
+        migrateAddArg(state, ttl_str, snprintf(ttl_str, sizeof(ttl_str), "%lld", ttl < 0 ? 0 : ttl));
+        migrateAddArg(state, payload, payload_len);
+    }
+
+    if (dump) {
+        RedisModule_FreeCallReply(dump);
+    }
+    if (pttl) {
+        RedisModule_FreeCallReply(pttl);
+    }
+}
+
+/* Continues scanning the keyspace for keys of the migrated slot, from where
+ * the previous MIGRATE stopped, until count keys were collected or the scan
+ * budget is exhausted.
+ *
+ * Redis offers no index of keys by hash slot outside of Redis Cluster, so the
+ * entire keyspace is scanned; the budget bounds the time the Redis thread is
+ * locked for every call.
+ */
+static void migrateCollectKeys(RedisRaftCtx *rr, SlotMigrationState *state, int count)
+{
+    ShardingInfo *si = rr->sharding_info;
+    int keys_num = 0;
+
+    if (si->migrate_slot != state->slot) {
+        si->migrate_slot = state->slot;
+        si->migrate_cursor = 0;
+    }
+
+    RedisModule_ThreadSafeContextLock(rr->ctx);
+
+    for (int i = 0; i < MIGRATE_SCAN_ITERATIONS && keys_num < count; i++) {
+        char cursor[32];
+        snprintf(cursor, sizeof(cursor), "%llu", si->migrate_cursor);
+
+        enterRedisModuleCall();
+        RedisModuleCallReply *reply = RedisModule_Call(rr->ctx, "SCAN", "clcl", cursor,
+                                                        "COUNT", (long long) MIGRATE_SCAN_COUNT);
+        exitRedisModuleCall();
+
+        if (!reply || RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_ARRAY ||
+            RedisModule_CallReplyLength(reply) != 2) {
+            LOG_ERROR("Slot migration: SCAN failed");
+            if (reply) {
+                RedisModule_FreeCallReply(reply);
+            }
+            break;
+        }
+
+        RedisModuleCallReply *keys = RedisModule_CallReplyArrayElement(reply, 1);
+        size_t keys_len = RedisModule_CallReplyLength(keys);
+        size_t j, len;
+
+        for (j = 0; j < keys_len && keys_num < count; j++) {
+            const char *key = RedisModule_CallReplyStringPtr(
+                    RedisModule_CallReplyArrayElement(keys, j), &len);
+            if (keyHashSlot(key, len) == state->slot) {
+                migrateAddKey(rr, state, key, len);
+                keys_num++;
+            }
+        }
+
+        /* If we stopped short of the end of the batch, the cursor is kept so
+         * the next MIGRATE scans it again: keys migrated meanwhile are gone by
+         * then, and the remaining ones are not skipped.
+         */
+        if (j < keys_len) {
+            RedisModule_FreeCallReply(reply);
+            break;
+        }
+
+        const char *str = RedisModule_CallReplyStringPtr(
+                RedisModule_CallReplyArrayElement(reply, 0), &len);
+        snprintf(cursor, sizeof(cursor), "%.*s", (int) len, str);
+        si->migrate_cursor = strtoull(cursor, NULL, 10);
+        RedisModule_FreeCallReply(reply);
+
+        if (!si->migrate_cursor) {
+            state->done = true;
+            break;
+        }
+    }
+
+    RedisModule_ThreadSafeContextUnlock(rr->ctx);
+}
+
+/* Replies to MIGRATE with the number of migrated keys, and whether more keys
+ * may remain.
+ */
+static void migrateReply(SlotMigrationState *state, long long keys_num)
+{
+    RedisModule_ReplyWithArray(state->req->ctx, 2);
+    RedisModule_ReplyWithLongLong(state->req->ctx, keys_num);
+    RedisModule_ReplyWithLongLong(state->req->ctx, state->done);
+
+    RaftReqFree(state->req);
+    state->req = NULL;
+}
+
+/* Once keys are imported by the target, delete them locally.  This is a
+ * normal log entry, so it's applied by all nodes of the cluster.
+ */
+static RRStatus migrateDeleteKeys(RedisRaftCtx *rr, SlotMigrationState *state)
+{
+    RaftRedisCommandArray cmds = { 0 };
+    RaftRedisCommand *cmd = RaftRedisCommandArrayExtend(&cmds);
+    int keys_num = migrateKeysNum(state);
+
+    cmd->argc = keys_num + 1;
+    cmd->argv = RedisModule_Alloc(sizeof(RedisModuleString *) * cmd->argc);
+    cmd->argv[0] = RedisModule_CreateString(NULL, "DEL", 3);
+    for (int i = 0; i < keys_num; i++) {
+        int idx = MIGRATE_IMPORT_ARGS + i * 3;
+        cmd->argv[i + 1] = RedisModule_CreateString(NULL, state->argv[idx], state->argvlen[idx]);
+    }
+
+    raft_entry_t *entry = RaftRedisCommandArraySerialize(&cmds);
+    entry->id = rand();
+    entry->type = RAFT_LOGTYPE_NORMAL;
+    RaftRedisCommandArrayFree(&cmds);
+
+    msg_entry_response_t response;
+    int e = raft_recv_entry(rr->raft, entry, &response);
+    raft_entry_release(entry);
+
+    if (e != 0) {
+        LOG_ERROR("Slot migration: failed to append DEL entry, error %d", e);
+        return RR_ERROR;
+    }
+
+    /* Deleted keys may be found by the next MIGRATE until the entry is
+     * applied.
+     */
+    rr->sharding_info->migrate_barrier_idx = raft_get_current_idx(rr->raft);
+
+    return RR_OK;
+}
+
+/* Handle the RAFT.SHARDGROUP IMPORT reply, which is the reply of the MULTI
+ * transaction of RESTORE commands.
+ */
+static void migrateHandleResponse(redisAsyncContext *c, void *r, void *privdata)
+{
+    UNUSED(c);
+
+    redisReply *reply = r;
+    Connection *conn = (Connection *) privdata;
+    RedisRaftCtx *rr = ConnGetRedisRaftCtx(conn);
+    SlotMigrationState *state = ConnGetPrivateData(conn);
+
+    if (!reply) {
+        LOG_ERROR("RAFT.SHARDGROUP IMPORT failed: connection dropped.");
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        /* -MOVED? */
+        if (strlen(reply->str) > 6 && !strncmp(reply->str, "MOVED ", 6)) {
+            NodeAddr addr;
+            if (!parseMovedReply(reply->str, &addr)) {
+                LOG_ERROR("RAFT.SHARDGROUP IMPORT failed: invalid MOVED response: %s", reply->str);
+            } else {
+                LOG_VERBOSE("RAFT.SHARDGROUP IMPORT redirected to leader: %s:%d",
+                            addr.host, addr.port);
+                NodeAddrListAddElement(&state->addr, &addr);
+            }
+        } else {
+            LOG_ERROR("RAFT.SHARDGROUP IMPORT failed: %s", reply->str);
+        }
+    } else {
+        bool ok = reply->type == REDIS_REPLY_ARRAY && reply->elements == (size_t) migrateKeysNum(state);
+        for (size_t i = 0; ok && i < reply->elements; i++) {
+            ok = reply->element[i]->type == REDIS_REPLY_STATUS &&
+                 !strcmp(reply->element[i]->str, "OK");
+        }
+
+        if (!ok) {
+            LOG_ERROR("RAFT.SHARDGROUP IMPORT: unexpected reply");
+        } else if (!raft_is_leader(rr->raft) || migrateDeleteKeys(rr, state) != RR_OK) {
+            /* Keys were imported but are still here; they're imported again
+             * (replacing the same values) by the next MIGRATE.
+             */
+            RedisModule_ReplyWithError(state->req->ctx, "TRYAGAIN Failed to delete migrated keys");
+            RaftReqFree(state->req);
+            state->req = NULL;
+        } else {
+            LOG_VERBOSE("Slot %d: migrated %d keys", state->slot, migrateKeysNum(state));
+            migrateReply(state, migrateKeysNum(state));
+        }
+
+        ConnAsyncTerminate(conn);
+        return;
+    }
+
+    ConnMarkDisconnected(conn);
+}
+
+/* Send the RAFT.SHARDGROUP IMPORT command on an active connection.
+ */
+static void migrateSendRequest(Connection *conn)
+{
+    if (!ConnIsConnected(conn)) {
+        return;
+    }
+
+    SlotMigrationState *state = ConnGetPrivateData(conn);
+    LOG_VERBOSE("Slot migration %s:%u: connected, importing keys",
+                state->addr_iter->addr.host, state->addr_iter->addr.port);
+
+    if (ConnSendCommandArgv(conn, migrateHandleResponse, conn, state->argc,
+                            (const char **) state->argv, state->argvlen) != REDIS_OK) {
+        redisAsyncDisconnect(ConnGetRedisCtx(conn));
+        ConnMarkDisconnected(conn);
+        return;
+    }
+}
+
+/* Connect to the target shardgroup, iterating its nodes and following
+ * redirects to its leader, like linkConnect().
+ */
+static void migrateConnect(Connection *conn)
+{
+    SlotMigrationState *state = ConnGetPrivateData(conn);
+
+    if (!state->addr_iter) {
+        state->addr_iter = state->addr;
+    } else {
+        state->addr_iter = state->addr_iter->next;
+    }
+
+    if (!state->addr_iter) {
+        RedisModule_ReplyWithError(state->req->ctx, "ERR failed to import keys, please check the logs.");
+        RaftReqFree(state->req);
+        state->req = NULL;
+
+        ConnAsyncTerminate(conn);
+        return;
+    }
+
+    LOG_VERBOSE("Slot migration: connecting to %s:%u",
+                state->addr_iter->addr.host, state->addr_iter->addr.port);
+
+    ConnConnect(state->conn, &state->addr_iter->addr, migrateSendRequest);
+}
+
+/* Handle RAFT.SHARDGROUP MIGRATE: stream a batch of keys of a migrating slot
+ * to the target shardgroup.
+ */
+void handleShardGroupMigrate(RedisRaftCtx *rr, RaftReq *req)
+{
+    ShardingInfo *si = rr->sharding_info;
+    int slot = req->r.shardgroup_migrate.slot;
+
+    /* Must be done on a leader */
+    if (checkRaftState(rr, req) == RR_ERROR ||
+        checkLeader(rr, req, NULL) == RR_ERROR) {
+        goto exit;
+    }
+
+    if (!rr->config->cluster_mode) {
+        RedisModule_ReplyWithError(req->ctx, "ERR not operating in Redis Cluster compatible mode");
+        goto exit;
+    }
+
+    if (si->slot_state[slot] != SLOT_MIGRATING) {
+        RedisModule_ReplyWithError(req->ctx, "ERR slot is not migrating");
+        goto exit;
+    }
+
+    if (raft_get_last_applied_idx(rr->raft) < si->migrate_barrier_idx) {
+        RedisModule_ReplyWithError(req->ctx, "TRYAGAIN Slot writes are still being applied");
+        goto exit;
+    }
+
+    SlotMigrationState *state = RedisModule_Calloc(1, sizeof(SlotMigrationState));
+    char slot_str[16];
+
+    state->slot = slot;
+    migrateAddArg(state, "RAFT.SHARDGROUP", 15);
+    migrateAddArg(state, "IMPORT", 6);
+    migrateAddArg(state, slot_str, snprintf(slot_str, sizeof(slot_str), "%d", slot));
+    migrateCollectKeys(rr, state, req->r.shardgroup_migrate.count);
+
+    if (!migrateKeysNum(state)) {
+        state->req = req;
+        migrateReply(state, 0);
+        migrateFree(state);
+        return;
+    }
+
+    /* Try the leader first, if we know it */
+    ShardGroup *sg = si->shard_groups[si->slot_peer[slot] - 1];
+    for (int i = 0; i < sg->nodes_num; i++) {
+        NodeAddrListAddElement(&state->addr, &sg->nodes[i].addr);
+    }
+    if (!state->addr) {
+        RedisModule_ReplyWithError(req->ctx, "ERR target shardgroup has no nodes");
+        migrateFree(state);
+        goto exit;
+    }
+
+    state->req = req;
+    state->conn = ConnCreate(rr, state, migrateConnect, migrateFree);
+
+    return;
+
+exit:
+    RaftReqFree(req);
+}
+
+typedef struct MigratingSlotKeys {
+    RedisRaftCtx *rr;
+    RedisModuleString **names;
+    int names_num;
+} MigratingSlotKeys;
+
+static RRStatus addMigratingSlotKey(void *privdata, const char *key, size_t key_len)
+{
+    MigratingSlotKeys *keys = privdata;
+
+    keys->names = RedisModule_Realloc(keys->names, sizeof(RedisModuleString *) * (keys->names_num + 1));
+    keys->names[keys->names_num++] = RedisModule_CreateString(keys->rr->ctx, key, key_len);
+
+    return RR_OK;
+}
+
+/* Counts the keys of the request that exist and that are missing.  Keys are
+ * collected first, as finding them may take the Redis lock itself (COMMAND
+ * GETKEYS); the lock is then taken once to look them all up.
+ */
+static void countMigratingSlotKeys(RedisRaftCtx *rr, RaftReq *req, int *present, int *missing)
+{
+    MigratingSlotKeys keys = { .rr = rr };
+
+    *present = 0;
+
+    iterateCommandKeys(rr, &req->r.redis.cmds, addMigratingSlotKey, &keys);
+
+    RedisModule_ThreadSafeContextLock(rr->ctx);
+    for (int i = 0; i < keys.names_num; i++) {
+        RedisModuleKey *k = RedisModule_OpenKey(rr->ctx, keys.names[i], REDISMODULE_READ);
+        if (RedisModule_KeyType(k) != REDISMODULE_KEYTYPE_EMPTY) {
+            (*present)++;
+        }
+        RedisModule_CloseKey(k);
+    }
+    RedisModule_ThreadSafeContextUnlock(rr->ctx);
+
+    for (int i = 0; i < keys.names_num; i++) {
+        RedisModule_FreeString(rr->ctx, keys.names[i]);
+    }
+    RedisModule_Free(keys.names);
+
+    *missing = keys.names_num - *present;
+}
+
+/* Decide how a request that accesses a migrating slot is handled:
+ *
+ * 1. If all keys are still here, reads are served.  Writes are refused with
+ *    -TRYAGAIN, as keys may already have been copied to the target.
+ * 2. If no keys are here they were migrated (or never existed), so the client
+ *    is redirected to the target with -ASK.
+ * 3. Otherwise, the keys are split and the client needs to retry with
+ *    -TRYAGAIN.
+ *
+ * Returns RR_OK if the request should be served, or RR_ERROR after replying.
+ */
+RRStatus ShardingInfoMigratingSlotAccess(RedisRaftCtx *rr, RaftReq *req, bool readonly)
+{
+    ShardingInfo *si = rr->sharding_info;
+    int slot = req->r.redis.hash_slot;
+    int present, missing;
+
+    countMigratingSlotKeys(rr, req, &present, &missing);
+
+    if (!missing) {
+        if (readonly) {
+            return RR_OK;
+        }
+        RedisModule_ReplyWithError(req->ctx, "TRYAGAIN Slot is being migrated");
+        return RR_ERROR;
+    }
+
+    ShardGroup *sg = si->shard_groups[si->slot_peer[slot] - 1];
+    if (present || !sg->nodes_num) {
+        RedisModule_ReplyWithError(req->ctx, "TRYAGAIN Multiple keys request during slot migration");
+        return RR_ERROR;
+    }
+
+    /* Like MOVED redirects, ASK directs to the leader only if it's known */
+    if (sg->leader_known) {
+        replyAsk(req, slot, &sg->nodes[0].addr);
+    } else {
+        if (sg->next_redir >= sg->nodes_num)
+            sg->next_redir = 0;
+        replyAsk(req, slot, &sg->nodes[sg->next_redir++].addr);
+    }
+
+    return RR_ERROR;
+}
@@ -0,0 +1,276 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020 Redis Labs
+ *
+ * RedisRaft is dual licensed under the GNU Affero General Public License version 3
+ * (AGPLv3) or the Redis Source Available License (RSAL).
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "redisraft.h"
+
+/* Command descriptors, used to classify commands on the hot path without
+ * allocating memory or calling into Redis.
+ *
+ * Key positions follow the Redis command table: first and last key argument
+ * (a negative last key counts back from the last argument) and the step
+ * between keys.  A first key of 0 indicates the command takes no keys.
+ *
+ * Commands with CMD_SPEC_MOVABLE_KEYS take keys at positions that depend on
+ * other arguments, and are resolved through the Module API.
+ *
+ * NOTE: The table is looked up using binary search and must be kept sorted.
+ */
+
+#define RO          CMD_SPEC_READONLY
+#define MOVABLE     CMD_SPEC_MOVABLE_KEYS
+
+static const CommandSpec commandSpecs[] = {
+    { "append",                 0,                  1, 1, 1 },
+    { "asking",                 CMD_SPEC_ASKING,    0, 0, 0 },
+    { "bitcount",               RO,                 1, 1, 1 },
+    { "bitfield",               0,                  1, 1, 1 },
+    { "bitop",                  0,                  2, -1, 1 },
+    { "bitpos",                 0,                  1, 1, 1 },
+    { "blpop",                  0,                  1, -2, 1 },
+    { "brpop",                  0,                  1, -2, 1 },
+    { "brpoplpush",             0,                  1, 2, 1 },
+    { "bzpopmax",               0,                  1, -2, 1 },
+    { "bzpopmin",               0,                  1, -2, 1 },
+    { "cluster",                CMD_SPEC_CLUSTER,   0, 0, 0 },
+    { "dbsize",                 RO,                 0, 0, 0 },
+    { "decr",                   0,                  1, 1, 1 },
+    { "decrby",                 0,                  1, 1, 1 },
+    { "del",                    0,                  1, -1, 1 },
+    { "discard",                CMD_SPEC_DISCARD,   0, 0, 0 },
+    { "dump",                   0,                  1, 1, 1 },
+    { "eval",                   MOVABLE,            0, 0, 0 },
+    { "evalsha",                MOVABLE,            0, 0, 0 },
+    { "exec",                   CMD_SPEC_EXEC,      0, 0, 0 },
+    { "exists",                 RO,                 1, -1, 1 },
+    { "expire",                 0,                  1, 1, 1 },
+    { "expireat",               0,                  1, 1, 1 },
+    { "flushall",               0,                  0, 0, 0 },
+    { "flushdb",                0,                  0, 0, 0 },
+    { "geoadd",                 0,                  1, 1, 1 },
+    { "geodist",                RO,                 1, 1, 1 },
+    { "geohash",                RO,                 1, 1, 1 },
+    { "geopos",                 RO,                 1, 1, 1 },
+    { "georadius",              MOVABLE,            1, 1, 1 },
+    { "georadius_ro",           RO,                 1, 1, 1 },
+    { "georadiusbymember",      MOVABLE,            1, 1, 1 },
+    { "georadiusbymember_ro",   RO,                 1, 1, 1 },
+    { "get",                    RO,                 1, 1, 1 },
+    { "getbit",                 RO,                 1, 1, 1 },
+    { "getrange",               RO,                 1, 1, 1 },
+    { "getset",                 0,                  1, 1, 1 },
+    { "hdel",                   0,                  1, 1, 1 },
+    { "hexists",                RO,                 1, 1, 1 },
+    { "hget",                   0,                  1, 1, 1 },
+    { "hgetall",                RO,                 1, 1, 1 },
+    { "hincrby",                0,                  1, 1, 1 },
+    { "hincrbyfloat",           0,                  1, 1, 1 },
+    { "hkeys",                  RO,                 1, 1, 1 },
+    { "hlen",                   RO,                 1, 1, 1 },
+    { "hmget",                  RO,                 1, 1, 1 },
+    { "hmset",                  0,                  1, 1, 1 },
+    { "hscan",                  RO,                 1, 1, 1 },
+    { "hset",                   0,                  1, 1, 1 },
+    { "hsetnx",                 0,                  1, 1, 1 },
+    { "hstrlen",                RO,                 1, 1, 1 },
+    { "hvals",                  RO,                 1, 1, 1 },
+    { "incr",                   0,                  1, 1, 1 },
+    { "incrby",                 0,                  1, 1, 1 },
+    { "incrbyfloat",            0,                  1, 1, 1 },
+    { "keys",                   RO,                 0, 0, 0 },
+    { "lindex",                 RO,                 1, 1, 1 },
+    { "linsert",                0,                  1, 1, 1 },
+    { "llen",                   RO,                 1, 1, 1 },
+    { "lpop",                   0,                  1, 1, 1 },
+    { "lpos",                   0,                  1, 1, 1 },
+    { "lpush",                  0,                  1, 1, 1 },
+    { "lpushx",                 0,                  1, 1, 1 },
+    { "lrange",                 RO,                 1, 1, 1 },
+    { "lrem",                   0,                  1, 1, 1 },
+    { "lset",                   0,                  1, 1, 1 },
+    { "ltrim",                  0,                  1, 1, 1 },
+    { "memory",                 MOVABLE,            0, 0, 0 },
+    { "mget",                   RO,                 1, -1, 1 },
+    { "migrate",                MOVABLE,            0, 0, 0 },
+    { "move",                   0,                  1, 1, 1 },
+    { "mset",                   0,                  1, -1, 2 },
+    { "msetnx",                 0,                  1, -1, 2 },
+    { "multi",                  CMD_SPEC_MULTI,     0, 0, 0 },
+    { "object",                 0,                  2, 2, 1 },
+    { "persist",                0,                  1, 1, 1 },
+    { "pexpire",                0,                  1, 1, 1 },
+    { "pexpireat",              0,                  1, 1, 1 },
+    { "pfadd",                  0,                  1, 1, 1 },
+    { "pfcount",                RO,                 1, -1, 1 },
+    { "pfmerge",                0,                  1, -1, 1 },
+    { "ping",                   0,                  0, 0, 0 },
+    { "psetex",                 0,                  1, 1, 1 },
+    { "pttl",                   0,                  1, 1, 1 },
+    { "publish",                0,                  0, 0, 0 },
+    { "randomkey",              RO,                 0, 0, 0 },
+    { "rename",                 0,                  1, 2, 1 },
+    { "renamenx",               0,                  1, 2, 1 },
+    { "restore",                0,                  1, 1, 1 },
+    { "rpop",                   0,                  1, 1, 1 },
+    { "rpoplpush",              0,                  1, 2, 1 },
+    { "rpush",                  0,                  1, 1, 1 },
+    { "rpushx",                 0,                  1, 1, 1 },
+    { "sadd",                   0,                  1, 1, 1 },
+    { "scan",                   RO,                 0, 0, 0 },
+    { "scard",                  RO,                 1, 1, 1 },
+    { "sdiff",                  RO,                 1, -1, 1 },
+    { "sdiffstore",             0,                  1, -1, 1 },
+    { "set",                    0,                  1, 1, 1 },
+    { "setbit",                 0,                  1, 1, 1 },
+    { "setex",                  0,                  1, 1, 1 },
+    { "setnx",                  0,                  1, 1, 1 },
+    { "setrange",               0,                  1, 1, 1 },
+    { "sinter",                 RO,                 1, -1, 1 },
+    { "sinterstore",            0,                  1, -1, 1 },
+    { "sismember",              RO,                 1, 1, 1 },
+    { "smembers",               RO,                 1, 1, 1 },
+    { "smove",                  0,                  1, 2, 1 },
+    { "sort",                   MOVABLE,            1, 1, 1 },
+    { "spop",                   0,                  1, 1, 1 },
+    { "srandmember",            RO,                 1, 1, 1 },
+    { "srem",                   0,                  1, 1, 1 },
+    { "sscan",                  RO,                 1, 1, 1 },
+    { "strlen",                 RO,                 1, 1, 1 },
+    { "substr",                 RO,                 1, 1, 1 },
+    { "sunion",                 RO,                 1, -1, 1 },
+    { "sunionstore",            0,                  1, -1, 1 },
+    { "swapdb",                 0,                  0, 0, 0 },
+    { "touch",                  0,                  1, -1, 1 },
+    { "ttl",                    RO,                 1, 1, 1 },
+    { "type",                   0,                  1, 1, 1 },
+    { "unlink",                 0,                  1, -1, 1 },
+    { "unwatch",                0,                  0, 0, 0 },
+    { "watch",                  0,                  1, -1, 1 },
+    { "xack",                   0,                  1, 1, 1 },
+    { "xadd",                   0,                  1, 1, 1 },
+    { "xclaim",                 0,                  1, 1, 1 },
+    { "xdel",                   0,                  1, 1, 1 },
+    { "xgroup",                 0,                  2, 2, 1 },
+    { "xinfo",                  0,                  2, 2, 1 },
+    { "xlen",                   0,                  1, 1, 1 },
+    { "xpending",               0,                  1, 1, 1 },
+    { "xrange",                 0,                  1, 1, 1 },
+    { "xread",                  MOVABLE,            0, 0, 0 },
+    { "xreadgroup",             MOVABLE,            0, 0, 0 },
+    { "xrevrange",              0,                  1, 1, 1 },
+    { "xsetid",                 0,                  1, 1, 1 },
+    { "xtrim",                  0,                  1, 1, 1 },
+    { "zadd",                   0,                  1, 1, 1 },
+    { "zcard",                  RO,                 1, 1, 1 },
+    { "zcount",                 RO,                 1, 1, 1 },
+    { "zincrby",                0,                  1, 1, 1 },
+    { "zinterstore",            MOVABLE,            0, 0, 0 },
+    { "zlexcount",              RO,                 1, 1, 1 },
+    { "zpopmax",                0,                  1, 1, 1 },
+    { "zpopmin",                0,                  1, 1, 1 },
+    { "zrange",                 RO,                 1, 1, 1 },
+    { "zrangebylex",            RO,                 1, 1, 1 },
+    { "zrangebyscore",          RO,                 1, 1, 1 },
+    { "zrank",                  RO,                 1, 1, 1 },
+    { "zrem",                   0,                  1, 1, 1 },
+    { "zremrangebylex",         0,                  1, 1, 1 },
+    { "zremrangebyrank",        0,                  1, 1, 1 },
+    { "zremrangebyscore",       0,                  1, 1, 1 },
+    { "zrevrange",              RO,                 1, 1, 1 },
+    { "zrevrangebylex",         RO,                 1, 1, 1 },
+    { "zrevrangebyscore",       RO,                 1, 1, 1 },
+    { "zrevrank",               RO,                 1, 1, 1 },
+    { "zscan",                  RO,                 1, 1, 1 },
+    { "zscore",                 RO,                 1, 1, 1 },
+    { "zunionstore",            MOVABLE,            0, 0, 0 },
+};
+
+#undef RO
+#undef MOVABLE
+
+#define COMMAND_SPECS_NUM   (sizeof(commandSpecs) / sizeof(commandSpecs[0]))
+
+/* Compares a command name of the specified length, in any case, against a
+ * lowercase descriptor name.
+ */
+static int compareCommandName(const char *name, size_t name_len, const char *spec_name)
+{
+    size_t i;
+
+    for (i = 0; i < name_len; i++) {
+        unsigned char c = tolower((unsigned char) name[i]);
+        unsigned char s = spec_name[i];
+
+        if (c != s) {
+            return c < s ? -1 : 1;
+        }
+        if (!s) {
+            /* Name has an embedded NUL, and is longer */
+            return 1;
+        }
+    }
+
+    return spec_name[i] ? -1 : 0;
+}
+
+/* Returns the descriptor of the specified command, or NULL if the command is
+ * unknown.
+ */
+const CommandSpec *CommandSpecGet(const RedisModuleString *cmd)
+{
+    size_t name_len;
+    const char *name = RedisModule_StringPtrLen(cmd, &name_len);
+    size_t lo = 0;
+    size_t hi = COMMAND_SPECS_NUM;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int ret = compareCommandName(name, name_len, commandSpecs[mid].name);
+
+        if (!ret) {
+            return &commandSpecs[mid];
+        } else if (ret < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns the flags of the specified command, or 0 if the command is unknown */
+int CommandSpecGetFlags(const RedisModuleString *cmd)
+{
+    const CommandSpec *spec = CommandSpecGet(cmd);
+    return spec ? spec->flags : 0;
+}
+
+/* Returns the argument indexes of the first and last key the command
+ * addresses, for a command of argc arguments.  Returns false if the command
+ * addresses no keys.
+ *
+ * Must not be used for commands with CMD_SPEC_MOVABLE_KEYS.
+ */
+bool CommandSpecGetKeyRange(const CommandSpec *spec, int argc, int *first, int *last)
+{
+    if (!spec->first_key || spec->first_key >= argc) {
+        return false;
+    }
+
+    *first = spec->first_key;
+    *last = spec->last_key < 0 ? argc + spec->last_key : spec->last_key;
+    if (*last >= argc) {
+        *last = argc - 1;
+    }
+
+    return *last >= *first;
+}
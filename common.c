@@ -66,6 +66,12 @@ void replyRaftError(RedisModuleCtx *ctx, int error)
         case RAFT_ERR_NOMEM:
             RedisModule_ReplyWithError(ctx, "-OOM Raft out of memory");
             break;
+        case RAFT_ERR_LEADER_TRANSFER_IN_PROGRESS:
+            RedisModule_ReplyWithError(ctx, "-TRYAGAIN leadership transfer in progress");
+            break;
+        case RAFT_ERR_INVALID_NODEID:
+            RedisModule_ReplyWithError(ctx, "-ERR invalid node id");
+            break;
         default:
             snprintf(buf, sizeof(buf) - 1, "-ERR Raft error %d", error);
             RedisModule_ReplyWithError(ctx, buf);
@@ -100,6 +106,19 @@ void replyRedirect(RedisRaftCtx *rr, RaftReq *req, NodeAddr *addr)
     RedisModule_Free(reply);
 }
 
+/* Create an -ASK reply, redirecting a single request to a node of the
+ * shardgroup the slot is migrating to.
+ */
+void replyAsk(RaftReq *req, int slot, NodeAddr *addr)
+{
+    size_t reply_maxlen = strlen(addr->host) + 40;
+    char *reply = RedisModule_Alloc(reply_maxlen);
+
+    snprintf(reply, reply_maxlen, "ASK %d %s:%u", slot, addr->host, addr->port);
+    RedisModule_ReplyWithError(req->ctx, reply);
+    RedisModule_Free(reply);
+}
+
 /* Check that this node is a Raft leader.  If not, reply with -MOVED and
  * return an error.
  */
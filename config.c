@@ -147,6 +147,34 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
             return RR_ERROR;
         }
         target->raft_log_max_file_size = (int)val;
+    } else if (!strcmp(keyword, "raft-log-segment-size")) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK || !val) {
+            snprintf(errbuf, errbuflen-1, "invalid 'raft-log-segment-size' value");
+            return RR_ERROR;
+        }
+        target->raft_log_segment_size = val;
+    } else if (!strcmp(keyword, "snapshot-chunk-size")) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK || !val) {
+            snprintf(errbuf, errbuflen-1, "invalid 'snapshot-chunk-size' value");
+            return RR_ERROR;
+        }
+        target->snapshot_chunk_size = val;
+    } else if (!strcmp(keyword, "snapshot-compression")) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'snapshot-compression' value");
+            return RR_ERROR;
+        }
+        target->snapshot_compression = val;
+    } else if (!strcmp(keyword, "bulk-connection")) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'bulk-connection' value");
+            return RR_ERROR;
+        }
+        target->bulk_connection = val;
     } else if (!strcmp(keyword, "raft-log-fsync")) {
         bool val;
         if (parseBool(value, &val) != RR_OK) {
@@ -154,6 +182,68 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
             return RR_ERROR;
         }
         target->raft_log_fsync = val;
+    } else if (!strcmp(keyword, "append-entries-window")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 1) {
+            snprintf(errbuf, errbuflen-1, "invalid 'append-entries-window' value");
+            return RR_ERROR;
+        }
+        target->append_entries_window = (int) val;
+    } else if (!strcmp(keyword, "append-entries-max-bytes")) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'append-entries-max-bytes' value");
+            return RR_ERROR;
+        }
+        target->append_entries_max_bytes = val;
+    } else if (!strcmp(keyword, "raft-log-group-commit-max-entries")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'raft-log-group-commit-max-entries' value");
+            return RR_ERROR;
+        }
+        target->raft_log_group_commit_max_entries = (int) val;
+    } else if (!strcmp(keyword, "raft-log-group-commit-max-delay")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'raft-log-group-commit-max-delay' value");
+            return RR_ERROR;
+        }
+        target->raft_log_group_commit_max_delay = (int) val;
+    } else if (!strcmp(keyword, "raft-log-sync-thread")) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'raft-log-sync-thread' value");
+            return RR_ERROR;
+        }
+        target->raft_log_sync_thread = val;
+    } else if (!strcmp(keyword, "apply-batch-max-entries")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'apply-batch-max-entries' value");
+            return RR_ERROR;
+        }
+        target->apply_batch_max_entries = (int) val;
+    } else if (!strcmp(keyword, "apply-batch-max-usec")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'apply-batch-max-usec' value");
+            return RR_ERROR;
+        }
+        target->apply_batch_max_usec = (int) val;
+    } else if (!strcmp(keyword, "write-coalesce-max-requests")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 1) {
+            snprintf(errbuf, errbuflen-1, "invalid 'write-coalesce-max-requests' value");
+            return RR_ERROR;
+        }
+        target->write_coalesce_max_requests = (int) val;
     } else if (!strcmp(keyword, "follower-proxy")) {
         bool val;
         if (parseBool(value, &val) != RR_OK) {
@@ -161,6 +251,21 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
             return RR_ERROR;
         }
         target->follower_proxy = val;
+    } else if (!strcmp(keyword, "follower-proxy-batch-size")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 1) {
+            snprintf(errbuf, errbuflen-1, "invalid 'follower-proxy-batch-size' value");
+            return RR_ERROR;
+        }
+        target->follower_proxy_batch_size = val;
+    } else if (!strcmp(keyword, "follower-reads")) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'follower-reads' value");
+            return RR_ERROR;
+        }
+        target->follower_reads = val;
     } else if (!strcmp(keyword, "quorum-reads")) {
         bool val;
         if (parseBool(value, &val) != RR_OK) {
@@ -168,6 +273,68 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
             return RR_ERROR;
         }
         target->quorum_reads = val;
+    } else if (!strcmp(keyword, "lease-reads")) {
+        bool val;
+        if (parseBool(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'lease-reads' value");
+            return RR_ERROR;
+        }
+        target->lease_reads = val;
+    } else if (!strcmp(keyword, "lease-drift-margin")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'lease-drift-margin' value");
+            return RR_ERROR;
+        }
+        target->lease_drift_margin = (int) val;
+    } else if (!strcmp(keyword, "learner-max-lag")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'learner-max-lag' value");
+            return RR_ERROR;
+        }
+        target->learner_max_lag = (int) val;
+    } else if (!strcmp(keyword, "learner-max-lag-msec")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'learner-max-lag-msec' value");
+            return RR_ERROR;
+        }
+        target->learner_max_lag_msec = (int) val;
+    } else if (!strcmp(keyword, "max-queued-requests")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'max-queued-requests' value");
+            return RR_ERROR;
+        }
+        target->max_queued_requests = (int) val;
+    } else if (!strcmp(keyword, "max-uncommitted-entries")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'max-uncommitted-entries' value");
+            return RR_ERROR;
+        }
+        target->max_uncommitted_entries = (int) val;
+    } else if (!strcmp(keyword, "max-uncommitted-bytes")) {
+        unsigned long val;
+        if (parseMemorySize(value, &val) != RR_OK) {
+            snprintf(errbuf, errbuflen-1, "invalid 'max-uncommitted-bytes' value");
+            return RR_ERROR;
+        }
+        target->max_uncommitted_bytes = val;
+    } else if (!strcmp(keyword, "max-proxied-requests")) {
+        char *errptr;
+        long val = strtol(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'max-proxied-requests' value");
+            return RR_ERROR;
+        }
+        target->max_proxied_requests = (int) val;
     } else if (!strcmp(keyword, "raftize-all-commands")) {
         bool val;
         if (parseBool(value, &val) != RR_OK) {
@@ -213,6 +380,14 @@ static RRStatus processConfigParam(const char *keyword, const char *value,
             return RR_ERROR;
         }
         target->shardgroup_update_interval = (int) val;
+    } else if (!strcmp(keyword, "leader-balance-interval")) {
+        char *errptr;
+        unsigned long val = strtoul(value, &errptr, 10);
+        if (*errptr != '\0' || val < 0) {
+            snprintf(errbuf, errbuflen-1, "invalid 'leader-balance-interval' value");
+            return RR_ERROR;
+        }
+        target->leader_balance_interval = (int) val;
     } else {
         snprintf(errbuf, errbuflen-1, "invalid parameter '%s'", keyword);
         return RR_ERROR;
@@ -249,6 +424,9 @@ void handleConfigSet(RedisRaftCtx *rr, RedisModuleCtx *ctx, RedisModuleString **
                 return;
             }
         }
+        if (rr->log) {
+            rr->log->segment_size = rr->config->raft_log_segment_size;
+        }
 
         RedisModule_ReplyWithSimpleString(ctx, "OK");
     } else {
@@ -325,6 +503,14 @@ void handleConfigGet(RedisModuleCtx *ctx, RedisRaftConfig *config, RedisModuleSt
         len++;
         replyConfigInt(ctx, "reconnect-interval", config->reconnect_interval);
     }
+    if (stringmatch(pattern, "append-entries-window", 1)) {
+        len++;
+        replyConfigInt(ctx, "append-entries-window", config->append_entries_window);
+    }
+    if (stringmatch(pattern, "append-entries-max-bytes", 1)) {
+        len++;
+        replyConfigMemSize(ctx, "append-entries-max-bytes", config->append_entries_max_bytes);
+    }
     if (stringmatch(pattern, "raft-log-max-cache-size", 1)) {
         len++;
         replyConfigMemSize(ctx, "raft-log-max-cache-size", config->raft_log_max_cache_size);
@@ -333,18 +519,98 @@ void handleConfigGet(RedisModuleCtx *ctx, RedisRaftConfig *config, RedisModuleSt
         len++;
         replyConfigMemSize(ctx, "raft-log-max-file-size", config->raft_log_max_file_size);
     }
+    if (stringmatch(pattern, "raft-log-segment-size", 1)) {
+        len++;
+        replyConfigMemSize(ctx, "raft-log-segment-size", config->raft_log_segment_size);
+    }
+    if (stringmatch(pattern, "snapshot-chunk-size", 1)) {
+        len++;
+        replyConfigMemSize(ctx, "snapshot-chunk-size", config->snapshot_chunk_size);
+    }
+    if (stringmatch(pattern, "snapshot-compression", 1)) {
+        len++;
+        replyConfigBool(ctx, "snapshot-compression", config->snapshot_compression);
+    }
+    if (stringmatch(pattern, "bulk-connection", 1)) {
+        len++;
+        replyConfigBool(ctx, "bulk-connection", config->bulk_connection);
+    }
     if (stringmatch(pattern, "raft-log-fsync", 1)) {
         len++;
         replyConfigBool(ctx, "raft-log-fsync", config->raft_log_fsync);
     }
+    if (stringmatch(pattern, "raft-log-group-commit-max-entries", 1)) {
+        len++;
+        replyConfigInt(ctx, "raft-log-group-commit-max-entries", config->raft_log_group_commit_max_entries);
+    }
+    if (stringmatch(pattern, "raft-log-group-commit-max-delay", 1)) {
+        len++;
+        replyConfigInt(ctx, "raft-log-group-commit-max-delay", config->raft_log_group_commit_max_delay);
+    }
+    if (stringmatch(pattern, "raft-log-sync-thread", 1)) {
+        len++;
+        replyConfigBool(ctx, "raft-log-sync-thread", config->raft_log_sync_thread);
+    }
+    if (stringmatch(pattern, "apply-batch-max-entries", 1)) {
+        len++;
+        replyConfigInt(ctx, "apply-batch-max-entries", config->apply_batch_max_entries);
+    }
+    if (stringmatch(pattern, "apply-batch-max-usec", 1)) {
+        len++;
+        replyConfigInt(ctx, "apply-batch-max-usec", config->apply_batch_max_usec);
+    }
+    if (stringmatch(pattern, "write-coalesce-max-requests", 1)) {
+        len++;
+        replyConfigInt(ctx, "write-coalesce-max-requests", config->write_coalesce_max_requests);
+    }
     if (stringmatch(pattern, "follower-proxy", 1)) {
         len++;
         replyConfigBool(ctx, "follower-proxy", config->follower_proxy);
     }
+    if (stringmatch(pattern, "follower-proxy-batch-size", 1)) {
+        len++;
+        replyConfigInt(ctx, "follower-proxy-batch-size", config->follower_proxy_batch_size);
+    }
+    if (stringmatch(pattern, "follower-reads", 1)) {
+        len++;
+        replyConfigBool(ctx, "follower-reads", config->follower_reads);
+    }
     if (stringmatch(pattern, "quorum-reads", 1)) {
         len++;
         replyConfigBool(ctx, "quorum-reads", config->quorum_reads);
     }
+    if (stringmatch(pattern, "lease-reads", 1)) {
+        len++;
+        replyConfigBool(ctx, "lease-reads", config->lease_reads);
+    }
+    if (stringmatch(pattern, "lease-drift-margin", 1)) {
+        len++;
+        replyConfigInt(ctx, "lease-drift-margin", config->lease_drift_margin);
+    }
+    if (stringmatch(pattern, "learner-max-lag", 1)) {
+        len++;
+        replyConfigInt(ctx, "learner-max-lag", config->learner_max_lag);
+    }
+    if (stringmatch(pattern, "learner-max-lag-msec", 1)) {
+        len++;
+        replyConfigInt(ctx, "learner-max-lag-msec", config->learner_max_lag_msec);
+    }
+    if (stringmatch(pattern, "max-queued-requests", 1)) {
+        len++;
+        replyConfigInt(ctx, "max-queued-requests", config->max_queued_requests);
+    }
+    if (stringmatch(pattern, "max-uncommitted-entries", 1)) {
+        len++;
+        replyConfigInt(ctx, "max-uncommitted-entries", config->max_uncommitted_entries);
+    }
+    if (stringmatch(pattern, "max-uncommitted-bytes", 1)) {
+        len++;
+        replyConfigMemSize(ctx, "max-uncommitted-bytes", config->max_uncommitted_bytes);
+    }
+    if (stringmatch(pattern, "max-proxied-requests", 1)) {
+        len++;
+        replyConfigInt(ctx, "max-proxied-requests", config->max_proxied_requests);
+    }
     if (stringmatch(pattern, "raftize-all-commands", 1)) {
         len++;
         replyConfigBool(ctx, "raftize-all-commands", config->raftize_all_commands);
@@ -375,6 +641,10 @@ void handleConfigGet(RedisModuleCtx *ctx, RedisRaftConfig *config, RedisModuleSt
         len++;
         replyConfigInt(ctx, "shardgroup-update-interval", config->shardgroup_update_interval);
     }
+    if (stringmatch(pattern, "leader-balance-interval", 1)) {
+        len++;
+        replyConfigInt(ctx, "leader-balance-interval", config->leader_balance_interval);
+    }
     RedisModule_ReplySetArrayLength(ctx, len * 2);
 }
 
@@ -389,15 +659,37 @@ void ConfigInit(RedisModuleCtx *ctx, RedisRaftConfig *config)
     config->reconnect_interval = REDIS_RAFT_DEFAULT_RECONNECT_INTERVAL;
     config->raft_response_timeout = REDIS_RAFT_DEFAULT_RAFT_RESPONSE_TIMEOUT;
     config->proxy_response_timeout = REDIS_RAFT_DEFAULT_PROXY_RESPONSE_TIMEOUT;
+    config->append_entries_window = REDIS_RAFT_DEFAULT_APPEND_ENTRIES_WINDOW;
+    config->append_entries_max_bytes = REDIS_RAFT_DEFAULT_APPEND_ENTRIES_MAX_BYTES;
     config->raft_log_max_cache_size = REDIS_RAFT_DEFAULT_LOG_MAX_CACHE_SIZE;
     config->raft_log_max_file_size = REDIS_RAFT_DEFAULT_LOG_MAX_FILE_SIZE;
+    config->raft_log_segment_size = REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE;
     config->raft_log_fsync = true;
+    config->snapshot_chunk_size = REDIS_RAFT_DEFAULT_SNAPSHOT_CHUNK_SIZE;
+    config->snapshot_compression = REDIS_RAFT_DEFAULT_SNAPSHOT_COMPRESSION;
+    config->bulk_connection = REDIS_RAFT_DEFAULT_BULK_CONNECTION;
+    config->raft_log_group_commit_max_entries = REDIS_RAFT_DEFAULT_LOG_GROUP_COMMIT_MAX_ENTRIES;
+    config->raft_log_group_commit_max_delay = REDIS_RAFT_DEFAULT_LOG_GROUP_COMMIT_MAX_DELAY;
+    config->raft_log_sync_thread = REDIS_RAFT_DEFAULT_LOG_SYNC_THREAD;
+    config->apply_batch_max_entries = REDIS_RAFT_DEFAULT_APPLY_BATCH_MAX_ENTRIES;
+    config->apply_batch_max_usec = REDIS_RAFT_DEFAULT_APPLY_BATCH_MAX_USEC;
+    config->write_coalesce_max_requests = REDIS_RAFT_DEFAULT_WRITE_COALESCE_MAX_REQUESTS;
+    config->follower_proxy_batch_size = REDIS_RAFT_DEFAULT_FOLLOWER_PROXY_BATCH_SIZE;
     config->quorum_reads = true;
+    config->lease_reads = false;
+    config->lease_drift_margin = REDIS_RAFT_DEFAULT_LEASE_DRIFT_MARGIN;
+    config->learner_max_lag = REDIS_RAFT_DEFAULT_LEARNER_MAX_LAG;
+    config->learner_max_lag_msec = REDIS_RAFT_DEFAULT_LEARNER_MAX_LAG_MSEC;
+    config->max_queued_requests = REDIS_RAFT_DEFAULT_MAX_QUEUED_REQUESTS;
+    config->max_uncommitted_entries = REDIS_RAFT_DEFAULT_MAX_UNCOMMITTED_ENTRIES;
+    config->max_uncommitted_bytes = REDIS_RAFT_DEFAULT_MAX_UNCOMMITTED_BYTES;
+    config->max_proxied_requests = REDIS_RAFT_DEFAULT_MAX_PROXIED_REQUESTS;
     config->raftize_all_commands = true;
     config->cluster_mode = false;
     config->cluster_start_hslot = REDIS_RAFT_HASH_MIN_SLOT;
     config->cluster_end_hslot = REDIS_RAFT_HASH_MAX_SLOT;
     config->shardgroup_update_interval = REDIS_RAFT_DEFAULT_SHARDGROUP_UPDATE_INTERVAL;
+    config->leader_balance_interval = REDIS_RAFT_DEFAULT_LEADER_BALANCE_INTERVAL;
 }
 
 static RRStatus setRedisConfig(RedisModuleCtx *ctx, const char *param, const char *value)
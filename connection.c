@@ -267,11 +267,38 @@ void ConnMarkDisconnected(Connection *conn)
 
     conn->state = CONN_DISCONNECTED;
     if (conn->rc) {
-        redisAsyncFree(conn->rc);
+        /* Pending callbacks are called by redisAsyncFree(), and may mark
+         * the connection disconnected again.
+         */
+        redisAsyncContext *ac = conn->rc;
         conn->rc = NULL;
+        redisAsyncFree(ac);
     }
 }
 
+/* Sends a command, like redisAsyncCommandArgv(), and accounts for the bytes
+ * of its arguments.
+ */
+int ConnSendCommandArgv(Connection *conn, redisCallbackFn *fn, void *privdata,
+        int argc, const char **argv, const size_t *argvlen)
+{
+    int i;
+
+    if (!conn->rc) {
+        return REDIS_ERR;
+    }
+
+    if (redisAsyncCommandArgv(conn->rc, fn, privdata, argc, argv, argvlen) != REDIS_OK) {
+        return REDIS_ERR;
+    }
+
+    for (i = 0; i < argc; i++) {
+        conn->bytes_sent += argvlen[i];
+    }
+
+    return REDIS_OK;
+}
+
 /* An idle state is one that will not transition automatically to another
  * state, unless actively mutated.
  */
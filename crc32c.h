@@ -0,0 +1,21 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020 Redis Labs
+ *
+ * RedisRaft is dual licensed under the GNU Affero General Public License version 3
+ * (AGPLv3) or the Redis Source Available License (RSAL).
+ */
+
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Computes the CRC32C (Castagnoli) checksum of buf, continuing from a
+ * previously returned crc value (use 0 to start).
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif /* _CRC32C_H_ */
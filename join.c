@@ -30,6 +30,7 @@ typedef struct JoinState {
     NodeAddrListElement *addr;
     NodeAddrListElement *addr_iter;
     Connection *conn;
+    bool learner;
 } JoinState;
 
 /* Callback for the RAFT.NODE ADD command.
@@ -85,6 +86,7 @@ static void handleNodeAddResponse(redisAsyncContext *c, void *r, void *privdata)
 static void sendNodeAddRequest(Connection *conn)
 {
     RedisRaftCtx *rr = ConnGetRedisRaftCtx(conn);
+    JoinState *state = ConnGetPrivateData(conn);
 
     /* Connection is not good?  Terminate and continue */
     if (!ConnIsConnected(conn)) {
@@ -92,10 +94,11 @@ static void sendNodeAddRequest(Connection *conn)
     }
 
     if (redisAsyncCommand(ConnGetRedisCtx(conn), handleNodeAddResponse, conn,
-        "RAFT.NODE %s %d %s:%u",
+        "RAFT.NODE %s %d %s:%u%s",
         "ADD",
         rr->config->id,
-        rr->config->addr.host, rr->config->addr.port) != REDIS_OK) {
+        rr->config->addr.host, rr->config->addr.port,
+        state->learner ? " LEARNER" : "") != REDIS_OK) {
 
         redisAsyncDisconnect(ConnGetRedisCtx(conn));
         ConnMarkDisconnected(conn);
@@ -143,13 +146,14 @@ void joinIdleCallback(Connection *conn)
 }
 
 /* Initiate the process of joining a cluster, using the specified list
- * of addresses.
+ * of addresses.  A learner asks to be added as a learner node.
  */
 
-void InitiateJoinCluster(RedisRaftCtx *rr, const NodeAddrListElement *addr)
+void InitiateJoinCluster(RedisRaftCtx *rr, const NodeAddrListElement *addr, bool learner)
 {
     JoinState *state = RedisModule_Calloc(1, sizeof(*state));
     NodeAddrListConcat(&state->addr, addr);
+    state->learner = learner;
 
     /* We just create the connection with an idle callback, which will
      * shortly fire and handle connection setup.
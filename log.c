@@ -12,13 +12,35 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <libgen.h>
 
 #include <assert.h>
 
 #include "redisraft.h"
+#include "crc32c.h"
 
 #define ENTRY_CACHE_INIT_SIZE 512
 
+/* The index file is mapped and grown in chunks of this many entries */
+#define INDEX_MAP_CHUNK_ENTRIES 65536
+
+/* Size of the readahead buffer of a RaftLogCursor */
+#define CURSOR_READAHEAD_SIZE   (1024 * 1024)
+
+/* Binary entry header, used since RAFTLOG_VERSION 2.  All fields are stored
+ * in host byte order:
+ *
+ *   uint32_t crc        CRC32C of the remainder of the header and the data
+ *   uint32_t data_len   Length of the data that follows the header
+ *   uint64_t term
+ *   int32_t  id
+ *   int32_t  type
+ */
+#define ENTRY_HEADER_SIZE   24
+
 #ifdef RAFT_LOG_TRACE
 #  define TRACE_LOG_OP(fmt, ...) LOG_DEBUG("Log>>" fmt, ##__VA_ARGS__)
 #else
@@ -27,7 +49,131 @@
 
 /*
  * Entries Cache.
+ *
+ * The cache holds its own copies of entries, allocated from large chunks
+ * rather than individually: each cached entry is bump-allocated into the
+ * current chunk, preceded by an EntryCacheSlot header that links it to
+ * its chunk.  A chunk is freed as a whole once all entries allocated from it
+ * have been freed, i.e. dropped from the cache and released by anyone else
+ * holding them.
+ *
+ * Copies take over the user_data of the appended entry, so a RaftReq that
+ * has been attached to it is handled when the cached copy is applied, or
+ * failed if it is freed first.
+ */
+
+typedef struct EntryCacheChunk {
+    unsigned long refs;     /* Entries not freed yet, +1 while current chunk */
+    unsigned long cached;   /* Entries in the cache, +1 while current chunk */
+    size_t size;            /* Size of buf */
+    size_t used;            /* Bytes of buf allocated so far */
+    char buf[];
+} EntryCacheChunk;
+
+typedef struct EntryCacheSlot {
+    EntryCacheChunk *chunk;
+    size_t size;            /* Bytes allocated, including this header */
+    bool attached;          /* user_data holds an attached RaftReq */
+} EntryCacheSlot;
+
+#define ENTRY_CACHE_CHUNK_SIZE  (1024 * 1024)
+#define ENTRY_CACHE_ALIGN(x)    (((x) + 7) & ~((size_t) 7))
+#define ENTRY_CACHE_SLOT_SIZE   ENTRY_CACHE_ALIGN(sizeof(EntryCacheSlot))
+
+static EntryCacheSlot *entryCacheGetSlot(raft_entry_t *ety)
+{
+    return (EntryCacheSlot *) ((char *) ety - ENTRY_CACHE_SLOT_SIZE);
+}
+
+static void entryCacheChunkRelease(EntryCacheChunk *chunk)
+{
+    if (!--chunk->refs) {
+        RedisModule_Free(chunk);
+    }
+}
+
+/* Accounts for a chunk no longer holding cached entries, or no longer
+ * being the current chunk.
  */
+static void entryCacheChunkUncache(EntryCache *cache, EntryCacheChunk *chunk)
+{
+    if (!--chunk->cached) {
+        cache->chunks_memsize -= sizeof(EntryCacheChunk) + chunk->size;
+    }
+}
+
+static void entryCacheFreeEntry(raft_entry_t *ety)
+{
+    EntryCacheSlot *slot = entryCacheGetSlot(ety);
+
+    if (slot->attached) {
+        EntryFailAttachedRaftReq(ety);
+    }
+
+    entryCacheChunkRelease(slot->chunk);
+}
+
+/* Drops an entry from the cache; it is freed once no longer held elsewhere */
+static void entryCacheDrop(EntryCache *cache, raft_entry_t *ety)
+{
+    EntryCacheSlot *slot = entryCacheGetSlot(ety);
+
+    cache->entries_memsize -= slot->size;
+    entryCacheChunkUncache(cache, slot->chunk);
+    raft_entry_release(ety);
+}
+
+/* Allocates a copy of the entry from the current chunk, starting a new chunk
+ * if it doesn't fit.
+ */
+static raft_entry_t *entryCacheCopy(EntryCache *cache, raft_entry_t *ety)
+{
+    size_t size = ENTRY_CACHE_SLOT_SIZE + ENTRY_CACHE_ALIGN(sizeof(raft_entry_t) + ety->data_len);
+    EntryCacheChunk *chunk = cache->chunk;
+
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > ENTRY_CACHE_CHUNK_SIZE ? size : ENTRY_CACHE_CHUNK_SIZE;
+
+        if (chunk) {
+            entryCacheChunkUncache(cache, chunk);
+            entryCacheChunkRelease(chunk);
+        }
+
+        chunk = RedisModule_Alloc(sizeof(EntryCacheChunk) + chunk_size);
+        chunk->refs = 1;
+        chunk->cached = 1;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        cache->chunk = chunk;
+        cache->chunks_memsize += sizeof(EntryCacheChunk) + chunk_size;
+    }
+
+    EntryCacheSlot *slot = (EntryCacheSlot *) (chunk->buf + chunk->used);
+    chunk->used += size;
+    chunk->refs++;
+    chunk->cached++;
+
+    slot->chunk = chunk;
+    slot->size = size;
+    slot->attached = false;
+
+    raft_entry_t *copy = (raft_entry_t *) ((char *) slot + ENTRY_CACHE_SLOT_SIZE);
+    memcpy(copy, ety, sizeof(raft_entry_t) + ety->data_len);
+    copy->refs = 1;
+    copy->free_func = entryCacheFreeEntry;
+
+    /* The only free_func used with user_data is the one of an attached
+     * RaftReq, see entryAttachRaftReq().
+     */
+    if (ety->user_data) {
+        slot->attached = ety->free_func != NULL;
+        ety->user_data = NULL;
+    }
+
+    cache->entries_memsize += size;
+    return copy;
+}
 
 EntryCache *EntryCacheNew(unsigned long initial_size)
 {
@@ -47,7 +193,12 @@ void EntryCacheFree(EntryCache *cache)
     unsigned long i;
 
     for (i = 0; i < cache->len; i++) {
-        raft_entry_release(cache->ptrs[(cache->start + i) % cache->size]);
+        entryCacheDrop(cache, cache->ptrs[(cache->start + i) % cache->size]);
+    }
+
+    if (cache->chunk) {
+        entryCacheChunkUncache(cache, cache->chunk);
+        entryCacheChunkRelease(cache->chunk);
     }
 
     RedisModule_Free(cache->ptrs);
@@ -75,10 +226,8 @@ void EntryCacheAppend(EntryCache *cache, raft_entry_t *ety, raft_index_t idx)
         cache->size = new_size;
     }
 
-    cache->ptrs[(cache->start + cache->len) % cache->size] = ety;
+    cache->ptrs[(cache->start + cache->len) % cache->size] = entryCacheCopy(cache, ety);
     cache->len++;
-    cache->entries_memsize += sizeof(raft_entry_t) + ety->data_len;
-    raft_entry_hold(ety);
 }
 
 raft_entry_t *EntryCacheGet(EntryCache *cache, raft_index_t idx)
@@ -97,6 +246,19 @@ raft_entry_t *EntryCacheGet(EntryCache *cache, raft_index_t idx)
     return ety;
 }
 
+static void entryCacheDropHead(EntryCache *cache)
+{
+    entryCacheDrop(cache, cache->ptrs[cache->start]);
+
+    cache->start_idx++;
+    cache->ptrs[cache->start] = NULL;
+    cache->start++;
+    if (cache->start >= cache->size) {
+        cache->start = 0;
+    }
+    cache->len--;
+}
+
 long EntryCacheDeleteHead(EntryCache *cache, raft_index_t first_idx)
 {
     long deleted = 0;
@@ -106,17 +268,7 @@ long EntryCacheDeleteHead(EntryCache *cache, raft_index_t first_idx)
     }
 
     while (first_idx > cache->start_idx && cache->len > 0) {
-        raft_entry_t *ety = cache->ptrs[cache->start];
-        cache->entries_memsize -= sizeof(raft_entry_t) + ety->data_len;
-        raft_entry_release(ety);
-
-        cache->start_idx++;
-        cache->ptrs[cache->start] = NULL;
-        cache->start++;
-        if (cache->start >= cache->size) {
-            cache->start = 0;
-        }
-        cache->len--;
+        entryCacheDropHead(cache);
         deleted++;
     }
 
@@ -148,10 +300,8 @@ long EntryCacheDeleteTail(EntryCache *cache, raft_index_t index)
     for (i = index; i < cache->start_idx + cache->len; i++) {
         unsigned long int relidx = i - cache->start_idx;
         unsigned long int ofs = (cache->start + relidx) % cache->size;
-        raft_entry_t *ety = cache->ptrs[ofs];
 
-        cache->entries_memsize -= sizeof(raft_entry_t) + ety->data_len;
-        raft_entry_release(ety);
+        entryCacheDrop(cache, cache->ptrs[ofs]);
 
         cache->ptrs[ofs] = NULL;
         deleted++;
@@ -166,22 +316,16 @@ long EntryCacheDeleteTail(EntryCache *cache, raft_index_t index)
     return deleted;
 }
 
+/* Drops entries from the head until the chunks holding cached entries fit
+ * in max_memory.  A chunk is only released once all of its entries are
+ * dropped, so this is what the cache really uses.
+ */
 long EntryCacheCompact(EntryCache *cache, size_t max_memory)
 {
     long deleted = 0;
 
-    while (cache->len > 0 && cache->entries_memsize > max_memory) {
-        raft_entry_t *ety = cache->ptrs[cache->start];
-        cache->entries_memsize -= sizeof(raft_entry_t) + ety->data_len;
-        raft_entry_release(ety);
-
-        cache->start_idx++;
-        cache->ptrs[cache->start] = NULL;
-        cache->start++;
-        if (cache->start >= cache->size) {
-            cache->start = 0;
-        }
-        cache->len--;
+    while (cache->len > 0 && cache->chunks_memsize > max_memory) {
+        entryCacheDropHead(cache);
         deleted++;
     }
 
@@ -192,15 +336,78 @@ long EntryCacheCompact(EntryCache *cache, size_t max_memory)
     return deleted;
 }
 
+/*
+ * Raft log files.
+ *
+ * The log is stored in several files, all named after the log filename:
+ *
+ *   <filename>                 Header: dbid, node id, snapshot term and index,
+ *                              current term and vote.
+ *   <filename>.manifest        List of segments, by index of first entry,
+ *                              and number of entries of sealed segments.
+ *   <filename>.seg.<idx>       Segment holding entries starting at <idx>.
+ *   <filename>.seg.<idx>.idx   Index of the entries in the segment.
+ *
+ * Entries are appended to the last segment, and a new segment is started
+ * once it has grown beyond the configured segment size.  Compaction only
+ * updates the header and removes segments that hold no entries beyond the
+ * snapshot, so the first segment may still hold entries included in the
+ * snapshot; these are skipped.
+ *
+ * Every segment but the last is sealed: its index file is synced before the
+ * next segment is listed in the manifest, along with its number of entries,
+ * so it can be trusted when the log is loaded rather than rebuilt.
+ *
+ * Logs created before RAFTLOG_VERSION 3 hold the header and all entries in
+ * a single file, and are moved into segments when opened.
+ */
+
+typedef struct RaftLogSegment {
+    raft_index_t first_idx;     /* Index of first entry */
+    unsigned long num_entries;  /* Entries in segment, including compacted */
+    unsigned long sealed_entries;   /* Entries listed in manifest if sealed */
+    size_t file_size;           /* File size at the time of last write */
+    char *filename;
+    FILE *file;
+    int idxfile;                /* Index file descriptor */
+    off_t *idxmap;              /* Memory mapped index file */
+    size_t idxmap_size;         /* Size of index mapping, in bytes */
+} RaftLogSegment;
+
+static void closeSegment(RaftLogSegment *seg)
+{
+    if (seg->file) {
+        fclose(seg->file);
+    }
+    if (seg->idxmap) {
+        munmap(seg->idxmap, seg->idxmap_size);
+    }
+    if (seg->idxfile != -1) {
+        close(seg->idxfile);
+    }
+    RedisModule_Free(seg->filename);
+    RedisModule_Free(seg);
+}
+
+static void stopSyncThread(RaftLog *log);
+
 void RaftLogClose(RaftLog *log)
 {
-    if (log->file) {
-        fclose(log->file);
-        log->file = NULL;
+    int i;
+
+    if (log->sync_thread) {
+        stopSyncThread(log);
+    }
+    for (i = 0; i < log->num_segments; i++) {
+        closeSegment(log->segments[i]);
     }
-    if (log->idxfile) {
-        fclose(log->idxfile);
-        log->idxfile = NULL;
+    if (log->segments) {
+        RedisModule_Free(log->segments);
+    }
+    for (i = 0; i < RAFT_LOG_CURSORS; i++) {
+        if (log->cursors[i]) {
+            RaftLogCursorFree(log->cursors[i]);
+        }
     }
     RedisModule_Free(log);
 }
@@ -298,12 +505,12 @@ typedef struct RawLogEntry {
     RawElement elements[];
 } RawLogEntry;
 
-static int readEncodedLength(RaftLog *log, char type, unsigned long *length)
+static int readEncodedLength(FILE *file, char type, unsigned long *length)
 {
     char buf[128];
     char *eptr;
 
-    if (!fgets(buf, sizeof(buf), log->file)) {
+    if (!fgets(buf, sizeof(buf), file)) {
         return -1;
     }
 
@@ -337,12 +544,12 @@ static void freeRawLogEntry(RawLogEntry *entry)
     RedisModule_Free(entry);
 }
 
-static int readRawLogEntry(RaftLog *log, RawLogEntry **entry)
+static int readRawLogEntry(FILE *file, RawLogEntry **entry)
 {
     unsigned long num_elements;
     int i;
 
-    if (readEncodedLength(log, '*', &num_elements) < 0) {
+    if (readEncodedLength(file, '*', &num_elements) < 0) {
         return -1;
     }
 
@@ -352,14 +559,14 @@ static int readRawLogEntry(RaftLog *log, RawLogEntry **entry)
         unsigned long len;
         char *ptr;
 
-        if (readEncodedLength(log, '$', &len) < 0) {
+        if (readEncodedLength(file, '$', &len) < 0) {
             goto error;
         }
         (*entry)->elements[i].len = len;
         (*entry)->elements[i].ptr = ptr = RedisModule_Alloc(len + 2);
 
         /* Read extra CRLF */
-        if (fread(ptr, 1, len + 2, log->file) != len + 2) {
+        if (fread(ptr, 1, len + 2, file) != len + 2) {
             goto error;
         }
         ptr[len] = '\0';
@@ -374,245 +581,851 @@ error:
     return -1;
 }
 
-static int updateIndex(RaftLog *log, raft_index_t index, off_t offset)
-{
-    long relidx = index - log->snapshot_last_idx;
-
-    if (fseek(log->idxfile, sizeof(off_t) * relidx, SEEK_SET) < 0 ||
-            fwrite(&offset, sizeof(off_t), 1, log->idxfile) != 1) {
-        return -1;
-    }
+/* Result of reading a single entry from the log */
+typedef enum ReadEntryStatus {
+    READ_ENTRY_OK = 0,
+    READ_ENTRY_EOF,             /* No more entries */
+    READ_ENTRY_TORN,            /* Last entry was not completely written */
+    READ_ENTRY_ERROR            /* Invalid or corrupt entry */
+} ReadEntryStatus;
 
-    return 0;
-}
+static raft_entry_t *parseRaftLogEntry(RawLogEntry *re);
 
-static char *getIndexFilename(const char *filename)
+static ReadEntryStatus readEntryV1(FILE *file, raft_entry_t **entry)
 {
-    int idx_filename_len = strlen(filename) + 10;
-    char *idx_filename = RedisModule_Alloc(idx_filename_len);
-    snprintf(idx_filename, idx_filename_len - 1, "%s.idx", filename);
-    return idx_filename;
-}
+    RawLogEntry *re;
 
-static RaftLog *prepareLog(const char *filename, RedisRaftConfig *config, int flags)
-{
-    FILE *file = fopen(filename, "a+");
-    if (!file) {
-        LOG_ERROR("Raft Log: %s: %s", filename, strerror(errno));
-        return NULL;
+    if (readRawLogEntry(file, &re) < 0) {
+        return READ_ENTRY_EOF;
     }
-
-    /* Index file */
-    char *idx_filename = getIndexFilename(filename);
-    FILE *idxfile = fopen(idx_filename, (flags & RAFTLOG_KEEP_INDEX) ? "r+" : "w+");
-    if (!idxfile) {
-        LOG_ERROR("Raft Log: %s: %s", idx_filename, strerror(errno));
-        RedisModule_Free(idx_filename);
-        fclose(file);
-        return NULL;
+    if (!re->num_elements) {
+        freeRawLogEntry(re);
+        return READ_ENTRY_EOF;
     }
-    RedisModule_Free(idx_filename);
-
-    /* Initialize struct */
-    RaftLog *log = RedisModule_Calloc(1, sizeof(RaftLog));
-    log->file = file;
-    log->idxfile = idxfile;
-    log->filename = filename;
 
-    /* Config */
-    if (config) {
-        log->fsync = config->raft_log_fsync;
-    } else {
-        log->fsync = true;
+    if (strcasecmp(re->elements[0].ptr, "ENTRY")) {
+        LOG_ERROR("Invalid log entry: %s", (char *) re->elements[0].ptr);
+        freeRawLogEntry(re);
+        return READ_ENTRY_ERROR;
     }
 
-    return log;
+    *entry = parseRaftLogEntry(re);
+    freeRawLogEntry(re);
+
+    return *entry ? READ_ENTRY_OK : READ_ENTRY_ERROR;
 }
 
-int writeLogHeader(FILE *logfile, RaftLog *log)
+static void encodeEntryHeader(unsigned char *buf, raft_entry_t *entry)
 {
-    if (writeBegin(logfile, 8) < 0 ||
-        writeBuffer(logfile, "RAFTLOG", 7) < 0 ||
-        writeUnsignedInteger(logfile, RAFTLOG_VERSION, 4) < 0 ||
-        writeBuffer(logfile, log->dbid, strlen(log->dbid)) < 0 ||
-        writeUnsignedInteger(logfile, log->node_id, 20) < 0 ||
-        writeUnsignedInteger(logfile, log->snapshot_last_term, 20) < 0 ||
-        writeUnsignedInteger(logfile, log->snapshot_last_idx, 20) < 0 ||
-        writeUnsignedInteger(logfile, log->term, 20) < 0 ||
-        writeInteger(logfile, log->vote, 11) < 0 ||
-        writeEnd(logfile, log->fsync) < 0) {
-            return -1;
-    }
-
-    return 0;
+    uint32_t data_len = entry->data_len;
+    uint64_t term = entry->term;
+    int32_t id = entry->id;
+    int32_t type = entry->type;
+
+    memcpy(buf + 4, &data_len, sizeof(data_len));
+    memcpy(buf + 8, &term, sizeof(term));
+    memcpy(buf + 16, &id, sizeof(id));
+    memcpy(buf + 20, &type, sizeof(type));
+
+    uint32_t crc = crc32c(0, buf + 4, ENTRY_HEADER_SIZE - 4);
+    crc = crc32c(crc, entry->data, entry->data_len);
+    memcpy(buf, &crc, sizeof(crc));
 }
 
-int updateLogHeader(RaftLog *log)
+/* Validates the CRC of an entry, once its data has been read, and decodes
+ * the remaining fields of its binary header.
+ */
+static bool decodeEntry(const unsigned char *hdr, raft_entry_t *e)
 {
-    int ret;
+    uint32_t crc;
+    uint64_t term;
+    int32_t id, type;
+    memcpy(&crc, hdr, sizeof(crc));
+    memcpy(&term, hdr + 8, sizeof(term));
+    memcpy(&id, hdr + 16, sizeof(id));
+    memcpy(&type, hdr + 20, sizeof(type));
 
-    /* Avoid same file open twice */
-    fclose(log->file);
-    log->file = NULL;
-
-    FILE *file = fopen(log->filename, "r+");
-    if (!file) {
-        PANIC("Failed to update log header: %s: %s",
-                log->filename, strerror(errno));
+    uint32_t calc_crc = crc32c(0, hdr + 4, ENTRY_HEADER_SIZE - 4);
+    calc_crc = crc32c(calc_crc, e->data, e->data_len);
+    if (calc_crc != crc) {
+        return false;
     }
 
-    ret = writeLogHeader(file, log);
-    fclose(file);
-
-    /* Reopen */
-    log->file = fopen(log->filename, "a+");
-    if (!log->file) {
-        PANIC("Failed to reopen log file: %s: %s",
-                log->filename, strerror(errno));
-    }
+    e->term = term;
+    e->id = id;
+    e->type = type;
 
-    return ret;
+    return true;
 }
 
-RaftLog *RaftLogCreate(const char *filename, const char *dbid, raft_term_t snapshot_term,
-        raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote, RedisRaftConfig *config)
+static uint32_t getEntryDataLen(const unsigned char *hdr)
 {
-    RaftLog *log = prepareLog(filename, config, 0);
-    if (!log) {
-        return NULL;
-    }
-
-    log->index = log->snapshot_last_idx = snapshot_index;
-    log->snapshot_last_term = snapshot_term;
-    log->term = current_term;
-    log->vote = last_vote;
-
-    memcpy(log->dbid, dbid, RAFT_DBID_LEN);
-    log->dbid[RAFT_DBID_LEN] = '\0';
-    log->node_id = config->id;
-
-    /* Truncate */
-    ftruncate(fileno(log->file), 0);
-    ftruncate(fileno(log->idxfile), 0);
-
-    /* Write log start */
-    if (writeLogHeader(log->file, log) < 0) {
-        LOG_ERROR("Failed to create Raft log: %s: %s", filename, strerror(errno));
-        RaftLogClose(log);
-        log = NULL;
-    }
-
-    return log;
+    uint32_t data_len;
+    memcpy(&data_len, hdr + 4, sizeof(data_len));
+    return data_len;
 }
 
-static raft_entry_t *parseRaftLogEntry(RawLogEntry *re)
+/* Reads a binary entry.  Entries are validated against their CRC, and an
+ * entry that is cut short or fails validation at the very end of the file is
+ * reported as torn; anywhere else it's an error.
+ */
+static ReadEntryStatus readEntryV2(FILE *file, size_t file_size, raft_entry_t **entry)
 {
-    char *eptr;
-    raft_entry_t *e;
+    unsigned char hdr[ENTRY_HEADER_SIZE];
+    long offset = ftell(file);
+    size_t n;
 
-    if (re->num_elements != 5) {
-        LOG_ERROR("Log entry: invalid number of arguments: %d", re->num_elements);
-        return NULL;
+    *entry = NULL;
+    if ((n = fread(hdr, 1, sizeof(hdr), file)) < sizeof(hdr)) {
+        return n > 0 ? READ_ENTRY_TORN : READ_ENTRY_EOF;
     }
 
-    e = raft_entry_new(re->elements[4].len);
-    memcpy(e->data, re->elements[4].ptr, re->elements[4].len);
-
-    e->term = strtoul(re->elements[1].ptr, &eptr, 10);
-    if (*eptr) {
-        goto error;
+    /* Don't trust data_len before we know it's within the file */
+    uint32_t data_len = getEntryDataLen(hdr);
+    size_t end = offset + sizeof(hdr) + data_len;
+    if (end > file_size) {
+        return READ_ENTRY_TORN;
     }
 
-    e->id = strtoul(re->elements[2].ptr, &eptr, 10);
-    if (*eptr) {
-        goto error;
+    raft_entry_t *e = raft_entry_new(data_len);
+    if (fread(e->data, 1, data_len, file) != data_len) {
+        raft_entry_release(e);
+        return READ_ENTRY_TORN;
     }
 
-    e->type = strtoul(re->elements[3].ptr, &eptr, 10);
-    if (*eptr) {
-        goto error;
+    if (!decodeEntry(hdr, e)) {
+        raft_entry_release(e);
+        if (end == file_size) {
+            return READ_ENTRY_TORN;
+        }
+        LOG_ERROR("Raft log: checksum mismatch in entry at offset %ld", offset);
+        return READ_ENTRY_ERROR;
     }
 
-    return e;
-
-error:
-    raft_entry_release(e);
-    return NULL;
+    *entry = e;
+    return READ_ENTRY_OK;
 }
 
-static int handleHeader(RaftLog *log, RawLogEntry *re)
+static off_t getFileSize(FILE *file)
 {
-    if (re->num_elements != 8 ||
-        strcmp(re->elements[0].ptr, "RAFTLOG")) {
-        LOG_ERROR("Invalid Raft log header.");
-        return -1;
-    }
+    struct stat st;
 
-    char *eptr;
-    unsigned long ver = strtoul(re->elements[1].ptr, &eptr, 10);
-    if (*eptr != '\0' || ver != RAFTLOG_VERSION) {
-        LOG_ERROR("Invalid Raft header version: %lu", ver);
+    if (fflush(file) < 0 || fstat(fileno(file), &st) < 0) {
         return -1;
     }
 
-    if (strlen(re->elements[2].ptr) > RAFT_DBID_LEN) {
-        LOG_ERROR("Invalid Raft log dbid: %s", (char *) re->elements[2].ptr);
-        return -1;
+    return st.st_size;
+}
+
+/* Makes sure the index mapping covers the specified relative index, growing
+ * the index file and remapping it if necessary.
+ */
+static int mapIndex(RaftLogSegment *seg, raft_index_t relidx)
+{
+    size_t required = sizeof(off_t) * (relidx + 1);
+    if (required <= seg->idxmap_size) {
+        return 0;
     }
-    strcpy(log->dbid, re->elements[2].ptr);
 
-    log->node_id = strtoul(re->elements[3].ptr, &eptr, 10);
-    if (*eptr != '\0') {
-        LOG_ERROR("Invalid Raft node_id: %s", (char *) re->elements[3].ptr);
+    struct stat st;
+    if (fstat(seg->idxfile, &st) < 0) {
         return -1;
     }
 
-    log->snapshot_last_term = strtoul(re->elements[4].ptr, &eptr, 10);
-    if (*eptr != '\0') {
-        LOG_ERROR("Invalid Raft log term: %s", (char *) re->elements[4].ptr);
+    size_t chunk = sizeof(off_t) * INDEX_MAP_CHUNK_ENTRIES;
+    size_t size = ((required + chunk - 1) / chunk) * chunk;
+    if ((size_t) st.st_size > size) {
+        size = st.st_size;
+    }
+    if ((size_t) st.st_size < size && ftruncate(seg->idxfile, size) < 0) {
         return -1;
     }
 
-    log->index = log->snapshot_last_idx = strtoul(re->elements[5].ptr, &eptr, 10);
-    if (*eptr != '\0') {
-        LOG_ERROR("Invalid Raft log index: %s", (char *) re->elements[5].ptr);
-        return -1;
+    if (seg->idxmap) {
+        munmap(seg->idxmap, seg->idxmap_size);
+        seg->idxmap = NULL;
+        seg->idxmap_size = 0;
     }
 
-    log->term = strtoul(re->elements[6].ptr, &eptr, 10);
-    if (*eptr != '\0') {
-        LOG_ERROR("Invalid Raft log voted term: %s", (char *) re->elements[6].ptr);
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, seg->idxfile, 0);
+    if (map == MAP_FAILED) {
         return -1;
     }
 
-    log->vote = strtol(re->elements[7].ptr, &eptr, 10);
-    if (*eptr != '\0') {
-        LOG_ERROR("Invalid Raft log vote: %s", (char *) re->elements[7].ptr);
+    seg->idxmap = map;
+    seg->idxmap_size = size;
+
+    return 0;
+}
+
+static int updateIndex(RaftLogSegment *seg, raft_index_t index, off_t offset)
+{
+    raft_index_t relidx = index - seg->first_idx;
+
+    if (mapIndex(seg, relidx) < 0) {
         return -1;
     }
 
+    seg->idxmap[relidx] = offset;
     return 0;
 }
 
-RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config, int flags)
+static char *getIndexFilename(const char *filename)
+{
+    int idx_filename_len = strlen(filename) + 10;
+    char *idx_filename = RedisModule_Alloc(idx_filename_len);
+    snprintf(idx_filename, idx_filename_len - 1, "%s.idx", filename);
+    return idx_filename;
+}
+
+static char *getManifestFilename(const char *filename)
 {
-    RaftLog *log = prepareLog(filename, config, flags);
-    RawLogEntry *e = NULL;
+    int manifest_filename_len = strlen(filename) + 10;
+    char *manifest_filename = RedisModule_Alloc(manifest_filename_len);
+    snprintf(manifest_filename, manifest_filename_len - 1, "%s.manifest", filename);
+    return manifest_filename;
+}
+
+static char *getSegmentFilename(const char *filename, raft_index_t first_idx)
+{
+    int seg_filename_len = strlen(filename) + 30;
+    char *seg_filename = RedisModule_Alloc(seg_filename_len);
+    snprintf(seg_filename, seg_filename_len - 1, "%s.seg.%lu", filename, (unsigned long) first_idx);
+    return seg_filename;
+}
 
-    if (!log) {
+/* Opens the segment starting at the specified index, or creates an empty
+ * one.  The index of a sealed segment is kept, so it may be reused when
+ * entries are loaded; otherwise it's rebuilt as entries are loaded or written.
+ */
+static RaftLogSegment *openSegment(const char *filename, raft_index_t first_idx,
+        unsigned long sealed_entries, bool create)
+{
+    char *seg_filename = getSegmentFilename(filename, first_idx);
+    FILE *file = NULL;
+
+    /* Entries are written directly to the file descriptor, see
+     * writeEntry(), so it must always append.
+     */
+    int fd = open(seg_filename, O_RDWR | O_APPEND | (create ? O_CREAT | O_TRUNC : 0), 0666);
+    if (fd < 0 || !(file = fdopen(fd, "a+"))) {
+        LOG_ERROR("Raft Log: %s: %s", seg_filename, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        RedisModule_Free(seg_filename);
         return NULL;
     }
 
-    /* Gracefully skip an empty file */
-    fseek(log->file, 0L, SEEK_END);
-    if (!ftell(log->file)) {
-        goto error;
+    bool keep_index = sealed_entries > 0 && !create;
+    char *idx_filename = getIndexFilename(seg_filename);
+    int idxfile = open(idx_filename, O_RDWR | O_CREAT | (keep_index ? 0 : O_TRUNC), 0666);
+    if (idxfile < 0) {
+        LOG_ERROR("Raft Log: %s: %s", idx_filename, strerror(errno));
+        RedisModule_Free(idx_filename);
+        RedisModule_Free(seg_filename);
+        fclose(file);
+        return NULL;
     }
+    RedisModule_Free(idx_filename);
 
-    /* Read start */
-    fseek(log->file, 0L, SEEK_SET);
+    RaftLogSegment *seg = RedisModule_Calloc(1, sizeof(RaftLogSegment));
+    seg->first_idx = first_idx;
+    seg->sealed_entries = keep_index ? sealed_entries : 0;
+    seg->filename = seg_filename;
+    seg->file = file;
+    seg->idxfile = idxfile;
+    seg->file_size = getFileSize(file);
 
-    if (readRawLogEntry(log, &e) < 0) {
+    return seg;
+}
+
+/* Entries are written bypassing stdio, so there's nothing to flush; the
+ * read buffer of the stream must not be flushed either, as it may be
+ * positioned beyond the end of a truncated file.
+ */
+static int syncSegment(RaftLogSegment *seg, bool use_fsync)
+{
+    if (use_fsync && fsync(fileno(seg->file)) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Seals a segment once a new one is started after it.  Its entries and the
+ * index are synced, so the index can be trusted once the manifest lists the
+ * segment as sealed.
+ */
+static int sealSegment(RaftLogSegment *seg, bool use_fsync)
+{
+    if (use_fsync) {
+        if (syncSegment(seg, true) < 0 ||
+            (seg->idxmap && msync(seg->idxmap, seg->idxmap_size, MS_SYNC) < 0) ||
+            fsync(seg->idxfile) < 0) {
+            return -1;
+        }
+    }
+
+    seg->sealed_entries = seg->num_entries;
+    return 0;
+}
+
+static void removeSegmentFiles(const char *seg_filename)
+{
+    char *idx_filename = getIndexFilename(seg_filename);
+
+    unlink(seg_filename);
+    unlink(idx_filename);
+
+    RedisModule_Free(idx_filename);
+}
+
+/* Returns the size of entries in the log beyond the snapshot, i.e. excluding
+ * entries in the first segment that have already been compacted.
+ */
+static size_t getLogSize(RaftLog *log)
+{
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < log->num_segments; i++) {
+        RaftLogSegment *seg = log->segments[i];
+        raft_index_t relidx = log->snapshot_last_idx + 1 - seg->first_idx;
+
+        if (seg->first_idx > log->snapshot_last_idx) {
+            size += seg->file_size;
+        } else if (relidx < seg->num_entries) {
+            size += seg->file_size - seg->idxmap[relidx];
+        }
+    }
+
+    return size;
+}
+
+/* Syncs the directory holding the log files, so files created or renamed in
+ * it are not lost on a crash even though their content was synced.
+ */
+static int syncLogDir(RaftLog *log)
+{
+    if (!log->fsync) {
+        return 0;
+    }
+
+    char dirbuf[strlen(log->filename) + 1];
+    strcpy(dirbuf, log->filename);
+
+    const char *dir = dirname(dirbuf);
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0 || fsync(fd) < 0) {
+        LOG_ERROR("Raft Log: failed to sync %s: %s", dir, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+
+    return 0;
+}
+
+/* Writes the list of segments, starting with segment @first, to a temporary
+ * file and renames it over the manifest.  Segments are listed by the index of
+ * their first entry; sealed segments, i.e. all but the last one, also list
+ * their number of entries as <first_idx>:<num_entries>.
+ */
+static int writeManifest(RaftLog *log, int first)
+{
+    char *manifest_filename = getManifestFilename(log->filename);
+    char tmp_filename[strlen(manifest_filename) + 5];
+    int ret = -1;
+    int i;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", manifest_filename);
+
+    FILE *file = fopen(tmp_filename, "w");
+    if (!file) {
+        LOG_ERROR("Raft Log: %s: %s", tmp_filename, strerror(errno));
+        goto exit;
+    }
+
+    if (writeBegin(file, log->num_segments - first + 1) < 0 ||
+        writeBuffer(file, "SEGMENTS", 8) < 0) {
+        fclose(file);
+        goto exit;
+    }
+    for (i = first; i < log->num_segments; i++) {
+        RaftLogSegment *seg = log->segments[i];
+        char buf[50];
+        int len;
+
+        if (i < log->num_segments - 1) {
+            len = snprintf(buf, sizeof(buf), "%lu:%lu",
+                           (unsigned long) seg->first_idx, seg->num_entries);
+        } else {
+            len = snprintf(buf, sizeof(buf), "%lu", (unsigned long) seg->first_idx);
+        }
+        if (writeBuffer(file, buf, len) < 0) {
+            fclose(file);
+            goto exit;
+        }
+    }
+    if (writeEnd(file, log->fsync) < 0) {
+        fclose(file);
+        goto exit;
+    }
+    fclose(file);
+
+    if (rename(tmp_filename, manifest_filename) < 0) {
+        LOG_ERROR("Raft Log: failed to rename %s: %s", tmp_filename, strerror(errno));
+        goto exit;
+    }
+
+    /* This also persists segments created since the last sync, which are
+     * always listed in the manifest right after they're created.
+     */
+    if (syncLogDir(log) < 0) {
+        goto exit;
+    }
+    ret = 0;
+
+exit:
+    RedisModule_Free(manifest_filename);
+    return ret;
+}
+
+/* Reads the manifest of the log, returning the segments in the elements of
+ * @re; see writeManifest() and parseManifestSegment().
+ */
+static int readManifest(const char *filename, RawLogEntry **re)
+{
+    char *manifest_filename = getManifestFilename(filename);
+    int ret = -1;
+
+    *re = NULL;
+
+    FILE *file = fopen(manifest_filename, "r");
+    if (!file) {
+        LOG_ERROR("Raft Log: %s: %s", manifest_filename, strerror(errno));
+        goto exit;
+    }
+
+    if (readRawLogEntry(file, re) < 0 ||
+        (*re)->num_elements < 1 ||
+        strcmp((*re)->elements[0].ptr, "SEGMENTS")) {
+        LOG_ERROR("Invalid Raft log manifest: %s", manifest_filename);
+        freeRawLogEntry(*re);
+        *re = NULL;
+    } else {
+        ret = 0;
+    }
+    fclose(file);
+
+exit:
+    RedisModule_Free(manifest_filename);
+    return ret;
+}
+
+/* Parses a segment listed in the manifest, returning the index of its first
+ * entry and its number of entries, or 0 if it's not sealed.
+ */
+static int parseManifestSegment(const char *s, raft_index_t *first_idx, unsigned long *num_entries)
+{
+    char *eptr;
+
+    *first_idx = strtoul(s, &eptr, 10);
+    *num_entries = 0;
+    if (*eptr == ':') {
+        *num_entries = strtoul(eptr + 1, &eptr, 10);
+        if (!*num_entries) {
+            return -1;
+        }
+    }
+
+    return *eptr == '\0' && *first_idx ? 0 : -1;
+}
+
+static void appendSegment(RaftLog *log, RaftLogSegment *seg)
+{
+    log->segments = RedisModule_Realloc(log->segments,
+            sizeof(RaftLogSegment *) * (log->num_segments + 1));
+    log->segments[log->num_segments++] = seg;
+}
+
+static int openSegments(RaftLog *log)
+{
+    RawLogEntry *re;
+    int i;
+
+    if (readManifest(log->filename, &re) < 0) {
+        return -1;
+    }
+
+    for (i = 1; i < re->num_elements; i++) {
+        raft_index_t first_idx;
+        unsigned long num_entries;
+
+        if (parseManifestSegment(re->elements[i].ptr, &first_idx, &num_entries) < 0 ||
+            (log->num_segments && first_idx <= log->segments[log->num_segments - 1]->first_idx)) {
+            LOG_ERROR("Invalid Raft log manifest segment: %s", (char *) re->elements[i].ptr);
+            freeRawLogEntry(re);
+            return -1;
+        }
+
+        RaftLogSegment *seg = openSegment(log->filename, first_idx, num_entries, false);
+        if (!seg) {
+            freeRawLogEntry(re);
+            return -1;
+        }
+        appendSegment(log, seg);
+    }
+
+    freeRawLogEntry(re);
+    return 0;
+}
+
+/* Removes the segment files listed in the manifest of the log, if it exists */
+static void removeSegments(const char *filename)
+{
+    char *manifest_filename = getManifestFilename(filename);
+    bool exists = access(manifest_filename, F_OK) == 0;
+    RawLogEntry *re;
+    int i;
+
+    RedisModule_Free(manifest_filename);
+    if (!exists || readManifest(filename, &re) < 0) {
+        return;
+    }
+
+    for (i = 1; i < re->num_elements; i++) {
+        raft_index_t first_idx;
+        unsigned long num_entries;
+
+        if (parseManifestSegment(re->elements[i].ptr, &first_idx, &num_entries) < 0) {
+            continue;
+        }
+
+        char *seg_filename = getSegmentFilename(filename, first_idx);
+        removeSegmentFiles(seg_filename);
+        RedisModule_Free(seg_filename);
+    }
+
+    freeRawLogEntry(re);
+}
+
+/* Removes the first @count segments (or the last ones if @count is negative)
+ * from the manifest and deletes their files.
+ */
+static int dropSegments(RaftLog *log, int count)
+{
+    int first = count > 0 ? 0 : log->num_segments + count;
+    int n = count > 0 ? count : -count;
+    int i;
+
+    assert(n <= log->num_segments);
+
+    log->cursors_gen++;
+    if (count > 0) {
+        if (writeManifest(log, n) < 0) {
+            return -1;
+        }
+    } else {
+        log->num_segments -= n;
+        if (writeManifest(log, 0) < 0) {
+            log->num_segments += n;
+            return -1;
+        }
+        log->num_segments += n;
+    }
+
+    for (i = first; i < first + n; i++) {
+        removeSegmentFiles(log->segments[i]->filename);
+        closeSegment(log->segments[i]);
+    }
+
+    if (count > 0) {
+        memmove(&log->segments[0], &log->segments[n],
+                sizeof(RaftLogSegment *) * (log->num_segments - n));
+    }
+    log->num_segments -= n;
+
+    return 0;
+}
+
+static RaftLog *prepareLog(const char *filename, RedisRaftConfig *config)
+{
+    RaftLog *log = RedisModule_Calloc(1, sizeof(RaftLog));
+    log->filename = filename;
+
+    /* Config */
+    if (config) {
+        log->fsync = config->raft_log_fsync;
+        log->segment_size = config->raft_log_segment_size;
+    } else {
+        log->fsync = true;
+    }
+    if (!log->segment_size) {
+        log->segment_size = REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE;
+    }
+
+    return log;
+}
+
+int writeLogHeader(FILE *logfile, RaftLog *log)
+{
+    if (writeBegin(logfile, 8) < 0 ||
+        writeBuffer(logfile, "RAFTLOG", 7) < 0 ||
+        writeUnsignedInteger(logfile, log->version, 4) < 0 ||
+        writeBuffer(logfile, log->dbid, strlen(log->dbid)) < 0 ||
+        writeUnsignedInteger(logfile, log->node_id, 20) < 0 ||
+        writeUnsignedInteger(logfile, log->snapshot_last_term, 20) < 0 ||
+        writeUnsignedInteger(logfile, log->snapshot_last_idx, 20) < 0 ||
+        writeUnsignedInteger(logfile, log->term, 20) < 0 ||
+        writeInteger(logfile, log->vote, 11) < 0 ||
+        writeEnd(logfile, log->fsync) < 0) {
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Writes the header to a temporary file and renames it over the header file,
+ * dropping anything else the file held.
+ */
+static int createLogHeader(RaftLog *log)
+{
+    char tmp_filename[strlen(log->filename) + 5];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", log->filename);
+
+    FILE *file = fopen(tmp_filename, "w");
+    if (!file) {
+        return -1;
+    }
+
+    int ret = writeLogHeader(file, log);
+    fclose(file);
+
+    if (ret < 0 || rename(tmp_filename, log->filename) < 0) {
+        unlink(tmp_filename);
+        return -1;
+    }
+
+    return syncLogDir(log);
+}
+
+/* Updates the header in place; fields are padded so it never changes size */
+int updateLogHeader(RaftLog *log)
+{
+    int ret;
+
+    FILE *file = fopen(log->filename, "r+");
+    if (!file) {
+        PANIC("Failed to update log header: %s: %s",
+                log->filename, strerror(errno));
+    }
+
+    ret = writeLogHeader(file, log);
+    fclose(file);
+
+    return ret;
+}
+
+RaftLog *RaftLogCreate(const char *filename, const char *dbid, raft_term_t snapshot_term,
+        raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote, RedisRaftConfig *config)
+{
+    RaftLog *log = prepareLog(filename, config);
+
+    log->version = RAFTLOG_VERSION;
+    log->index = log->snapshot_last_idx = snapshot_index;
+    log->snapshot_last_term = snapshot_term;
+    log->durable_idx = snapshot_index;
+    log->term = current_term;
+    log->vote = last_vote;
+
+    memcpy(log->dbid, dbid, RAFT_DBID_LEN);
+    log->dbid[RAFT_DBID_LEN] = '\0';
+    log->node_id = config->id;
+
+    /* Drop segments of a previous log by the same name */
+    removeSegments(filename);
+
+    /* Write log start */
+    if (writeManifest(log, 0) < 0 || createLogHeader(log) < 0) {
+        LOG_ERROR("Failed to create Raft log: %s: %s", filename, strerror(errno));
+        RaftLogClose(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+static raft_entry_t *parseRaftLogEntry(RawLogEntry *re)
+{
+    char *eptr;
+    raft_entry_t *e;
+
+    if (re->num_elements != 5) {
+        LOG_ERROR("Log entry: invalid number of arguments: %d", re->num_elements);
+        return NULL;
+    }
+
+    e = raft_entry_new(re->elements[4].len);
+    memcpy(e->data, re->elements[4].ptr, re->elements[4].len);
+
+    e->term = strtoul(re->elements[1].ptr, &eptr, 10);
+    if (*eptr) {
+        goto error;
+    }
+
+    e->id = strtoul(re->elements[2].ptr, &eptr, 10);
+    if (*eptr) {
+        goto error;
+    }
+
+    e->type = strtoul(re->elements[3].ptr, &eptr, 10);
+    if (*eptr) {
+        goto error;
+    }
+
+    return e;
+
+error:
+    raft_entry_release(e);
+    return NULL;
+}
+
+static int handleHeader(RaftLog *log, RawLogEntry *re)
+{
+    if (re->num_elements != 8 ||
+        strcmp(re->elements[0].ptr, "RAFTLOG")) {
+        LOG_ERROR("Invalid Raft log header.");
+        return -1;
+    }
+
+    char *eptr;
+    unsigned long ver = strtoul(re->elements[1].ptr, &eptr, 10);
+    if (*eptr != '\0' || ver < 1 || ver > RAFTLOG_VERSION) {
+        LOG_ERROR("Invalid Raft header version: %lu", ver);
+        return -1;
+    }
+    log->version = ver;
+
+    if (strlen(re->elements[2].ptr) > RAFT_DBID_LEN) {
+        LOG_ERROR("Invalid Raft log dbid: %s", (char *) re->elements[2].ptr);
+        return -1;
+    }
+    strcpy(log->dbid, re->elements[2].ptr);
+
+    log->node_id = strtoul(re->elements[3].ptr, &eptr, 10);
+    if (*eptr != '\0') {
+        LOG_ERROR("Invalid Raft node_id: %s", (char *) re->elements[3].ptr);
+        return -1;
+    }
+
+    log->snapshot_last_term = strtoul(re->elements[4].ptr, &eptr, 10);
+    if (*eptr != '\0') {
+        LOG_ERROR("Invalid Raft log term: %s", (char *) re->elements[4].ptr);
+        return -1;
+    }
+
+    log->index = log->snapshot_last_idx = strtoul(re->elements[5].ptr, &eptr, 10);
+    if (*eptr != '\0') {
+        LOG_ERROR("Invalid Raft log index: %s", (char *) re->elements[5].ptr);
+        return -1;
+    }
+
+    log->term = strtoul(re->elements[6].ptr, &eptr, 10);
+    if (*eptr != '\0') {
+        LOG_ERROR("Invalid Raft log voted term: %s", (char *) re->elements[6].ptr);
+        return -1;
+    }
+
+    log->vote = strtol(re->elements[7].ptr, &eptr, 10);
+    if (*eptr != '\0') {
+        LOG_ERROR("Invalid Raft log vote: %s", (char *) re->elements[7].ptr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Moves the entries of a single file log, following its header in @file,
+ * into segments.  The header is rewritten last, so if we fail before that
+ * the log is simply upgraded again the next time it's opened.
+ */
+static int upgradeLog(RaftLog *log, FILE *file)
+{
+    uint32_t version = log->version;
+    unsigned long count = 0;
+    ReadEntryStatus status;
+    raft_entry_t *e;
+
+    off_t file_size = getFileSize(file);
+    if (file_size < 0) {
+        return -1;
+    }
+
+    removeSegments(log->filename);
+
+    do {
+        status = version == 1 ? readEntryV1(file, &e) : readEntryV2(file, file_size, &e);
+        if (status != READ_ENTRY_OK) {
+            break;
+        }
+
+        RRStatus ret = RaftLogWriteEntry(log, e);
+        raft_entry_release(e);
+        if (ret != RR_OK) {
+            return -1;
+        }
+        count++;
+    } while (1);
+
+    /* A torn last entry is dropped, as it would be when loading entries */
+    if (status == READ_ENTRY_ERROR) {
+        return -1;
+    }
+
+    log->version = RAFTLOG_VERSION;
+    if (RaftLogSync(log) != RR_OK ||
+        writeManifest(log, 0) < 0 ||
+        createLogHeader(log) < 0) {
+        return -1;
+    }
+
+    /* The index of the previous version is held in a single file */
+    char *idx_filename = getIndexFilename(log->filename);
+    unlink(idx_filename);
+    RedisModule_Free(idx_filename);
+
+    LOG_INFO("Raft log: upgraded from version %u, %lu entries moved to segments",
+             version, count);
+    return 0;
+}
+
+RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config)
+{
+    RaftLog *log = prepareLog(filename, config);
+    RawLogEntry *e = NULL;
+
+    /* Gracefully skip a missing or empty file */
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        if (errno != ENOENT) {
+            LOG_ERROR("Raft Log: %s: %s", filename, strerror(errno));
+        }
+        goto error;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (!ftell(file)) {
+        goto error;
+    }
+
+    /* Read start */
+    fseek(file, 0L, SEEK_SET);
+
+    if (readRawLogEntry(file, &e) < 0) {
         LOG_ERROR("Failed to read Raft log: %s", errno ? strerror(errno) : "invalid data");
         goto error;
     }
@@ -621,212 +1434,975 @@ RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config, int flags)
         goto error;
     }
 
+    if (log->version < RAFTLOG_VERSION) {
+        if (upgradeLog(log, file) < 0) {
+            LOG_ERROR("Failed to upgrade Raft log: %s", filename);
+            goto error;
+        }
+    } else if (openSegments(log) < 0) {
+        goto error;
+    }
+
     freeRawLogEntry(e);
+    fclose(file);
     return log;
 
 error:
     if (e != NULL) {
         freeRawLogEntry(e);
     }
-    RaftLogClose(log);
-    return NULL;
+    if (file) {
+        fclose(file);
+    }
+    RaftLogClose(log);
+    return NULL;
+}
+
+RRStatus RaftLogReset(RaftLog *log, raft_index_t index, raft_term_t term)
+{
+    log->index = log->snapshot_last_idx = index;
+    log->durable_idx = index;
+    if (log->sync_idx > index) {
+        log->sync_idx = index;
+    }
+    log->snapshot_last_term = term;
+    log->num_entries = 0;
+    log->unsynced_entries = 0;
+    if (log->term > term) {
+        log->term = term;
+        log->vote = -1;
+    }
+
+    /* Segments are dropped first, as they may not follow the new snapshot */
+    if (dropSegments(log, log->num_segments) < 0 ||
+        updateLogHeader(log) < 0) {
+
+        return RR_ERROR;
+    }
+    log->file_size = 0;
+
+    return RR_OK;
+}
+
+/* Skips an entry that does not need to be read, only making sure it's
+ * within the file.
+ */
+static ReadEntryStatus skipEntryV2(FILE *file, size_t file_size)
+{
+    unsigned char hdr[ENTRY_HEADER_SIZE];
+    long offset = ftell(file);
+    size_t n;
+
+    if ((n = fread(hdr, 1, sizeof(hdr), file)) < sizeof(hdr)) {
+        return n > 0 ? READ_ENTRY_TORN : READ_ENTRY_EOF;
+    }
+
+    size_t end = offset + sizeof(hdr) + getEntryDataLen(hdr);
+    if (end > file_size) {
+        return READ_ENTRY_TORN;
+    }
+    if (fseek(file, end, SEEK_SET) < 0) {
+        return READ_ENTRY_ERROR;
+    }
+
+    return READ_ENTRY_OK;
+}
+
+/* Entries are loaded by a separate thread, which reads and validates them
+ * ahead into a bounded queue while RaftLogLoadEntries() hands them over to
+ * the callback in batches.
+ */
+#define LOG_LOADER_QUEUE_SIZE   1024
+
+typedef struct LogLoaderItem {
+    raft_entry_t *entry;
+    raft_index_t idx;
+} LogLoaderItem;
+
+typedef struct LogLoader {
+    RaftLog *log;
+    raft_index_t skip_idx;      /* Entries up to this index are not read */
+    raft_index_t last_idx;      /* Index of last entry loaded */
+    uv_mutex_t mutex;
+    uv_cond_t cond;             /* Signaled when the queue changes */
+    LogLoaderItem queue[LOG_LOADER_QUEUE_SIZE];
+    int queue_start;
+    int queue_len;
+    bool done;
+    bool failed;
+} LogLoader;
+
+/* Queues an entry, waiting for room if the queue is full */
+static void loaderPush(LogLoader *loader, raft_entry_t *entry, raft_index_t idx)
+{
+    uv_mutex_lock(&loader->mutex);
+    while (loader->queue_len == LOG_LOADER_QUEUE_SIZE) {
+        uv_cond_wait(&loader->cond, &loader->mutex);
+    }
+
+    LogLoaderItem *item = &loader->queue[(loader->queue_start + loader->queue_len) % LOG_LOADER_QUEUE_SIZE];
+    item->entry = entry;
+    item->idx = idx;
+    loader->queue_len++;
+
+    uv_cond_signal(&loader->cond);
+    uv_mutex_unlock(&loader->mutex);
+}
+
+/* Takes all queued entries, waiting for some to be queued unless loading is
+ * done.  Returns the number of entries taken.
+ */
+static int loaderPop(LogLoader *loader, LogLoaderItem *batch, bool *done)
+{
+    int n, i;
+
+    uv_mutex_lock(&loader->mutex);
+    while (!loader->queue_len && !loader->done) {
+        uv_cond_wait(&loader->cond, &loader->mutex);
+    }
+
+    n = loader->queue_len;
+    for (i = 0; i < n; i++) {
+        batch[i] = loader->queue[(loader->queue_start + i) % LOG_LOADER_QUEUE_SIZE];
+    }
+    loader->queue_start = (loader->queue_start + n) % LOG_LOADER_QUEUE_SIZE;
+    loader->queue_len = 0;
+    *done = loader->done;
+
+    uv_cond_signal(&loader->cond);
+    uv_mutex_unlock(&loader->mutex);
+
+    return n;
+}
+
+/* Reuses the index of a sealed segment, once it's been checked against the
+ * segment: it must cover all entries listed in the manifest, starting at the
+ * beginning of the file and ending at its end.
+ */
+static bool useSealedIndex(RaftLogSegment *seg)
+{
+    unsigned long n = seg->sealed_entries;
+    unsigned char hdr[ENTRY_HEADER_SIZE];
+    struct stat st;
+
+    if (!n || fstat(seg->idxfile, &st) < 0 ||
+        (size_t) st.st_size < sizeof(off_t) * n ||
+        mapIndex(seg, n - 1) < 0) {
+        return false;
+    }
+
+    off_t last = seg->idxmap[n - 1];
+    if (seg->idxmap[0] != 0 || last < 0 || (size_t) last >= seg->file_size ||
+        pread(fileno(seg->file), hdr, sizeof(hdr), last) != sizeof(hdr) ||
+        last + sizeof(hdr) + getEntryDataLen(hdr) != seg->file_size) {
+        return false;
+    }
+
+    seg->num_entries = n;
+    return true;
+}
+
+/* Reads the entries of a sealed segment using its index, starting with the
+ * first one that should not be skipped.
+ */
+static int loadSealedEntries(LogLoader *loader, RaftLogSegment *seg)
+{
+    raft_index_t last_idx = seg->first_idx + seg->num_entries - 1;
+    raft_index_t idx = seg->first_idx > loader->skip_idx ? seg->first_idx : loader->skip_idx + 1;
+
+    if (idx > last_idx) {
+        return 0;
+    }
+    if (fseek(seg->file, seg->idxmap[idx - seg->first_idx], SEEK_SET) < 0) {
+        return -1;
+    }
+
+    for (; idx <= last_idx; idx++) {
+        raft_entry_t *e;
+
+        if (readEntryV2(seg->file, seg->file_size, &e) != READ_ENTRY_OK) {
+            LOG_ERROR("Raft log: failed to read entry %ld of %s", idx, seg->filename);
+            return -1;
+        }
+        loaderPush(loader, e, idx);
+    }
+
+    return 0;
+}
+
+/* Loads the entries of a segment, rebuilding its index; a torn entry is only
+ * expected at the end of the last segment and is truncated.  Entries that
+ * should be skipped are only indexed.
+ */
+static int scanSegmentEntries(LogLoader *loader, RaftLogSegment *seg, bool last)
+{
+    if (fseek(seg->file, 0, SEEK_SET) < 0) {
+        return -1;
+    }
+
+    off_t file_size = getFileSize(seg->file);
+    if (file_size < 0) {
+        return -1;
+    }
+    seg->file_size = file_size;
+    seg->num_entries = 0;
+
+    do {
+        raft_index_t idx = seg->first_idx + seg->num_entries;
+        raft_entry_t *e = NULL;
+        ReadEntryStatus status;
+
+        long offset = ftell(seg->file);
+        if (idx <= loader->skip_idx) {
+            status = skipEntryV2(seg->file, seg->file_size);
+        } else {
+            status = readEntryV2(seg->file, seg->file_size, &e);
+        }
+
+        if (status == READ_ENTRY_EOF) {
+            break;
+        } else if (status == READ_ENTRY_TORN && last) {
+            LOG_INFO("Raft log: truncating incomplete entry at offset %ld of %s",
+                     offset, seg->filename);
+            if (ftruncate(fileno(seg->file), offset) < 0) {
+                LOG_ERROR("Raft log: failed to truncate: %s", strerror(errno));
+                return -1;
+            }
+            seg->file_size = offset;
+            break;
+        } else if (status != READ_ENTRY_OK) {
+            if (status == READ_ENTRY_TORN) {
+                LOG_ERROR("Raft log: incomplete entry at offset %ld of %s",
+                          offset, seg->filename);
+            }
+            return -1;
+        }
+
+        seg->num_entries++;
+        if (updateIndex(seg, idx, offset) < 0) {
+            LOG_ERROR("Raft log: failed to update index of %s: %s",
+                      seg->filename, strerror(errno));
+            if (e) {
+                raft_entry_release(e);
+            }
+            return -1;
+        }
+
+        if (e) {
+            loaderPush(loader, e, idx);
+        }
+    } while(1);
+
+    return 0;
+}
+
+static void loadEntriesThread(void *arg)
+{
+    LogLoader *loader = (LogLoader *) arg;
+    RaftLog *log = loader->log;
+    bool failed = false;
+    int i;
+
+    for (i = 0; i < log->num_segments && !failed; i++) {
+        RaftLogSegment *seg = log->segments[i];
+        bool last = i == log->num_segments - 1;
+
+        /* Segments must continue the log with no gaps */
+        if (seg->first_idx > loader->last_idx + 1 ||
+            (i > 0 && seg->first_idx < log->segments[i - 1]->first_idx + (raft_index_t) log->segments[i - 1]->num_entries)) {
+            LOG_ERROR("Raft log: segment %s does not follow previous entries", seg->filename);
+            failed = true;
+            break;
+        }
+
+        if (!last && useSealedIndex(seg)) {
+            failed = loadSealedEntries(loader, seg) < 0;
+        } else {
+            if (!last && seg->sealed_entries) {
+                LOG_INFO("Raft log: index of %s does not match segment, rebuilding", seg->filename);
+            }
+            failed = scanSegmentEntries(loader, seg, last) < 0;
+        }
+
+        raft_index_t last_idx = seg->first_idx + seg->num_entries - 1;
+        if (last_idx > loader->last_idx) {
+            loader->last_idx = last_idx;
+        }
+    }
+
+    uv_mutex_lock(&loader->mutex);
+    loader->done = true;
+    loader->failed = failed;
+    uv_cond_signal(&loader->cond);
+    uv_mutex_unlock(&loader->mutex);
+}
+
+/* Loads the entries of the log, calling the callback for every entry beyond
+ * the snapshot in order.  Entries up to @applied_idx are already reflected in
+ * the dataset, so they are indexed without being read and the callback is not
+ * called for them.
+ *
+ * Returns the number of entries beyond the snapshot, or -1 on error.
+ */
+int RaftLogLoadEntries(RaftLog *log, raft_index_t applied_idx,
+        int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg)
+{
+    LogLoader *loader = RedisModule_Calloc(1, sizeof(LogLoader));
+    LogLoaderItem *batch = RedisModule_Alloc(sizeof(LogLoaderItem) * LOG_LOADER_QUEUE_SIZE);
+    uv_thread_t thread;
+    bool done;
+    int ret = -1;
+    int n, i;
+
+    loader->log = log;
+    loader->skip_idx = applied_idx > log->snapshot_last_idx ? applied_idx : log->snapshot_last_idx;
+    loader->last_idx = log->snapshot_last_idx;
+    uv_mutex_init(&loader->mutex);
+    uv_cond_init(&loader->cond);
+
+    log->index = log->snapshot_last_idx;
+
+    if (uv_thread_create(&thread, loadEntriesThread, loader) < 0) {
+        LOG_ERROR("Raft log: failed to create loader thread");
+        goto exit;
+    }
+
+    do {
+        n = loaderPop(loader, batch, &done);
+        for (i = 0; i < n; i++) {
+            log->index = batch[i].idx;
+            if (callback) {
+                callback(callback_arg, batch[i].entry, batch[i].idx);
+            }
+            raft_entry_release(batch[i].entry);
+        }
+    } while (n > 0 || !done);
+
+    uv_thread_join(&thread);
+
+    if (!loader->failed) {
+        log->index = log->durable_idx = loader->last_idx;
+        log->file_size = getLogSize(log);
+        ret = log->index - log->snapshot_last_idx;
+        if (ret > 0) {
+            log->num_entries = ret;
+        }
+    }
+
+exit:
+    uv_cond_destroy(&loader->cond);
+    uv_mutex_destroy(&loader->mutex);
+    RedisModule_Free(batch);
+    RedisModule_Free(loader);
+    return ret;
+}
+
+/* Writes the entry header and data with a single writev() directly to the
+ * file, bypassing stdio.  A partial write is rolled back so the log never
+ * ends with a torn entry we know about.
+ */
+static int writeEntry(RaftLogSegment *seg, raft_entry_t *entry)
+{
+    unsigned char hdr[ENTRY_HEADER_SIZE];
+    encodeEntryHeader(hdr, entry);
+
+    struct iovec iov[2] = {
+        { .iov_base = hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = entry->data, .iov_len = entry->data_len }
+    };
+    struct iovec *iovp = iov;
+    int iovcnt = entry->data_len ? 2 : 1;
+    size_t total = sizeof(hdr) + entry->data_len;
+    size_t written = 0;
+
+    while (written < total) {
+        ssize_t n = writev(fileno(seg->file), iovp, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (written > 0) {
+                ftruncate(fileno(seg->file), seg->file_size);
+            }
+            return -1;
+        }
+
+        written += n;
+        while (iovcnt > 0 && (size_t) n >= iovp->iov_len) {
+            n -= iovp->iov_len;
+            iovp++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iovp->iov_base = (char *) iovp->iov_base + n;
+            iovp->iov_len -= n;
+        }
+    }
+
+    return total;
+}
+
+/* Returns the segment the next entry goes to, starting a new segment if the
+ * last one is full or does not end with the last entry.
+ */
+static RaftLogSegment *getWriteSegment(RaftLog *log)
+{
+    RaftLogSegment *seg = log->num_segments ? log->segments[log->num_segments - 1] : NULL;
+
+    /* An empty segment may have been left behind by a failed write */
+    if (seg && !seg->num_entries && seg->first_idx != log->index + 1) {
+        if (dropSegments(log, -1) < 0) {
+            return NULL;
+        }
+        seg = log->num_segments ? log->segments[log->num_segments - 1] : NULL;
+    }
+
+    if (seg && seg->first_idx + (raft_index_t) seg->num_entries == log->index + 1 &&
+        (!seg->num_entries || seg->file_size < log->segment_size)) {
+        return seg;
+    }
+
+    /* Only the last segment is synced by RaftLogSync(), so entries left in
+     * the previous one must be synced now, along with its index.
+     */
+    if (seg && sealSegment(seg, log->fsync) < 0) {
+        return NULL;
+    }
+
+    seg = openSegment(log->filename, log->index + 1, 0, true);
+    if (!seg) {
+        return NULL;
+    }
+
+    appendSegment(log, seg);
+    if (writeManifest(log, 0) < 0) {
+        log->num_segments--;
+        removeSegmentFiles(seg->filename);
+        closeSegment(seg);
+        return NULL;
+    }
+
+    return seg;
+}
+
+RRStatus RaftLogWriteEntry(RaftLog *log, raft_entry_t *entry)
+{
+    RaftLogSegment *seg = getWriteSegment(log);
+    if (!seg) {
+        return RR_ERROR;
+    }
+
+    off_t offset = seg->file_size;
+    int n = writeEntry(seg, entry);
+    if (n < 0) {
+        return RR_ERROR;
+    }
+
+    /* Update index */
+    seg->file_size += n;
+    seg->num_entries++;
+    log->file_size += n;
+    log->index++;
+    log->unsynced_entries++;
+    if (updateIndex(seg, log->index, offset) < 0) {
+        return RR_ERROR;
+    }
+
+    return RR_OK;
+}
+
+RRStatus RaftLogSync(RaftLog *log)
+{
+    if (log->num_segments &&
+        syncSegment(log->segments[log->num_segments - 1], log->fsync) < 0) {
+        return RR_ERROR;
+    }
+    log->unsynced_entries = 0;
+    log->durable_idx = log->index;
+    return RR_OK;
 }
 
-RRStatus RaftLogReset(RaftLog *log, raft_index_t index, raft_term_t term)
+RRStatus RaftLogAppend(RaftLog *log, raft_entry_t *entry)
 {
-    log->index = log->snapshot_last_idx = index;
-    log->snapshot_last_term = term;
-    if (log->term > term) {
-        log->term = term;
-        log->vote = -1;
+    if (RaftLogWriteEntry(log, entry) != RR_OK ||
+            RaftLogSync(log) != RR_OK) {
+        return RR_ERROR;
     }
 
-    if (ftruncate(fileno(log->file), 0) < 0 ||
-        ftruncate(fileno(log->idxfile), 0) < 0 ||
-        writeLogHeader(log->file, log) < 0) {
+    log->num_entries++;
+    return RR_OK;
+}
 
+/* Appends an entry without syncing the log.  The entry is only guaranteed
+ * to be durable after the next call to RaftLogSync().
+ */
+RRStatus RaftLogAppendNoSync(RaftLog *log, raft_entry_t *entry)
+{
+    if (RaftLogWriteEntry(log, entry) != RR_OK) {
         return RR_ERROR;
     }
 
+    log->num_entries++;
     return RR_OK;
 }
 
-int RaftLogLoadEntries(RaftLog *log, int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg)
+/* Log sync thread.
+ *
+ * With raft-log-sync-thread, RaftLogSyncPending() hands the log over to a
+ * thread that syncs it, so the Raft thread keeps processing requests and
+ * sending AppendEntries meanwhile.  The thread syncs a duplicate of the file
+ * descriptor, as the segment may be closed before it's done.  Once done, it
+ * signals sync_done_sig and RaftLogHandleSynced() advances durable_idx.
+ *
+ * A single sync is in progress at a time; entries appended meanwhile are
+ * synced once it's done.
+ */
+typedef struct LogSyncThread {
+    uv_thread_t thread;
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    uv_async_t *sync_done_sig;  /* Signaled when a sync is done */
+    int fd;                     /* File descriptor to sync, or -1 */
+    bool done;                  /* Sync is done but not handled yet */
+    int error;                  /* errno of a failed sync, or 0 */
+    bool exit;
+} LogSyncThread;
+
+static void logSyncThread(void *arg)
 {
-    int ret = 0;
+    LogSyncThread *st = (LogSyncThread *) arg;
 
-    if (fseek(log->file, 0, SEEK_SET) < 0) {
-        return -1;
+    uv_mutex_lock(&st->mutex);
+    while (!st->exit) {
+        if (st->fd == -1) {
+            uv_cond_wait(&st->cond, &st->mutex);
+            continue;
+        }
+
+        int fd = st->fd;
+        uv_mutex_unlock(&st->mutex);
+
+        int error = fsync(fd) < 0 ? errno : 0;
+        close(fd);
+
+        uv_mutex_lock(&st->mutex);
+        st->fd = -1;
+        st->done = true;
+        st->error = error;
+        uv_async_send(st->sync_done_sig);
     }
+    uv_mutex_unlock(&st->mutex);
+}
 
-    log->term = 1;
-    log->index = 0;
+static LogSyncThread *startSyncThread(uv_async_t *sync_done_sig)
+{
+    LogSyncThread *st = RedisModule_Calloc(1, sizeof(LogSyncThread));
+
+    st->fd = -1;
+    st->sync_done_sig = sync_done_sig;
+    uv_mutex_init(&st->mutex);
+    uv_cond_init(&st->cond);
+
+    if (uv_thread_create(&st->thread, logSyncThread, st) < 0) {
+        LOG_ERROR("Raft log: failed to create log sync thread");
+        uv_cond_destroy(&st->cond);
+        uv_mutex_destroy(&st->mutex);
+        RedisModule_Free(st);
+        return NULL;
+    }
 
-    /* Read Header */
-    RawLogEntry *re = NULL;
-    if (readRawLogEntry(log, &re) < 0 || handleHeader(log, re) < 0)  {
-        freeRawLogEntry(re);
-        LOG_INFO("Failed to read Raft log header");
-        return -1;
+    return st;
+}
+
+/* Stops the sync thread, waiting for a sync in progress to complete */
+static void stopSyncThread(RaftLog *log)
+{
+    LogSyncThread *st = log->sync_thread;
+
+    uv_mutex_lock(&st->mutex);
+    st->exit = true;
+    uv_cond_signal(&st->cond);
+    uv_mutex_unlock(&st->mutex);
+
+    uv_thread_join(&st->thread);
+
+    if (st->fd != -1) {
+        close(st->fd);
     }
-    freeRawLogEntry(re);
+    uv_cond_destroy(&st->cond);
+    uv_mutex_destroy(&st->mutex);
+    RedisModule_Free(st);
 
-    /* Read Entries */
-    do {
-        raft_entry_t *e = NULL;
+    log->sync_thread = NULL;
+}
 
-        long offset = ftell(log->file);
-        if (readRawLogEntry(log, &re) < 0 || !re->num_elements) {
-            break;
-        }
+/* Hands the last segment over to the sync thread, unless a sync is already
+ * in progress.
+ */
+static RRStatus startLogSync(RedisRaftCtx *rr)
+{
+    RaftLog *log = rr->log;
 
-        if (!strcasecmp(re->elements[0].ptr, "ENTRY")) {
-            e = parseRaftLogEntry(re);
-            if (!e) {
-                freeRawLogEntry(re);
-                ret = -1;
-                break;
-            }
-            log->index++;
-            ret++;
+    if (log->sync_in_progress) {
+        return RR_OK;
+    }
 
-            updateIndex(log, log->index, offset);
-        } else {
-            LOG_ERROR("Invalid log entry: %s", (char *) re->elements[0].ptr);
-            freeRawLogEntry(re);
+    if (!log->sync_thread && !(log->sync_thread = startSyncThread(&rr->log_sync_done_sig))) {
+        return RR_ERROR;
+    }
 
-            ret = -1;
-            break;
-        }
+    int fd = dup(fileno(log->segments[log->num_segments - 1]->file));
+    if (fd < 0) {
+        return RR_ERROR;
+    }
 
-        int cb_ret = 0;
-        if (callback) {
-            callback(callback_arg, e, log->index);
-        }
+    LogSyncThread *st = log->sync_thread;
+    uv_mutex_lock(&st->mutex);
+    st->fd = fd;
+    uv_cond_signal(&st->cond);
+    uv_mutex_unlock(&st->mutex);
 
-        freeRawLogEntry(re);
-        raft_entry_release(e);
+    log->sync_in_progress = true;
+    log->sync_start = uv_hrtime();
+    log->sync_idx = log->index;
+    log->sync_entries = log->unsynced_entries;
+    log->unsynced_entries = 0;
 
-        if (cb_ret < 0) {
-            ret = cb_ret;
-            break;
-        }
-    } while(1);
+    return RR_OK;
+}
 
-    if (ret > 0) {
-        log->num_entries = ret;
+static void updateSyncStats(RedisRaftCtx *rr, unsigned long entries, uint64_t start)
+{
+    LatencyHistogramRecord(&rr->latency[LATENCY_LOG_SYNC], (uv_hrtime() - start) / 1000);
+    rr->log_fsyncs++;
+    rr->log_fsync_entries += entries;
+    if (entries > rr->log_fsync_max_entries) {
+        rr->log_fsync_max_entries = entries;
     }
-    return ret;
 }
 
-RRStatus RaftLogWriteEntry(RaftLog *log, raft_entry_t *entry)
+/* Syncs all log entries appended since the last sync (group commit), and
+ * accounts for it in the fsync stats.  May be called at any time,
+ * and does nothing if there are no unsynced entries.
+ *
+ * With raft-log-sync-thread, this only starts syncing the log, and entries
+ * are durable once durable_idx reaches them.
+ */
+RRStatus RaftLogSyncPending(RedisRaftCtx *rr)
 {
-    size_t written = 0;
-    int n;
+    RaftLog *log = rr->log;
 
-    if ((n = writeBegin(log->file, 5)) < 0) {
-        return RR_ERROR;
+    if (!log || !log->unsynced_entries) {
+        return RR_OK;
     }
-    written += n;
-    if ((n = writeBuffer(log->file, "ENTRY", 5)) < 0) {
-        return RR_ERROR;
+
+    if (rr->config->raft_log_sync_thread && log->fsync && log->num_segments) {
+        return startLogSync(rr);
     }
-    written += n;
-    if ((n = writeUnsignedInteger(log->file, entry->term, 0)) < 0) {
+
+    unsigned long int entries = log->unsynced_entries;
+    uint64_t start = uv_hrtime();
+    if (RaftLogSync(log) != RR_OK) {
         return RR_ERROR;
     }
-    written += n;
-    if ((n = writeUnsignedInteger(log->file, entry->id, 0)) < 0) {
-        return RR_ERROR;
+
+    if (log->fsync) {
+        updateSyncStats(rr, entries, start);
     }
-    written += n;
-    if ((n = writeUnsignedInteger(log->file, entry->type, 0)) < 0) {
-        return RR_ERROR;
+
+    return RR_OK;
+}
+
+/* Called on the Raft thread once sync_done_sig is signaled.  If the sync in
+ * progress is done, the entries it covers become durable.
+ *
+ * Returns RR_ERROR if the sync has failed.
+ */
+RRStatus RaftLogHandleSynced(RedisRaftCtx *rr)
+{
+    RaftLog *log = rr->log;
+    bool done;
+    int error;
+
+    if (!log || !log->sync_thread) {
+        return RR_OK;
     }
-    written += n;
-    if ((n = writeBuffer(log->file, entry->data, entry->data_len)) < 0) {
-        return RR_ERROR;
+
+    LogSyncThread *st = log->sync_thread;
+    uv_mutex_lock(&st->mutex);
+    done = st->done;
+    error = st->error;
+    st->done = false;
+    uv_mutex_unlock(&st->mutex);
+
+    if (!done) {
+        return RR_OK;
     }
-    written += n;
 
-    /* Update index */
-    log->file_size = ftell(log->file);
-    off_t offset = log->file_size - written;
-    log->index++;
-    if (updateIndex(log, log->index, offset) < 0) {
+    log->sync_in_progress = false;
+    if (error) {
+        errno = error;
         return RR_ERROR;
     }
 
+    if (log->sync_idx > log->durable_idx) {
+        log->durable_idx = log->sync_idx;
+    }
+    updateSyncStats(rr, log->sync_entries, log->sync_start);
+
     return RR_OK;
 }
 
-RRStatus RaftLogSync(RaftLog *log)
+/* Reads the entry at the specified offset of a segment.  This uses pread()
+ * rather than the stream, as the stream's buffer does not track entries
+ * written or truncated through the file descriptor.
+ */
+static raft_entry_t *readEntryAt(RaftLogSegment *seg, off_t offset)
 {
-    if (writeEnd(log->file, log->fsync) < 0) {
-        return RR_ERROR;
+    unsigned char hdr[ENTRY_HEADER_SIZE];
+    int fd = fileno(seg->file);
+
+    if (pread(fd, hdr, sizeof(hdr), offset) != sizeof(hdr)) {
+        return NULL;
     }
-    return RR_OK;
+
+    uint32_t data_len = getEntryDataLen(hdr);
+    if (offset + sizeof(hdr) + data_len > seg->file_size) {
+        return NULL;
+    }
+
+    raft_entry_t *e = raft_entry_new(data_len);
+    if (pread(fd, e->data, data_len, offset + sizeof(hdr)) != data_len ||
+        !decodeEntry(hdr, e)) {
+        raft_entry_release(e);
+        return NULL;
+    }
+
+    return e;
 }
 
-RRStatus RaftLogAppend(RaftLog *log, raft_entry_t *entry)
+/* Returns the segment holding the entry at the specified index */
+static RaftLogSegment *findSegment(RaftLog *log, raft_index_t idx)
 {
-    if (RaftLogWriteEntry(log, entry) != RR_OK ||
-            writeEnd(log->file, log->fsync) < 0) {
-        return RR_ERROR;
+    int lo = 0;
+    int hi = log->num_segments - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        RaftLogSegment *seg = log->segments[mid];
+
+        if (idx < seg->first_idx) {
+            hi = mid - 1;
+        } else if (idx >= seg->first_idx + (raft_index_t) seg->num_entries) {
+            lo = mid + 1;
+        } else {
+            return seg;
+        }
     }
 
-    log->num_entries++;
-    return RR_OK;
+    return NULL;
 }
 
-static off_t seekEntry(RaftLog *log, raft_index_t idx)
+/* Returns the offset of the entry at the specified index, and its segment */
+static off_t seekEntry(RaftLog *log, raft_index_t idx, RaftLogSegment **seg)
 {
     /* Bounds check */
     if (idx <= log->snapshot_last_idx) {
-        return 0;
+        return -1;
     }
 
     if (idx > log->snapshot_last_idx + log->num_entries) {
-        return 0;
+        return -1;
+    }
+
+    if (!(*seg = findSegment(log, idx))) {
+        return -1;
     }
 
-    raft_index_t relidx = idx - log->snapshot_last_idx;
+    raft_index_t relidx = idx - (*seg)->first_idx;
+    if (sizeof(off_t) * (relidx + 1) > (*seg)->idxmap_size) {
+        return -1;
+    }
+
+    return (*seg)->idxmap[relidx];
+}
+
+raft_entry_t *RaftLogGet(RaftLog *log, raft_index_t idx)
+{
+    RaftLogSegment *seg;
     off_t offset;
-    if (fseek(log->idxfile, sizeof(off_t) * relidx, SEEK_SET) < 0 ||
-            fread(&offset, sizeof(offset), 1, log->idxfile) != 1) {
-        return 0;
+
+    if ((offset = seekEntry(log, idx, &seg)) < 0) {
+        return NULL;
     }
 
-    if (fseek(log->file, offset, SEEK_SET) < 0) {
+    return readEntryAt(seg, offset);
+}
+
+/* A cursor reads consecutive entries through a readahead buffer, so reading
+ * a range of entries takes a single pread() per CURSOR_READAHEAD_SIZE bytes
+ * rather than two per entry.  The index is only used to position the cursor,
+ * following entries are found by their length.
+ *
+ * A cursor is repositioned when it's asked for an entry other than the next
+ * one, or after entries have been deleted or segments dropped (as tracked by
+ * log->cursors_gen) as the buffer and segment may no longer be valid.
+ */
+struct RaftLogCursor {
+    RaftLog *log;
+    raft_index_t idx;           /* Index of the next entry, 0 if not positioned */
+    RaftLogSegment *seg;        /* Segment holding it */
+    off_t offset;               /* Its offset in seg */
+    unsigned long gen;          /* log->cursors_gen the position is valid for */
+    unsigned long last_used;    /* log->cursors_clock when last used */
+    char *buf;                  /* Readahead buffer */
+    size_t buf_size;
+    off_t buf_offset;           /* Offset in seg of buf[0] */
+    size_t buf_len;             /* Bytes read into buf */
+};
+
+RaftLogCursor *RaftLogCursorNew(RaftLog *log)
+{
+    RaftLogCursor *cursor = RedisModule_Calloc(1, sizeof(RaftLogCursor));
+
+    cursor->log = log;
+    cursor->buf_size = CURSOR_READAHEAD_SIZE;
+    cursor->buf = RedisModule_Alloc(cursor->buf_size);
+
+    return cursor;
+}
+
+void RaftLogCursorFree(RaftLogCursor *cursor)
+{
+    RedisModule_Free(cursor->buf);
+    RedisModule_Free(cursor);
+}
+
+/* Makes sure the readahead buffer holds len bytes at the specified offset,
+ * reading ahead as much as the buffer (and segment) allows.
+ */
+static int cursorFill(RaftLogCursor *cursor, off_t offset, size_t len)
+{
+    RaftLogSegment *seg = cursor->seg;
+
+    if (cursor->buf_len && offset >= cursor->buf_offset &&
+        offset + len <= cursor->buf_offset + cursor->buf_len) {
         return 0;
     }
 
-    return offset;
+    if (offset + len > seg->file_size) {
+        return -1;
+    }
+
+    if (len > cursor->buf_size) {
+        cursor->buf_size = len;
+        cursor->buf = RedisModule_Realloc(cursor->buf, cursor->buf_size);
+    }
+
+    size_t size = seg->file_size - offset;
+    if (size > cursor->buf_size) {
+        size = cursor->buf_size;
+    }
+
+    cursor->buf_len = 0;
+    while (cursor->buf_len < size) {
+        ssize_t n = pread(fileno(seg->file), cursor->buf + cursor->buf_len,
+                          size - cursor->buf_len, offset + cursor->buf_len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            cursor->buf_len = 0;
+            return -1;
+        }
+        cursor->buf_len += n;
+    }
+    cursor->buf_offset = offset;
+
+    return 0;
 }
 
-raft_entry_t *RaftLogGet(RaftLog *log, raft_index_t idx)
+/* Returns the entry at the specified index.  Consecutive calls for
+ * consecutive indexes read ahead, others reposition the cursor.
+ */
+raft_entry_t *RaftLogCursorGet(RaftLogCursor *cursor, raft_index_t idx)
 {
-    if (seekEntry(log, idx) <= 0) {
+    RaftLog *log = cursor->log;
+    RaftLogSegment *seg = cursor->seg;
+
+    if (idx != cursor->idx || cursor->gen != log->cursors_gen ||
+        idx >= seg->first_idx + (raft_index_t) seg->num_entries) {
+        cursor->idx = 0;
+        cursor->buf_len = 0;
+        cursor->gen = log->cursors_gen;
+        if ((cursor->offset = seekEntry(log, idx, &cursor->seg)) < 0) {
+            return NULL;
+        }
+        seg = cursor->seg;
+    } else if (idx <= log->snapshot_last_idx || idx > log->index) {
         return NULL;
     }
 
-    RawLogEntry *re;
-    if (readRawLogEntry(log, &re) != RR_OK) {
+    if (cursorFill(cursor, cursor->offset, ENTRY_HEADER_SIZE) < 0) {
         return NULL;
     }
 
-    raft_entry_t *e = parseRaftLogEntry(re);
-    freeRawLogEntry(re);
+    unsigned char hdr[ENTRY_HEADER_SIZE];
+    memcpy(hdr, cursor->buf + (cursor->offset - cursor->buf_offset), sizeof(hdr));
+
+    uint32_t data_len = getEntryDataLen(hdr);
+    if (cursorFill(cursor, cursor->offset, sizeof(hdr) + data_len) < 0) {
+        return NULL;
+    }
 
-    if (!e) {
+    raft_entry_t *e = raft_entry_new(data_len);
+    memcpy(e->data, cursor->buf + (cursor->offset - cursor->buf_offset) + sizeof(hdr), data_len);
+    if (!decodeEntry(hdr, e)) {
+        raft_entry_release(e);
         return NULL;
     }
 
+    cursor->idx = idx + 1;
+    cursor->offset += sizeof(hdr) + data_len;
+
     return e;
 }
 
+/* Returns the cursor to read entries from the specified index: the one that
+ * has just read the previous entry if any, or else the least recently used
+ * one.  A few cursors are kept so followers catching up at the same time
+ * don't keep repositioning each other's.
+ */
+static RaftLogCursor *getLogCursor(RaftLog *log, raft_index_t idx)
+{
+    RaftLogCursor *cursor = NULL;
+    int i;
+
+    for (i = 0; i < RAFT_LOG_CURSORS; i++) {
+        RaftLogCursor *c = log->cursors[i];
+
+        if (!c) {
+            c = log->cursors[i] = RaftLogCursorNew(log);
+        }
+        if (c->idx == idx && c->gen == log->cursors_gen) {
+            cursor = c;
+            break;
+        }
+        if (!cursor || c->last_used < cursor->last_used) {
+            cursor = c;
+        }
+    }
+
+    cursor->last_used = ++log->cursors_clock;
+    return cursor;
+}
+
+/* Deletes entries from the tail of the log.  Only the last segments are
+ * affected: they're truncated, or dropped once they hold no entries.
+ */
 RRStatus RaftLogDelete(RaftLog *log, raft_index_t from_idx, func_entry_notify_f cb, void *cb_arg)
 {
+    RaftLogSegment *seg;
     off_t offset;
     RRStatus ret = RR_OK;
     unsigned long removed = 0;
@@ -835,39 +2411,50 @@ RRStatus RaftLogDelete(RaftLog *log, raft_index_t from_idx, func_entry_notify_f
         return RR_ERROR;
     }
 
+    log->cursors_gen++;
     while (log->index >= from_idx) {
-        if (!(offset = seekEntry(log, log->index))) {
+        if ((offset = seekEntry(log, log->index, &seg)) < 0) {
             return RR_ERROR;
         }
 
-        RawLogEntry *re;
-        raft_entry_t *e;
-
-        if (readRawLogEntry(log, &re) < 0) {
+        raft_entry_t *e = readEntryAt(seg, offset);
+        if (!e) {
             ret = RR_ERROR;
             break;
         }
 
-        if (!strcasecmp(re->elements[0].ptr, "ENTRY")) {
-            if ((e = parseRaftLogEntry(re)) == NULL) {
-                freeRawLogEntry(re);
-                ret = RR_ERROR;
-                break;
-            }
-            if (cb) {
-                cb(cb_arg, e, log->index);
-            }
+        if (cb) {
+            cb(cb_arg, e, log->index);
+        }
 
-            removed++;
-            log->index--;
-            log->num_entries--;
+        removed++;
+        log->index--;
+        log->num_entries--;
+        if (log->unsynced_entries > 0) {
+            log->unsynced_entries--;
+        }
 
-            raft_entry_release(e);
+        raft_entry_release(e);
 
-            ftruncate(fileno(log->file), offset);
+        log->file_size -= seg->file_size - offset;
+        if (!offset && seg == log->segments[log->num_segments - 1]) {
+            if (dropSegments(log, -1) < 0) {
+                ret = RR_ERROR;
+                break;
+            }
+        } else {
+            ftruncate(fileno(seg->file), offset);
+            seg->file_size = offset;
+            seg->num_entries--;
         }
+    }
 
-        freeRawLogEntry(re);
+    /* Entries written in place of deleted ones need to be synced again */
+    if (log->durable_idx > log->index) {
+        log->durable_idx = log->index;
+    }
+    if (log->sync_idx > log->index) {
+        log->sync_idx = log->index;
     }
 
     return ret;
@@ -913,99 +2500,88 @@ raft_index_t RaftLogCount(RaftLog *log)
  * Log compaction.
  */
 
-
-/* Rewrite the current log state into a new file:
- * 1. Latest snapshot info
- * 2. All entries
- * 3. Current term and vote
+/* Compacts the log once a snapshot that includes all entries up to @last_idx
+ * has been stored.  The header is updated to skip these entries, and segments
+ * holding no other entries are removed; entries are never rewritten.
  */
-long long int RaftLogRewrite(RedisRaftCtx *rr, const char *filename, raft_index_t last_idx, raft_term_t last_term)
+RRStatus RaftLogCompact(RaftLog *log, raft_index_t last_idx, raft_term_t last_term)
 {
-    RaftLog *log = RaftLogCreate(filename, rr->snapshot_info.dbid,
-            last_term, last_idx,
-            raft_get_current_term(rr->raft),
-            raft_get_voted_for(rr->raft),
-            rr->config);
-    long long int num_entries = 0;
+    raft_index_t old_idx = log->snapshot_last_idx;
+    raft_term_t old_term = log->snapshot_last_term;
+    int count = 0;
 
-    raft_index_t i;
-    for (i = last_idx + 1; i <= RaftLogCurrentIdx(rr->log); i++) {
-        num_entries++;
-        raft_entry_t *ety = raft_get_entry_from_idx(rr->raft, i);
-        if (RaftLogWriteEntry(log, ety) != RR_OK) {
-            RaftLogClose(log);
-            return -1;
-        }
-        raft_entry_release(ety);
+    if (last_idx < log->snapshot_last_idx || last_idx > log->index) {
+        return RR_ERROR;
     }
 
-    if (RaftLogSync(log) != RR_OK) {
-        RaftLogClose(log);
-        return -1;
+    log->snapshot_last_idx = last_idx;
+    log->snapshot_last_term = last_term;
+    if (updateLogHeader(log) < 0) {
+        log->snapshot_last_idx = old_idx;
+        log->snapshot_last_term = old_term;
+        return RR_ERROR;
     }
+    log->num_entries = log->index - last_idx;
 
-    RaftLogClose(log);
-    return num_entries;
+    while (count < log->num_segments &&
+           log->segments[count]->first_idx + (raft_index_t) log->segments[count]->num_entries <= last_idx + 1) {
+        count++;
+    }
+
+    /* If this fails the log is still consistent, just not compacted */
+    if (count > 0 && dropSegments(log, count) < 0) {
+        LOG_ERROR("Raft log: failed to remove compacted segments");
+    }
+
+    log->file_size = getLogSize(log);
+    return RR_OK;
 }
 
 void RaftLogRemoveFiles(const char *filename)
 {
-    char *idx_filename = getIndexFilename(filename);
+    char *manifest_filename = getManifestFilename(filename);
 
     LOG_DEBUG("Removing Raft Log files: %s", filename);
+    removeSegments(filename);
+    unlink(manifest_filename);
     unlink(filename);
-    unlink(idx_filename);
 
-    RedisModule_Free(idx_filename);
+    RedisModule_Free(manifest_filename);
 }
 
-void RaftLogArchiveFiles(RedisRaftCtx *rr)
+static void archiveFile(const char *filename, raft_node_id_t node_id)
 {
-    char *idx_filename = getIndexFilename(rr->config->raft_log_filename);
-    unlink(idx_filename);
-    RedisModule_Free(idx_filename);
-
-    char bak_filename_maxlen = strlen(rr->config->raft_log_filename) + 100;
+    size_t bak_filename_maxlen = strlen(filename) + 100;
     char bak_filename[bak_filename_maxlen];
-    snprintf(bak_filename, bak_filename_maxlen - 1,
-            "%s.%d.bak", rr->config->raft_log_filename, raft_get_nodeid(rr->raft));
-    rename(rr->config->raft_log_filename, bak_filename);
+
+    snprintf(bak_filename, bak_filename_maxlen - 1, "%s.%d.bak", filename, node_id);
+    rename(filename, bak_filename);
 }
 
-RRStatus RaftLogRewriteSwitch(RedisRaftCtx *rr, RaftLog *new_log, unsigned long new_log_entries)
+void RaftLogArchiveFiles(RedisRaftCtx *rr)
 {
-    /* Rename Raft log.  If we fail, we can assume the old log is still
-     * okay and we can just cancel the operation.
-     */
-    if (rename(new_log->filename, rr->log->filename) < 0) {
-        LOG_ERROR("Failed to switch Raft log: %s to %s: %s",
-                new_log->filename, rr->log->filename, strerror(errno));
-        return RR_ERROR;
-    }
-
-    /* Rename the index.  If we fail now we're in inconsistent state, so we
-     * panic and expect the index to be re-built when the process restarts.
-     */
-    char *log_idx_filename = getIndexFilename(rr->log->filename);
-    char *new_idx_filename = getIndexFilename(new_log->filename);
-    if (rename(new_idx_filename, log_idx_filename) < 0) {
-        PANIC("Failed to switch Raft log index: %s to %s: %s",
-               new_idx_filename, log_idx_filename, strerror(errno));
-    }
+    raft_node_id_t node_id = raft_get_nodeid(rr->raft);
+    int i;
 
-    RedisModule_Free(log_idx_filename);
-    RedisModule_Free(new_idx_filename);
+    if (rr->log) {
+        for (i = 0; i < rr->log->num_segments; i++) {
+            RaftLogSegment *seg = rr->log->segments[i];
+            char *idx_filename = getIndexFilename(seg->filename);
 
-    new_log->filename = rr->log->filename;
-    new_log->num_entries = new_log_entries;
-    new_log->index = new_log->snapshot_last_idx + new_log->num_entries;
+            unlink(idx_filename);
+            RedisModule_Free(idx_filename);
+            archiveFile(seg->filename, node_id);
+        }
+    }
 
-    RaftLogClose(rr->log);
-    rr->log = new_log;
+    char *manifest_filename = getManifestFilename(rr->config->raft_log_filename);
+    archiveFile(manifest_filename, node_id);
+    RedisModule_Free(manifest_filename);
 
-    return RR_OK;
+    archiveFile(rr->config->raft_log_filename, node_id);
 }
 
+
 /*
  * Interface to Raft library.
  */
@@ -1049,7 +2625,16 @@ static int logImplAppend(void *rr_, raft_entry_t *ety)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) rr_;
     TRACE_LOG_OP("Append(id=%d, term=%lu) -> index %lu", ety->id, ety->term, rr->log->index + 1);
-    if (RaftLogAppend(rr->log, ety) != RR_OK) {
+
+    /* Entries are not synced here; the Raft thread syncs them as a group
+     * (see RaftLogSyncPending) before acknowledging or committing them.
+     */
+    if (RaftLogAppendNoSync(rr->log, ety) != RR_OK) {
+        return -1;
+    }
+    if (rr->config->raft_log_group_commit_max_entries &&
+        rr->log->unsynced_entries >= (unsigned long) rr->config->raft_log_group_commit_max_entries &&
+        RaftLogSyncPending(rr) != RR_OK) {
         return -1;
     }
     EntryCacheAppend(rr->logcache, ety, rr->log->index);
@@ -1068,6 +2653,7 @@ static int logImplPop(void *rr_, raft_index_t from_idx, func_entry_notify_f cb,
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) rr_;
     TRACE_LOG_OP("Delete(from_idx=%lu)", from_idx);
+    RaftFailUnsyncedAppendEntries(rr, raft_get_current_term(rr->raft), from_idx);
     EntryCacheDeleteTail(rr->logcache, from_idx);
     if (RaftLogDelete(rr->log, from_idx, cb, cb_arg) != RR_OK) {
         return -1;
@@ -1093,21 +2679,37 @@ static raft_entry_t *logImplGet(void *rr_, raft_index_t idx)
     return ety;
 }
 
+/* Entries not in the cache are read through a cursor, as batches are mostly
+ * read to catch up followers.  Batches are limited to append-entries-max-bytes
+ * of entry data, but always hold at least one entry.
+ */
 static int logImplGetBatch(void *rr_, raft_index_t idx, int entries_n, raft_entry_t **entries)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) rr_;
+    RaftLogCursor *cursor = NULL;
+    size_t max_bytes = rr->config->append_entries_max_bytes;
+    size_t bytes = 0;
     int n = 0;
     raft_index_t i = idx;
 
     while (n < entries_n) {
         raft_entry_t *e = EntryCacheGet(rr->logcache, i);
         if (!e) {
-            e = RaftLogGet(rr->log, i);
+            if (!cursor) {
+                cursor = getLogCursor(rr->log, i);
+            }
+            e = RaftLogCursorGet(cursor, i);
         }
         if (!e) {
             break;
         }
 
+        if (n > 0 && max_bytes && bytes + e->data_len > max_bytes) {
+            raft_entry_release(e);
+            break;
+        }
+        bytes += e->data_len;
+
         entries[n] = e;
         n++;
         i++;
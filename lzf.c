@@ -0,0 +1,161 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020 Redis Labs
+ *
+ * RedisRaft is dual licensed under the GNU Affero General Public License version 3
+ * (AGPLv3) or the Redis Source Available License (RSAL).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lzf.h"
+
+/* LZF compressed data is a sequence of literal runs and back references,
+ * each starting with a control byte:
+ *
+ * 000LLLLL <L+1 literal bytes>         Literal run of 1..32 bytes
+ * LLLooooo oooooooo                    Back reference, length L+2 (3..8)
+ * 111ooooo LLLLLLLL oooooooo           Back reference, length L+9 (9..264)
+ *
+ * A back reference copies bytes starting at offset o+1 before the current
+ * output position.
+ */
+
+#define LZF_HASH_LOG    13
+#define LZF_HASH_SIZE   (1 << LZF_HASH_LOG)
+#define LZF_MAX_LIT     32
+#define LZF_MAX_OFF     (1 << 13)
+#define LZF_MAX_REF     ((1 << 8) + (1 << 3))
+
+#define LZF_HASH(p) \
+    ((((uint32_t) (p)[0] << 16 | (uint32_t) (p)[1] << 8 | (p)[2]) * 2654435761U) >> \
+     (32 - LZF_HASH_LOG))
+
+static int emitLiterals(uint8_t **op, uint8_t *out_end, const uint8_t *lit, size_t len)
+{
+    while (len > 0) {
+        size_t n = len > LZF_MAX_LIT ? LZF_MAX_LIT : len;
+        if ((size_t) (out_end - *op) < n + 1) {
+            return -1;
+        }
+
+        *(*op)++ = n - 1;
+        memcpy(*op, lit, n);
+        *op += n;
+        lit += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+size_t lzfCompress(const void *in, size_t in_len, void *out, size_t out_len)
+{
+    /* Positions are stored +1, so 0 means an empty slot */
+    uint32_t htab[LZF_HASH_SIZE] = { 0 };
+    const uint8_t *in_start = in;
+    const uint8_t *ip = in_start;
+    const uint8_t *in_end = in_start + in_len;
+    const uint8_t *lit = ip;
+    uint8_t *op = out;
+    uint8_t *out_end = op + out_len;
+
+    while (in_end - ip >= 3) {
+        uint32_t h = LZF_HASH(ip);
+        uint32_t cand = htab[h];
+        htab[h] = ip - in_start + 1;
+
+        if (cand) {
+            const uint8_t *ref = in_start + cand - 1;
+            size_t off = ip - ref - 1;
+
+            if (off < LZF_MAX_OFF && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+                size_t maxlen = in_end - ip;
+                size_t len = 3;
+
+                if (maxlen > LZF_MAX_REF) {
+                    maxlen = LZF_MAX_REF;
+                }
+                while (len < maxlen && ref[len] == ip[len]) {
+                    len++;
+                }
+
+                if (emitLiterals(&op, out_end, lit, ip - lit) < 0 || out_end - op < 3) {
+                    return 0;
+                }
+
+                size_t l = len - 2;
+                if (l < 7) {
+                    *op++ = (l << 5) | (off >> 8);
+                } else {
+                    *op++ = (7 << 5) | (off >> 8);
+                    *op++ = l - 7;
+                }
+                *op++ = off & 0xff;
+
+                ip += len;
+                lit = ip;
+                continue;
+            }
+        }
+
+        ip++;
+    }
+
+    if (emitLiterals(&op, out_end, lit, in_end - lit) < 0) {
+        return 0;
+    }
+
+    return op - (uint8_t *) out;
+}
+
+size_t lzfDecompress(const void *in, size_t in_len, void *out, size_t out_len)
+{
+    const uint8_t *ip = in;
+    const uint8_t *in_end = ip + in_len;
+    uint8_t *op = out;
+    uint8_t *out_end = op + out_len;
+
+    while (ip < in_end) {
+        unsigned int ctrl = *ip++;
+
+        if (ctrl < LZF_MAX_LIT) {
+            size_t len = ctrl + 1;
+            if ((size_t) (in_end - ip) < len || (size_t) (out_end - op) < len) {
+                return 0;
+            }
+
+            memcpy(op, ip, len);
+            op += len;
+            ip += len;
+        } else {
+            size_t len = ctrl >> 5;
+            if (len == 7) {
+                if (ip >= in_end) {
+                    return 0;
+                }
+                len += *ip++;
+            }
+            len += 2;
+
+            if (ip >= in_end) {
+                return 0;
+            }
+
+            size_t off = ((ctrl & 0x1f) << 8 | *ip++) + 1;
+            if ((size_t) (op - (uint8_t *) out) < off || (size_t) (out_end - op) < len) {
+                return 0;
+            }
+
+            /* Source and destination may overlap, copy byte by byte */
+            const uint8_t *ref = op - off;
+            while (len--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return op - (uint8_t *) out;
+}
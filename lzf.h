@@ -0,0 +1,30 @@
+/*
+ * This file is part of RedisRaft.
+ *
+ * Copyright (c) 2020 Redis Labs
+ *
+ * RedisRaft is dual licensed under the GNU Affero General Public License version 3
+ * (AGPLv3) or the Redis Source Available License (RSAL).
+ */
+
+#ifndef _LZF_H_
+#define _LZF_H_
+
+#include <stddef.h>
+
+/* Compresses in_len bytes from in into out, using the LZF format (the same
+ * format Redis uses for RDB string compression).
+ *
+ * Returns the compressed length, or 0 if the compressed data does not fit
+ * in out_len bytes (i.e. the input is not compressible enough).
+ */
+size_t lzfCompress(const void *in, size_t in_len, void *out, size_t out_len);
+
+/* Decompresses in_len bytes of LZF data from in into out.
+ *
+ * Returns the decompressed length, or 0 if the data is corrupt or does not
+ * fit in out_len bytes.
+ */
+size_t lzfDecompress(const void *in, size_t in_len, void *out, size_t out_len);
+
+#endif /* _LZF_H_ */
@@ -17,6 +17,11 @@
  * using Redis commands. We also maintain additional information like general
  * metrics, and information about pending responses (used to implement timeouts
  * and reconnects).
+ *
+ * With bulk-connection, a second connection is used for bulk transfers
+ * (snapshots), so they don't delay heartbeats, AppendEntries and
+ * proxied requests queued behind them.  It has its own pending responses,
+ * and is dropped along with the node.
  */
 
 static LIST_HEAD(node_list, Node) node_list = LIST_HEAD_INITIALIZER(node_list);
@@ -28,6 +33,7 @@ static void clearPendingResponses(Node *node)
 {
     node->pending_raft_response_num = 0;
     node->pending_proxy_response_num = 0;
+    node->ae_inflight = 0;
 
     while (!STAILQ_EMPTY(&node->pending_responses)) {
         PendingResponse *resp = STAILQ_FIRST(&node->pending_responses);
@@ -36,6 +42,17 @@ static void clearPendingResponses(Node *node)
     }
 }
 
+static void clearBulkPendingResponses(Node *node)
+{
+    node->pending_bulk_response_num = 0;
+
+    while (!STAILQ_EMPTY(&node->pending_bulk_responses)) {
+        PendingResponse *resp = STAILQ_FIRST(&node->pending_bulk_responses);
+        STAILQ_REMOVE_HEAD(&node->pending_bulk_responses, entries);
+        RedisModule_Free(resp);
+    }
+}
+
 /* Connect callback */
 static void handleNodeConnect(Connection *conn)
 {
@@ -43,10 +60,26 @@ static void handleNodeConnect(Connection *conn)
 
     if (ConnIsConnected(conn)) {
         clearPendingResponses(node);
+        node->legacy_ae = false;    /* Node may have been upgraded */
+        node->legacy_snapshot = false;
+        node->legacy_snapshot_chunks = false;
+        node->legacy_proxy = false;
+        node->legacy_readindex = false;
+        NodeResetAppendEntriesPipeline(node);
         NODE_TRACE(node, "Node connection established.");
     }
 }
 
+static void handleNodeBulkConnect(Connection *conn)
+{
+    Node *node = (Node *) ConnGetPrivateData(conn);
+
+    if (ConnIsConnected(conn)) {
+        clearBulkPendingResponses(node);
+        NODE_TRACE(node, "Node bulk connection established.");
+    }
+}
+
 /* Idle callback: when we have a connection associated with an active node,
  * we initiate ConnConnect().
  */
@@ -61,6 +94,24 @@ static void nodeIdleCallback(Connection *conn)
     }
 }
 
+/* Bulk connection idle callback: like nodeIdleCallback(), as long as
+ * bulk-connection is enabled.
+ */
+static void nodeBulkIdleCallback(Connection *conn)
+{
+    Node *node = ConnGetPrivateData(conn);
+    RedisRaftCtx *rr = ConnGetRedisRaftCtx(conn);
+
+    if (!rr->config->bulk_connection) {
+        return;
+    }
+
+    raft_node_t *raft_node = raft_get_node(rr->raft, node->id);
+    if (raft_node != NULL && raft_node_is_active(raft_node)) {
+        ConnConnect(node->bulk_conn, &node->addr, handleNodeBulkConnect);
+    }
+}
+
 /* Free node object and remove it from the nodes linked list */
 static void NodeFree(Node *node)
 {
@@ -70,6 +121,19 @@ static void NodeFree(Node *node)
 
     clearPendingResponses(node);
 
+    /* Dropping the bulk connection calls its pending callbacks, which
+     * still refer to the node.
+     */
+    if (node->bulk_conn) {
+        if (ConnIsConnected(node->bulk_conn)) {
+            ConnMarkDisconnected(node->bulk_conn);
+        }
+        node->bulk_conn->privdata = NULL;
+        ConnAsyncTerminate(node->bulk_conn);
+        node->bulk_conn = NULL;
+    }
+    clearBulkPendingResponses(node);
+
     LIST_REMOVE(node, entries);
     RedisModule_Free(node);
 }
@@ -92,6 +156,7 @@ Node *NodeCreate(RedisRaftCtx *rr, int id, const NodeAddr *addr)
 {
     Node *node = RedisModule_Calloc(1, sizeof(Node));
     STAILQ_INIT(&node->pending_responses);
+    STAILQ_INIT(&node->pending_bulk_responses);
 
     node->id = id;
     node->rr = rr;
@@ -101,10 +166,49 @@ Node *NodeCreate(RedisRaftCtx *rr, int id, const NodeAddr *addr)
 
     LIST_INSERT_HEAD(&node_list, node, entries);
     node->conn = ConnCreate(node->rr, node, nodeIdleCallback, nodeFreeCallback);
+    if (rr->config->bulk_connection) {
+        node->bulk_conn = ConnCreate(node->rr, node, nodeBulkIdleCallback, NULL);
+    }
 
     return node;
 }
 
+/* Returns the connection to use for bulk transfers: the bulk connection if
+ * enabled and connected, or the node's connection otherwise.
+ */
+Connection *NodeGetBulkConn(Node *node)
+{
+    if (node->rr->config->bulk_connection && node->bulk_conn &&
+        ConnIsConnected(node->bulk_conn)) {
+        return node->bulk_conn;
+    }
+
+    return node->conn;
+}
+
+/* Tracks a pending response of a request sent on the bulk connection */
+void NodeAddBulkPendingResponse(Node *node)
+{
+    PendingResponse *resp = RedisModule_Calloc(1, sizeof(PendingResponse));
+    resp->request_time = RedisModule_Milliseconds();
+    resp->send_time = uv_hrtime();
+
+    node->pending_bulk_response_num++;
+    STAILQ_INSERT_TAIL(&node->pending_bulk_responses, resp, entries);
+}
+
+void NodeDismissBulkPendingResponse(Node *node)
+{
+    PendingResponse *resp = STAILQ_FIRST(&node->pending_bulk_responses);
+    if (!resp) {
+        return;
+    }
+
+    STAILQ_REMOVE_HEAD(&node->pending_bulk_responses, entries);
+    node->pending_bulk_response_num--;
+    RedisModule_Free(resp);
+}
+
 
 /* Track a new pending response for a request that was sent to the node.
  * This is used to track connection liveness and decide when it should be
@@ -117,6 +221,7 @@ void NodeAddPendingResponse(Node *node, bool proxy)
     PendingResponse *resp = RedisModule_Calloc(1, sizeof(PendingResponse));
     resp->proxy = proxy;
     resp->request_time = RedisModule_Milliseconds();
+    resp->send_time = uv_hrtime();
     resp->id = ++response_id;
 
     if (proxy) {
@@ -132,10 +237,13 @@ void NodeAddPendingResponse(Node *node, bool proxy)
 
 /* Acknowledge a response that has been received and remove it from the
  * node's list of pending responses.
+ *
+ * Returns the uv_hrtime() the request was sent at.
  */
-void NodeDismissPendingResponse(Node *node)
+uint64_t NodeDismissPendingResponse(Node *node)
 {
     PendingResponse *resp = STAILQ_FIRST(&node->pending_responses);
+    uint64_t send_time = resp->send_time;
     STAILQ_REMOVE_HEAD(&node->pending_responses, entries);
 
     if (resp->proxy) {
@@ -149,6 +257,22 @@ void NodeDismissPendingResponse(Node *node)
             RedisModule_Milliseconds() - resp->request_time);
 
     RedisModule_Free(resp);
+    return send_time;
+}
+
+/* Discard AppendEntries pipelining state, after entries that were sent
+ * optimistically may have been lost.  The node's next_idx is rewound so
+ * they are sent again.
+ */
+void NodeResetAppendEntriesPipeline(Node *node)
+{
+    if (node->ae_sent_idx && node->rr->raft) {
+        raft_node_t *raft_node = raft_get_node(node->rr->raft, node->id);
+        if (raft_node) {
+            raft_node_set_next_idx(raft_node, raft_node_get_match_idx(raft_node) + 1);
+        }
+    }
+    node->ae_sent_idx = 0;
 }
 
 /* Gets called periodically to look for nodes with commands that should time out
@@ -178,6 +302,22 @@ void HandleNodeStates(RedisRaftCtx *rr)
                 ConnMarkDisconnected(node->conn);
             }
         }
+
+        if (node->bulk_conn && ConnIsConnected(node->bulk_conn) &&
+            !STAILQ_EMPTY(&node->pending_bulk_responses)) {
+            PendingResponse *resp = STAILQ_FIRST(&node->pending_bulk_responses);
+            long timeout = rr->config->raft_response_timeout;
+
+            if (timeout && resp->request_time + timeout < RedisModule_Milliseconds()) {
+                NODE_TRACE(node, "Pending bulk response timeout expired, reconnecting.");
+                ConnMarkDisconnected(node->bulk_conn);
+            }
+        }
+
+        /* bulk-connection may have been enabled since the node was created */
+        if (rr->config->bulk_connection && !node->bulk_conn) {
+            node->bulk_conn = ConnCreate(rr, node, nodeBulkIdleCallback, NULL);
+        }
     }
 }
 
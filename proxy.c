@@ -7,6 +7,8 @@
  * (AGPLv3) or the Redis Source Available License (RSAL).
  */
 
+#include <string.h>
+
 #include "redisraft.h"
 
 static RRStatus hiredisReplyToModule(redisReply *reply, RedisModuleCtx *ctx)
@@ -47,9 +49,10 @@ static RRStatus hiredisReplyToModule(redisReply *reply, RedisModuleCtx *ctx)
 static void handleProxiedCommandResponse(redisAsyncContext *c, void *r, void *privdata)
 {
     RaftReq *req = privdata;
+    RedisRaftCtx *rr = req->r.redis.proxy_node->rr;
     redisReply *reply = r;
 
-    redis_raft.proxy_outstanding_reqs--;
+    rr->proxy_outstanding_reqs--;
     NodeDismissPendingResponse(req->r.redis.proxy_node);
 
     if (!reply) {
@@ -60,7 +63,7 @@ static void handleProxiedCommandResponse(redisAsyncContext *c, void *r, void *pr
          */
         ConnMarkDisconnected(req->r.redis.proxy_node->conn);
         RedisModule_ReplyWithError(req->ctx, "TIMEOUT no reply from leader");
-        redis_raft.proxy_failed_responses++;
+        rr->proxy_failed_responses++;
         goto exit;
     }
 
@@ -76,23 +79,24 @@ exit:
     RaftReqFree(req);
 }
 
-RRStatus ProxyCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader)
+static RRStatus sendProxiedCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader)
 {
     /* TODO: Fail if any key is watched. */
-    redisAsyncContext *rc;
-    if (!ConnIsConnected(leader->conn) || !(rc = ConnGetRedisCtx(leader->conn))) {
-        redis_raft.proxy_failed_reqs++;
+    if (!ConnIsConnected(leader->conn)) {
+        rr->proxy_failed_reqs++;
         return RR_ERROR;
     }
 
     req->r.redis.proxy_node = leader;
     raft_entry_t *entry = RaftRedisCommandArraySerialize(&req->r.redis.cmds);
-    int ret = redisAsyncCommand(rc, handleProxiedCommandResponse,
-        req, "RAFT.ENTRY %b", entry->data, entry->data_len);
+    const char *argv[] = { "RAFT.ENTRY", entry->data };
+    size_t argvlen[] = { strlen(argv[0]), entry->data_len };
+    int ret = ConnSendCommandArgv(leader->conn, handleProxiedCommandResponse,
+        req, 2, argv, argvlen);
     raft_entry_release(entry);
 
     if (ret != REDIS_OK) {
-        redis_raft.proxy_failed_reqs++;
+        rr->proxy_failed_reqs++;
         return RR_ERROR;
     }
 
@@ -103,3 +107,183 @@ RRStatus ProxyCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader)
     return RR_OK;
 }
 
+/* Requests proxied while the Raft thread drains its request queue are not
+ * sent right away, but collected and sent together as a single RAFT.ENTRY
+ * command carrying a serialized entry for every request.  The leader appends
+ * them to its log as a single entry and replies with an array holding the
+ * reply of every request.
+ */
+
+typedef struct ProxyBatch {
+    Node *node;
+    int len;
+    RaftReq *reqs[];
+} ProxyBatch;
+
+static void failProxiedCommand(RaftReq *req)
+{
+    RedisModule_ReplyWithError(req->ctx, "NOTLEADER Failed to proxy command");
+    RaftReqFree(req);
+}
+
+static void handleProxiedBatchResponse(redisAsyncContext *c, void *r, void *privdata)
+{
+    ProxyBatch *batch = privdata;
+    Node *node = batch->node;
+    RedisRaftCtx *rr = node->rr;
+    redisReply *reply = r;
+    int i;
+
+    rr->proxy_outstanding_reqs -= batch->len;
+    NodeDismissPendingResponse(node);
+
+    if (!reply) {
+        /* As with a single request, the state of the requests is unknown */
+        ConnMarkDisconnected(node->conn);
+        for (i = 0; i < batch->len; i++) {
+            RedisModule_ReplyWithError(batch->reqs[i]->ctx, "TIMEOUT no reply from leader");
+            RaftReqFree(batch->reqs[i]);
+        }
+        rr->proxy_failed_responses += batch->len;
+        goto exit;
+    }
+
+    /* The leader does not support batches and has not processed any of the
+     * requests, so send them again one by one.
+     */
+    if (reply->type == REDIS_REPLY_ERROR && !node->legacy_proxy &&
+        strstr(reply->str, "wrong number of arguments")) {
+        NODE_LOG_VERBOSE(node, "Node does not support batched RAFT.ENTRY, disabling.");
+        node->legacy_proxy = true;
+        for (i = 0; i < batch->len; i++) {
+            if (sendProxiedCommand(rr, batch->reqs[i], node) != RR_OK) {
+                failProxiedCommand(batch->reqs[i]);
+            }
+        }
+        goto exit;
+    }
+
+    for (i = 0; i < batch->len; i++) {
+        RaftReq *req = batch->reqs[i];
+
+        if (RedisModule_BlockedClientDisconnected(req->ctx)) {
+            RaftReqFree(req);
+            continue;
+        }
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            RedisModule_ReplyWithError(req->ctx, reply->str);
+        } else if (reply->type != REDIS_REPLY_ARRAY || reply->elements != batch->len ||
+                   hiredisReplyToModule(reply->element[i], req->ctx) != RR_OK) {
+            RedisModule_ReplyWithError(req->ctx, "ERR bad reply from leader");
+        }
+
+        RaftReqFree(req);
+    }
+
+exit:
+    RedisModule_Free(batch);
+}
+
+/* Sends all requests collected by ProxyCommand() */
+void ProxyFlushBatch(RedisRaftCtx *rr)
+{
+    Node *leader = rr->proxy_batch_node;
+    int len = rr->proxy_batch_len;
+    RaftReq *req;
+    int i;
+
+    if (!len) {
+        return;
+    }
+
+    rr->proxy_batch_node = NULL;
+    rr->proxy_batch_len = 0;
+
+    if (len == 1) {
+        req = STAILQ_FIRST(&rr->proxy_batch);
+        STAILQ_REMOVE_HEAD(&rr->proxy_batch, entries);
+        if (sendProxiedCommand(rr, req, leader) != RR_OK) {
+            failProxiedCommand(req);
+        }
+        return;
+    }
+
+    ProxyBatch *batch = RedisModule_Alloc(sizeof(ProxyBatch) + len * sizeof(RaftReq *));
+    raft_entry_t **entries = RedisModule_Alloc(len * sizeof(raft_entry_t *));
+    const char **argv = RedisModule_Alloc((len + 1) * sizeof(char *));
+    size_t *argvlen = RedisModule_Alloc((len + 1) * sizeof(size_t));
+
+    batch->node = leader;
+    batch->len = len;
+
+    argv[0] = "RAFT.ENTRY";
+    argvlen[0] = strlen(argv[0]);
+    for (i = 0; i < len; i++) {
+        req = STAILQ_FIRST(&rr->proxy_batch);
+        STAILQ_REMOVE_HEAD(&rr->proxy_batch, entries);
+
+        batch->reqs[i] = req;
+        entries[i] = RaftRedisCommandArraySerialize(&req->r.redis.cmds);
+        argv[i + 1] = entries[i]->data;
+        argvlen[i + 1] = entries[i]->data_len;
+    }
+
+    int ret = REDIS_ERR;
+    if (ConnIsConnected(leader->conn)) {
+        ret = ConnSendCommandArgv(leader->conn, handleProxiedBatchResponse, batch,
+                len + 1, argv, argvlen);
+    }
+
+    for (i = 0; i < len; i++) {
+        raft_entry_release(entries[i]);
+    }
+    RedisModule_Free(entries);
+    RedisModule_Free(argv);
+    RedisModule_Free(argvlen);
+
+    if (ret != REDIS_OK) {
+        rr->proxy_failed_reqs += len;
+        for (i = 0; i < len; i++) {
+            failProxiedCommand(batch->reqs[i]);
+        }
+        RedisModule_Free(batch);
+        return;
+    }
+
+    NodeAddPendingResponse(leader, true);
+    rr->proxy_reqs += len;
+    rr->proxy_outstanding_reqs += len;
+    rr->proxy_batches++;
+}
+
+RRStatus ProxyCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader)
+{
+    /* Batches are not used in cluster mode, as commands of different
+     * requests may not map to the same hash slot.
+     */
+    if (leader->legacy_proxy || rr->config->cluster_mode ||
+        rr->config->follower_proxy_batch_size <= 1) {
+        return sendProxiedCommand(rr, req, leader);
+    }
+
+    if (!ConnIsConnected(leader->conn)) {
+        rr->proxy_failed_reqs++;
+        return RR_ERROR;
+    }
+
+    if (rr->proxy_batch_node != leader) {
+        ProxyFlushBatch(rr);
+    }
+
+    req->r.redis.proxy_node = leader;
+    STAILQ_INSERT_TAIL(&rr->proxy_batch, req, entries);
+    rr->proxy_batch_node = leader;
+    rr->proxy_batch_len++;
+
+    if (rr->proxy_batch_len >= rr->config->follower_proxy_batch_size) {
+        ProxyFlushBatch(rr);
+    }
+
+    return RR_OK;
+}
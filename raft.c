@@ -11,7 +11,6 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
-#include <ctype.h>
 #include <strings.h>
 
 #include "redisraft.h"
@@ -30,13 +29,25 @@ const char *RaftReqTypeStr[] = {
     "RR_COMPACT",
     "RR_CLIENT_DISCONNECT",
     "RR_SHARDGROUP_ADD",
-    "RR_SHARDGROUP_GET"
+    "RR_SHARDGROUP_GET",
+    "RR_SHARDGROUP_LINK",
+    "RR_READINDEX",
+    "RR_SHARDGROUP_SETSLOT",
+    "RR_SHARDGROUP_MIGRATE",
+    "RR_TRANSFER_LEADER",
+    "RR_TIMEOUT_NOW"
 };
 
 /* Forward declarations */
 static void initRaftLibrary(RedisRaftCtx *rr);
 static void configureFromSnapshot(RedisRaftCtx *rr);
 static void applyShardGroupChange(RedisRaftCtx *rr, raft_entry_t *entry);
+static void applySlotConfigChange(RedisRaftCtx *rr, raft_entry_t *entry);
+static void serveFollowerReads(RedisRaftCtx *rr);
+static void sendReadIndexRequest(RedisRaftCtx *rr);
+static void handleRedisCommand(RedisRaftCtx *rr, RaftReq *req);
+static int applyCommittedEntries(RedisRaftCtx *rr);
+static void appendCoalescedWrites(RedisRaftCtx *rr);
 static RaftReqHandler RaftReqHandlers[];
 
 static bool processExiting = false;
@@ -46,92 +57,49 @@ static void __setProcessExiting(void) {
 
 /* A dict that maps client ID to MultiClientState structs */
 static RedisModuleDict *multiClientState = NULL;
+static RedisModuleDict *askingClientState = NULL;
 
-/* ------------------------------------ Command Classification ------------------------------------ */
-
-static RedisModuleDict *readonlyCommandDict = NULL;
-
-static void populateReadonlyCommandDict(RedisModuleCtx *ctx)
-{
-    static char *commands[] = {
-        "get",
-        "strlen",
-        "exists",
-        "getbit",
-        "getrange",
-        "substr",
-        "mget",
-        "llen",
-        "lindex",
-        "lrange",
-        "scard",
-        "sismember",
-        "srandmember",
-        "sinter",
-        "sunion",
-        "sdiff",
-        "smembers",
-        "sscan",
-        "zrange",
-        "zrangebyscore",
-        "zrevrangebyscore",
-        "zrangebylex",
-        "zrevrangebylex",
-        "zcount",
-        "zlexcount",
-        "zrevrange",
-        "zcard",
-        "zscore",
-        "zrank",
-        "zrevrank",
-        "zscan",
-        "hmget",
-        "hlen",
-        "hstrlen",
-        "hkeys",
-        "hvals",
-        "hgetall",
-        "hexists",
-        "hscan",
-        "randomkey",
-        "keys",
-        "scan",
-        "dbsize",
-        "ttl",
-        "bitcount",
-        "georadius_ro",
-        "georadiusbymember_ro",
-        "geohash",
-        "geopos",
-        "geodist",
-        "pfcount",
-        NULL
-    };
+/* ------------------------------------ Common helpers ------------------------------------ */
+
+/* Reply with an error to a RR_REDISCOMMAND request, or to all requests it
+ * holds if it's a request of coalesced writes.
+ */
+static void replyRedisCommandError(RaftReq *req, const char *err)
+{
+    if (!req->r.redis.coalesced) {
+        RedisModule_ReplyWithError(req->ctx, err);
+        return;
+    }
 
-    readonlyCommandDict = RedisModule_CreateDict(ctx);
     int i;
-    for (i = 0; commands[i] != NULL; i++) {
-        RedisModule_DictSetC(readonlyCommandDict, commands[i], strlen(commands[i]), (void *) 0x01);
+    for (i = 0; i < req->r.redis.coalesced_num; i++) {
+        RedisModule_ReplyWithError(req->r.redis.coalesced[i]->ctx, err);
     }
 }
 
-/* ------------------------------------ Common helpers ------------------------------------ */
-
 /* Set up a Raft log entry with an attached RaftReq. We use this when a user command provided
  * in a RaftReq should keep the client blocked until the log entry is committed and applied.
  */
 
-static void entryFreeAttachedRaftReq(raft_entry_t *ety)
+/* Fails the RaftReq attached to an entry that is freed without having been
+ * applied.  This is what an entry's free_func does, before freeing it.
+ */
+void EntryFailAttachedRaftReq(raft_entry_t *ety)
 {
     RaftReq *req = (RaftReq *) ety->user_data;
     ety->user_data = NULL;
 
     if (req) {
         redis_raft.client_attached_entries--;
-        RedisModule_ReplyWithError(req->ctx, "TIMEOUT not committed yet");
+        redis_raft.client_attached_bytes -= ety->data_len;
+        replyRedisCommandError(req, "TIMEOUT not committed yet");
         RaftReqFree(req);
     }
+}
 
+static void entryFreeAttachedRaftReq(raft_entry_t *ety)
+{
+    EntryFailAttachedRaftReq(ety);
     RedisModule_Free(ety);
 }
 
@@ -147,6 +115,198 @@ static void entryAttachRaftReq(RedisRaftCtx *rr, raft_entry_t *entry, RaftReq *r
     entry->user_data = req;
     entry->free_func = entryFreeAttachedRaftReq;
     rr->client_attached_entries++;
+    rr->client_attached_bytes += entry->data_len;
+}
+
+/* An AppendEntries response that is handled once our own entries it
+ * acknowledges are durable.
+ */
+typedef struct UnsyncedAEResponse {
+    raft_node_id_t node_id;
+    msg_appendentries_response_t response;
+    STAILQ_ENTRY(UnsyncedAEResponse) entries;
+} UnsyncedAEResponse;
+
+/* Group commit: log entries are written as they are appended, but synced
+ * only here. This must be called before anything that acknowledges them,
+ * i.e. replying to AppendEntries or processing AppendEntries responses
+ * (which may advance the commit index).
+ *
+ * With raft-log-sync-thread the log is synced by the log sync thread, so
+ * this only starts syncing it.  Acknowledging entries then waits until
+ * they're durable, see isLogDurable() and handleSyncedEntries().
+ */
+static void syncRaftLog(RedisRaftCtx *rr)
+{
+    if (RaftLogSyncPending(rr) != RR_OK) {
+        PANIC("Failed to sync Raft log: %s", strerror(errno));
+    }
+}
+
+/* Returns true if our log is durable up to the specified index. */
+static bool isLogDurable(RedisRaftCtx *rr, raft_index_t idx)
+{
+    if (!rr->log) {
+        return true;
+    }
+
+    return rr->log->durable_idx >= idx;
+}
+
+/* Called before log entries starting at from_idx are deleted, or when a new
+ * term starts.  AppendEntries replies waiting for entries to be synced no
+ * longer hold if they acknowledge deleted entries or an older term, so they
+ * are turned into failures carrying the specified term and an index we still
+ * have: a leader must not count us towards committing entries we've dropped.
+ *
+ * AppendEntries responses waiting for our own deleted entries are dropped, as
+ * we are no longer the leader they were sent to.
+ */
+void RaftFailUnsyncedAppendEntries(RedisRaftCtx *rr, raft_term_t term, raft_index_t from_idx)
+{
+    struct unsynced_ae_responses kept = STAILQ_HEAD_INITIALIZER(kept);
+    UnsyncedAEResponse *ur;
+    RaftReq *req;
+
+    STAILQ_FOREACH(req, &rr->unsynced_appendentries, entries) {
+        msg_appendentries_response_t *response = &req->r.appendentries.response;
+
+        if (response->term == term && response->current_idx < from_idx) {
+            continue;
+        }
+
+        response->term = term;
+        response->success = 0;
+        if (response->current_idx >= from_idx) {
+            response->current_idx = from_idx - 1;
+        }
+    }
+
+    while ((ur = STAILQ_FIRST(&rr->unsynced_ae_responses)) != NULL) {
+        STAILQ_REMOVE_HEAD(&rr->unsynced_ae_responses, entries);
+        if (ur->response.current_idx >= from_idx) {
+            RedisModule_Free(ur);
+        } else {
+            STAILQ_INSERT_TAIL(&kept, ur, entries);
+        }
+    }
+    STAILQ_CONCAT(&rr->unsynced_ae_responses, &kept);
+}
+
+static void replyAppendEntries(RaftReq *req)
+{
+    msg_appendentries_response_t *response = &req->r.appendentries.response;
+
+    RedisModule_ReplyWithArray(req->ctx, 4);
+    RedisModule_ReplyWithLongLong(req->ctx, response->term);
+    RedisModule_ReplyWithLongLong(req->ctx, response->success);
+    RedisModule_ReplyWithLongLong(req->ctx, response->current_idx);
+    RedisModule_ReplyWithLongLong(req->ctx, response->msg_id);
+}
+
+static void recvAppendEntriesResponse(RedisRaftCtx *rr, raft_node_id_t node_id,
+                                      msg_appendentries_response_t *response)
+{
+    raft_node_t *raft_node = raft_get_node(rr->raft, node_id);
+    int ret;
+
+    if (!raft_node) {
+        return;
+    }
+    if ((ret = raft_recv_appendentries_response(rr->raft, raft_node, response)) != 0) {
+        TRACE("raft_recv_appendentries_response failed, node %d, error %d", node_id, ret);
+    }
+}
+
+/* Called as our log entries become durable: acknowledges AppendEntries and
+ * handles AppendEntries responses that were waiting for them, in order, and
+ * applies entries that can now be applied.
+ */
+static void handleSyncedEntries(RedisRaftCtx *rr)
+{
+    UnsyncedAEResponse *ur;
+    RaftReq *req;
+    bool handled = false;
+
+    /* Failures acknowledge nothing, so they don't wait */
+    while ((req = STAILQ_FIRST(&rr->unsynced_appendentries)) != NULL &&
+           (!req->r.appendentries.response.success ||
+            isLogDurable(rr, req->r.appendentries.response.current_idx))) {
+        STAILQ_REMOVE_HEAD(&rr->unsynced_appendentries, entries);
+        replyAppendEntries(req);
+        RaftReqFree(req);
+    }
+
+    while ((ur = STAILQ_FIRST(&rr->unsynced_ae_responses)) != NULL &&
+           (!ur->response.success || isLogDurable(rr, ur->response.current_idx))) {
+        STAILQ_REMOVE_HEAD(&rr->unsynced_ae_responses, entries);
+        recvAppendEntriesResponse(rr, ur->node_id, &ur->response);
+        RedisModule_Free(ur);
+        handled = true;
+    }
+
+    if (rr->raft && rr->state == REDIS_RAFT_UP &&
+        raft_get_commit_idx(rr->raft) > raft_get_last_applied_idx(rr->raft)) {
+        applyCommittedEntries(rr);
+    }
+    if (handled) {
+        raft_process_read_queue(rr->raft);
+    }
+}
+
+/* Syncs the log and handles what was waiting for entries to be synced,
+ * including applying entries that became committed but could not be applied
+ * before being synced (e.g. in the single node case, where the local log
+ * alone makes up the majority).
+ */
+static void syncRaftLogAndApply(RedisRaftCtx *rr)
+{
+    syncRaftLog(rr);
+    handleSyncedEntries(rr);
+}
+
+/* The log sync thread is done; entries appended while it was syncing are
+ * synced right away, as they've already been waiting.
+ */
+static void callLogSyncDone(uv_async_t *handle)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
+    if (processExiting) {
+        return;
+    }
+
+    if (RaftLogHandleSynced(rr) != RR_OK) {
+        PANIC("Failed to sync Raft log: %s", strerror(errno));
+    }
+    syncRaftLogAndApply(rr);
+}
+
+static void callLogSync(uv_timer_t *handle)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
+    if (processExiting) {
+        return;
+    }
+
+    syncRaftLogAndApply(rr);
+}
+
+/* Called after a batch of requests has been processed.  Unless configured to
+ * defer it, sync now; otherwise make sure a sync is scheduled no later than
+ * raft-log-group-commit-max-delay after the first unsynced entry was written.
+ */
+static void scheduleRaftLogSync(RedisRaftCtx *rr)
+{
+    if (!rr->log || !rr->log->unsynced_entries) {
+        return;
+    }
+
+    if (!rr->config->raft_log_group_commit_max_delay) {
+        syncRaftLogAndApply(rr);
+    } else if (!uv_is_active((uv_handle_t *) &rr->log_sync_timer)) {
+        uv_timer_start(&rr->log_sync_timer, callLogSync,
+                rr->config->raft_log_group_commit_max_delay, 0);
+    }
 }
 
 /* ------------------------------------ RaftRedisCommand ------------------------------------ */
@@ -167,6 +327,96 @@ static void entryAttachRaftReq(RedisRaftCtx *rr, raft_entry_t *entry, RaftReq *r
 
 /* ------------------------------------ Log Execution ------------------------------------ */
 
+static void executeRaftRedisCommand(RaftRedisCommand *c,
+    RedisModuleCtx *ctx, RedisModuleCtx *reply_ctx)
+{
+    size_t cmdlen;
+    const char *cmd = RedisModule_StringPtrLen(c->argv[0], &cmdlen);
+
+    enterRedisModuleCall();
+    RedisModuleCallReply *reply = RedisModule_Call(
+            ctx, cmd, "v", &c->argv[1], c->argc - 1);
+    exitRedisModuleCall();
+
+    if (reply_ctx) {
+        if (reply) {
+            RedisModule_ReplyWithCallReply(reply_ctx, reply);
+        } else {
+            RedisModule_ReplyWithError(reply_ctx, "ERR Unknown command/arguments");
+        }
+    }
+
+    if (reply) {
+        RedisModule_FreeCallReply(reply);
+    }
+}
+
+/* Execute a command of a RaftRedisCommandArrayView, not delivering any reply.
+ * RedisModuleStrings are created only for the arguments passed to
+ * RedisModule_Call(), and the command name is copied to a buffer to null
+ * terminate it.
+ */
+#define VIEW_MAX_STACK_ARGS 16
+
+static void executeRaftRedisCommandView(RaftRedisCommandView *c, RedisModuleCtx *ctx)
+{
+    RedisModuleString *stack_args[VIEW_MAX_STACK_ARGS];
+    RedisModuleString **args = stack_args;
+    char stack_cmd[32];
+    char *cmd = stack_cmd;
+    int argc = c->argc - 1;
+    int i;
+
+    if (c->argv[0].len >= sizeof(stack_cmd)) {
+        cmd = RedisModule_Alloc(c->argv[0].len + 1);
+    }
+    memcpy(cmd, c->argv[0].ptr, c->argv[0].len);
+    cmd[c->argv[0].len] = '\0';
+
+    if (argc > VIEW_MAX_STACK_ARGS) {
+        args = RedisModule_Alloc(argc * sizeof(RedisModuleString *));
+    }
+    for (i = 0; i < argc; i++) {
+        args[i] = RedisModule_CreateString(NULL, c->argv[i + 1].ptr, c->argv[i + 1].len);
+    }
+
+    enterRedisModuleCall();
+    RedisModuleCallReply *reply = RedisModule_Call(ctx, cmd, "v", args, argc);
+    exitRedisModuleCall();
+
+    if (reply) {
+        RedisModule_FreeCallReply(reply);
+    }
+
+    for (i = 0; i < argc; i++) {
+        RedisModule_FreeString(NULL, args[i]);
+    }
+    if (args != stack_args) {
+        RedisModule_Free(args);
+    }
+    if (cmd != stack_cmd) {
+        RedisModule_Free(cmd);
+    }
+}
+
+/* Execute all commands in a specified RaftRedisCommandArrayView, skipping
+ * MULTI as executeRaftRedisCommandArray() does.
+ */
+static void executeRaftRedisCommandArrayView(RaftRedisCommandArrayView *view, RedisModuleCtx *ctx)
+{
+    int i;
+
+    for (i = 0; i < view->len; i++) {
+        RaftRedisArgView *cmd = &view->commands[i].argv[0];
+
+        if (i == 0 && cmd->len == 5 && !strncasecmp(cmd->ptr, "MULTI", 5)) {
+            continue;
+        }
+
+        executeRaftRedisCommandView(&view->commands[i], ctx);
+    }
+}
+
 /* Execute all commands in a specified RaftRedisCommandArray.
  *
  * The commands are executed on ctx, which can be a real or thread-safe
@@ -174,12 +424,32 @@ static void entryAttachRaftReq(RedisRaftCtx *rr, raft_entry_t *entry, RaftReq *r
  *
  * If reply_ctx is non-NULL, replies are delivered to it.
  * Otherwise no replies are delivered.
+ *
+ * If batch is non-NULL, the array holds the commands of a batch of proxied
+ * requests and the reply is an array with a reply for every request.
  */
 static void executeRaftRedisCommandArray(RaftRedisCommandArray *array,
+    const ProxyBatchItem *batch, int batch_len,
     RedisModuleCtx *ctx, RedisModuleCtx *reply_ctx)
 {
     int i;
 
+    if (batch && reply_ctx) {
+        int j, k = 0;
+
+        RedisModule_ReplyWithArray(reply_ctx, batch_len);
+        for (i = 0; i < batch_len; i++) {
+            if (batch[i].multi) {
+                RedisModule_ReplyWithArray(reply_ctx, batch[i].cmds_num);
+            }
+            for (j = 0; j < batch[i].cmds_num; j++) {
+                executeRaftRedisCommand(array->commands[k++], ctx, reply_ctx);
+            }
+        }
+
+        return;
+    }
+
     for (i = 0; i < array->len; i++) {
         RaftRedisCommand *c = array->commands[i];
 
@@ -199,22 +469,7 @@ static void executeRaftRedisCommandArray(RaftRedisCommandArray *array,
             continue;
         }
 
-        enterRedisModuleCall();
-        RedisModuleCallReply *reply = RedisModule_Call(
-                ctx, cmd, "v", &c->argv[1], c->argc - 1);
-        exitRedisModuleCall();
-
-        if (reply_ctx) {
-            if (reply) {
-                RedisModule_ReplyWithCallReply(reply_ctx, reply);
-            } else {
-                RedisModule_ReplyWithError(reply_ctx, "ERR Unknown command/arguments");
-            }
-        }
-
-        if (reply) {
-            RedisModule_FreeCallReply(reply);
-        }
+        executeRaftRedisCommand(c, ctx, reply_ctx);
     }
 }
 
@@ -230,24 +485,50 @@ static void executeLogEntry(RedisRaftCtx *rr, raft_entry_t *entry, raft_index_t
 {
     assert(entry->type == RAFT_LOGTYPE_NORMAL);
 
-    /* TODO: optimize and avoid deserialization here, we can use the
-     * original argv in RaftReq
+    /* If the entry originated locally and the request is still attached, it
+     * holds the original commands so we can skip deserialization.  Otherwise
+     * the entry is only decoded into a view, as no replies are delivered.
      */
+    RaftReq *req = entry->user_data;
+    RaftRedisCommandArrayView view = { 0 };
 
-    RaftRedisCommandArray entry_cmds = { 0 };
-    if (RaftRedisCommandArrayDeserialize(&entry_cmds, entry->data, entry->data_len) != RR_OK) {
+    if (!req && RaftRedisCommandArrayViewDecode(&view, entry->data, entry->data_len) != RR_OK) {
         PANIC("Invalid Raft entry");
     }
 
-    RaftReq *req = entry->user_data;
-    RedisModuleCtx *ctx = req ? req->ctx : rr->ctx;
+    RedisModuleCtx *ctx = req && req->ctx ? req->ctx : rr->ctx;
 
     /* Redis Module API requires commands executing on a locked thread
-     * safe context.
+     * safe context.  When applying a batch, it is locked already.
      */
 
-    RedisModule_ThreadSafeContextLock(ctx);
-    executeRaftRedisCommandArray(&entry_cmds, ctx, req? req->ctx : NULL);
+    if (!rr->apply_locked) {
+        RedisModule_ThreadSafeContextLock(ctx);
+    }
+    if (req) {
+        req->ts.apply = uv_hrtime();
+    }
+    if (req && req->r.redis.coalesced) {
+        /* Coalesced writes: execute every request on its own, so every
+         * client gets its own reply.
+         */
+        int i;
+        for (i = 0; i < req->r.redis.coalesced_num; i++) {
+            RaftReq *r = req->r.redis.coalesced[i];
+            r->ts.apply = uv_hrtime();
+            executeRaftRedisCommandArray(&r->r.redis.cmds, r->r.redis.batch,
+                    r->r.redis.batch_len, r->ctx, r->ctx);
+            r->ts.applied = uv_hrtime();
+        }
+    } else if (req) {
+        executeRaftRedisCommandArray(&req->r.redis.cmds, req->r.redis.batch,
+                req->r.redis.batch_len, ctx, req->ctx);
+    } else {
+        executeRaftRedisCommandArrayView(&view, ctx);
+    }
+    if (req) {
+        req->ts.applied = uv_hrtime();
+    }
 
     /* Update snapshot info in Redis dataset. This must be done now so it's
      * always consistent with what we applied and we never end up applying
@@ -256,15 +537,83 @@ static void executeLogEntry(RedisRaftCtx *rr, raft_entry_t *entry, raft_index_t
     rr->snapshot_info.last_applied_term = entry->term;
     rr->snapshot_info.last_applied_idx = entry_idx;
 
-    RedisModule_ThreadSafeContextUnlock(ctx);
-    RaftRedisCommandArrayFree(&entry_cmds);
+    if (!rr->apply_locked) {
+        RedisModule_ThreadSafeContextUnlock(ctx);
+    }
+    RaftRedisCommandArrayViewFree(&view);
 
     if (req) {
-        /* Free request now, we don't need it anymore */
+        /* Free request now, we don't need it anymore.  If applying a batch,
+         * this (and unblocking the client) is deferred until unlocked.
+         */
         entry->user_data = NULL;
         rr->client_attached_entries--;
-        RaftReqFree(req);
+        rr->client_attached_bytes -= entry->data_len;
+        if (rr->apply_locked) {
+            STAILQ_INSERT_TAIL(&rr->applied_reqs, req, entries);
+        } else {
+            RaftReqFree(req);
+        }
+    }
+}
+
+/* Applies all committed entries, like raft_apply_all(), but in batches:
+ * the Redis lock is taken once per batch rather than once per entry.  The
+ * batch size is limited by apply-batch-max-entries and apply-batch-max-usec,
+ * and the lock is released between batches to let the Redis thread run.
+ */
+static int applyCommittedEntries(RedisRaftCtx *rr)
+{
+    int ret = 0;
+
+    if (raft_snapshot_is_in_progress(rr->raft)) {
+        return 0;
+    }
+
+    /* Entries are only applied once durable in our own log */
+    raft_index_t apply_idx = raft_get_commit_idx(rr->raft);
+    if (rr->log && rr->log->durable_idx < apply_idx) {
+        apply_idx = rr->log->durable_idx;
+    }
+
+    while (!ret && raft_get_last_applied_idx(rr->raft) < apply_idx) {
+        uint64_t start = uv_hrtime();
+        int count = 0;
+
+        RedisModule_ThreadSafeContextLock(rr->ctx);
+        rr->apply_locked = true;
+
+        while (raft_get_last_applied_idx(rr->raft) < apply_idx) {
+            if ((ret = raft_apply_entry(rr->raft)) != 0) {
+                break;
+            }
+
+            count++;
+            if (rr->config->apply_batch_max_entries &&
+                count >= rr->config->apply_batch_max_entries) {
+                break;
+            }
+            if (rr->config->apply_batch_max_usec &&
+                (uv_hrtime() - start) / 1000 >= (uint64_t) rr->config->apply_batch_max_usec) {
+                break;
+            }
+        }
+
+        rr->apply_locked = false;
+        RedisModule_ThreadSafeContextUnlock(rr->ctx);
+
+        RaftReq *req;
+        while ((req = STAILQ_FIRST(&rr->applied_reqs)) != NULL) {
+            STAILQ_REMOVE_HEAD(&rr->applied_reqs, entries);
+            RaftReqFree(req);
+        }
+    }
+
+    if (!STAILQ_EMPTY(&rr->follower_reads)) {
+        serveFollowerReads(rr);
     }
+
+    return ret;
 }
 
 
@@ -326,15 +675,16 @@ static int raftSendRequestVote(raft_server_t *raft, void *user_data,
         return 0;
     }
 
-    /* RAFT.REQUESTVOTE <src_node_id> <term> <candidate_id> <last_log_idx> <last_log_term> */
+    /* RAFT.REQUESTVOTE <src_node_id> <term> <candidate_id> <last_log_idx> <last_log_term> <transfer_leader> */
     if (redisAsyncCommand(ConnGetRedisCtx(node->conn), handleRequestVoteResponse,
-                node, "RAFT.REQUESTVOTE %d %d %d:%d:%d:%d",
+                node, "RAFT.REQUESTVOTE %d %d %d:%d:%d:%d:%d",
                 raft_node_get_id(raft_node),
                 raft_get_nodeid(raft),
                 msg->term,
                 msg->candidate_id,
                 msg->last_log_idx,
-                msg->last_log_term) != REDIS_OK) {
+                msg->last_log_term,
+                msg->transfer_leader) != REDIS_OK) {
         NODE_TRACE(node, "failed requestvote");
     } else {
         NodeAddPendingResponse(node, false);
@@ -343,6 +693,48 @@ static int raftSendRequestVote(raft_server_t *raft, void *user_data,
     return 0;
 }
 
+/* ------------------------------------ TimeoutNow ------------------------------------ */
+
+static void handleTimeoutNowResponse(redisAsyncContext *c, void *r, void *privdata)
+{
+    Node *node = privdata;
+    redisReply *reply = r;
+
+    NodeDismissPendingResponse(node);
+    if (!reply) {
+        NODE_LOG_DEBUG(node, "RAFT.TIMEOUTNOW failed: connection dropped.");
+        ConnMarkDisconnected(node->conn);
+        return;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        NODE_LOG_ERROR(node, "RAFT.TIMEOUTNOW error: %s", reply->str);
+    }
+}
+
+/* Sent by the leader once the target of a leadership transfer is up to date,
+ * to make it start an election right away rather than wait for its election
+ * timeout.
+ */
+static int raftSendTimeoutNow(raft_server_t *raft, raft_node_t *raft_node)
+{
+    Node *node = (Node *) raft_node_get_udata(raft_node);
+
+    if (!ConnIsConnected(node->conn)) {
+        NODE_TRACE(node, "not connected, state=%s", NodeStateStr[node->state]);
+        return 0;
+    }
+
+    /* RAFT.TIMEOUTNOW <target_node_id> */
+    if (redisAsyncCommand(ConnGetRedisCtx(node->conn), handleTimeoutNowResponse,
+                node, "RAFT.TIMEOUTNOW %d", raft_node_get_id(raft_node)) != REDIS_OK) {
+        NODE_TRACE(node, "failed timeoutnow");
+    } else {
+        NodeAddPendingResponse(node, false);
+    }
+
+    return 0;
+}
+
 /* ------------------------------------ AppendEntries ------------------------------------ */
 
 static void handleAppendEntriesResponse(redisAsyncContext *c, void *r, void *privdata)
@@ -350,7 +742,7 @@ static void handleAppendEntriesResponse(redisAsyncContext *c, void *r, void *pri
     Node *node = privdata;
     RedisRaftCtx *rr = node->rr;
 
-    NodeDismissPendingResponse(node);
+    uint64_t send_time = NodeDismissPendingResponse(node);
 
     redisReply *reply = r;
     if (!reply) {
@@ -358,7 +750,21 @@ static void handleAppendEntriesResponse(redisAsyncContext *c, void *r, void *pri
         ConnMarkDisconnected(node->conn);
         return;
     }
+    if (node->ae_inflight > 0) {
+        node->ae_inflight--;
+    }
     if (reply->type == REDIS_REPLY_ERROR) {
+        NodeResetAppendEntriesPipeline(node);
+
+        /* Nodes running an older version don't know RAFT.AE2; fall back
+         * to RAFT.AE until reconnected.  The message is retransmitted by
+         * Raft as usual.
+         */
+        if (!node->legacy_ae && !strncmp(reply->str, "ERR unknown command", 19)) {
+            NODE_LOG_INFO(node, "RAFT.AE2 not supported, falling back to RAFT.AE");
+            node->legacy_ae = true;
+            return;
+        }
         NODE_TRACE(node, "RAFT.AE error: %s", reply->str);
         return;
     }
@@ -378,35 +784,90 @@ static void handleAppendEntriesResponse(redisAsyncContext *c, void *r, void *pri
         .msg_id = reply->element[3]->integer
     };
 
-    raft_node_t *raft_node = raft_get_node(rr->raft, node->id);
+    LatencyHistogramRecord(&rr->latency[LATENCY_AE_RTT], (uv_hrtime() - send_time) / 1000);
 
-    int ret;
-    if ((ret = raft_recv_appendentries_response(
-            rr->raft,
-            raft_node,
-            &response)) != 0) {
-        NODE_TRACE(node, "raft_recv_appendentries_response failed, error %d", ret);
+    /* Pipelining: on a mismatch the Raft library rewinds next_idx, and
+     * anything sent optimistically beyond it has to be sent again.
+     */
+    if (!response.success) {
+        node->ae_sent_idx = 0;
+    }
+
+    /* Any response in our term, successful or not, means the node accepted
+     * us as leader when the request was sent; this extends the read lease.
+     */
+    if (response.term == raft_get_current_term(rr->raft) && raft_is_leader(rr->raft) &&
+        (node->lease_ack_term != response.term || node->lease_ack_time < send_time)) {
+        node->lease_ack_term = response.term;
+        node->lease_ack_time = send_time;
+    }
+
+    /* Our own entries must be durable before they count towards commit, so
+     * the response waits until they are, along with later responses.  A
+     * failure acknowledges nothing, so it's handled right away.
+     */
+    syncRaftLog(rr);
+    if (response.success &&
+        (!isLogDurable(rr, response.current_idx) || !STAILQ_EMPTY(&rr->unsynced_ae_responses))) {
+        UnsyncedAEResponse *ur = RedisModule_Alloc(sizeof(UnsyncedAEResponse));
+        ur->node_id = node->id;
+        ur->response = response;
+        STAILQ_INSERT_TAIL(&rr->unsynced_ae_responses, ur, entries);
+        return;
     }
 
+    recvAppendEntriesResponse(rr, node->id, &response);
+
     /* Maybe we have pending stuff to apply now */
-    raft_apply_all(rr->raft);
+    applyCommittedEntries(rr);
     raft_process_read_queue(rr->raft);
 }
 
-static int raftSendAppendEntries(raft_server_t *raft, void *user_data,
+/* Sends RAFT.AE2, the binary encoded variant of RAFT.AE.  This avoids
+ * formatting and parsing entry metadata as text.
+ */
+static RRStatus sendAppendEntriesBinary(raft_server_t *raft, Node *node,
         raft_node_t *raft_node, msg_appendentries_t *msg)
 {
-    Node *node = (Node *) raft_node_get_udata(raft_node);
+    RRStatus ret = RR_OK;
+    int argc = 2 + msg->n_entries;
+    const char *argv[argc];
+    size_t argvlen[argc];
+
+    char *blob = RedisModule_Alloc(RAFT_AE2_BLOB_SIZE(msg->n_entries));
+
+    argv[0] = "RAFT.AE2";
+    argvlen[0] = strlen(argv[0]);
+    argv[1] = blob;
+    argvlen[1] = AppendEntriesEncode(blob, raft_node_get_id(raft_node),
+                                     raft_get_nodeid(raft), msg);
+
+    int i;
+    for (i = 0; i < msg->n_entries; i++) {
+        argv[2 + i] = msg->entries[i]->data;
+        argvlen[2 + i] = msg->entries[i]->data_len;
+    }
+
+    if (ConnSendCommandArgv(node->conn, handleAppendEntriesResponse,
+                node, argc, argv, argvlen) != REDIS_OK) {
+        NODE_TRACE(node, "failed appendentries");
+        ret = RR_ERROR;
+    } else {
+        NodeAddPendingResponse(node, false);
+    }
 
+    RedisModule_Free(blob);
+    return ret;
+}
+
+static RRStatus sendAppendEntries(raft_server_t *raft, Node *node,
+        raft_node_t *raft_node, msg_appendentries_t *msg)
+{
+    RRStatus ret = RR_OK;
     int argc = 5 + msg->n_entries * 2;
     char *argv[argc];
     size_t argvlen[argc];
 
-    if (!ConnIsConnected(node->conn)) {
-        NODE_TRACE(node, "not connected, state=%s", NodeStateStr[node->state]);
-        return 0;
-    }
-
     char target_node_str[12];
     char source_node_str[12];
     char msg_str[100];
@@ -441,9 +902,10 @@ static int raftSendAppendEntries(raft_server_t *raft, void *user_data,
         argv[6 + i*2] = e->data;
     }
 
-    if (redisAsyncCommandArgv(ConnGetRedisCtx(node->conn), handleAppendEntriesResponse,
+    if (ConnSendCommandArgv(node->conn, handleAppendEntriesResponse,
                 node, argc, (const char **)argv, argvlen) != REDIS_OK) {
         NODE_TRACE(node, "failed appendentries");
+        ret = RR_ERROR;
     } else{
         NodeAddPendingResponse(node, false);
     }
@@ -451,6 +913,76 @@ static int raftSendAppendEntries(raft_server_t *raft, void *user_data,
     for (i = 0; i < msg->n_entries; i++) {
         RedisModule_Free(argv[5 + i*2]);
     }
+    return ret;
+}
+
+/* AppendEntries pipelining: when append-entries-window is greater than 1,
+ * we don't wait for a response before sending more entries to a node.
+ *
+ * Instead, the node's next_idx is advanced as soon as entries are sent, so
+ * the Raft library keeps on sending new entries as they are appended.  The
+ * library resets next_idx when processing a successful response, so entries
+ * still in flight are trimmed from the message here rather than sent again.
+ *
+ * Returns false if the message should not be sent, because the window is
+ * full.
+ */
+static bool pipelineAppendEntries(Node *node, msg_appendentries_t *msg, int window)
+{
+    if (node->ae_inflight > 0 && node->ae_sent_idx > msg->prev_log_idx) {
+        raft_index_t skip = node->ae_sent_idx - msg->prev_log_idx;
+        if (skip >= msg->n_entries) {
+            msg->n_entries = 0;
+        } else {
+            msg->entries += skip;
+            msg->n_entries -= skip;
+        }
+        msg->prev_log_idx = node->ae_sent_idx;
+        msg->prev_log_term = node->ae_sent_term;
+    }
+
+    /* Heartbeats are always sent */
+    return !msg->n_entries || node->ae_inflight < window;
+}
+
+static int raftSendAppendEntries(raft_server_t *raft, void *user_data,
+        raft_node_t *raft_node, msg_appendentries_t *msg)
+{
+    RedisRaftCtx *rr = (RedisRaftCtx *) user_data;
+    Node *node = (Node *) raft_node_get_udata(raft_node);
+
+    if (!ConnIsConnected(node->conn)) {
+        NODE_TRACE(node, "not connected, state=%s", NodeStateStr[node->state]);
+        return 0;
+    }
+
+    /* The message is adjusted on a copy, as the library releases the entries
+     * it holds once we return.
+     */
+    int window = rr->config->append_entries_window;
+    msg_appendentries_t send_msg = *msg;
+    msg = &send_msg;
+
+    if (window > 1 && !pipelineAppendEntries(node, msg, window)) {
+        return 0;
+    }
+
+    RRStatus ret;
+    if (!node->legacy_ae) {
+        ret = sendAppendEntriesBinary(raft, node, raft_node, msg);
+    } else {
+        ret = sendAppendEntries(raft, node, raft_node, msg);
+    }
+
+    if (ret == RR_OK && window > 1) {
+        node->ae_inflight++;
+        if (msg->n_entries > 0) {
+            node->ae_sent_idx = msg->prev_log_idx + msg->n_entries;
+            node->ae_sent_term = msg->entries[msg->n_entries - 1]->term;
+            raft_node_set_next_idx(raft_node, node->ae_sent_idx + 1);
+        }
+    }
+
     return 0;
 }
 
@@ -482,6 +1014,7 @@ static int raftPersistTerm(raft_server_t *raft, void *user_data, raft_term_t ter
         LOG_ERROR("ERROR: RaftLogSetTerm");
         return RAFT_ERR_SHUTDOWN;
     }
+    RaftFailUnsyncedAppendEntries(rr, term, rr->log->index + 1);
 
     return 0;
 }
@@ -520,6 +1053,10 @@ static int raftApplyLog(raft_server_t *raft, void *user_data, raft_entry_t *entr
         case RAFT_LOGTYPE_ADD_SHARDGROUP:
         case RAFT_LOGTYPE_UPDATE_SHARDGROUP:
             applyShardGroupChange(rr, entry);
+            break;
+        case RAFT_LOGTYPE_SLOT_CONFIG:
+            applySlotConfigChange(rr, entry);
+            break;
         default:
             break;
     }
@@ -551,6 +1088,14 @@ static raft_node_id_t raftLogGetNodeId(raft_server_t *raft, void *user_data, raf
     return req->id;
 }
 
+/* Returns true if a RAFT_LOGTYPE_ADD_NONVOTING_NODE entry adds a learner */
+static bool cfgChangeIsLearner(raft_entry_t *entry)
+{
+    RaftCfgChange *cfgchange = (RaftCfgChange *) entry->data;
+
+    return entry->data_len >= sizeof(RaftCfgChange) && cfgchange->learner;
+}
+
 static int raftNodeHasSufficientLogs(raft_server_t *raft, void *user_data, raft_node_t *raft_node)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) user_data;
@@ -575,6 +1120,12 @@ static int raftNodeHasSufficientLogs(raft_server_t *raft, void *user_data, raft_
     Node *node = raft_node_get_udata(raft_node);
     assert (node != NULL);
 
+    /* Learners are never promoted */
+    if (node->learner) {
+        TRACE("node:%d has sufficient logs now, staying a learner.", node->id);
+        return 0;
+    }
+
     TRACE("node:%d has sufficient logs now, adding as voting node.", node->id);
 
     raft_entry_t *entry = raft_entry_new(sizeof(RaftCfgChange));
@@ -616,12 +1167,14 @@ void raftNotifyMembershipEvent(raft_server_t *raft, void *user_data, raft_node_t
             assert(entry->type == RAFT_LOGTYPE_ADD_NODE || entry->type == RAFT_LOGTYPE_ADD_NONVOTING_NODE);
             cfgchange = (RaftCfgChange *) entry->data;
             if (cfgchange->id == my_id) {
+                rr->learner = cfgChangeIsLearner(entry);
                 break;
             }
 
             /* Allocate a new node */
             node = NodeCreate(rr, cfgchange->id, &cfgchange->addr);
             assert(node != NULL);
+            node->learner = cfgChangeIsLearner(entry);
 
             addUsedNodeId(rr, cfgchange->id);
 
@@ -640,6 +1193,7 @@ void raftNotifyMembershipEvent(raft_server_t *raft, void *user_data, raft_node_t
             assert(0);
     }
 
+    ShardingInfoTopologyChanged(rr);
 }
 
 static char *raftMembershipInfoString(raft_server_t *raft)
@@ -676,6 +1230,8 @@ static char *raftMembershipInfoString(raft_server_t *raft)
 
 static void raftNotifyStateEvent(raft_server_t *raft, void *user_data, raft_state_e state)
 {
+    ShardingInfoTopologyChanged((RedisRaftCtx *) user_data);
+
     switch (state) {
         case RAFT_STATE_FOLLOWER:
             LOG_INFO("State change: Node is now a follower, term %ld",
@@ -688,6 +1244,14 @@ static void raftNotifyStateEvent(raft_server_t *raft, void *user_data, raft_stat
         case RAFT_STATE_LEADER:
             LOG_INFO("State change: Node is now a leader, term %ld",
                     raft_get_current_term(raft));
+
+            /* Entries of the previous leader may still write to migrating
+             * slots, see handleShardGroupMigrate().
+             */
+            if (((RedisRaftCtx *) user_data)->sharding_info) {
+                ((RedisRaftCtx *) user_data)->sharding_info->migrate_barrier_idx =
+                    raft_get_current_idx(raft);
+            }
             break;
         default:
             break;
@@ -698,6 +1262,46 @@ static void raftNotifyStateEvent(raft_server_t *raft, void *user_data, raft_stat
     RedisModule_Free(s);
 }
 
+/* Called by the leader when a leadership transfer completes or times out.
+ */
+static void raftNotifyTransferEvent(raft_server_t *raft, void *user_data, raft_leader_transfer_e result)
+{
+    RedisRaftCtx *rr = user_data;
+    RaftReq *req = rr->transfer_req;
+
+    /* Acknowledgements received before now don't extend the read lease, as
+     * the target may have been elected regardless, see checkReadLease().
+     */
+    rr->transfer_end_time = uv_hrtime();
+
+    switch (result) {
+        case RAFT_LEADER_TRANSFER_EXPECTED_LEADER:
+            LOG_INFO("Leadership transferred, term %ld", raft_get_current_term(raft));
+            break;
+        case RAFT_LEADER_TRANSFER_UNEXPECTED_LEADER:
+            LOG_INFO("Leadership transfer failed: another node was elected");
+            break;
+        case RAFT_LEADER_TRANSFER_TIMEOUT:
+            LOG_INFO("Leadership transfer failed: timed out");
+            break;
+    }
+
+    if (!req) {
+        return;
+    }
+
+    if (result == RAFT_LEADER_TRANSFER_EXPECTED_LEADER) {
+        RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+    } else if (result == RAFT_LEADER_TRANSFER_UNEXPECTED_LEADER) {
+        RedisModule_ReplyWithError(req->ctx, "ERR another node was elected leader");
+    } else {
+        RedisModule_ReplyWithError(req->ctx, "ERR leadership transfer timed out");
+    }
+
+    rr->transfer_req = NULL;
+    RaftReqFree(req);
+}
+
 raft_cbs_t redis_raft_callbacks = {
     .send_requestvote = raftSendRequestVote,
     .send_appendentries = raftSendAppendEntries,
@@ -709,7 +1313,9 @@ raft_cbs_t redis_raft_callbacks = {
     .node_has_sufficient_logs = raftNodeHasSufficientLogs,
     .send_snapshot = raftSendSnapshot,
     .notify_membership_event = raftNotifyMembershipEvent,
-    .notify_state_event = raftNotifyStateEvent
+    .notify_state_event = raftNotifyStateEvent,
+    .send_timeoutnow = raftSendTimeoutNow,
+    .notify_transfer_event = raftNotifyTransferEvent
 };
 
 /* ------------------------------------ Raft Thread ------------------------------------ */
@@ -766,7 +1372,7 @@ RRStatus applyLoadedRaftLog(RedisRaftCtx *rr)
     raft_set_snapshot_metadata(rr->raft, rr->snapshot_info.last_applied_term,
             rr->snapshot_info.last_applied_idx);
 
-    raft_apply_all(rr->raft);
+    applyCommittedEntries(rr);
 
     raft_set_current_term(rr->raft, rr->log->term);
     raft_vote_for_nodeid(rr->raft, rr->log->vote);
@@ -865,6 +1471,9 @@ static void callRaftPeriodic(uv_timer_t *handle)
         return;
     }
 
+    /* raft_periodic() may commit and apply entries */
+    syncRaftLog(rr);
+
     /* If we're creating a persistent snapshot, check if we're done */
     if (rr->snapshot_in_progress) {
         SnapshotResult sr;
@@ -881,7 +1490,7 @@ static void callRaftPeriodic(uv_timer_t *handle)
 
     ret = raft_periodic(rr->raft, rr->config->raft_interval);
     if (ret == 0) {
-        ret = raft_apply_all(rr->raft);
+        ret = applyCommittedEntries(rr);
     }
 
     if (ret == RAFT_ERR_SHUTDOWN) {
@@ -1074,22 +1683,30 @@ void addUsedNodeId(RedisRaftCtx *rr, raft_node_id_t node_id) {
     rr->snapshot_info.used_node_ids = entry;
 }
 
+/* Called for every entry loaded beyond the snapshot we've loaded.  Entries
+ * are also cached, up to the cache size limit, so applying them does not
+ * read them again.
+ */
 static int loadEntriesCallback(void *arg, raft_entry_t *entry, raft_index_t idx)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) arg;
 
     if (rr->snapshot_info.last_applied_term <= entry->term &&
-            rr->snapshot_info.last_applied_idx < rr->log->index &&
             raft_entry_is_cfg_change(entry)) {
         raft_handle_append_cfg_change(rr->raft, entry, idx);
     }
 
+    EntryCacheAppend(rr->logcache, entry, idx);
+    EntryCacheCompact(rr->logcache, rr->config->raft_log_max_cache_size);
+
     return 0;
 }
 
 RRStatus loadRaftLog(RedisRaftCtx *rr)
 {
-    int entries = RaftLogLoadEntries(rr->log, loadEntriesCallback, rr);
+    /* Entries already applied to the snapshot are not read */
+    int entries = RaftLogLoadEntries(rr->log, rr->snapshot_info.last_applied_idx,
+                                     loadEntriesCallback, rr);
     if (entries < 0) {
         LOG_ERROR("Failed to read Raft log");
         return RR_ERROR;
@@ -1137,6 +1754,14 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
 {
     memset(rr, 0, sizeof(RedisRaftCtx));
     STAILQ_INIT(&rr->rqueue);
+    STAILQ_INIT(&rr->applied_reqs);
+    STAILQ_INIT(&rr->proxy_batch);
+    STAILQ_INIT(&rr->coalesced_writes);
+    STAILQ_INIT(&rr->read_index_batch);
+    STAILQ_INIT(&rr->follower_reads);
+    STAILQ_INIT(&rr->unsynced_appendentries);
+    STAILQ_INIT(&rr->unsynced_ae_responses);
+    rr->incoming_snapshot_fd = -1;
 
     /* Register an atexit handler to tell us we're exiting.  Redis offers no
      * other way and we need to be aware of this to avoid getting into execution
@@ -1144,9 +1769,6 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
      */
     atexit(__setProcessExiting);
 
-    /* Populate Read-only command dict */
-    populateReadonlyCommandDict(ctx);
-
     /* Initialize uv loop */
     rr->loop = RedisModule_Alloc(sizeof(uv_loop_t));
     uv_loop_init(rr->loop);
@@ -1164,12 +1786,23 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
     uv_timer_init(rr->loop, &rr->node_reconnect_timer);
     uv_handle_set_data((uv_handle_t *) &rr->node_reconnect_timer, rr);
 
+    /* Deferred log sync timer */
+    uv_timer_init(rr->loop, &rr->log_sync_timer);
+    uv_handle_set_data((uv_handle_t *) &rr->log_sync_timer, rr);
+
+    /* Log sync thread completion */
+    uv_async_init(rr->loop, &rr->log_sync_done_sig, callLogSyncDone);
+    uv_handle_set_data((uv_handle_t *) &rr->log_sync_done_sig, rr);
+
     rr->ctx = RedisModule_GetThreadSafeContext(NULL);
     rr->config = config;
 
     /* Client state for MULTI support */
     multiClientState = RedisModule_CreateDict(ctx);
 
+    /* Clients that sent ASKING, for slot migration */
+    askingClientState = RedisModule_CreateDict(ctx);
+
     /* Read configuration from Redis */
     if (ConfigReadFromRedis(rr) == RR_ERROR) {
         PANIC("Raft initialization failed: invalid Redis configuration!");
@@ -1192,7 +1825,7 @@ RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *c
      * or RAFT.CLUSTER JOIN command.
      */
 
-    if ((rr->log = RaftLogOpen(rr->config->raft_log_filename, rr->config, 0)) != NULL) {
+    if ((rr->log = RaftLogOpen(rr->config->raft_log_filename, rr->config)) != NULL) {
         rr->state = REDIS_RAFT_LOADING;
     } else {
         rr->state = REDIS_RAFT_UNINITIALIZED;
@@ -1214,6 +1847,21 @@ RRStatus RedisRaftStart(RedisModuleCtx *ctx, RedisRaftCtx *rr)
 
 /* ------------------------------------ RaftReq ------------------------------------ */
 
+/* Records the write path latency of a request that has been applied and is
+ * about to be replied to.  Only called on the Raft thread.
+ */
+static void recordRaftReqLatency(RedisRaftCtx *rr, RaftReq *req)
+{
+    uint64_t now = uv_hrtime();
+
+    LatencyHistogramRecord(&rr->latency[LATENCY_QUEUE], (req->ts.dequeue - req->ts.init) / 1000);
+    LatencyHistogramRecord(&rr->latency[LATENCY_APPEND], (req->ts.append - req->ts.dequeue) / 1000);
+    LatencyHistogramRecord(&rr->latency[LATENCY_COMMIT], (req->ts.apply - req->ts.append) / 1000);
+    LatencyHistogramRecord(&rr->latency[LATENCY_APPLY], (req->ts.applied - req->ts.apply) / 1000);
+    LatencyHistogramRecord(&rr->latency[LATENCY_REPLY], (now - req->ts.applied) / 1000);
+    LatencyHistogramRecord(&rr->latency[LATENCY_TOTAL], (now - req->ts.init) / 1000);
+}
+
 /* Free a RaftReq structure.
  *
  * If it is associated with a blocked client, it will be unblocked and
@@ -1224,6 +1872,10 @@ void RaftReqFree(RaftReq *req)
 {
     TRACE("RaftReqFree: req=%p, req->ctx=%p, req->client=%p", req, req->ctx, req->client);
 
+    if (req->type == RR_REDISCOMMAND && req->ctx && req->ts.append && req->ts.applied) {
+        recordRaftReqLatency(&redis_raft, req);
+    }
+
     switch (req->type) {
         case RR_APPENDENTRIES:
             /* Note: we only free the array of entries but not actual entries, as they
@@ -1245,6 +1897,16 @@ void RaftReqFree(RaftReq *req)
             if (req->ctx && req->r.redis.cmds.size) {
                 RaftRedisCommandArrayFree(&req->r.redis.cmds);
             }
+            if (req->r.redis.batch) {
+                RedisModule_Free(req->r.redis.batch);
+            }
+            if (req->r.redis.coalesced) {
+                int i;
+                for (i = 0; i < req->r.redis.coalesced_num; i++) {
+                    RaftReqFree(req->r.redis.coalesced[i]);
+                }
+                RedisModule_Free(req->r.redis.coalesced);
+            }
             // TODO: hold a reference from entry so we can disconnect our req
             break;
         case RR_LOADSNAPSHOT:
@@ -1253,6 +1915,11 @@ void RaftReqFree(RaftReq *req)
         case RR_CLUSTER_JOIN:
             NodeAddrListFree(req->r.cluster_join.addr);
             break;
+        case RR_INFO:
+            if (req->r.info.section) {
+                RedisModule_Free(req->r.info.section);
+            }
+            break;
         case RR_DEBUG:
             switch (req->r.debug.type) {
                 case RR_DEBUG_COMPACT:
@@ -1264,6 +1931,8 @@ void RaftReqFree(RaftReq *req)
                     break;
                 case RR_DEBUG_SENDSNAPSHOT:
                     break;
+                case RR_DEBUG_RESETLATENCY:
+                    break;
             }
             break;
         case RR_SHARDGROUP_ADD:
@@ -1290,6 +1959,7 @@ RaftReq *RaftReqInit(RedisModuleCtx *ctx, enum RaftReqType type)
         req->ctx = RedisModule_GetThreadSafeContext(req->client);
     }
     req->type = type;
+    req->ts.init = uv_hrtime();
 
     TRACE("RaftReqInit: req=%p, type=%s, client=%p, ctx=%p",
             req, RaftReqTypeStr[req->type], req->client, req->ctx);
@@ -1305,38 +1975,90 @@ RaftReq *RaftDebugReqInit(RedisModuleCtx *ctx, enum RaftDebugReqType type)
     return req;
 }
 
-void RaftReqSubmit(RedisRaftCtx *rr, RaftReq *req)
+/* Returns true if max-queued-requests applies to the request, i.e. it's a
+ * write.  MULTI, EXEC and DISCARD are not rejected, so a transaction can
+ * always be completed or discarded.
+ */
+static bool isQueueLimited(RaftReq *req)
 {
-    uv_mutex_lock(&rr->rqueue_mutex);
-    STAILQ_INSERT_TAIL(&rr->rqueue, req, entries);
-    uv_mutex_unlock(&rr->rqueue_mutex);
-    uv_async_send(&rr->rqueue_sig);
+    if (req->type != RR_REDISCOMMAND) {
+        return false;
+    }
+
+    RaftRedisCommandArray *cmds = &req->r.redis.cmds;
+    for (int i = 0; i < cmds->len; i++) {
+        int flags = CommandSpecGetFlags(cmds->commands[i]->argv[0]);
+        if (!(flags & (CMD_SPEC_READONLY | CMD_SPEC_CLUSTER | CMD_SPEC_ASKING |
+                       CMD_SPEC_MULTI | CMD_SPEC_EXEC | CMD_SPEC_DISCARD))) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-static RaftReq *raft_req_fetch(RedisRaftCtx *rr)
+/* Queue a request for the Raft thread.  The Raft thread is signaled only if
+ * it has not been signaled already since it last drained the queue.
+ *
+ * With max-queued-requests, writes are rejected right away once too many
+ * requests are queued, rather than waiting for the Raft thread.  This is
+ * called on the Redis thread.
+ */
+void RaftReqSubmit(RedisRaftCtx *rr, RaftReq *req)
 {
-    RaftReq *r = NULL;
+    bool limited = isQueueLimited(req) && rr->config->max_queued_requests;
+    bool signal;
 
     uv_mutex_lock(&rr->rqueue_mutex);
-    if (!STAILQ_EMPTY(&rr->rqueue)) {
-        r = STAILQ_FIRST(&rr->rqueue);
-        STAILQ_REMOVE_HEAD(&rr->rqueue, entries);
+    if (limited && rr->rqueue_len >= (unsigned long) rr->config->max_queued_requests) {
+        rr->rejected_queued_reqs++;
+        uv_mutex_unlock(&rr->rqueue_mutex);
+
+        RedisModule_ReplyWithError(req->ctx, "TRYAGAIN Too many queued requests");
+        RaftReqFree(req);
+        return;
     }
+    STAILQ_INSERT_TAIL(&rr->rqueue, req, entries);
+    rr->rqueue_len++;
+    signal = !rr->rqueue_signaled;
+    rr->rqueue_signaled = true;
     uv_mutex_unlock(&rr->rqueue_mutex);
 
-    return r;
+    if (signal) {
+        uv_async_send(&rr->rqueue_sig);
+    }
 }
 
+/* Drain the request queue: all pending requests are moved to a local list
+ * in a single operation, so the lock is not taken per request.
+ */
 void RaftReqHandleQueue(uv_async_t *handle)
 {
     RedisRaftCtx *rr = (RedisRaftCtx *) uv_handle_get_data((uv_handle_t *) handle);
+    struct rqueue pending = STAILQ_HEAD_INITIALIZER(pending);
     RaftReq *req;
 
-    while ((req = raft_req_fetch(rr))) {
+    uv_mutex_lock(&rr->rqueue_mutex);
+    STAILQ_CONCAT(&pending, &rr->rqueue);
+    rr->rqueue_len = 0;
+    rr->rqueue_signaled = false;
+    uv_mutex_unlock(&rr->rqueue_mutex);
+
+    while ((req = STAILQ_FIRST(&pending)) != NULL) {
+        STAILQ_REMOVE_HEAD(&pending, entries);
         TRACE("RaftReqHandleQueue: req=%p, type=%s",
                 req, RaftReqTypeStr[req->type]);
+        req->ts.dequeue = uv_hrtime();
         RaftReqHandlers[req->type](rr, req);
     }
+
+    /* Writes and requests proxied while draining the queue are sent together */
+    appendCoalescedWrites(rr);
+    ProxyFlushBatch(rr);
+    sendReadIndexRequest(rr);
+
+    /* Entries appended while draining the queue are synced together */
+    scheduleRaftLogSync(rr);
 }
 
 /* ------------------------------------ RaftReq Implementation ------------------------------------ */
@@ -1389,11 +2111,25 @@ static void handleAppendEntries(RedisRaftCtx *rr, RaftReq *req)
         goto exit;
     }
 
-    RedisModule_ReplyWithArray(req->ctx, 4);
-    RedisModule_ReplyWithLongLong(req->ctx, response.term);
-    RedisModule_ReplyWithLongLong(req->ctx, response.success);
-    RedisModule_ReplyWithLongLong(req->ctx, response.current_idx);
-    RedisModule_ReplyWithLongLong(req->ctx, response.msg_id);
+    /* Track the leader's commit index, to bound the staleness of learner reads */
+    if (response.term == req->r.appendentries.msg.term) {
+        rr->leader_commit_idx = req->r.appendentries.msg.leader_commit;
+        rr->last_leader_contact = RedisModule_Milliseconds();
+    }
+
+    /* Don't acknowledge entries before they're durable; if they're synced by
+     * the log sync thread, the reply waits (along with later ones) and the
+     * Raft thread moves on meanwhile.
+     */
+    syncRaftLog(rr);
+    req->r.appendentries.response = response;
+    if ((response.success && !isLogDurable(rr, response.current_idx)) ||
+        !STAILQ_EMPTY(&rr->unsynced_appendentries)) {
+        STAILQ_INSERT_TAIL(&rr->unsynced_appendentries, req, entries);
+        return;
+    }
+
+    replyAppendEntries(req);
 
 exit:
     RaftReqFree(req);
@@ -1464,33 +2200,20 @@ static void handleReadOnlyCommand(void *arg, int can_read)
     }
 
     RedisModule_ThreadSafeContextLock(req->ctx);
-    executeRaftRedisCommandArray(&req->r.redis.cmds, req->ctx, req->ctx);
+    executeRaftRedisCommandArray(&req->r.redis.cmds, req->r.redis.batch,
+            req->r.redis.batch_len, req->ctx, req->ctx);
     RedisModule_ThreadSafeContextUnlock(req->ctx);
 
 exit:
     RaftReqFree(req);
 }
 
-static bool checkReadOnlyCommand(RedisModuleString *cmd)
-{
-    size_t cmd_len;
-    const char *cmd_str = RedisModule_StringPtrLen(cmd, &cmd_len);
-    char lcmd[cmd_len];
-
-    int i;
-    for (i = 0; i < cmd_len; i++) {
-        lcmd[i] = tolower(cmd_str[i]);
-    }
-
-    return RedisModule_DictGetC(readonlyCommandDict, lcmd, cmd_len, NULL) != NULL;
-}
-
 static bool checkReadOnlyCommandArray(RaftRedisCommandArray *array)
 {
     int i;
 
     for (i = 0; i < array->len; i++) {
-        if (!checkReadOnlyCommand(array->commands[i]->argv[0]))
+        if (!(CommandSpecGetFlags(array->commands[i]->argv[0]) & CMD_SPEC_READONLY))
             return false;
     }
 
@@ -1541,176 +2264,698 @@ static void freeMultiState(MultiState *multiState)
     RedisModule_Free(multiState);
 }
 
-static void freeMultiExecState(unsigned long long client_id)
-{
+static void freeMultiExecState(unsigned long long client_id)
+{
+
+    MultiState *multiState = NULL;
+
+    if (RedisModule_DictDelC(multiClientState, &client_id, sizeof(client_id),
+               &multiState) == REDISMODULE_OK) {
+       if (multiState) {
+           freeMultiState(multiState);
+       }
+    }
+}
+
+static bool handleMultiExec(RedisRaftCtx *rr, RaftReq *req)
+{
+    unsigned long long client_id = RedisModule_GetClientId(req->ctx);
+
+    /* Get Multi state */
+    MultiState *multiState = RedisModule_DictGetC(multiClientState, &client_id, sizeof(client_id), NULL);
+
+    /* Is this a MULTI command? */
+    RaftRedisCommand *cmd = req->r.redis.cmds.commands[0];
+    int cmd_flags = CommandSpecGetFlags(cmd->argv[0]);
+    if (req->r.redis.cmds.len == 1 && (cmd_flags & CMD_SPEC_MULTI)) {
+        if (multiState) {
+            RedisModule_ReplyWithError(req->ctx, "ERR MULTI calls can not be nested");
+        } else {
+            multiState = RedisModule_Calloc(sizeof(MultiState), 1);
+            RedisModule_DictSetC(multiClientState, &client_id, sizeof(client_id), multiState);
+
+            /* We put the MULTI as the first command in the array, as we still need to
+             * distinguish single-MULTI array from a single command.
+             */
+            RaftRedisCommandArrayMove(&multiState->cmds, &req->r.redis.cmds);
+
+            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+        }
+
+        RaftReqFree(req);
+        return true;
+    }
+
+    if (cmd_flags & CMD_SPEC_EXEC) {
+        if (!multiState) {
+            RedisModule_ReplyWithError(req->ctx, "ERR EXEC without MULTI");
+            RaftReqFree(req);
+            return true;
+        }
+
+        int ctx_flags = RedisModule_GetContextFlags(req->ctx);
+
+        /* Check if we can execute:
+         * 1) No errors in the transaction so far;
+         * 2) No dirty watch.
+         */
+        if (multiState->error) {
+            RedisModule_ReplyWithError(req->ctx, "EXECABORT Transaction discarded because of previous errors.");
+            RaftReqFree(req);
+            req = NULL;
+        } else if (ctx_flags & REDISMODULE_CTX_FLAGS_MULTI_DIRTY) {
+            RedisModule_ReplyWithNull(req->ctx);
+            RaftReqFree(req);
+            req = NULL;
+        } else {
+            /* Just swap our commands with the EXEC command and proceed. */
+            RaftRedisCommandArrayFree(&req->r.redis.cmds);
+            RaftRedisCommandArrayMove(&req->r.redis.cmds, &multiState->cmds);
+        }
+
+        RedisModule_DictDelC(multiClientState, &client_id, sizeof(client_id), NULL);
+        freeMultiState(multiState);
+        return req == NULL;
+    }
+
+    if (cmd_flags & CMD_SPEC_DISCARD) {
+        if (!multiState) {
+            RedisModule_ReplyWithError(req->ctx, "ERR DISCARD without MULTI");
+        } else {
+            RedisModule_DictDelC(multiClientState, &client_id, sizeof(client_id), NULL);
+            freeMultiState(multiState);
+
+            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+        }
+
+        RaftReqFree(req);
+        return true;
+    }
+
+    /* Are we in MULTI? */
+    if (multiState) {
+        /* TODO: Add command checks and set multiState->error if necessary; This probably requires
+         * Module API extensions.
+         */
+        RaftRedisCommandArrayMove(&multiState->cmds, &req->r.redis.cmds);
+        RedisModule_ReplyWithSimpleString(req->ctx, "QUEUED");
+
+        RaftReqFree(req);
+        return true;
+    }
+
+    return false;
+}
+
+/* Handle interception of Redis commands that have a different
+ * implementation in RedisRaft.
+ *
+ * This is logically similar to handleMultiExec but implemented
+ * separately for readability purposes.
+ *
+ * Currently intercepted commands:
+ * - CLUSTER
+ * - ASKING
+ *
+ * Returns true if the command was intercepted, in which case the RaftReq has
+ * been replied to and freed.
+ */
+
+static bool handleInterceptedCommands(RedisRaftCtx *rr, RaftReq *req)
+{
+    RaftRedisCommand *cmd = req->r.redis.cmds.commands[0];
+
+    int cmd_flags = CommandSpecGetFlags(cmd->argv[0]);
+
+    if (cmd_flags & CMD_SPEC_CLUSTER) {
+            handleClusterCommand(rr, req);
+            return true;
+    }
+
+    if (cmd_flags & CMD_SPEC_ASKING) {
+        if (!rr->config->cluster_mode) {
+            RedisModule_ReplyWithError(req->ctx, "ERR not operating in Redis Cluster compatible mode");
+        } else {
+            /* Flag the client's next command, see handleClustering() */
+            unsigned long long client_id = RedisModule_GetClientId(req->ctx);
+            RedisModule_DictReplaceC(askingClientState, &client_id, sizeof(client_id), NULL);
+            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+        }
+        RaftReqFree(req);
+        return true;
+    }
+
+    return false;
+}
+
+/* When cluster_mode is enabled, handle clustering aspects before processing
+ * the request:
+ *
+ * 1. Compute hash slot of all associated keys and validate there's no cross-slot
+ *    violation.
+ * 2. Update the request's hash_slot for future refrence.
+ * 3. If the hash slot is associated with a foreign ShardGroup, perform a redirect,
+ *    unless it's being imported and the client sent ASKING.
+ * 4. If the hash slot is being migrated, serve it only if the keys are still
+ *    here, see ShardingInfoMigratingSlotAccess().
+ * 5. If the hash slot is not mapped, produce a CLUSTERDOWN error.
+ */
+
+static RRStatus handleClustering(RedisRaftCtx *rr, RaftReq *req)
+{
+    /* ASKING applies to a single command */
+    unsigned long long client_id = RedisModule_GetClientId(req->ctx);
+    if (RedisModule_DictDelC(askingClientState, &client_id, sizeof(client_id), NULL) == REDISMODULE_OK) {
+        req->r.redis.asking = true;
+    }
+
+    if (computeHashSlot(rr, req) != RR_OK) {
+        RedisModule_ReplyWithError(req->ctx, "CROSSSLOT Keys in request don't hash to the same slot");
+        return RR_ERROR;
+    }
+
+    /* If command has no keys, continue */
+    if (req->r.redis.hash_slot == -1) return RR_OK;
+
+    /* Make sure hash slot is mapped and handled locally. */
+    int sgid = rr->sharding_info->hash_slots_map[req->r.redis.hash_slot];
+    if (!sgid) {
+        RedisModule_ReplyWithError(req->ctx, "CLUSTERDOWN Hash slot is not served");
+        return RR_ERROR;
+    }
+
+    /* If accessing a foreign shardgroup, issue a redirect.  If the shardgroup
+     * was updated by synchronization we know its leader, listed first.
+     * Otherwise we use round-robin to all nodes to compensate for the fact we
+     * do not know who the leader is.
+     */
+    int slot = req->r.redis.hash_slot;
+    if (sgid != 1 && req->r.redis.asking &&
+        rr->sharding_info->slot_state[slot] == SLOT_IMPORTING) {
+        return RR_OK;
+    }
+
+    if (sgid != 1) {
+        ShardGroup *sg = rr->sharding_info->shard_groups[sgid-1];
+        if (sg->leader_known && sg->nodes_num > 0) {
+            replyRedirect(rr, req, &sg->nodes[0].addr);
+            return RR_ERROR;
+        }
+        if (sg->next_redir >= sg->nodes_num)
+            sg->next_redir = 0;
+        replyRedirect(rr, req, &sg->nodes[sg->next_redir++].addr);
+        return RR_ERROR;
+    }
+
+    if (rr->sharding_info->slot_state[slot] == SLOT_MIGRATING) {
+        return ShardingInfoMigratingSlotAccess(rr, req,
+                checkReadOnlyCommandArray(&req->r.redis.cmds));
+    }
+
+    return RR_OK;
+}
+
+/* Appends a log entry holding the specified commands, and attaches the
+ * request to it.
+ */
+static void appendRedisCommandEntry(RedisRaftCtx *rr, RaftReq *req, RaftRedisCommandArray *cmds)
+{
+    raft_entry_t *entry = RaftRedisCommandArraySerialize(cmds);
+    entry->id = rand();
+    entry->type = RAFT_LOGTYPE_NORMAL;
+    entryAttachRaftReq(rr, entry, req);
+    int e = raft_recv_entry(rr->raft, entry, &req->r.redis.response);
+    raft_entry_release(entry);
+
+    if (e != 0) {
+        if (req->r.redis.coalesced) {
+            int i;
+            for (i = 0; i < req->r.redis.coalesced_num; i++) {
+                replyRaftError(req->r.redis.coalesced[i]->ctx, e);
+            }
+        } else {
+            replyRaftError(req->ctx, e);
+        }
+        RaftReqFree(req);
+        return;
+    }
+
+    req->ts.append = uv_hrtime();
+    if (req->r.redis.coalesced) {
+        int i;
+        for (i = 0; i < req->r.redis.coalesced_num; i++) {
+            req->r.redis.coalesced[i]->ts.append = req->ts.append;
+        }
+    }
+
+    /* If we're a single node the entry may already be committed, but we
+     * can't apply it until it's synced.  This happens once all queued
+     * requests have been processed, see scheduleRaftLogSync().
+     *
+     * Until applied by applyCommittedEntries() (and freed by it), the request
+     * is pending so we don't free it or unblock the client.
+     */
+}
+
+/* Write coalescing: if write-coalesce-max-requests is greater than 1, writes
+ * handled while draining the request queue are appended to the log together
+ * as a single entry.
+ *
+ * The entry is attached to a request that holds all coalesced requests, so
+ * when it's applied every request executes its own commands and gets its own
+ * reply.  The entry itself holds the commands of all requests without MULTI,
+ * which only affects how replies are grouped, so it executes the same way on
+ * all nodes.
+ */
+static void appendCoalescedWrites(RedisRaftCtx *rr)
+{
+    int len = rr->coalesced_writes_len;
+    RaftReq *req;
+    int i, j;
+
+    if (!len) {
+        return;
+    }
+    rr->coalesced_writes_len = 0;
+
+    if (len == 1) {
+        req = STAILQ_FIRST(&rr->coalesced_writes);
+        STAILQ_REMOVE_HEAD(&rr->coalesced_writes, entries);
+        appendRedisCommandEntry(rr, req, &req->r.redis.cmds);
+        return;
+    }
+
+    RaftReq *creq = RaftReqInit(NULL, RR_REDISCOMMAND);
+    creq->r.redis.coalesced = RedisModule_Alloc(len * sizeof(RaftReq *));
+    creq->r.redis.coalesced_num = len;
+
+    RaftRedisCommandArray cmds = { 0 };
+    for (i = 0; i < len; i++) {
+        req = STAILQ_FIRST(&rr->coalesced_writes);
+        STAILQ_REMOVE_HEAD(&rr->coalesced_writes, entries);
+        creq->r.redis.coalesced[i] = req;
+        cmds.size += req->r.redis.cmds.len;
+    }
+
+    cmds.commands = RedisModule_Alloc(cmds.size * sizeof(RaftRedisCommand *));
+    for (i = 0; i < len; i++) {
+        RaftRedisCommandArray *c = &creq->r.redis.coalesced[i]->r.redis.cmds;
+        for (j = 0; j < c->len; j++) {
+            if (j == 0 && RaftRedisCommandIsMulti(c->commands[j])) {
+                continue;
+            }
+            cmds.commands[cmds.len++] = c->commands[j];
+        }
+    }
+
+    rr->coalesced_entries++;
+    rr->coalesced_reqs += len;
+
+    appendRedisCommandEntry(rr, creq, &cmds);
+
+    /* Commands are owned by the coalesced requests */
+    RedisModule_Free(cmds.commands);
+}
+
+/* Read leases: a leader that has been acknowledged by a majority of voting
+ * nodes within the last election-timeout (less lease-drift-margin) knows no
+ * other leader can have been elected since.  It can therefore serve reads
+ * right away, rather than confirming its leadership through the read queue.
+ *
+ * Acknowledgements are timed from when the AppendEntries message was sent,
+ * so the time spent in flight shortens the lease rather than extending it.
+ *
+ * The lease also requires an entry of the current term to have been applied,
+ * so everything committed by previous leaders is visible locally.
+ */
+static bool checkReadLease(RedisRaftCtx *rr)
+{
+    if (!raft_is_leader(rr->raft)) {
+        return false;
+    }
+
+    /* The target of a leadership transfer is elected without waiting for
+     * followers to time out, so the lease doesn't hold while transferring.
+     */
+    if (raft_get_transfer_leader(rr->raft) != RAFT_NODE_ID_NONE) {
+        return false;
+    }
+
+    raft_term_t term = raft_get_current_term(rr->raft);
+    raft_index_t applied_idx = raft_get_last_applied_idx(rr->raft);
+    raft_term_t applied_term;
+
+    if (applied_idx == raft_get_snapshot_last_idx(rr->raft)) {
+        applied_term = raft_get_snapshot_last_term(rr->raft);
+    } else {
+        raft_entry_t *entry = raft_get_entry_from_idx(rr->raft, applied_idx);
+        if (!entry) {
+            return false;
+        }
+        applied_term = entry->term;
+        raft_entry_release(entry);
+    }
+
+    if (applied_term != term) {
+        return false;
+    }
+
+    long long lease = rr->config->election_timeout - rr->config->lease_drift_margin;
+    if (lease <= 0) {
+        return false;
+    }
+
+    uint64_t now = uv_hrtime();
+    uint64_t lease_ns = lease * 1000000;
+    raft_node_t *me = raft_get_my_node(rr->raft);
+    int acks = raft_node_is_voting(me) ? 1 : 0;
+    int i;
+
+    for (i = 0; i < raft_get_num_nodes(rr->raft); i++) {
+        raft_node_t *rn = raft_get_node_from_idx(rr->raft, i);
+        if (rn == me || !raft_node_is_voting(rn)) {
+            continue;
+        }
+
+        Node *node = raft_node_get_udata(rn);
+        if (node && node->lease_ack_term == term && now - node->lease_ack_time < lease_ns &&
+            node->lease_ack_time > rr->transfer_end_time) {
+            acks++;
+        }
+    }
+
+    return acks > raft_get_num_voting_nodes(rr->raft) / 2;
+}
+
+/* ------------------------------------ Follower Reads ------------------------------------ */
+
+/* Follower reads use the ReadIndex protocol: the follower asks the leader
+ * for its commit index using RAFT.READINDEX, which the leader replies to once
+ * it has confirmed it is still the leader.  When the follower has applied
+ * its log up to that index, it has seen every write completed before the
+ * request was sent and can serve the read locally.
+ *
+ * All reads received while the Raft thread drains its request queue share a
+ * single RAFT.READINDEX request.
+ */
+
+typedef struct ReadIndexBatch {
+    Node *node;
+    struct rqueue reqs;
+} ReadIndexBatch;
+
+static void failFollowerReads(struct rqueue *reqs, const char *err)
+{
+    RaftReq *req;
+
+    while ((req = STAILQ_FIRST(reqs)) != NULL) {
+        STAILQ_REMOVE_HEAD(reqs, entries);
+        RedisModule_ReplyWithError(req->ctx, err);
+        RaftReqFree(req);
+    }
+}
+
+/* Serves follower reads whose read index has been applied */
+static void serveFollowerReads(RedisRaftCtx *rr)
+{
+    struct rqueue pending = STAILQ_HEAD_INITIALIZER(pending);
+    raft_index_t applied_idx = raft_get_last_applied_idx(rr->raft);
+    RaftReq *req;
+
+    STAILQ_CONCAT(&pending, &rr->follower_reads);
+    while ((req = STAILQ_FIRST(&pending)) != NULL) {
+        STAILQ_REMOVE_HEAD(&pending, entries);
+
+        if (req->r.redis.read_idx > applied_idx) {
+            STAILQ_INSERT_TAIL(&rr->follower_reads, req, entries);
+            continue;
+        }
+
+        rr->follower_reads_served++;
+        handleReadOnlyCommand(req, 1);
+    }
+}
+
+static void handleReadIndexResponse(redisAsyncContext *c, void *r, void *privdata)
+{
+    ReadIndexBatch *batch = privdata;
+    Node *node = batch->node;
+    RedisRaftCtx *rr = node->rr;
+    redisReply *reply = r;
+    RaftReq *req;
+
+    NodeDismissPendingResponse(node);
+
+    if (!reply) {
+        ConnMarkDisconnected(node->conn);
+        failFollowerReads(&batch->reqs, "TIMEOUT no reply from leader");
+        goto exit;
+    }
+
+    /* The leader does not support follower reads, so have the requests
+     * handled as usual (proxied or redirected).
+     */
+    if (reply->type == REDIS_REPLY_ERROR && !node->legacy_readindex &&
+        strstr(reply->str, "unknown command")) {
+        NODE_LOG_VERBOSE(node, "Node does not support RAFT.READINDEX, disabling follower reads.");
+        node->legacy_readindex = true;
+        while ((req = STAILQ_FIRST(&batch->reqs)) != NULL) {
+            STAILQ_REMOVE_HEAD(&batch->reqs, entries);
+            handleRedisCommand(rr, req);
+        }
+        ProxyFlushBatch(rr);
+        goto exit;
+    }
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+        failFollowerReads(&batch->reqs, reply->str);
+        goto exit;
+    }
+    if (reply->type != REDIS_REPLY_INTEGER) {
+        failFollowerReads(&batch->reqs, "ERR bad reply from leader");
+        goto exit;
+    }
+
+    while ((req = STAILQ_FIRST(&batch->reqs)) != NULL) {
+        STAILQ_REMOVE_HEAD(&batch->reqs, entries);
+        req->r.redis.read_idx = reply->integer;
+        STAILQ_INSERT_TAIL(&rr->follower_reads, req, entries);
+    }
+    serveFollowerReads(rr);
+
+exit:
+    RedisModule_Free(batch);
+}
+
+/* Sends a RAFT.READINDEX request for all reads queued by queueFollowerRead() */
+static void sendReadIndexRequest(RedisRaftCtx *rr)
+{
+    Node *leader = rr->read_index_node;
+    redisAsyncContext *rc;
+
+    if (STAILQ_EMPTY(&rr->read_index_batch)) {
+        return;
+    }
+
+    ReadIndexBatch *batch = RedisModule_Alloc(sizeof(ReadIndexBatch));
+    batch->node = leader;
+    STAILQ_INIT(&batch->reqs);
+    STAILQ_CONCAT(&batch->reqs, &rr->read_index_batch);
+    rr->read_index_node = NULL;
+
+    if (!ConnIsConnected(leader->conn) || !(rc = ConnGetRedisCtx(leader->conn)) ||
+        redisAsyncCommand(rc, handleReadIndexResponse, batch, "RAFT.READINDEX") != REDIS_OK) {
+        failFollowerReads(&batch->reqs, "NOTLEADER Failed to reach leader");
+        RedisModule_Free(batch);
+        return;
+    }
+
+    NodeAddPendingResponse(leader, false);
+    rr->read_index_reqs++;
+}
+
+/* Queues a read to be served locally by a follower.  Returns RR_ERROR if
+ * the request cannot be served this way, and should be handled as usual.
+ */
+static RRStatus queueFollowerRead(RedisRaftCtx *rr, RaftReq *req)
+{
+    raft_node_t *leader = raft_get_current_leader_node(rr->raft);
+    Node *leader_node;
+
+    if (!leader || raft_node_get_id(leader) == raft_get_nodeid(rr->raft) ||
+        !(leader_node = raft_node_get_udata(leader)) ||
+        leader_node->legacy_readindex || !ConnIsConnected(leader_node->conn)) {
+        return RR_ERROR;
+    }
+
+    if (rr->read_index_node != leader_node) {
+        sendReadIndexRequest(rr);
+    }
+
+    STAILQ_INSERT_TAIL(&rr->read_index_batch, req, entries);
+    rr->read_index_node = leader_node;
+
+    return RR_OK;
+}
+
+/* Learner reads: a learner serves reads locally, without asking the leader
+ * for a read index, as long as it is within learner-max-lag entries of the
+ * leader's commit index and has heard from the leader in the last
+ * learner-max-lag-msec.  The leader's commit index is the one it sent in its
+ * last AppendEntries, so reads may be stale by up to these bounds.
+ */
 
-    MultiState *multiState = NULL;
+/* Returns the number of entries committed by the leader but not yet applied */
+static raft_index_t getReplicationLag(RedisRaftCtx *rr)
+{
+    raft_index_t applied_idx = raft_get_last_applied_idx(rr->raft);
 
-    if (RedisModule_DictDelC(multiClientState, &client_id, sizeof(client_id),
-               &multiState) == REDISMODULE_OK) {
-       if (multiState) {
-           freeMultiState(multiState);
-       }
+    if (raft_is_leader(rr->raft) || rr->leader_commit_idx <= applied_idx) {
+        return 0;
     }
+
+    return rr->leader_commit_idx - applied_idx;
 }
 
-static bool handleMultiExec(RedisRaftCtx *rr, RaftReq *req)
+/* Returns the milliseconds since AppendEntries was last accepted from the
+ * leader, or -1 if it never was.
+ */
+static long long getReplicationLagMsec(RedisRaftCtx *rr)
 {
-    unsigned long long client_id = RedisModule_GetClientId(req->ctx);
+    if (raft_is_leader(rr->raft)) {
+        return 0;
+    }
+    if (!rr->last_leader_contact) {
+        return -1;
+    }
 
-    /* Get Multi state */
-    MultiState *multiState = RedisModule_DictGetC(multiClientState, &client_id, sizeof(client_id), NULL);
+    return RedisModule_Milliseconds() - rr->last_leader_contact;
+}
 
-    /* Is this a MULTI command? */
-    RaftRedisCommand *cmd = req->r.redis.cmds.commands[0];
-    size_t cmd_len;
-    const char *cmd_str = RedisModule_StringPtrLen(cmd->argv[0], &cmd_len);
-    if (req->r.redis.cmds.len == 1 && cmd_len == 5 && !strncasecmp(cmd_str, "MULTI", 5)) {
-        if (multiState) {
-            RedisModule_ReplyWithError(req->ctx, "ERR MULTI calls can not be nested");
-        } else {
-            multiState = RedisModule_Calloc(sizeof(MultiState), 1);
-            RedisModule_DictSetC(multiClientState, &client_id, sizeof(client_id), multiState);
+static bool learnerCanServeRead(RedisRaftCtx *rr)
+{
+    long long lag_msec = getReplicationLagMsec(rr);
 
-            /* We put the MULTI as the first command in the array, as we still need to
-             * distinguish single-MULTI array from a single command.
-             */
-            RaftRedisCommandArrayMove(&multiState->cmds, &req->r.redis.cmds);
+    if (lag_msec < 0 ||
+        (rr->config->learner_max_lag_msec && lag_msec > rr->config->learner_max_lag_msec) ||
+        (rr->config->learner_max_lag && getReplicationLag(rr) > rr->config->learner_max_lag)) {
+        return false;
+    }
 
-            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
-        }
+    return true;
+}
 
-        RaftReqFree(req);
-        return true;
+static void handleReadIndexConfirmed(void *arg, int can_read)
+{
+    RaftReq *req = (RaftReq *) arg;
+
+    if (!can_read) {
+        RedisModule_ReplyWithError(req->ctx, "TIMEOUT no quorum for read");
+    } else {
+        RedisModule_ReplyWithLongLong(req->ctx, raft_get_commit_idx(redis_raft.raft));
     }
 
-    if (cmd_len == 4 && !strncasecmp(cmd_str, "EXEC", 4)) {
-        if (!multiState) {
-            RedisModule_ReplyWithError(req->ctx, "ERR EXEC without MULTI");
-            RaftReqFree(req);
-            return true;
-        }
+    RaftReqFree(req);
+}
 
-        int ctx_flags = RedisModule_GetContextFlags(req->ctx);
+static void handleReadIndex(RedisRaftCtx *rr, RaftReq *req)
+{
+    if (checkRaftState(rr, req) == RR_ERROR ||
+        checkLeader(rr, req, NULL) == RR_ERROR) {
+        RaftReqFree(req);
+        return;
+    }
 
-        /* Check if we can execute:
-         * 1) No errors in the transaction so far;
-         * 2) No dirty watch.
-         */
-        if (multiState->error) {
-            RedisModule_ReplyWithError(req->ctx, "EXECABORT Transaction discarded because of previous errors.");
-            RaftReqFree(req);
-            req = NULL;
-        } else if (ctx_flags & REDISMODULE_CTX_FLAGS_MULTI_DIRTY) {
-            RedisModule_ReplyWithNull(req->ctx);
-            RaftReqFree(req);
-            req = NULL;
-        } else {
-            /* Just swap our commands with the EXEC command and proceed. */
-            RaftRedisCommandArrayFree(&req->r.redis.cmds);
-            RaftRedisCommandArrayMove(&req->r.redis.cmds, &multiState->cmds);
+    if (rr->config->lease_reads && checkReadLease(rr)) {
+        rr->lease_read_hits++;
+        handleReadIndexConfirmed(req, 1);
+    } else {
+        if (rr->config->lease_reads) {
+            rr->lease_read_misses++;
         }
-
-        RedisModule_DictDelC(multiClientState, &client_id, sizeof(client_id), NULL);
-        freeMultiState(multiState);
-        return req == NULL;
+        raft_queue_read_request(rr->raft, handleReadIndexConfirmed, req);
     }
+}
 
-    if (cmd_len == 7 && !strncasecmp(cmd_str, "DISCARD", 7)) {
-        if (!multiState) {
-            RedisModule_ReplyWithError(req->ctx, "ERR DISCARD without MULTI");
-        } else {
-            RedisModule_DictDelC(multiClientState, &client_id, sizeof(client_id), NULL);
-            freeMultiState(multiState);
+/* Handle RAFT.TRANSFER-LEADER.  The leader brings the target up to date and
+ * then sends it RAFT.TIMEOUTNOW; the client is replied to when the target is
+ * elected, or the transfer times out after an election timeout.
+ */
+static void handleTransferLeader(RedisRaftCtx *rr, RaftReq *req)
+{
+    if (checkRaftState(rr, req) == RR_ERROR ||
+        checkLeader(rr, req, NULL) == RR_ERROR) {
+        goto exit;
+    }
 
-            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
-        }
+    if (rr->transfer_req) {
+        RedisModule_ReplyWithError(req->ctx, "ERR leadership transfer already in progress");
+        goto exit;
+    }
 
-        RaftReqFree(req);
-        return true;
+    int e = raft_transfer_leader(rr->raft, req->r.transfer_leader.node_id,
+                                 rr->config->election_timeout);
+    if (e != 0) {
+        replyRaftError(req->ctx, e);
+        goto exit;
     }
 
-    /* Are we in MULTI? */
-    if (multiState) {
-        /* TODO: Add command checks and set multiState->error if necessary; This probably requires
-         * Module API extensions.
-         */
-        RaftRedisCommandArrayMove(&multiState->cmds, &req->r.redis.cmds);
-        RedisModule_ReplyWithSimpleString(req->ctx, "QUEUED");
+    LOG_INFO("Transferring leadership to node %d", raft_get_transfer_leader(rr->raft));
 
-        RaftReqFree(req);
-        return true;
-    }
+    rr->transfer_req = req;
+    return;
 
-    return false;
+exit:
+    RaftReqFree(req);
 }
 
-/* Handle interception of Redis commands that have a different
- * implementation in RedisRaft.
- *
- * This is logically similar to handleMultiExec but implemented
- * separately for readability purposes.
- *
- * Currently intercepted commands:
- * - CLUSTER
- *
- * Returns true if the command was intercepted, in which case the RaftReq has
- * been replied to and freed.
+/* Handle RAFT.TIMEOUTNOW, by starting an election immediately.
  */
-
-static bool handleInterceptedCommands(RedisRaftCtx *rr, RaftReq *req)
+static void handleTimeoutNow(RedisRaftCtx *rr, RaftReq *req)
 {
-    const char _cmd_cluster[] = "CLUSTER";
-    RaftRedisCommand *cmd = req->r.redis.cmds.commands[0];
-    size_t cmd_len;
-    const char *cmd_str = RedisModule_StringPtrLen(cmd->argv[0], &cmd_len);
+    if (checkRaftState(rr, req) == RR_ERROR) {
+        goto exit;
+    }
 
-    if (cmd_len == sizeof(_cmd_cluster) - 1 &&
-        !strncasecmp(cmd_str, _cmd_cluster, sizeof(_cmd_cluster) - 1)) {
-            handleClusterCommand(rr, req);
-            return true;
+    int e = raft_timeout_now(rr->raft);
+    if (e != 0) {
+        replyRaftError(req->ctx, e);
+        goto exit;
     }
 
-    return false;
+    RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+
+exit:
+    RaftReqFree(req);
 }
 
-/* When cluster_mode is enabled, handle clustering aspects before processing
- * the request:
+/* Admission control: rejects a write with -TRYAGAIN when the Raft pipeline
+ * lags too far behind, rather than queueing it until the client times out.
+ * Reads are not affected. Limits set to 0 are not enforced.
  *
- * 1. Compute hash slot of all associated keys and validate there's no cross-slot
- *    violation.
- * 2. Update the request's hash_slot for future refrence.
- * 3. If the hash slot is associated with a foreign ShardGroup, perform a redirect.
- * 4. If the hash slot is not mapped, produce a CLUSTERDOWN error.
+ * max-queued-requests is enforced earlier, by RaftReqSubmit().
  */
-
-static RRStatus handleClustering(RedisRaftCtx *rr, RaftReq *req)
+static RRStatus admitWrite(RedisRaftCtx *rr, RaftReq *req, Node *leader_proxy)
 {
-    if (computeHashSlot(rr, req) != RR_OK) {
-        RedisModule_ReplyWithError(req->ctx, "CROSSSLOT Keys in request don't hash to the same slot");
-        return RR_ERROR;
-    }
+    RedisRaftConfig *config = rr->config;
 
-    /* If command has no keys, continue */
-    if (req->r.redis.hash_slot == -1) return RR_OK;
-
-    /* Make sure hash slot is mapped and handled locally. */
-    int sgid = rr->sharding_info->hash_slots_map[req->r.redis.hash_slot];
-    if (!sgid) {
-        RedisModule_ReplyWithError(req->ctx, "CLUSTERDOWN Hash slot is not served");
-        return RR_ERROR;
+    if (leader_proxy) {
+        if (config->max_proxied_requests &&
+            rr->proxy_outstanding_reqs >= (unsigned long) config->max_proxied_requests) {
+            rr->rejected_proxy_reqs++;
+            replyRedisCommandError(req, "TRYAGAIN Too many outstanding proxied requests");
+            return RR_ERROR;
+        }
+        return RR_OK;
     }
 
-    /* If accessing a foreign shardgroup, issue a redirect. We use round-robin
-     * to all nodes to compensate for the fact we do not have an up-to-date knowledge
-     * of who the leader is and whether or not some configuration has changed since
-     * last refresh (when refresh is implemented, in the future).
-     */
-    if (sgid != 1) {
-        ShardGroup *sg = rr->sharding_info->shard_groups[sgid-1];
-        if (sg->next_redir >= sg->nodes_num)
-            sg->next_redir = 0;
-        replyRedirect(rr, req, &sg->nodes[sg->next_redir++].addr);
+    if ((config->max_uncommitted_entries &&
+         raft_get_current_idx(rr->raft) - raft_get_commit_idx(rr->raft) >=
+            config->max_uncommitted_entries) ||
+        (config->max_uncommitted_bytes &&
+         rr->client_attached_bytes >= config->max_uncommitted_bytes)) {
+        rr->rejected_uncommitted_reqs++;
+        replyRedisCommandError(req, "TRYAGAIN Too many uncommitted entries");
         return RR_ERROR;
     }
 
@@ -1738,7 +2983,7 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
      * commands we've received this as a RAFT.ENTRY input and bundling, probably through a
      * proxy, and bundling was done before.
      */
-    if (req->r.redis.cmds.len == 1) {
+    if (req->r.redis.cmds.len == 1 && !req->r.redis.batch) {
         if (handleMultiExec(rr, req)) {
             return;
         }
@@ -1754,7 +2999,30 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
     /* Handle intercepted commands. We do this also on non-leader nodes or if we don't
      * have a leader, so it's up to the commands to check these conditions if they have to.
      */
-    if (handleInterceptedCommands(rr, req)) {
+    if (!req->r.redis.batch && handleInterceptedCommands(rr, req)) {
+        return;
+    }
+
+    /* Learners serve reads locally if they're not lagging too far behind, or
+     * handle them as usual otherwise.
+     */
+    if (rr->learner && !rr->config->cluster_mode && !req->r.redis.batch &&
+        checkReadOnlyCommandArray(&req->r.redis.cmds)) {
+        if (learnerCanServeRead(rr)) {
+            rr->learner_reads_served++;
+            handleReadOnlyCommand(req, 1);
+            return;
+        }
+        rr->learner_reads_stale++;
+    }
+
+    /* Followers may serve reads locally, once they've caught up with the leader.
+     * This is not supported in cluster mode, which relies on the leader to
+     * validate hash slots.
+     */
+    if (rr->config->follower_reads && !rr->config->cluster_mode && !req->r.redis.batch &&
+        !raft_is_leader(rr->raft) && checkReadOnlyCommandArray(&req->r.redis.cmds) &&
+        queueFollowerRead(rr, req) == RR_OK) {
         return;
     }
 
@@ -1763,6 +3031,11 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
         goto exit;
     }
 
+    if (!checkReadOnlyCommandArray(&req->r.redis.cmds) &&
+        admitWrite(rr, req, leader_proxy) == RR_ERROR) {
+        goto exit;
+    }
+
     /* Proxy */
     if (leader_proxy) {
         if (ProxyCommand(rr, req, leader_proxy) != RR_OK) {
@@ -1783,7 +3056,13 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
      * until we can confirm it's safe to execute (i.e. still a leader).
      */
     if (checkReadOnlyCommandArray(&req->r.redis.cmds)) {
-        if (rr->config->quorum_reads) {
+        if (rr->config->quorum_reads && rr->config->lease_reads && checkReadLease(rr)) {
+            rr->lease_read_hits++;
+            handleReadOnlyCommand(req, 1);
+        } else if (rr->config->quorum_reads) {
+            if (rr->config->lease_reads) {
+                rr->lease_read_misses++;
+            }
             raft_queue_read_request(rr->raft, handleReadOnlyCommand, req);
         } else {
             handleReadOnlyCommand(req, 1);
@@ -1791,38 +3070,65 @@ static void handleRedisCommand(RedisRaftCtx *rr,RaftReq *req)
         return;
     }
 
-    raft_entry_t *entry = RaftRedisCommandArraySerialize(&req->r.redis.cmds);
-    entry->id = rand();
-    entry->type = RAFT_LOGTYPE_NORMAL;
-    entryAttachRaftReq(rr, entry, req);
-    int e = raft_recv_entry(rr->raft, entry, &req->r.redis.response);
-    raft_entry_release(entry);
-
-    if (e != 0) {
-        replyRaftError(req->ctx, e);
-        goto exit;
-    }
-
-    /* If we're a single node we can try to apply now, as we have no need
-     * or way to wait for AE responses to do that.
+    /* Coalesce with other writes, unless it's an empty transaction which
+     * has no commands to coalesce.
      */
-    if (raft_get_current_idx(rr->raft) == raft_get_commit_idx(rr->raft)) {
-        raft_apply_all(rr->raft);
+    if (rr->config->write_coalesce_max_requests > 1 &&
+        !(req->r.redis.cmds.len == 1 && RaftRedisCommandIsMulti(req->r.redis.cmds.commands[0]))) {
+        STAILQ_INSERT_TAIL(&rr->coalesced_writes, req, entries);
+        if (++rr->coalesced_writes_len >= rr->config->write_coalesce_max_requests) {
+            appendCoalescedWrites(rr);
+        }
+        return;
     }
 
-    /* Unless applied by raft_apply_all() (and freed by it), the request
-     * is pending so we don't free it or unblock the client.
-     */
+    appendRedisCommandEntry(rr, req, &req->r.redis.cmds);
     return;
 
 exit:
     RaftReqFree(req);
 }
 
+static const char *latency_stat_names[LATENCY_STATS_NUM] = {
+    [LATENCY_QUEUE] = "queue",
+    [LATENCY_APPEND] = "append",
+    [LATENCY_COMMIT] = "commit",
+    [LATENCY_APPLY] = "apply",
+    [LATENCY_REPLY] = "reply",
+    [LATENCY_TOTAL] = "total",
+    [LATENCY_LOG_SYNC] = "log_sync",
+    [LATENCY_AE_RTT] = "ae_rtt"
+};
+
+/* Returns true if the RAFT.INFO section should be reported, following INFO:
+ * with no section (or "default") all but the non-default sections are
+ * reported, and "all" reports everything.
+ */
+static bool infoSectionIncluded(const char *section, const char *name, bool is_default)
+{
+    if (!section || !strcasecmp(section, "default")) {
+        return is_default;
+    }
+
+    return !strcasecmp(section, "all") || !strcasecmp(section, name);
+}
+
+/* Appends a section header, separated from the previous section if any */
+static char *catInfoSection(char *s, size_t *slen, const char *title)
+{
+    return catsnprintf(s, slen, "%s# %s\r\n", *s ? "\r\n" : "", title);
+}
+
 static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
 {
     size_t slen = 1024;
     char *s = RedisModule_Calloc(1, slen);
+    const char *section = req->r.info.section;
+    int i;
+
+    if (!infoSectionIncluded(section, "raft", true)) {
+        goto log;
+    }
 
     char role[10];
     if (!rr->raft) {
@@ -1845,26 +3151,31 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
     }
 
     raft_node_t *me = rr->raft ? raft_get_my_node(rr->raft) : NULL;
+    s = catInfoSection(s, &slen, "Raft");
     s = catsnprintf(s, &slen,
-            "# Raft\r\n"
             "node_id:%d\r\n"
             "state:%s\r\n"
             "role:%s\r\n"
             "is_voting:%s\r\n"
+            "is_learner:%s\r\n"
             "leader_id:%d\r\n"
+            "transfer_leader_id:%d\r\n"
             "current_term:%d\r\n"
             "num_nodes:%d\r\n"
-            "num_voting_nodes:%d\r\n",
+            "num_voting_nodes:%d\r\n"
+            "topology_epoch:%llu\r\n",
             rr->config->id,
             getStateStr(rr),
             role,
             me ? (raft_node_is_voting(raft_get_my_node(rr->raft)) ? "yes" : "no") : "-",
+            rr->learner ? "yes" : "no",
             rr->raft ? raft_get_current_leader(rr->raft) : -1,
+            rr->raft ? raft_get_transfer_leader(rr->raft) : RAFT_NODE_ID_NONE,
             rr->raft ? raft_get_current_term(rr->raft) : 0,
             rr->raft ? raft_get_num_nodes(rr->raft) : 0,
-            rr->raft ? raft_get_num_voting_nodes(rr->raft) : 0);
+            rr->raft ? raft_get_num_voting_nodes(rr->raft) : 0,
+            rr->sharding_info ? rr->sharding_info->epoch : 0);
 
-    int i;
     long long now = RedisModule_Milliseconds();
     int num_nodes = rr->raft ? raft_get_num_nodes(rr->raft) : 0;
     for (i = 0; i < num_nodes; i++) {
@@ -1875,53 +3186,152 @@ static void handleInfo(RedisRaftCtx *rr, RaftReq *req)
         }
 
         s = catsnprintf(s, &slen,
-                "node%d:id=%d,state=%s,voting=%s,addr=%s,port=%d,last_conn_secs=%ld,conn_errors=%lu,conn_oks=%lu\r\n",
+                "node%d:id=%d,state=%s,voting=%s,learner=%s,addr=%s,port=%d,last_conn_secs=%ld,conn_errors=%lu,conn_oks=%lu,ae_inflight=%ld,"
+                "sent_bytes=%llu,pending_reqs=%ld,bulk_state=%s,bulk_sent_bytes=%llu,bulk_pending_reqs=%ld\r\n",
                 i, node->id, ConnGetStateStr(node->conn),
                 raft_node_is_voting(rnode) ? "yes" : "no",
+                node->learner ? "yes" : "no",
                 node->addr.host, node->addr.port,
                 node->conn->last_connected_time ? (now - node->conn->last_connected_time)/1000 : -1,
-                node->conn->connect_errors, node->conn->connect_oks);
+                node->conn->connect_errors, node->conn->connect_oks,
+                node->ae_inflight,
+                node->conn->bytes_sent,
+                node->pending_raft_response_num + node->pending_proxy_response_num,
+                node->bulk_conn ? ConnGetStateStr(node->bulk_conn) : "-",
+                node->bulk_conn ? node->bulk_conn->bytes_sent : 0ULL,
+                node->pending_bulk_response_num);
+    }
+
+log:
+    if (!infoSectionIncluded(section, "log", true)) {
+        goto snapshot;
     }
 
+    s = catInfoSection(s, &slen, "Log");
     s = catsnprintf(s, &slen,
-            "\r\n# Log\r\n"
             "log_entries:%d\r\n"
             "current_index:%d\r\n"
+            "durable_index:%ld\r\n"
             "commit_index:%d\r\n"
             "last_applied_index:%d\r\n"
+            "replication_lag:%ld\r\n"
+            "replication_lag_msec:%lld\r\n"
             "file_size:%lu\r\n"
+            "file_segments:%d\r\n"
             "cache_memory_size:%lu\r\n"
+            "cache_chunks_memory_size:%lu\r\n"
             "cache_entries:%lu\r\n"
-            "client_attached_entries:%lu\r\n",
+            "client_attached_entries:%lu\r\n"
+            "client_attached_bytes:%llu\r\n"
+            "fsyncs:%llu\r\n"
+            "fsync_entries:%llu\r\n"
+            "fsync_avg_entries:%.2f\r\n"
+            "fsync_max_entries:%lu\r\n",
             rr->raft ? raft_get_log_count(rr->raft) : 0,
             rr->raft ? raft_get_current_idx(rr->raft) : 0,
+            rr->log ? (long) rr->log->durable_idx : 0,
             rr->raft ? raft_get_commit_idx(rr->raft) : 0,
             rr->raft ? raft_get_last_applied_idx(rr->raft) : 0,
+            rr->raft ? (long) getReplicationLag(rr) : 0,
+            rr->raft ? getReplicationLagMsec(rr) : -1,
             rr->log ? rr->log->file_size : 0,
+            rr->log ? rr->log->num_segments : 0,
             rr->logcache ? rr->logcache->entries_memsize : 0,
+            rr->logcache ? rr->logcache->chunks_memsize : 0,
             rr->logcache ? rr->logcache->len : 0,
-            rr->client_attached_entries);
+            rr->client_attached_entries,
+            rr->client_attached_bytes,
+            rr->log_fsyncs,
+            rr->log_fsync_entries,
+            rr->log_fsyncs ? (double) rr->log_fsync_entries / rr->log_fsyncs : 0,
+            rr->log_fsync_max_entries);
+
+snapshot:
+    if (!infoSectionIncluded(section, "snapshot", true)) {
+        goto clients;
+    }
 
+    s = catInfoSection(s, &slen, "Snapshot");
     s = catsnprintf(s, &slen,
-            "\r\n# Snapshot\r\n"
             "snapshot_in_progress:%s\r\n"
-            "snapshots_loaded:%lu\r\n",
+            "snapshots_loaded:%lu\r\n"
+            "snapshots_delivered:%lu\r\n"
+            "snapshot_bytes_sent:%llu\r\n"
+            "snapshot_raw_bytes_sent:%llu\r\n"
+            "snapshot_bytes_received:%llu\r\n"
+            "snapshot_raw_bytes_received:%llu\r\n"
+            "last_snapshot_delivery_time:%lu\r\n",
             rr->snapshot_in_progress ? "yes" : "no",
-            rr->snapshots_loaded);
+            rr->snapshots_loaded,
+            rr->snapshots_delivered,
+            rr->snapshot_bytes_sent,
+            rr->snapshot_raw_bytes_sent,
+            rr->snapshot_bytes_received,
+            rr->snapshot_raw_bytes_received,
+            rr->last_snapshot_delivery_time);
+
+clients:
+    if (!infoSectionIncluded(section, "clients", true)) {
+        goto latency;
+    }
 
+    s = catInfoSection(s, &slen, "Clients");
     s = catsnprintf(s, &slen,
-            "\r\n# Clients\r\n"
             "clients_in_multi_state:%d\r\n"
             "proxy_reqs:%llu\r\n"
             "proxy_failed_reqs:%llu\r\n"
             "proxy_failed_responses:%llu\r\n"
-            "proxy_outstanding_reqs:%ld\r\n",
+            "proxy_outstanding_reqs:%ld\r\n"
+            "proxy_batches:%llu\r\n"
+            "coalesced_entries:%llu\r\n"
+            "coalesced_reqs:%llu\r\n"
+            "lease_read_hits:%llu\r\n"
+            "lease_read_misses:%llu\r\n"
+            "follower_reads_served:%llu\r\n"
+            "read_index_reqs:%llu\r\n"
+            "learner_reads_served:%llu\r\n"
+            "learner_reads_stale:%llu\r\n"
+            "rejected_queued_reqs:%llu\r\n"
+            "rejected_uncommitted_reqs:%llu\r\n"
+            "rejected_proxy_reqs:%llu\r\n",
             RedisModule_DictSize(multiClientState),
             rr->proxy_reqs,
             rr->proxy_failed_reqs,
             rr->proxy_failed_responses,
-            rr->proxy_outstanding_reqs);
+            rr->proxy_outstanding_reqs,
+            rr->proxy_batches,
+            rr->coalesced_entries,
+            rr->coalesced_reqs,
+            rr->lease_read_hits,
+            rr->lease_read_misses,
+            rr->follower_reads_served,
+            rr->read_index_reqs,
+            rr->learner_reads_served,
+            rr->learner_reads_stale,
+            rr->rejected_queued_reqs,
+            rr->rejected_uncommitted_reqs,
+            rr->rejected_proxy_reqs);
+
+latency:
+    if (!infoSectionIncluded(section, "latency", false)) {
+        goto exit;
+    }
+
+    s = catInfoSection(s, &slen, "Latency");
+    for (i = 0; i < LATENCY_STATS_NUM; i++) {
+        LatencyHistogram *h = &rr->latency[i];
+        s = catsnprintf(s, &slen,
+                "latency_%s_usec:count=%llu,p50=%llu,p90=%llu,p99=%llu,p999=%llu,max=%llu\r\n",
+                latency_stat_names[i],
+                (unsigned long long) h->count,
+                (unsigned long long) LatencyHistogramPercentile(h, 50),
+                (unsigned long long) LatencyHistogramPercentile(h, 90),
+                (unsigned long long) LatencyHistogramPercentile(h, 99),
+                (unsigned long long) LatencyHistogramPercentile(h, 99.9),
+                (unsigned long long) h->max);
+    }
 
+exit:
     RedisModule_ReplyWithStringBuffer(req->ctx, s, strlen(s));
     RedisModule_Free(s);
 
@@ -1970,7 +3380,7 @@ static void handleClusterJoin(RedisRaftCtx *rr, RaftReq *req)
     initializeSnapshotInfo(rr);
 
     /* Initiate cluster join */
-    InitiateJoinCluster(rr, req->r.cluster_join.addr);
+    InitiateJoinCluster(rr, req->r.cluster_join.addr, req->r.cluster_join.learner);
 
     rr->state = REDIS_RAFT_JOINING;
 
@@ -2006,7 +3416,10 @@ void HandleClusterJoinCompleted(RedisRaftCtx *rr)
 
 static void handleClientDisconnect(RedisRaftCtx *rr, RaftReq *req)
 {
-    freeMultiExecState(req->r.client_disconnect.client_id);
+    unsigned long long client_id = req->r.client_disconnect.client_id;
+
+    freeMultiExecState(client_id);
+    RedisModule_DictDelC(askingClientState, &client_id, sizeof(client_id), NULL);
     RaftReqFree(req);
 }
 
@@ -2084,6 +3497,13 @@ void handleDebug(RedisRaftCtx *rr, RaftReq *req)
         case RR_DEBUG_SENDSNAPSHOT:
             handleDebugSendSnapshot(rr, req);
             break;
+        case RR_DEBUG_RESETLATENCY:
+            for (int i = 0; i < LATENCY_STATS_NUM; i++) {
+                LatencyHistogramReset(&rr->latency[i]);
+            }
+            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+            RaftReqFree(req);
+            break;
         default:
             assert(0);
     }
@@ -2139,6 +3559,37 @@ void applyShardGroupChange(RedisRaftCtx *rr, raft_entry_t *entry)
     }
 }
 
+/* Apply a RAFT_LOGTYPE_SLOT_CONFIG entry, produced by RAFT.SHARDGROUP SETSLOT.
+ * As with shardgroup changes, reply if a local client is waiting.
+ */
+void applySlotConfigChange(RedisRaftCtx *rr, raft_entry_t *entry)
+{
+    SlotConfig cfg;
+    RRStatus ret = RR_ERROR;
+
+    if (SlotConfigParse(entry->data, entry->data_len, &cfg) != RR_OK) {
+        LOG_ERROR("Failed to parse SLOT_CONFIG payload: [%.*s]",
+                entry->data_len, entry->data);
+    } else if (!rr->sharding_info) {
+        LOG_ERROR("Ignoring SLOT_CONFIG entry, not in cluster mode");
+    } else {
+        ret = ShardingInfoSetSlot(rr, &cfg);
+    }
+
+    if (entry->user_data) {
+        RaftReq *req = entry->user_data;
+
+        if (ret == RR_OK) {
+            RedisModule_ReplyWithSimpleString(req->ctx, "OK");
+        } else {
+            RedisModule_ReplyWithError(req->ctx, "ERR failed to locally apply change, should never happen.");
+        }
+        RaftReqFree(req);
+
+        entry->user_data = NULL;
+    }
+}
+
 /* Handle adding of ShardGroup.
  * FIXME: Currently this is done locally, should instead create a
  * custom Raft log entry which calls addShardGroup when applied only.
@@ -2188,9 +3639,13 @@ void handleShardGroupGet(RedisRaftCtx *rr, RaftReq *req)
     RedisModule_ReplyWithLongLong(req->ctx, rr->config->cluster_end_hslot);
     alen = 2;
 
-    for (int i = 0; i < raft_get_num_nodes(rr->raft); i++) {
-        raft_node_t *raft_node = raft_get_node_from_idx(rr->raft, i);
-        if (!raft_node_is_active(raft_node))
+    /* We're the leader, and list ourselves first so remote shardgroups know
+     * where to redirect clients.
+     */
+    for (int i = -1; i < raft_get_num_nodes(rr->raft); i++) {
+        raft_node_t *raft_node = i < 0 ? raft_get_my_node(rr->raft) : raft_get_node_from_idx(rr->raft, i);
+        if (!raft_node_is_active(raft_node) ||
+            (i >= 0 && raft_node == raft_get_my_node(rr->raft)))
             continue;
 
         NodeAddr *addr = NULL;
@@ -2237,5 +3692,10 @@ static RaftReqHandler RaftReqHandlers[] = {
     handleShardGroupAdd,    /* RR_SHARDGROUP_ADD */
     handleShardGroupGet,    /* RR_SHARDGROUP_GET */
     handleShardGroupLink,   /* RR_SHARDGROUP_LINK */
+    handleReadIndex,        /* RR_READINDEX */
+    handleShardGroupSetSlot,    /* RR_SHARDGROUP_SETSLOT */
+    handleShardGroupMigrate,    /* RR_SHARDGROUP_MIGRATE */
+    handleTransferLeader,   /* RR_TRANSFER_LEADER */
+    handleTimeoutNow,       /* RR_TIMEOUT_NOW */
     NULL
 };
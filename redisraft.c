@@ -42,9 +42,10 @@ static RRStatus getNodeAddrFromArg(RedisModuleCtx *ctx, RedisModuleString *arg,
     return RR_OK;
 }
 
-/* RAFT.NODE ADD [id] [address:port]
+/* RAFT.NODE ADD [id] [address:port] [LEARNER]
  *   Add a new node to the cluster.  The [id] can be an explicit non-zero value,
- *   or zero to let the cluster choose one.
+ *   or zero to let the cluster choose one.  A LEARNER node receives the log
+ *   but is never promoted to a voting node.
  * Reply:
  *   -NOCLUSTER ||
  *   -LOADING ||
@@ -82,11 +83,20 @@ static int cmdRaftNode(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 
     const char *cmd = RedisModule_StringPtrLen(argv[1], &cmd_len);
     if (!strncasecmp(cmd, "ADD", cmd_len)) {
-        if (argc != 4) {
+        if (argc != 4 && argc != 5) {
             RedisModule_WrongArity(ctx);
             return REDISMODULE_OK;
         }
 
+        bool learner = false;
+        if (argc == 5) {
+            if (strcasecmp(RedisModule_StringPtrLen(argv[4], NULL), "LEARNER") != 0) {
+                RedisModule_ReplyWithError(ctx, "ERR syntax error");
+                return REDISMODULE_OK;
+            }
+            learner = true;
+        }
+
         /* Validate node id */
         long long node_id;
         if (RedisModule_StringToLongLong(argv[2], &node_id) != REDISMODULE_OK ||
@@ -110,6 +120,7 @@ static int cmdRaftNode(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         req = RaftReqInit(ctx, RR_CFGCHANGE_ADDNODE);
         req->r.cfgchange.id = node_id;
         req->r.cfgchange.addr = node_addr;
+        req->r.cfgchange.learner = learner;
     } else if (!strncasecmp(cmd, "REMOVE", cmd_len)) {
         if (argc != 3) {
             RedisModule_WrongArity(ctx);
@@ -140,8 +151,9 @@ static int cmdRaftNode(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
     return REDISMODULE_OK;
 }
 
-/* RAFT.REQUESTVOTE [target_node_id] [src_node_id] [term]:[candidate_id]:[last_log_idx]:[last_log_term]
- *   Request a node's vote (per Raft paper).
+/* RAFT.REQUESTVOTE [target_node_id] [src_node_id] [term]:[candidate_id]:[last_log_idx]:[last_log_term]:[transfer_leader]
+ *   Request a node's vote (per Raft paper).  [transfer_leader] is set by a
+ *   leadership transfer target and may be omitted.
  * Reply:
  *   -NOCLUSTER ||
  *   -LOADING ||
@@ -174,11 +186,12 @@ static int cmdRaftRequestVote(RedisModuleCtx *ctx, RedisModuleString **argv, int
 
     size_t tmplen;
     const char *tmpstr = RedisModule_StringPtrLen(argv[3], &tmplen);
-    if (sscanf(tmpstr, "%ld:%d:%ld:%ld",
+    if (sscanf(tmpstr, "%ld:%d:%ld:%ld:%d",
                 &req->r.requestvote.msg.term,
                 &req->r.requestvote.msg.candidate_id,
                 &req->r.requestvote.msg.last_log_idx,
-                &req->r.requestvote.msg.last_log_term) != 4) {
+                &req->r.requestvote.msg.last_log_term,
+                &req->r.requestvote.msg.transfer_leader) < 4) {
         RedisModule_ReplyWithError(ctx, "invalid message");
         goto error_cleanup;
     }
@@ -191,6 +204,70 @@ error_cleanup:
     return REDISMODULE_OK;
 }
 
+/* RAFT.TIMEOUTNOW [target_node_id]
+ *   Sent by a leader transferring leadership to this node, once it is up to
+ *   date, to start an election immediately.
+ * Reply:
+ *   -NOCLUSTER ||
+ *   -LOADING ||
+ *   +OK
+ */
+
+static int cmdRaftTimeoutNow(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    RedisRaftCtx *rr = &redis_raft;
+
+    if (argc != 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
+    int target_node_id;
+    if (RedisModuleStringToInt(argv[1], &target_node_id) == REDISMODULE_ERR ||
+        target_node_id != rr->config->id) {
+            RedisModule_ReplyWithError(ctx, "invalid or incorrect target node id");
+            return REDISMODULE_OK;
+    }
+
+    RaftReq *req = RaftReqInit(ctx, RR_TIMEOUT_NOW);
+    RaftReqSubmit(rr, req);
+
+    return REDISMODULE_OK;
+}
+
+/* RAFT.TRANSFER-LEADER [node-id]
+ *   Transfers leadership to the specified node, or to the most up to date
+ *   voting node if none is specified.  Writes are refused until the transfer
+ *   completes, which takes no longer than an election timeout.
+ * Reply:
+ *   -NOCLUSTER ||
+ *   -LOADING ||
+ *   -MOVED <addr> ||
+ *   -ERR error description ||
+ *   +OK
+ */
+
+static int cmdRaftTransferLeader(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc > 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
+    int node_id = RAFT_NODE_ID_NONE;
+    if (argc == 2 && (RedisModuleStringToInt(argv[1], &node_id) == REDISMODULE_ERR ||
+                      node_id <= 0)) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid node id");
+        return REDISMODULE_OK;
+    }
+
+    RaftReq *req = RaftReqInit(ctx, RR_TRANSFER_LEADER);
+    req->r.transfer_leader.node_id = node_id;
+    RaftReqSubmit(&redis_raft, req);
+
+    return REDISMODULE_OK;
+}
+
 /* RAFT [Redis command to execute]
  *   Submit a Redis command to be appended to the Raft log and applied.
  *   The command blocks until it has been committed to the log by the majority
@@ -234,42 +311,138 @@ static int cmdRaft(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
  * Reply:
  *   -MOVED <addr> ||
  *   Any standard Redis reply
+ *
+ * RAFT.ENTRY [Serialized Entry] [Serialized Entry] ...
+ *   Receive a batch of proxied requests, each a serialized batch of Redis
+ *   commands, and process them together as a single Raft entry.
+ * Reply:
+ *   -MOVED <addr> ||
+ *   *<n> Standard Redis reply for each request
  */
+
 static int cmdRaftEntry(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
-    if (argc != 2) {
+    if (argc < 2) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_OK;
     }
 
     size_t data_len;
-    const char *data = RedisModule_StringPtrLen(argv[1], &data_len);
+    const char *data;
 
     RaftReq *req = RaftReqInit(ctx, RR_REDISCOMMAND);
-    if (RaftRedisCommandArrayDeserialize(&req->r.redis.cmds, data, data_len) != RR_OK) {
-        RedisModule_ReplyWithError(ctx, "ERR invalid argument");
-        RaftReqFree(req);
-    } else {
+    if (argc == 2) {
+        data = RedisModule_StringPtrLen(argv[1], &data_len);
+        if (RaftRedisCommandArrayDeserialize(&req->r.redis.cmds, data, data_len) != RR_OK) {
+            goto invalid;
+        }
+
         RaftReqSubmit(&redis_raft, req);
+        return REDISMODULE_OK;
+    }
+
+    /* A batch; concatenate the commands of all requests, leaving out MULTI
+     * so the resulting entry executes the same way everywhere.  Replies are
+     * grouped according to req->r.redis.batch.
+     */
+    req->r.redis.batch_len = argc - 1;
+    req->r.redis.batch = RedisModule_Calloc(argc - 1, sizeof(ProxyBatchItem));
+
+    for (int i = 0; i < argc - 1; i++) {
+        RaftRedisCommandArray cmds = { 0 };
+        ProxyBatchItem *item = &req->r.redis.batch[i];
+
+        data = RedisModule_StringPtrLen(argv[i + 1], &data_len);
+        if (RaftRedisCommandArrayDeserialize(&cmds, data, data_len) != RR_OK) {
+            goto invalid;
+        }
+
+        if (cmds.len > 0 && RaftRedisCommandIsMulti(cmds.commands[0])) {
+            item->multi = true;
+            RaftRedisCommandFree(cmds.commands[0]);
+            RedisModule_Free(cmds.commands[0]);
+            memmove(&cmds.commands[0], &cmds.commands[1], (cmds.len - 1) * sizeof(RaftRedisCommand *));
+            cmds.commands[--cmds.len] = NULL;
+        }
+
+        item->cmds_num = cmds.len;
+        RaftRedisCommandArrayMove(&req->r.redis.cmds, &cmds);
+        RaftRedisCommandArrayFree(&cmds);
+    }
+
+    /* Nothing to execute, only empty transactions */
+    if (!req->r.redis.cmds.len) {
+        RedisModule_ReplyWithArray(ctx, req->r.redis.batch_len);
+        for (int i = 0; i < req->r.redis.batch_len; i++) {
+            RedisModule_ReplyWithArray(ctx, 0);
+        }
+        RaftReqFree(req);
+        return REDISMODULE_OK;
     }
 
+    RaftReqSubmit(&redis_raft, req);
+    return REDISMODULE_OK;
+
+invalid:
+    RedisModule_ReplyWithError(ctx, "ERR invalid argument");
+    RaftReqFree(req);
     return REDISMODULE_OK;
 }
 
-/* RAFT.INFO
- *   Display Raft module specific info.
+/* RAFT.INFO [section]
+ *   Display Raft module specific info.  Like INFO, [section] may be a
+ *   specific section, "all" or "default"; the latency section is only
+ *   reported if requested explicitly or by "all".
  * Reply:
  *   Raw text output, formatted like INFO.
  */
 static int cmdRaftInfo(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
+    if (argc > 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
     RaftReq *req = RaftReqInit(ctx, RR_INFO);
+    if (argc == 2) {
+        size_t slen;
+        const char *str = RedisModule_StringPtrLen(argv[1], &slen);
+
+        req->r.info.section = RedisModule_Alloc(slen + 1);
+        memcpy(req->r.info.section, str, slen);
+        req->r.info.section[slen] = '\0';
+    }
     RaftReqSubmit(&redis_raft, req);
 
     return REDISMODULE_OK;
 }
 
 
+/* RAFT.READINDEX
+ *   Used by followers to serve reads locally: the leader confirms it is
+ *   still the leader and returns its commit index.  Once the follower has
+ *   applied the log up to that index, it can serve reads received before the
+ *   request was sent.
+ * Reply:
+ *   -NOCLUSTER ||
+ *   -LOADING ||
+ *   -MOVED <addr> ||
+ *   -TIMEOUT ||
+ *   :<commit_idx>
+ */
+static int cmdRaftReadIndex(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    if (argc != 1) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
+    RaftReq *req = RaftReqInit(ctx, RR_READINDEX);
+    RaftReqSubmit(&redis_raft, req);
+
+    return REDISMODULE_OK;
+}
+
 /* RAFT.AE [target_node_id] [src_node_id] [term]:[prev_log_idx]:[prev_log_term]:[leader_commit]
  *      [n_entries] [<term>:<id>:<type> <entry>]...
  *   A leader request to append entries to the Raft log (per Raft paper).
@@ -360,6 +533,63 @@ error_cleanup:
     return REDISMODULE_OK;
 }
 
+/* RAFT.AE2 [header] [<entry>]...
+ *   Same as RAFT.AE, using a compact binary encoding of the message header
+ *   and entry metadata (see serialization.c).
+ * Reply:
+ *   Same as RAFT.AE.
+ */
+
+static int cmdRaftAppendEntriesBinary(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
+{
+    RedisRaftCtx *rr = &redis_raft;
+
+    if (argc < 2) {
+        RedisModule_WrongArity(ctx);
+        return REDISMODULE_OK;
+    }
+
+    size_t blob_len;
+    const char *blob = RedisModule_StringPtrLen(argv[1], &blob_len);
+
+    RaftReq *req = RaftReqInit(ctx, RR_APPENDENTRIES);
+    msg_appendentries_t *msg = &req->r.appendentries.msg;
+    raft_node_id_t target_node_id;
+
+    if (AppendEntriesDecodeHeader(blob, blob_len, &target_node_id,
+                &req->r.appendentries.src_node_id, msg) != RR_OK) {
+        RedisModule_ReplyWithError(ctx, "invalid message");
+        goto error_cleanup;
+    }
+
+    if (target_node_id != rr->config->id) {
+        RedisModule_ReplyWithError(ctx, "invalid or incorrect target node id");
+        goto error_cleanup;
+    }
+
+    if (argc != 2 + msg->n_entries) {
+        RedisModule_WrongArity(ctx);
+        goto error_cleanup;
+    }
+
+    if (msg->n_entries > 0) {
+        msg->entries = RedisModule_Calloc(msg->n_entries, sizeof(msg_entry_t *));
+    }
+
+    for (int i = 0; i < msg->n_entries; i++) {
+        size_t data_len;
+        const char *data = RedisModule_StringPtrLen(argv[2 + i], &data_len);
+        msg->entries[i] = AppendEntriesDecodeEntry(blob, i, data, data_len);
+    }
+
+    RaftReqSubmit(rr, req);
+    return REDISMODULE_OK;
+
+error_cleanup:
+    RaftReqFree(req);
+    return REDISMODULE_OK;
+}
+
 /* RAFT.CONFIG GET [wildcard]
  *   Query Raft configuration parameters.
  *
@@ -401,13 +631,25 @@ static int cmdRaftConfig(RedisModuleCtx *ctx, RedisModuleString **argv, int argc
  *    -LEADER ||
  *    :0 (already have snapshot or newer)
  *    :1 (loaded)
+ *
+ * RAFT.LOADSNAPSHOT [target-node-id] [current-term] [snapshot-last-index]
+ *      [snapshot-size] [offset] [chunk] <LZF [chunk-length]>
+ *   Receive a chunk of the specified snapshot, and load it once all chunks
+ *   have been received.  If LZF is specified, the chunk is LZF compressed
+ *   and chunk-length is its decompressed length.
+ *
+ *  Reply:
+ *    -LEADER ||
+ *    *2
+ *    :<status> (0: already have snapshot or newer, 1: loaded, 2: chunk accepted)
+ *    :<offset> (offset to send next chunk from)
  */
 
 static int cmdRaftLoadSnapshot(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
     RedisRaftCtx *rr = &redis_raft;
 
-    if (argc != 5) {
+    if (argc != 5 && argc != 7 && argc != 9) {
         RedisModule_WrongArity(ctx);
         return REDISMODULE_OK;
     }
@@ -427,10 +669,40 @@ static int cmdRaftLoadSnapshot(RedisModuleCtx *ctx, RedisModuleString **argv, in
         return REDISMODULE_OK;
     }
 
+    long long size = 0;
+    long long offset = 0;
+    if (argc > 5 &&
+        (RedisModule_StringToLongLong(argv[4], &size) != REDISMODULE_OK ||
+         RedisModule_StringToLongLong(argv[5], &offset) != REDISMODULE_OK ||
+         size <= 0 || offset < 0 || offset >= size)) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid numeric values");
+        return REDISMODULE_OK;
+    }
+
+    long long raw_len = 0;
+    if (argc == 9) {
+        size_t enc_len;
+        const char *enc = RedisModule_StringPtrLen(argv[7], &enc_len);
+        if (enc_len != 3 || strncasecmp(enc, "LZF", 3)) {
+            RedisModule_ReplyWithError(ctx, "ERR unsupported snapshot encoding");
+            return REDISMODULE_OK;
+        }
+
+        if (RedisModule_StringToLongLong(argv[8], &raw_len) != REDISMODULE_OK ||
+            raw_len <= 0 || raw_len > size - offset) {
+            RedisModule_ReplyWithError(ctx, "ERR invalid numeric values");
+            return REDISMODULE_OK;
+        }
+    }
+
     RaftReq *req = RaftReqInit(ctx, RR_LOADSNAPSHOT);
-    req->r.loadsnapshot.snapshot = argv[4];
+    req->r.loadsnapshot.snapshot = argv[argc == 5 ? 4 : 6];
     req->r.loadsnapshot.idx = idx;
     req->r.loadsnapshot.term = term;
+    req->r.loadsnapshot.chunked = (argc > 5);
+    req->r.loadsnapshot.size = size;
+    req->r.loadsnapshot.offset = offset;
+    req->r.loadsnapshot.raw_len = raw_len;
     RedisModule_RetainString(ctx, req->r.loadsnapshot.snapshot);
 
     RaftReqSubmit(&redis_raft, req);
@@ -443,8 +715,8 @@ static int cmdRaftLoadSnapshot(RedisModuleCtx *ctx, RedisModuleString **argv, in
  * Reply:
  *   +OK [dbid]
  *
- * RAFT.CLUSTER JOIN [addr:port]
- *   Join an existing cluster.
+ * RAFT.CLUSTER JOIN [LEARNER] [addr:port]
+ *   Join an existing cluster, as a learner if LEARNER is specified.
  *   The operation is asynchronous and may take place/retry in the background.
  * Reply:
  *   +OK
@@ -474,10 +746,20 @@ static int cmdRaftCluster(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
             return REDISMODULE_OK;
         }
 
-        int i;
+        int i = 2;
+        bool learner = false;
+        if (!strcasecmp(RedisModule_StringPtrLen(argv[i], NULL), "LEARNER")) {
+            learner = true;
+            if (++i == argc) {
+                RedisModule_WrongArity(ctx);
+                return REDISMODULE_OK;
+            }
+        }
+
         req = RaftReqInit(ctx, RR_CLUSTER_JOIN);
+        req->r.cluster_join.learner = learner;
 
-        for (i = 2; i < argc; i++) {
+        for (; i < argc; i++) {
             NodeAddr addr;
             if (getNodeAddrFromArg(ctx, argv[i], &addr) == RR_ERROR) {
                 /* Error already produced */
@@ -510,6 +792,30 @@ static int cmdRaftCluster(RedisModuleCtx *ctx, RedisModuleString **argv, int arg
  * Reply:
  *   +OK
  *   -ERR error description
+ *
+ * RAFT.SHARDGROUP SETSLOT [slot] MIGRATING|IMPORTING|NODE [node-id]
+ * RAFT.SHARDGROUP SETSLOT [slot] STABLE
+ *   Changes the migration state or the owner of a hash slot; node-id
+ *   identifies the shardgroup keys are migrated to, from, or that owns the
+ *   slot.
+ * Reply:
+ *   +OK
+ *   -ERR error description
+ *
+ * RAFT.SHARDGROUP MIGRATE [slot] [count]
+ *   Migrates up to [count] keys (default 100) of a migrating slot to the
+ *   target shardgroup.
+ * Reply:
+ *   *2
+ *   :[number of keys migrated]
+ *   :[1 if all keys of the slot were migrated, otherwise 0]
+ *   -TRYAGAIN if still applying previous writes
+ *
+ * RAFT.SHARDGROUP IMPORT [slot] [key] [ttl] [serialized-value] [key ...]
+ *   Restores keys of an importing slot, as dumped by MIGRATE.
+ * Reply:
+ *   *[number of keys]
+ *   +OK
  */
 
 static int cmdRaftShardGroup(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
@@ -560,10 +866,133 @@ static int cmdRaftShardGroup(RedisModuleCtx *ctx, RedisModuleString **argv, int
             return REDISMODULE_OK;
         }
 
+        RaftReqSubmit(&redis_raft, req);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp(cmd, "SETSLOT", cmd_len)) {
+        if (argc != 4 && argc != 5) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_OK;
+        }
+
+        long long slot;
+        if (RedisModule_StringToLongLong(argv[2], &slot) != REDISMODULE_OK ||
+            !HashSlotValid(slot)) {
+            RedisModule_ReplyWithError(ctx, "ERR invalid slot");
+            return REDISMODULE_OK;
+        }
+
+        size_t len;
+        const char *str = RedisModule_StringPtrLen(argv[3], &len);
+        enum SlotConfigAction action;
+
+        if (!strncasecmp(str, "MIGRATING", len)) {
+            action = SLOT_CONFIG_MIGRATING;
+        } else if (!strncasecmp(str, "IMPORTING", len)) {
+            action = SLOT_CONFIG_IMPORTING;
+        } else if (!strncasecmp(str, "NODE", len)) {
+            action = SLOT_CONFIG_NODE;
+        } else if (!strncasecmp(str, "STABLE", len)) {
+            action = SLOT_CONFIG_STABLE;
+        } else {
+            RedisModule_ReplyWithError(ctx, "ERR invalid SETSLOT action");
+            return REDISMODULE_OK;
+        }
+
+        if ((action == SLOT_CONFIG_STABLE) != (argc == 4)) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_OK;
+        }
+
+        req = RaftReqInit(ctx, RR_SHARDGROUP_SETSLOT);
+        req->r.shardgroup_setslot.cfg.slot = slot;
+        req->r.shardgroup_setslot.cfg.action = action;
+        if (argc == 5) {
+            str = RedisModule_StringPtrLen(argv[4], &len);
+            if (len != RAFT_SHARDGROUP_NODEID_LEN) {
+                RedisModule_ReplyWithError(ctx, "ERR invalid node id length");
+                RaftReqFree(req);
+                return REDISMODULE_OK;
+            }
+            memcpy(req->r.shardgroup_setslot.node_id, str, len);
+            req->r.shardgroup_setslot.node_id[len] = '\0';
+        }
+
+        RaftReqSubmit(&redis_raft, req);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp(cmd, "MIGRATE", cmd_len)) {
+        if (argc != 3 && argc != 4) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_OK;
+        }
+
+        long long slot;
+        long long count = 100;
+        if (RedisModule_StringToLongLong(argv[2], &slot) != REDISMODULE_OK ||
+            !HashSlotValid(slot)) {
+            RedisModule_ReplyWithError(ctx, "ERR invalid slot");
+            return REDISMODULE_OK;
+        }
+        if (argc == 4 && (RedisModule_StringToLongLong(argv[3], &count) != REDISMODULE_OK ||
+                          count < 1 || count > INT_MAX)) {
+            RedisModule_ReplyWithError(ctx, "ERR invalid count");
+            return REDISMODULE_OK;
+        }
+
+        req = RaftReqInit(ctx, RR_SHARDGROUP_MIGRATE);
+        req->r.shardgroup_migrate.slot = slot;
+        req->r.shardgroup_migrate.count = count;
+
+        RaftReqSubmit(&redis_raft, req);
+        return REDISMODULE_OK;
+    } else if (!strncasecmp(cmd, "IMPORT", cmd_len)) {
+        if (argc < 6 || (argc - 3) % 3) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_OK;
+        }
+
+        long long slot;
+        if (RedisModule_StringToLongLong(argv[2], &slot) != REDISMODULE_OK ||
+            !HashSlotValid(slot)) {
+            RedisModule_ReplyWithError(ctx, "ERR invalid slot");
+            return REDISMODULE_OK;
+        }
+
+        for (int i = 3; i < argc; i += 3) {
+            size_t len;
+            const char *key = RedisModule_StringPtrLen(argv[i], &len);
+            if (keyHashSlot(key, len) != slot) {
+                RedisModule_ReplyWithError(ctx, "ERR key does not hash to slot");
+                return REDISMODULE_OK;
+            }
+        }
+
+        /* Keys are restored in a MULTI transaction, as a command that may
+         * access the importing slot (see handleClustering).
+         */
+        req = RaftReqInit(ctx, RR_REDISCOMMAND);
+        req->r.redis.asking = true;
+
+        RaftRedisCommand *multi = RaftRedisCommandArrayExtend(&req->r.redis.cmds);
+        multi->argc = 1;
+        multi->argv = RedisModule_Alloc(sizeof(RedisModuleString *));
+        multi->argv[0] = RedisModule_CreateString(NULL, "MULTI", 5);
+
+        for (int i = 3; i < argc; i += 3) {
+            RaftRedisCommand *restore = RaftRedisCommandArrayExtend(&req->r.redis.cmds);
+            restore->argc = 5;
+            restore->argv = RedisModule_Alloc(5 * sizeof(RedisModuleString *));
+            restore->argv[0] = RedisModule_CreateString(NULL, "RESTORE", 7);
+            for (int j = 0; j < 3; j++) {
+                restore->argv[j + 1] = argv[i + j];
+                RedisModule_RetainString(req->ctx, argv[i + j]);
+            }
+            restore->argv[4] = RedisModule_CreateString(NULL, "REPLACE", 7);
+        }
+
         RaftReqSubmit(&redis_raft, req);
         return REDISMODULE_OK;
     } else {
-        RedisModule_ReplyWithError(ctx, "RAFT.SHARDGROUP supports GET / ADD / LINK only");
+        RedisModule_ReplyWithError(ctx, "RAFT.SHARDGROUP supports GET / ADD / LINK / SETSLOT / MIGRATE / IMPORT only");
         return REDISMODULE_OK;
     }
 }
@@ -575,6 +1004,11 @@ static int cmdRaftShardGroup(RedisModuleCtx *ctx, RedisModuleString **argv, int
  *   the background rewrite child process.
  * Reply:
  *   +OK
+ *
+ * RAFT.DEBUG RESET_LATENCY
+ *   Reset the latency stats reported by RAFT.INFO latency.
+ * Reply:
+ *   +OK
  */
 static int cmdRaftDebug(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
 {
@@ -638,6 +1072,14 @@ static int cmdRaftDebug(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
         RaftReq *req = RaftDebugReqInit(ctx, RR_DEBUG_SENDSNAPSHOT);
         req->r.debug.d.sendsnapshot.id = node_id;
         RaftReqSubmit(&redis_raft, req);
+    } else if (!strncasecmp(cmd, "reset_latency", cmdlen)) {
+        if (argc != 2) {
+            RedisModule_WrongArity(ctx);
+            return REDISMODULE_OK;
+        }
+
+        RaftReq *req = RaftDebugReqInit(ctx, RR_DEBUG_RESETLATENCY);
+        RaftReqSubmit(&redis_raft, req);
     } else if (!strncasecmp(cmd, "used_node_ids", cmdlen)) {
         RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
 
@@ -711,6 +1153,26 @@ static int registerRaftCommands(RedisModuleCtx *ctx)
         return REDISMODULE_ERR;
     }
 
+    if (RedisModule_CreateCommand(ctx, "raft.ae2",
+                cmdRaftAppendEntriesBinary, "write", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "raft.readindex",
+                cmdRaftReadIndex, "admin", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "raft.timeoutnow",
+                cmdRaftTimeoutNow, "admin", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_CreateCommand(ctx, "raft.transfer-leader",
+                cmdRaftTransferLeader, "admin", 0, 0, 0) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
     if (RedisModule_CreateCommand(ctx, "raft.requestvote",
                 cmdRaftRequestVote, "admin", 0, 0, 0) == REDISMODULE_ERR) {
         return REDISMODULE_ERR;
@@ -29,6 +29,9 @@
 
 #define UNUSED(x)   ((void) x)
 
+/* TODO -- move this to Raft library header file */
+void raft_node_set_next_idx(raft_node_t* me_, raft_index_t nextIdx);
+
 /* --------------- Forward declarations -------------- */
 
 struct RaftReq;
@@ -42,7 +45,7 @@ struct ShardGroup;
 /* --------------- RedisModule_Log levels used -------------- */
 
 #define REDIS_RAFT_DATATYPE_NAME     "redisraft"
-#define REDIS_RAFT_DATATYPE_ENCVER   1
+#define REDIS_RAFT_DATATYPE_ENCVER   3
 
 /* --------------- RedisModule_Log levels used -------------- */
 
@@ -161,6 +164,7 @@ typedef struct Connection {
     long long last_connected_time;      /* Last connection time */
     unsigned long int connect_oks;      /* Successful connects */
     unsigned long int connect_errors;   /* Connection errors since last connection */
+    unsigned long long bytes_sent;      /* Argument bytes sent by ConnSendCommandArgv() */
     void *privdata;                     /* User provided pointer */
 
     /* Connect callback is guaranteed after ConnConnect(); Callback should check
@@ -201,6 +205,7 @@ typedef enum RedisRaftState {
 typedef struct SnapshotCfgEntry {
     raft_node_id_t  id;
     int             voting;
+    int             learner;
     NodeAddr        addr;
     struct SnapshotCfgEntry *next;
 } SnapshotCfgEntry;
@@ -231,6 +236,33 @@ typedef struct RaftSnapshotInfo {
     NodeIdEntry *used_node_ids;  /* All node ids that are, or have ever been, part of this cluster */
 } RaftSnapshotInfo;
 
+/* Latency histogram, see util.c */
+#define LATENCY_HIST_SUB_BITS       5
+#define LATENCY_HIST_SUB_BUCKETS    (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS       40      /* Larger values are counted as the max. bucket */
+#define LATENCY_HIST_BUCKETS        ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_BUCKETS)
+
+typedef struct LatencyHistogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
+/* Latency stats, reported in usec by RAFT.INFO latency.  The write path
+ * stages are timed using the timestamps of RaftReq.
+ */
+enum LatencyStat {
+    LATENCY_QUEUE,          /* Waiting in rqueue, from RaftReqInit() to dequeue */
+    LATENCY_APPEND,         /* Serialization and log write, to append */
+    LATENCY_COMMIT,         /* Log sync, replication and commit, to apply */
+    LATENCY_APPLY,          /* Execution under the Redis lock */
+    LATENCY_REPLY,          /* Until the client is unblocked with its reply */
+    LATENCY_TOTAL,          /* From RaftReqInit() to reply */
+    LATENCY_LOG_SYNC,       /* Log syncs */
+    LATENCY_AE_RTT,         /* AppendEntries round trips */
+    LATENCY_STATS_NUM
+};
+
 /* Global Raft context */
 typedef struct RedisRaftCtx {
     void *raft;                 /* Raft library context */
@@ -242,8 +274,24 @@ typedef struct RedisRaftCtx {
     uv_async_t rqueue_sig;      /* A signal we have something on rqueue */
     uv_timer_t raft_periodic_timer;     /* Invoke Raft periodic func */
     uv_timer_t node_reconnect_timer;    /* Handle connection issues */
+    uv_timer_t log_sync_timer;          /* Deferred Raft log sync (group commit) */
+    uv_async_t log_sync_done_sig;       /* Log sync thread is done syncing */
     uv_mutex_t rqueue_mutex;    /* Mutex protecting rqueue access */
     STAILQ_HEAD(rqueue, RaftReq) rqueue;     /* Requests queue (Redis thread -> Raft thread) */
+    bool rqueue_signaled;       /* rqueue_sig sent and rqueue not drained yet */
+    unsigned long rqueue_len;   /* Requests in rqueue, see max-queued-requests */
+    bool apply_locked;          /* Redis GIL is held while applying a batch of entries */
+    struct rqueue applied_reqs; /* Requests applied in the current batch, to free after unlocking */
+    struct rqueue proxy_batch;  /* Requests to proxy to the leader in a single batch */
+    struct rqueue coalesced_writes; /* Writes to append in a single entry */
+    int coalesced_writes_len;   /* Number of requests in coalesced_writes */
+    int proxy_batch_len;        /* Number of requests in proxy_batch */
+    struct Node *proxy_batch_node;  /* Leader node proxy_batch is sent to */
+    struct rqueue read_index_batch; /* Follower reads waiting to request a read index */
+    struct Node *read_index_node;   /* Leader node read_index_batch is sent to */
+    struct rqueue follower_reads;   /* Follower reads waiting for their read index to be applied */
+    struct rqueue unsynced_appendentries;   /* AppendEntries not acknowledged until synced */
+    STAILQ_HEAD(unsynced_ae_responses, UnsyncedAEResponse) unsynced_ae_responses; /* AppendEntries responses not handled until synced */
     struct RaftLog *log;        /* Raft persistent log; May be NULL if not used */
     struct EntryCache *logcache;
     struct RedisRaftConfig *config;     /* User provided configuration */
@@ -251,18 +299,53 @@ typedef struct RedisRaftCtx {
     raft_index_t last_snapshot_idx;
     raft_term_t last_snapshot_term;
     struct RaftReq *debug_req;    /* Current RAFT.DEBUG request context, if processing one */
+    struct RaftReq *transfer_req; /* Current RAFT.TRANSFER-LEADER request, if processing one */
+    uint64_t transfer_end_time;   /* Time (uv_hrtime) the last leadership transfer ended */
+    long long last_leader_balance;  /* Last time leader balancing was checked, see leader-balance-interval */
+    bool learner;               /* This node is a learner, see Node.learner */
+    raft_index_t leader_commit_idx; /* Leader's commit index, as of the last AppendEntries received */
+    long long last_leader_contact;  /* Last time AppendEntries was accepted from the leader */
     bool callbacks_set;         /* TODO: Needed? */
     int snapshot_child_fd;      /* Pipe connected to snapshot child process */
     RaftSnapshotInfo snapshot_info; /* Current snapshot info */
+    /* Snapshot being received in chunks */
+    int incoming_snapshot_fd;               /* Temporary file, or -1 if none */
+    raft_term_t incoming_snapshot_term;     /* Leader term the transfer began with */
+    raft_index_t incoming_snapshot_idx;     /* Snapshot last included index */
+    size_t incoming_snapshot_size;          /* Total snapshot size */
+    size_t incoming_snapshot_offset;        /* Bytes received so far */
     RedisModuleCommandFilter *registered_filter;
     struct ShardingInfo *sharding_info; /* Information about sharding, when cluster mode is enabled */
     /* General stats */
     unsigned long client_attached_entries;      /* Number of log entries attached to user connections */
+    unsigned long long client_attached_bytes;   /* Size of the log entries attached to user connections */
     unsigned long long proxy_reqs;              /* Number of proxied requests */
     unsigned long long proxy_failed_reqs;       /* Number of failed proxy requests, i.e. did not send */
     unsigned long long proxy_failed_responses;  /* Number of failed proxy responses, i.e. did not complete */
     unsigned long proxy_outstanding_reqs;       /* Number of proxied requests pending */
+    unsigned long long proxy_batches;           /* Number of batches of proxied requests sent */
+    unsigned long long coalesced_entries;       /* Number of log entries holding coalesced writes */
+    unsigned long long coalesced_reqs;          /* Number of writes coalesced into them */
+    unsigned long long lease_read_hits;         /* Reads served under the leader lease */
+    unsigned long long lease_read_misses;       /* Reads queued because the lease has lapsed */
+    unsigned long long follower_reads_served;   /* Reads served locally by a follower */
+    unsigned long long read_index_reqs;         /* Number of RAFT.READINDEX requests sent */
+    unsigned long long learner_reads_served;    /* Reads served locally by a learner */
+    unsigned long long learner_reads_stale;     /* Learner reads not served locally, exceeding the lag bounds */
+    unsigned long long rejected_queued_reqs;    /* Writes rejected by max-queued-requests, protected by rqueue_mutex */
+    unsigned long long rejected_uncommitted_reqs;   /* Writes rejected by max-uncommitted-entries/bytes */
+    unsigned long long rejected_proxy_reqs;     /* Writes rejected by max-proxied-requests */
     unsigned long snapshots_loaded;             /* Number of snapshots loaded */
+    unsigned long long snapshot_bytes_sent;     /* Snapshot bytes sent on the wire */
+    unsigned long long snapshot_raw_bytes_sent; /* Snapshot bytes sent, before compression */
+    unsigned long long snapshot_bytes_received; /* Snapshot bytes received from the wire */
+    unsigned long long snapshot_raw_bytes_received; /* Snapshot bytes received, after decompression */
+    unsigned long snapshots_delivered;          /* Number of snapshots delivered to other nodes */
+    uint64_t last_snapshot_delivery_time;       /* Duration of last snapshot delivery (msec) */
+    unsigned long long log_fsyncs;              /* Number of log syncs that made new entries durable */
+    unsigned long long log_fsync_entries;       /* Number of entries made durable by log syncs */
+    unsigned long log_fsync_max_entries;        /* Most entries made durable by a single log sync */
+    LatencyHistogram latency[LATENCY_STATS_NUM];    /* Latency stats, see enum LatencyStat */
 } RedisRaftCtx;
 
 extern RedisRaftCtx redis_raft;
@@ -276,13 +359,34 @@ extern raft_log_impl_t RaftLogImpl;
 #define REDIS_RAFT_DEFAULT_RECONNECT_INTERVAL       100
 #define REDIS_RAFT_DEFAULT_PROXY_RESPONSE_TIMEOUT   10000
 #define REDIS_RAFT_DEFAULT_RAFT_RESPONSE_TIMEOUT    1000
+#define REDIS_RAFT_DEFAULT_APPEND_ENTRIES_WINDOW    1
+#define REDIS_RAFT_DEFAULT_APPEND_ENTRIES_MAX_BYTES 1024*1024
+#define REDIS_RAFT_DEFAULT_SNAPSHOT_CHUNK_SIZE      1024*1024
+#define REDIS_RAFT_DEFAULT_SNAPSHOT_COMPRESSION     true
+#define REDIS_RAFT_DEFAULT_BULK_CONNECTION          true
 #define REDIS_RAFT_DEFAULT_LOG_MAX_CACHE_SIZE       8*1000*1000
 #define REDIS_RAFT_DEFAULT_LOG_MAX_FILE_SIZE        64*1000*1000
+#define REDIS_RAFT_DEFAULT_LOG_SEGMENT_SIZE         8*1000*1000
+#define REDIS_RAFT_DEFAULT_LOG_GROUP_COMMIT_MAX_ENTRIES 0
+#define REDIS_RAFT_DEFAULT_LOG_GROUP_COMMIT_MAX_DELAY   0
+#define REDIS_RAFT_DEFAULT_LOG_SYNC_THREAD          true
+#define REDIS_RAFT_DEFAULT_APPLY_BATCH_MAX_ENTRIES  1000
+#define REDIS_RAFT_DEFAULT_APPLY_BATCH_MAX_USEC     5000
+#define REDIS_RAFT_DEFAULT_FOLLOWER_PROXY_BATCH_SIZE    64
+#define REDIS_RAFT_DEFAULT_WRITE_COALESCE_MAX_REQUESTS  1
+#define REDIS_RAFT_DEFAULT_LEASE_DRIFT_MARGIN       100
+#define REDIS_RAFT_DEFAULT_LEARNER_MAX_LAG          1000
+#define REDIS_RAFT_DEFAULT_LEARNER_MAX_LAG_MSEC     1000
+#define REDIS_RAFT_DEFAULT_MAX_QUEUED_REQUESTS      0
+#define REDIS_RAFT_DEFAULT_MAX_UNCOMMITTED_ENTRIES  0
+#define REDIS_RAFT_DEFAULT_MAX_UNCOMMITTED_BYTES    0
+#define REDIS_RAFT_DEFAULT_MAX_PROXIED_REQUESTS     0
 
 #define REDIS_RAFT_HASH_SLOTS                       16384
 #define REDIS_RAFT_HASH_MIN_SLOT                    0
 #define REDIS_RAFT_HASH_MAX_SLOT                    16383
 #define REDIS_RAFT_DEFAULT_SHARDGROUP_UPDATE_INTERVAL 5000
+#define REDIS_RAFT_DEFAULT_LEADER_BALANCE_INTERVAL  0
 
 static inline bool HashSlotValid(int slot)
 {
@@ -301,7 +405,13 @@ typedef struct RedisRaftConfig {
     char *rdb_filename;         /* Original Redis dbfilename */
     char *raft_log_filename;    /* Raft log file name, derived from dbfilename */
     bool follower_proxy;        /* Do follower nodes proxy requests to leader? */
+    int follower_proxy_batch_size;  /* Max. number of proxied requests sent in a batch */
+    bool follower_reads;        /* Do follower nodes serve reads using ReadIndex? */
     bool quorum_reads;          /* Reads have to go through quorum */
+    bool lease_reads;           /* Leader may serve quorum reads under a lease */
+    int lease_drift_margin;     /* Milliseconds lease is shorter than election timeout */
+    int learner_max_lag;        /* Max. entries a learner may lag behind and serve reads; 0 for no limit */
+    int learner_max_lag_msec;   /* Max. milliseconds since a learner heard from the leader to serve reads; 0 for no limit */
     bool raftize_all_commands;  /* Automatically pass all commands through Raft? */
     /* Tuning */
     int raft_interval;
@@ -310,29 +420,62 @@ typedef struct RedisRaftConfig {
     int reconnect_interval;
     int proxy_response_timeout;
     int raft_response_timeout;
+    int append_entries_window;  /* Max. AppendEntries with entries in flight per node */
+    unsigned long append_entries_max_bytes; /* Max. size of entries sent in an AppendEntries; 0 for no limit */
     /* Cache and file compaction */
     unsigned long raft_log_max_cache_size;
     unsigned long raft_log_max_file_size;
+    unsigned long raft_log_segment_size;    /* Size at which a new log segment is started */
     bool raft_log_fsync;
+    unsigned long snapshot_chunk_size;  /* Max. size of a snapshot chunk sent to a node */
+    bool snapshot_compression;          /* Compress snapshot chunks sent to nodes */
+    bool bulk_connection;               /* Deliver snapshots on a separate connection */
+    /* Group commit */
+    int raft_log_group_commit_max_entries;  /* Entries to write before forcing a sync; 0 for no limit */
+    int raft_log_group_commit_max_delay;    /* Milliseconds a sync may be deferred; 0 to sync right away */
+    bool raft_log_sync_thread;              /* Sync the log on a separate thread */
+    /* Batched apply */
+    int apply_batch_max_entries;        /* Entries to apply per Redis lock; 0 for no limit */
+    int apply_batch_max_usec;           /* Microseconds to hold Redis lock when applying; 0 for no limit */
+    /* Write coalescing */
+    int write_coalesce_max_requests;    /* Writes to append as a single entry; 1 to disable */
+    /* Admission control; 0 for no limit */
+    int max_queued_requests;            /* Requests waiting for the Raft thread before writes are rejected */
+    int max_uncommitted_entries;        /* Uncommitted log entries before writes are rejected */
+    unsigned long max_uncommitted_bytes;    /* Size of entries awaiting commit before writes are rejected */
+    int max_proxied_requests;           /* Outstanding proxied requests before writes are rejected */
     /* Cluster mode */
     bool cluster_mode;                  /* Are we running in a cluster compatible mode? */
     int cluster_start_hslot;            /* First cluster hash slot */
     int cluster_end_hslot;              /* Last cluster hash slot */
     int shardgroup_update_interval;     /* Milliseconds between shardgroup updates */
+    int leader_balance_interval;        /* Milliseconds between leader balancing checks; 0 to disable */
 } RedisRaftConfig;
 
 typedef struct PendingResponse {
     bool proxy;
     int id;
     long long request_time;
+    uint64_t send_time;         /* uv_hrtime() of request, monotonic */
     STAILQ_ENTRY(PendingResponse) entries;
 } PendingResponse;
 
 /* Maintains all state about peer nodes */
+/* RAFT.AE2 binary encoding, see serialization.c */
+#define RAFT_AE2_HEADER_SIZE    56
+#define RAFT_AE2_ENTRY_SIZE     16
+#define RAFT_AE2_BLOB_SIZE(n)   (RAFT_AE2_HEADER_SIZE + (size_t) (n) * RAFT_AE2_ENTRY_SIZE)
+
+/* RAFT.LOADSNAPSHOT chunk reply status */
+#define SNAPSHOT_SKIPPED            0   /* Not needed, node already has it or newer */
+#define SNAPSHOT_LOADED             1   /* Last chunk received, snapshot loaded */
+#define SNAPSHOT_CHUNK_ACCEPTED     2   /* Continue from the returned offset */
+
 typedef struct Node {
     raft_node_id_t id;              /* Raft unique node ID */
     RedisRaftCtx *rr;               /* RedisRaftCtx handle */
     Connection *conn;               /* Connection to node */
+    Connection *bulk_conn;          /* Connection for bulk transfers (snapshots), or NULL */
     NodeAddr addr;                  /* Node's address */
     bool load_snapshot_in_progress; /* Are we currently pushing a snapshot? */
     raft_index_t load_snapshot_idx; /* Index of snapshot we're pushing */
@@ -340,12 +483,29 @@ typedef struct Node {
     uv_fs_t uv_snapshot_req;        /* libuv handle managing snapshot loading from disk */
     uv_file uv_snapshot_file;       /* libuv handle for snapshot file */
     size_t snapshot_size;           /* Size of snapshot we're pushing */
-    char *snapshot_buf;             /* Snapshot buffer; TODO: Currently we buffer the entire RDB
-                                     * because hiredis will not stream it for us. */
+    size_t snapshot_offset;         /* Offset acknowledged by node; where we resume from */
+    char *snapshot_buf;             /* Buffer holding the chunk being sent */
+    size_t snapshot_buf_size;       /* Size of snapshot_buf */
     uv_buf_t uv_snapshot_buf;       /* libuv wrapper for snapshot_buf */
+    Connection *snapshot_conn;      /* Connection used for the snapshot we're pushing */
+    char *snapshot_zbuf;            /* Buffer holding the compressed chunk */
+    uint64_t snapshot_start_time;   /* When the current delivery started (uv_now) */
+    bool legacy_snapshot;           /* Node does not support compressed snapshot chunks */
+    bool legacy_snapshot_chunks;    /* Node does not support snapshot chunks */
+    bool legacy_proxy;              /* Node does not support batched RAFT.ENTRY */
+    bool legacy_readindex;          /* Node does not support RAFT.READINDEX */
+    bool learner;                   /* Non-voting node that is never promoted */
     long pending_raft_response_num;     /* Number of pending Raft responses */
     long pending_proxy_response_num;    /* Number of pending proxy responses */
+    long pending_bulk_response_num;     /* Number of pending responses on bulk_conn */
+    bool legacy_ae;                 /* Node does not support RAFT.AE2 */
+    long ae_inflight;               /* AppendEntries sent and awaiting a response (pipelining) */
+    raft_index_t ae_sent_idx;       /* Last entry index sent to the node (pipelining) */
+    raft_term_t ae_sent_term;       /* Term of entry at ae_sent_idx */
+    uint64_t lease_ack_time;        /* Send time (uv_hrtime) of last AppendEntries acknowledged in lease_ack_term */
+    raft_term_t lease_ack_term;     /* Term of lease_ack_time */
     STAILQ_HEAD(pending_responses, PendingResponse) pending_responses;
+    STAILQ_HEAD(pending_bulk_responses, PendingResponse) pending_bulk_responses;
     LIST_ENTRY(Node) entries;
 } Node;
 
@@ -375,7 +535,12 @@ enum RaftReqType {
     RR_CLIENT_DISCONNECT,
     RR_SHARDGROUP_ADD,
     RR_SHARDGROUP_GET,
-    RR_SHARDGROUP_LINK
+    RR_SHARDGROUP_LINK,
+    RR_READINDEX,
+    RR_SHARDGROUP_SETSLOT,
+    RR_SHARDGROUP_MIGRATE,
+    RR_TRANSFER_LEADER,
+    RR_TIMEOUT_NOW
 };
 
 extern const char *RaftReqTypeStr[];
@@ -383,6 +548,7 @@ extern const char *RaftReqTypeStr[];
 typedef struct {
     raft_node_id_t id;
     NodeAddr addr;
+    int learner;        /* Added as a learner; entries written by older versions end before this field */
 } RaftCfgChange;
 
 typedef struct {
@@ -396,6 +562,50 @@ typedef struct {
     RaftRedisCommand **commands;
 } RaftRedisCommandArray;
 
+/* A view of a serialized command argument; not null terminated */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} RaftRedisArgView;
+
+typedef struct {
+    int argc;
+    RaftRedisArgView *argv;
+} RaftRedisCommandView;
+
+/* A view of a serialized RaftRedisCommandArray, see serialization.c */
+typedef struct {
+    int len;                            /* Number of commands */
+    RaftRedisCommandView *commands;     /* Commands and arguments, in one allocation */
+} RaftRedisCommandArrayView;
+
+/* Command descriptor flags */
+#define CMD_SPEC_READONLY       (1<<0)  /* Command does not modify the dataset */
+#define CMD_SPEC_MOVABLE_KEYS   (1<<1)  /* Key positions depend on arguments */
+#define CMD_SPEC_MULTI          (1<<2)  /* Intercepted: MULTI */
+#define CMD_SPEC_EXEC           (1<<3)  /* Intercepted: EXEC */
+#define CMD_SPEC_DISCARD        (1<<4)  /* Intercepted: DISCARD */
+#define CMD_SPEC_CLUSTER        (1<<5)  /* Intercepted: CLUSTER */
+#define CMD_SPEC_ASKING         (1<<6)  /* Intercepted: ASKING */
+
+/* Describes a Redis command, see commands.c */
+typedef struct CommandSpec {
+    const char *name;   /* Lowercase command name */
+    int flags;          /* CMD_SPEC_* flags */
+    int first_key;      /* First key argument, or 0 if no keys */
+    int last_key;       /* Last key argument, negative counts from the end */
+    int key_step;       /* Step between key arguments */
+} CommandSpec;
+
+/* A request that is part of a batch of proxied requests.  The commands of all
+ * requests in a batch are stored in a single RaftRedisCommandArray, and this
+ * describes how to reply to each request.
+ */
+typedef struct ProxyBatchItem {
+    int cmds_num;       /* Number of commands of the request */
+    bool multi;         /* Is this a MULTI/EXEC transaction? */
+} ProxyBatchItem;
+
 /* Max length of a ShardGroupNode string, including newline and null terminator */
 #define SHARDGROUPNODE_MAXLEN   (RAFT_SHARDGROUP_NODEID_LEN+1 + NODEADDR_MAXLEN + 2)
 
@@ -422,6 +632,7 @@ typedef struct ShardGroup {
 
     /* Runtime state */
     unsigned int next_redir;             /* Round-robin -MOVED index */
+    bool leader_known;                   /* Is nodes[0] the leader, as of the last update? */
 
     /* Synchronization state */
     unsigned int node_conn_idx;          /* Next node to connect to, when looking for a live one */
@@ -434,6 +645,30 @@ typedef struct ShardGroup {
 
 #define RAFT_LOGTYPE_ADD_SHARDGROUP     (RAFT_LOGTYPE_NUM+1)
 #define RAFT_LOGTYPE_UPDATE_SHARDGROUP  (RAFT_LOGTYPE_NUM+2)
+#define RAFT_LOGTYPE_SLOT_CONFIG        (RAFT_LOGTYPE_NUM+3)
+
+/* Migration state of a hash slot */
+enum SlotState {
+    SLOT_STABLE = 0,
+    SLOT_MIGRATING,                     /* Owned locally, keys moving to slot_peer */
+    SLOT_IMPORTING                      /* Owned by slot_peer, keys moving here */
+};
+
+/* A slot configuration change, as requested by RAFT.SHARDGROUP SETSLOT and
+ * committed as a RAFT_LOGTYPE_SLOT_CONFIG entry.
+ */
+enum SlotConfigAction {
+    SLOT_CONFIG_STABLE = 0,             /* Clear migration state */
+    SLOT_CONFIG_MIGRATING,              /* Start migrating to shardgroup sgid */
+    SLOT_CONFIG_IMPORTING,              /* Start importing from shardgroup sgid */
+    SLOT_CONFIG_NODE                    /* Assign to shardgroup sgid, clearing migration state */
+};
+
+typedef struct SlotConfig {
+    int slot;
+    enum SlotConfigAction action;
+    unsigned int sgid;
+} SlotConfig;
 
 /* Sharding information, used when cluster_mode is enabled and multiple
  * RedisRaft clusters operate together to perform sharding.
@@ -449,15 +684,62 @@ typedef struct ShardingInfo {
      * should therefore be adjusted before refering the array.
      */
     int hash_slots_map[REDIS_RAFT_HASH_SLOTS];
+
+    /* Slot migration state: an enum SlotState for every hash slot, and the
+     * (one-based) index of the shardgroup keys are moving to or from.
+     */
+    unsigned char slot_state[REDIS_RAFT_HASH_SLOTS];
+    int slot_peer[REDIS_RAFT_HASH_SLOTS];
+
+    /* Leader only: key streaming progress of RAFT.SHARDGROUP MIGRATE */
+    int migrate_slot;                   /* Slot migrate_cursor refers to */
+    unsigned long long migrate_cursor;  /* SCAN cursor */
+    raft_index_t migrate_barrier_idx;   /* Entries that may still write to migrating slots */
+
+    /* Topology epoch, incremented whenever shardgroups, membership or
+     * leadership change.  CLUSTER SLOTS and CLUSTER NODES replies are
+     * cached until it changes.
+     */
+    unsigned long long epoch;
+    struct TopologyReply *slots_reply;
+    struct TopologyReply *nodes_reply;
 } ShardingInfo;
 
+/* An element of a cached TopologyReply */
+enum TopologyReplyElemType {
+    TOPOLOGY_REPLY_ARRAY,
+    TOPOLOGY_REPLY_INTEGER,
+    TOPOLOGY_REPLY_STRING
+};
+
+typedef struct TopologyReplyElem {
+    enum TopologyReplyElemType type;
+    long long value;                    /* Array length, integer, or string offset in buf */
+    size_t len;                         /* String length */
+} TopologyReplyElem;
+
+/* A CLUSTER SLOTS or CLUSTER NODES reply, built once per topology epoch and
+ * replayed from the flat elems array, with strings stored in buf.
+ */
+typedef struct TopologyReply {
+    unsigned long long epoch;           /* Epoch the reply was built for */
+    raft_node_id_t leader_id;           /* Local leader the reply was built for */
+    int elems_num;
+    int elems_size;
+    TopologyReplyElem *elems;
+    size_t buf_len;
+    size_t buf_size;
+    char *buf;
+} TopologyReply;
+
 /* Debug message structure, used for RAFT.DEBUG / RR_DEBUG
  * requests.
  */
 enum RaftDebugReqType {
     RR_DEBUG_COMPACT,
     RR_DEBUG_NODECFG,
-    RR_DEBUG_SENDSNAPSHOT
+    RR_DEBUG_SENDSNAPSHOT,
+    RR_DEBUG_RESETLATENCY
 };
 
 typedef struct RaftDebugReq {
@@ -481,14 +763,23 @@ typedef struct RaftReq {
     STAILQ_ENTRY(RaftReq) entries;
     RedisModuleBlockedClient *client;
     RedisModuleCtx *ctx;
+    struct {
+        uint64_t init;          /* RaftReqInit() */
+        uint64_t dequeue;       /* Taken from rqueue by the Raft thread */
+        uint64_t append;        /* Appended to the log */
+        uint64_t apply;         /* Execution started */
+        uint64_t applied;       /* Execution completed */
+    } ts;                       /* uv_hrtime() of write path stages, see enum LatencyStat */
     union {
         struct {
             NodeAddrListElement *addr;
+            bool learner;
         } cluster_join;
         RaftCfgChange cfgchange;
         struct {
             raft_node_id_t src_node_id;
             msg_appendentries_t msg;
+            msg_appendentries_response_t response;  /* Reply waiting for entries to be synced */
         } appendentries;
         struct {
             raft_node_id_t src_node_id;
@@ -498,28 +789,50 @@ typedef struct RaftReq {
             Node *proxy_node;
             int hash_slot;
             RaftRedisCommandArray cmds;
+            ProxyBatchItem *batch;      /* Batch of proxied requests, or NULL */
+            int batch_len;              /* Number of requests in batch */
+            struct RaftReq **coalesced; /* Requests coalesced into one entry, or NULL */
+            int coalesced_num;          /* Number of requests in coalesced */
+            raft_index_t read_idx;      /* Follower read: index to apply before serving */
+            bool asking;                /* May access an importing slot, see ASKING */
             msg_entry_response_t response;
         } redis;
         struct {
             raft_term_t term;
             raft_index_t idx;
             RedisModuleString *snapshot;
+            bool chunked;           /* Chunk of a snapshot, rather than whole */
+            size_t size;            /* Total snapshot size, if chunked */
+            size_t offset;          /* Chunk offset, if chunked */
+            size_t raw_len;         /* Decompressed chunk length, or 0 if uncompressed */
         } loadsnapshot;
         struct {
             unsigned long long client_id;
         } client_disconnect;
+        struct {
+            char *section;          /* Section to report, or NULL for default */
+        } info;
         struct ShardGroup shardgroup_add;
         struct {
             NodeAddr addr;
         } shardgroup_link;
+        struct {
+            SlotConfig cfg;
+            char node_id[RAFT_SHARDGROUP_NODEID_LEN+1];     /* Identifies cfg.sgid */
+        } shardgroup_setslot;
+        struct {
+            int slot;
+            int count;              /* Max. number of keys to migrate */
+        } shardgroup_migrate;
+        struct {
+            raft_node_id_t node_id;     /* Target, or RAFT_NODE_ID_NONE to pick one */
+        } transfer_leader;
         RaftDebugReq debug;
     } r;
 } RaftReq;
 
-#define RAFTLOG_VERSION     1
-
-/* Flags for RaftLogOpen */
-#define RAFTLOG_KEEP_INDEX  1                   /* Index was written by this process, safe to use. */
+#define RAFTLOG_VERSION     3
+#define RAFT_LOG_CURSORS    4
 
 typedef struct RaftLog {
     uint32_t            version;                /* Log file format version */
@@ -532,12 +845,25 @@ typedef struct RaftLog {
     raft_index_t        index;                  /* Index of last entry */
     raft_term_t         term;                   /* Last term we're aware of */
     raft_node_id_t      vote;                   /* Our vote in the last term, or -1 */
-    size_t              file_size;              /* File size at the time of last write */
+    size_t              file_size;              /* Size of entries beyond the snapshot */
+    unsigned long int   unsynced_entries;       /* Entries written since last sync */
+    raft_index_t        durable_idx;            /* Index of last entry known to be synced */
+    struct LogSyncThread *sync_thread;          /* Log sync thread, if started */
+    bool                sync_in_progress;       /* Log sync thread is syncing */
+    raft_index_t        sync_idx;               /* Index of last entry being synced */
+    uint64_t            sync_start;             /* uv_hrtime() the sync in progress started at */
+    unsigned long int   sync_entries;           /* Entries being synced */
     const char          *filename;
-    FILE                *file;
-    FILE                *idxfile;
+    size_t              segment_size;           /* Size at which a new segment is started */
+    struct RaftLogSegment **segments;           /* Segment files, by index */
+    int                 num_segments;
+    struct RaftLogCursor *cursors[RAFT_LOG_CURSORS];    /* Cursors used by logImplGetBatch() */
+    unsigned long       cursors_gen;            /* Incremented when entries are deleted or segments dropped */
+    unsigned long       cursors_clock;          /* Cursor use counter, to reuse the least recently used cursor */
 } RaftLog;
 
+typedef struct RaftLogCursor RaftLogCursor;
+
 
 #define SNAPSHOT_RESULT_MAGIC    0x70616e73  /* "snap" */
 typedef struct SnapshotResult {
@@ -583,6 +909,7 @@ RRStatus checkRaftNotLoading(RedisRaftCtx *rr, RaftReq *req);
 RRStatus checkRaftState(RedisRaftCtx *rr, RaftReq *req);
 RRStatus setRaftizeMode(RedisRaftCtx *rr, RedisModuleCtx *ctx, bool flag);
 void replyRedirect(RedisRaftCtx *rr, RaftReq *req, NodeAddr *addr);
+void replyAsk(RaftReq *req, int slot, NodeAddr *addr);
 bool parseMovedReply(const char *str, NodeAddr *addr);
 
 /* node_addr.c */
@@ -593,27 +920,39 @@ void NodeAddrListConcat(NodeAddrListElement **head, const NodeAddrListElement *o
 void NodeAddrListFree(NodeAddrListElement *head);
 
 /* join.c */
-void InitiateJoinCluster(RedisRaftCtx *rr, const NodeAddrListElement *addr);
+void InitiateJoinCluster(RedisRaftCtx *rr, const NodeAddrListElement *addr, bool learner);
 
 /* node.c */
 Node *NodeCreate(RedisRaftCtx *rr, int id, const NodeAddr *addr);
 void HandleNodeStates(RedisRaftCtx *rr);
 void NodeAddPendingResponse(Node *node, bool proxy);
-void NodeDismissPendingResponse(Node *node);
+uint64_t NodeDismissPendingResponse(Node *node);
+Connection *NodeGetBulkConn(Node *node);
+void NodeAddBulkPendingResponse(Node *node);
+void NodeDismissBulkPendingResponse(Node *node);
+void NodeResetAppendEntriesPipeline(Node *node);
 
 /* serialization.c */
 raft_entry_t *RaftRedisCommandArraySerialize(const RaftRedisCommandArray *source);
 size_t RaftRedisCommandDeserialize(RaftRedisCommand *target, const void *buf, size_t buf_size);
 RRStatus RaftRedisCommandArrayDeserialize(RaftRedisCommandArray *target, const void *buf, size_t buf_size);
+RRStatus RaftRedisCommandArrayViewDecode(RaftRedisCommandArrayView *target, const void *buf, size_t buf_size);
+void RaftRedisCommandArrayViewFree(RaftRedisCommandArrayView *view);
 void RaftRedisCommandArrayFree(RaftRedisCommandArray *array);
 void RaftRedisCommandFree(RaftRedisCommand *r);
+bool RaftRedisCommandIsMulti(const RaftRedisCommand *cmd);
 RaftRedisCommand *RaftRedisCommandArrayExtend(RaftRedisCommandArray *target);
 void RaftRedisCommandArrayMove(RaftRedisCommandArray *target, RaftRedisCommandArray *source);
+size_t AppendEntriesEncode(char *buf, raft_node_id_t target_node_id, raft_node_id_t source_node_id, msg_appendentries_t *msg);
+RRStatus AppendEntriesDecodeHeader(const char *buf, size_t buf_len, raft_node_id_t *target_node_id, raft_node_id_t *source_node_id, msg_appendentries_t *msg);
+raft_entry_t *AppendEntriesDecodeEntry(const char *buf, int i, const char *data, size_t data_len);
 
 /* raft.c */
 RRStatus RedisRaftInit(RedisModuleCtx *ctx, RedisRaftCtx *rr, RedisRaftConfig *config);
 RRStatus RedisRaftStart(RedisModuleCtx *ctx, RedisRaftCtx *rr);
 void HandleClusterJoinCompleted(RedisRaftCtx *rr);
+void EntryFailAttachedRaftReq(raft_entry_t *ety);
+void RaftFailUnsyncedAppendEntries(RedisRaftCtx *rr, raft_term_t term, raft_index_t from_idx);
 
 void RaftReqFree(RaftReq *req);
 RaftReq *RaftReqInit(RedisModuleCtx *ctx, enum RaftReqType type);
@@ -632,34 +971,44 @@ int RedisInfoIterate(const char **info_ptr, size_t *info_len, const char **key,
 char *RedisInfoGetParam(RedisRaftCtx *rr, const char *section, const char *param);
 RRStatus parseMemorySize(const char *value, unsigned long *result);
 RRStatus formatExactMemorySize(unsigned long value, char *buf, size_t buf_size);
+void LatencyHistogramRecord(LatencyHistogram *h, uint64_t value);
+uint64_t LatencyHistogramPercentile(LatencyHistogram *h, double percentile);
+void LatencyHistogramReset(LatencyHistogram *h);
 
 /* log.c */
 RaftLog *RaftLogCreate(const char *filename, const char *dbid, raft_term_t snapshot_term, raft_index_t snapshot_index, raft_term_t current_term, raft_node_id_t last_vote, RedisRaftConfig *config);
-RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config, int flags);
+RaftLog *RaftLogOpen(const char *filename, RedisRaftConfig *config);
 void RaftLogClose(RaftLog *log);
 RRStatus RaftLogAppend(RaftLog *log, raft_entry_t *entry);
+RRStatus RaftLogAppendNoSync(RaftLog *log, raft_entry_t *entry);
 RRStatus RaftLogSetVote(RaftLog *log, raft_node_id_t vote);
 RRStatus RaftLogSetTerm(RaftLog *log, raft_term_t term, raft_node_id_t vote);
-int RaftLogLoadEntries(RaftLog *log, int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg);
+int RaftLogLoadEntries(RaftLog *log, raft_index_t applied_idx, int (*callback)(void *, raft_entry_t *, raft_index_t), void *callback_arg);
 RRStatus RaftLogWriteEntry(RaftLog *log, raft_entry_t *entry);
 RRStatus RaftLogSync(RaftLog *log);
+RRStatus RaftLogSyncPending(RedisRaftCtx *rr);
+RRStatus RaftLogHandleSynced(RedisRaftCtx *rr);
 raft_entry_t *RaftLogGet(RaftLog *log, raft_index_t idx);
+RaftLogCursor *RaftLogCursorNew(RaftLog *log);
+void RaftLogCursorFree(RaftLogCursor *cursor);
+raft_entry_t *RaftLogCursorGet(RaftLogCursor *cursor, raft_index_t idx);
 RRStatus RaftLogDelete(RaftLog *log, raft_index_t from_idx, func_entry_notify_f cb, void *cb_arg);
 RRStatus RaftLogReset(RaftLog *log, raft_index_t index, raft_term_t term);
 raft_index_t RaftLogCount(RaftLog *log);
 raft_index_t RaftLogFirstIdx(RaftLog *log);
 raft_index_t RaftLogCurrentIdx(RaftLog *log);
-long long int RaftLogRewrite(RedisRaftCtx *rr, const char *filename, raft_index_t last_idx, raft_term_t last_term);
+RRStatus RaftLogCompact(RaftLog *log, raft_index_t last_idx, raft_term_t last_term);
 void RaftLogRemoveFiles(const char *filename);
 void RaftLogArchiveFiles(RedisRaftCtx *rr);
-RRStatus RaftLogRewriteSwitch(RedisRaftCtx *rr, RaftLog *new_log, unsigned long new_log_entries);
 
 typedef struct EntryCache {
     unsigned long int size;             /* Size of ptrs */
     unsigned long int len;              /* Number of entries in cache */
     unsigned long int start_idx;        /* Log index of first entry */
     unsigned long int start;            /* ptrs array index of first entry */
-    unsigned long int entries_memsize;  /* Total memory used by entries */
+    unsigned long int entries_memsize;  /* Chunk memory used by entries, including headers */
+    unsigned long int chunks_memsize;   /* Total size of chunks holding entries */
+    struct EntryCacheChunk *chunk;      /* Chunk new entries are allocated from */
     raft_entry_t **ptrs;
 } EntryCache;
 
@@ -671,6 +1020,11 @@ long EntryCacheDeleteHead(EntryCache *cache, raft_index_t idx);
 long EntryCacheDeleteTail(EntryCache *cache, raft_index_t index);
 long EntryCacheCompact(EntryCache *cache, size_t max_memory);
 
+/* commands.c */
+const CommandSpec *CommandSpecGet(const RedisModuleString *cmd);
+int CommandSpecGetFlags(const RedisModuleString *cmd);
+bool CommandSpecGetKeyRange(const CommandSpec *spec, int argc, int *first, int *last);
+
 /* config.c */
 void ConfigInit(RedisModuleCtx *ctx, RedisRaftConfig *config);
 RRStatus ConfigParseArgs(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, RedisRaftConfig *target);
@@ -696,12 +1050,14 @@ void archiveSnapshot(RedisRaftCtx *rr);
 
 /* proxy.c */
 RRStatus ProxyCommand(RedisRaftCtx *rr, RaftReq *req, Node *leader);
+void ProxyFlushBatch(RedisRaftCtx *rr);
 
 /* connection.c */
 Connection *ConnCreate(RedisRaftCtx *rr, void *privdata, ConnectionCallbackFunc idle_cb, ConnectionFreeFunc free_cb);
 RRStatus ConnConnect(Connection *conn, const NodeAddr *addr, ConnectionCallbackFunc connect_callback);
 void ConnAsyncTerminate(Connection *conn);
 void ConnMarkDisconnected(Connection *conn);
+int ConnSendCommandArgv(Connection *conn, redisCallbackFn *fn, void *privdata, int argc, const char **argv, const size_t *argvlen);
 void HandleIdleConnections(RedisRaftCtx *rr);
 void *ConnGetPrivateData(Connection *conn);
 RedisRaftCtx *ConnGetRedisRaftCtx(Connection *conn);
@@ -711,6 +1067,7 @@ bool ConnIsConnected(Connection *conn);
 const char *ConnGetStateStr(Connection *conn);
 
 /* cluster.c */
+unsigned int keyHashSlot(const char *key, int keylen);
 char *ShardGroupSerialize(ShardGroup *sg);
 RRStatus ShardGroupDeserialize(const char *buf, size_t buf_len, ShardGroup *sg);
 void ShardGroupFree(ShardGroup *sg);
@@ -723,10 +1080,16 @@ void ShardingInfoReset(RedisRaftCtx *rr);
 RRStatus ShardingInfoValidateShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg);
 RRStatus ShardingInfoAddShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg);
 RRStatus ShardingInfoUpdateShardGroup(RedisRaftCtx *rr, ShardGroup *new_sg);
+void ShardingInfoTopologyChanged(RedisRaftCtx *rr);
 void ShardingInfoRDBSave(RedisModuleIO *rdb);
-void ShardingInfoRDBLoad(RedisModuleIO *rdb);
+void ShardingInfoRDBLoad(RedisModuleIO *rdb, int encver);
 void ClusterPeriodicCall(RedisRaftCtx *rr);
 RRStatus ShardGroupAppendLogEntry(RedisRaftCtx *rr, ShardGroup *sg, int type, void *user_data);
 void handleShardGroupLink(RedisRaftCtx *rr, RaftReq *req);
+RRStatus SlotConfigParse(const char *buf, size_t buf_len, SlotConfig *cfg);
+RRStatus ShardingInfoSetSlot(RedisRaftCtx *rr, SlotConfig *cfg);
+RRStatus ShardingInfoMigratingSlotAccess(RedisRaftCtx *rr, RaftReq *req, bool readonly);
+void handleShardGroupSetSlot(RedisRaftCtx *rr, RaftReq *req);
+void handleShardGroupMigrate(RedisRaftCtx *rr, RaftReq *req);
 
 #endif  /* _REDISRAFT_H */
@@ -8,7 +8,9 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
+#include <strings.h>
 #include "redisraft.h"
 
 /* RaftRedisCommand represents a single Redis command to execute.  Every Raft log entry
@@ -65,6 +67,17 @@ void RaftRedisCommandFree(RaftRedisCommand *r)
     r->argc = 0;
 }
 
+/* Returns true if the command is MULTI, which begins a MULTI/EXEC transaction
+ * in a RaftRedisCommandArray.
+ */
+bool RaftRedisCommandIsMulti(const RaftRedisCommand *cmd)
+{
+    size_t cmd_len;
+    const char *cmd_str = RedisModule_StringPtrLen(cmd->argv[0], &cmd_len);
+
+    return cmd_len == 5 && !strncasecmp(cmd_str, "MULTI", 5);
+}
+
 void RaftRedisCommandArrayFree(RaftRedisCommandArray *array)
 {
     int i;
@@ -89,22 +102,27 @@ void RaftRedisCommandArrayFree(RaftRedisCommandArray *array)
 }
 
 
-/* Return expected length of integer value as decimal digits + 2 byte overhead */
+/* Return number of decimal digits of val */
+static int calcDigits(size_t val)
+{
+    int n = 1;
+
+    while (val >= 10) {
+        val /= 10;
+        n++;
+    }
+    return n;
+}
+
+/* Return length of integer value as decimal digits + 2 byte overhead */
 static int calcIntSerializedLen(size_t val)
 {
-    if (val < 10) return 3;
-    if (val < 100) return 4;
-    if (val < 1000) return 5;
-    if (val < 10000) return 6;
-    if (val < 100000) return 7;
-    if (val < 1000000) return 8;
-    if (val < 10000000) return 9;
-    return 22;
+    return calcDigits(val) + 2;
 }
 
 static size_t calcSerializedSize(RaftRedisCommand *cmd)
 {
-    size_t sz = calcIntSerializedLen(cmd->argc + 1);
+    size_t sz = calcIntSerializedLen(cmd->argc);
     int i;
 
     for (i = 0; i < cmd->argc; i++) {
@@ -118,11 +136,20 @@ static size_t calcSerializedSize(RaftRedisCommand *cmd)
 
 static int encodeInteger(char prefix, char *ptr, size_t sz, unsigned long val)
 {
-    int n = snprintf(ptr, sz, "%c%lu\n", prefix, val);
-    
-    if (n >= sz) {
+    int n = calcIntSerializedLen(val);
+    char *p = ptr + n - 2;
+
+    if (n > sz) {
         return -1;
     }
+
+    *ptr = prefix;
+    do {
+        *p-- = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    ptr[n - 1] = '\n';
+
     return n;
 }
 
@@ -158,12 +185,12 @@ raft_entry_t *RaftRedisCommandArraySerialize(const RaftRedisCommandArray *source
 
         for (j = 0; j < src->argc; j++) {
             const char *e = RedisModule_StringPtrLen(src->argv[j], &len);
-            assert(sz > len);
 
             n = encodeInteger('$', p, sz, len);
             assert(n != -1);
             p += n; sz -= n;
 
+            assert(sz > len);
             memcpy(p, e, len);
             p += len;
             *p = '\n';
@@ -171,6 +198,7 @@ raft_entry_t *RaftRedisCommandArraySerialize(const RaftRedisCommandArray *source
             sz -= (len + 1);
         }
     }
+    assert(sz == 0);
 
     return ety;
 }
@@ -244,6 +272,109 @@ error:
     return 0;
 }
 
+/* Command array views.
+ *
+ * Applying an entry that did not originate locally only needs the command
+ * arguments long enough to execute them, so rather than deserializing it
+ * into a RaftRedisCommandArray (with allocations for every command,
+ * argv array and argument) it is decoded into a view: all commands and
+ * arguments are held in a single allocation, and arguments point into the
+ * entry data, which must outlive the view.
+ *
+ * An argument view is not null terminated; RedisModuleStrings are only
+ * created for arguments passed to RedisModule_Call().
+ */
+
+/* Scans the command at buf.  Returns its length, or 0 if invalid.  If
+ * args is non-NULL, the arguments are stored in it; otherwise they're only
+ * counted in *argc.
+ */
+static size_t scanCommandView(const char *buf, size_t buf_size, RaftRedisArgView *args, int *argc)
+{
+    const char *p = buf;
+    size_t len;
+    int i, n;
+
+    if ((n = decodeInteger(p, buf_size, '*', &len)) < 0 || !len || len > INT_MAX) {
+        return 0;
+    }
+    p += n; buf_size -= n;
+    *argc = len;
+
+    for (i = 0; i < *argc; i++) {
+        if ((n = decodeInteger(p, buf_size, '$', &len)) < 0) {
+            return 0;
+        }
+        p += n; buf_size -= n;
+        if (buf_size <= len) {
+            return 0;
+        }
+
+        if (args) {
+            args[i].ptr = p;
+            args[i].len = len;
+        }
+        p += len + 1;
+        buf_size -= (len + 1);
+    }
+
+    return p - buf;
+}
+
+RRStatus RaftRedisCommandArrayViewDecode(RaftRedisCommandArrayView *target, const void *buf, size_t buf_size)
+{
+    const char *start;
+    const char *p = buf;
+    size_t commands_num, size, len;
+    size_t args_num = 0;
+    int i, n, argc;
+
+    /* First pass: validate, and count commands and arguments */
+    if ((n = decodeInteger(p, buf_size, '*', &commands_num)) < 0 ||
+            !commands_num || commands_num > INT_MAX) {
+        return RR_ERROR;
+    }
+    p += n; buf_size -= n;
+    start = p;
+    size = buf_size;
+
+    for (i = 0; i < commands_num; i++) {
+        if (!(len = scanCommandView(p, buf_size, NULL, &argc))) {
+            return RR_ERROR;
+        }
+        args_num += argc;
+        p += len; buf_size -= len;
+    }
+
+    /* Second pass: store commands and arguments */
+    target->len = commands_num;
+    target->commands = RedisModule_Alloc(commands_num * sizeof(RaftRedisCommandView) +
+                                         args_num * sizeof(RaftRedisArgView));
+
+    RaftRedisArgView *args = (RaftRedisArgView *) (target->commands + commands_num);
+    p = start;
+    buf_size = size;
+    for (i = 0; i < commands_num; i++) {
+        RaftRedisCommandView *cmd = &target->commands[i];
+
+        cmd->argv = args;
+        len = scanCommandView(p, buf_size, args, &cmd->argc);
+        args += cmd->argc;
+        p += len; buf_size -= len;
+    }
+
+    return RR_OK;
+}
+
+void RaftRedisCommandArrayViewFree(RaftRedisCommandArrayView *view)
+{
+    if (view->commands) {
+        RedisModule_Free(view->commands);
+        view->commands = NULL;
+    }
+    view->len = 0;
+}
+
 RRStatus RaftRedisCommandArrayDeserialize(RaftRedisCommandArray *target, const void *buf, size_t buf_size)
 {
     const void *p = buf;
@@ -281,3 +412,149 @@ RRStatus RaftRedisCommandArrayDeserialize(RaftRedisCommandArray *target, const v
 }
 
 
+
+/* RAFT.AE2 uses a compact binary encoding of the AppendEntries message.
+ * The message header and all entry metadata are packed into a single
+ * blob, stored in little endian byte order:
+ *
+ *   Header (RAFT_AE2_HEADER_SIZE bytes):
+ *     uint32_t target_node_id
+ *     uint32_t source_node_id
+ *     uint64_t term
+ *     uint64_t prev_log_idx
+ *     uint64_t prev_log_term
+ *     uint64_t leader_commit
+ *     uint64_t msg_id
+ *     uint32_t n_entries
+ *     uint32_t reserved
+ *
+ *   Followed by n_entries times (RAFT_AE2_ENTRY_SIZE bytes):
+ *     uint64_t term
+ *     uint32_t id
+ *     uint32_t type
+ *
+ * Entry payloads are not part of the blob; they follow it as separate
+ * command arguments, so they are never copied or encoded.
+ */
+
+static char *encodeU32(char *p, uint32_t val)
+{
+    for (int i = 0; i < 4; i++) {
+        *p++ = (char) (val >> (i * 8));
+    }
+    return p;
+}
+
+static char *encodeU64(char *p, uint64_t val)
+{
+    for (int i = 0; i < 8; i++) {
+        *p++ = (char) (val >> (i * 8));
+    }
+    return p;
+}
+
+static const char *decodeU32(const char *p, uint32_t *val)
+{
+    const unsigned char *u = (const unsigned char *) p;
+    *val = 0;
+    for (int i = 0; i < 4; i++) {
+        *val |= (uint32_t) u[i] << (i * 8);
+    }
+    return p + 4;
+}
+
+static const char *decodeU64(const char *p, uint64_t *val)
+{
+    const unsigned char *u = (const unsigned char *) p;
+    *val = 0;
+    for (int i = 0; i < 8; i++) {
+        *val |= (uint64_t) u[i] << (i * 8);
+    }
+    return p + 8;
+}
+
+/* Encode the AppendEntries header and entry metadata into buf, which must
+ * be at least RAFT_AE2_BLOB_SIZE(msg->n_entries) bytes long.  Returns the
+ * number of bytes written.
+ */
+size_t AppendEntriesEncode(char *buf, raft_node_id_t target_node_id,
+        raft_node_id_t source_node_id, msg_appendentries_t *msg)
+{
+    char *p = buf;
+
+    p = encodeU32(p, target_node_id);
+    p = encodeU32(p, source_node_id);
+    p = encodeU64(p, msg->term);
+    p = encodeU64(p, msg->prev_log_idx);
+    p = encodeU64(p, msg->prev_log_term);
+    p = encodeU64(p, msg->leader_commit);
+    p = encodeU64(p, msg->msg_id);
+    p = encodeU32(p, msg->n_entries);
+    p = encodeU32(p, 0);
+
+    for (int i = 0; i < msg->n_entries; i++) {
+        raft_entry_t *e = msg->entries[i];
+        p = encodeU64(p, e->term);
+        p = encodeU32(p, e->id);
+        p = encodeU32(p, e->type);
+    }
+
+    return p - buf;
+}
+
+/* Decode the header of a RAFT.AE2 blob.  On success, msg is populated
+ * (except for entries) and the number of entries is returned in
+ * *n_entries.  The blob size is verified to match the number of entries.
+ */
+RRStatus AppendEntriesDecodeHeader(const char *buf, size_t buf_len,
+        raft_node_id_t *target_node_id, raft_node_id_t *source_node_id,
+        msg_appendentries_t *msg)
+{
+    const char *p = buf;
+    uint32_t u32;
+    uint64_t u64;
+
+    if (buf_len < RAFT_AE2_HEADER_SIZE) {
+        return RR_ERROR;
+    }
+
+    p = decodeU32(p, &u32); *target_node_id = (int32_t) u32;
+    p = decodeU32(p, &u32); *source_node_id = (int32_t) u32;
+    p = decodeU64(p, &u64); msg->term = u64;
+    p = decodeU64(p, &u64); msg->prev_log_idx = u64;
+    p = decodeU64(p, &u64); msg->prev_log_term = u64;
+    p = decodeU64(p, &u64); msg->leader_commit = u64;
+    p = decodeU64(p, &u64); msg->msg_id = u64;
+    p = decodeU32(p, &u32);
+
+    if (u32 > (buf_len - RAFT_AE2_HEADER_SIZE) / RAFT_AE2_ENTRY_SIZE ||
+        buf_len != RAFT_AE2_BLOB_SIZE(u32)) {
+        return RR_ERROR;
+    }
+    msg->n_entries = u32;
+
+    return RR_OK;
+}
+
+/* Decode the metadata of entry i from a RAFT.AE2 blob previously validated
+ * by AppendEntriesDecodeHeader(), and create an entry with the specified
+ * payload.
+ */
+raft_entry_t *AppendEntriesDecodeEntry(const char *buf, int i, const char *data, size_t data_len)
+{
+    const char *p = buf + RAFT_AE2_HEADER_SIZE + i * RAFT_AE2_ENTRY_SIZE;
+    uint64_t term;
+    uint32_t id, type;
+
+    p = decodeU64(p, &term);
+    p = decodeU32(p, &id);
+    decodeU32(p, &type);
+
+    raft_entry_t *e = raft_entry_new(data_len);
+    memcpy(e->data, data, data_len);
+    e->term = term;
+    e->id = (int32_t) id;
+    e->type = (int32_t) type;
+
+    return e;
+}
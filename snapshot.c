@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "redisraft.h"
+#include "lzf.h"
 
 /* These are ugly hacks to work around missing Redis Module API calls!
  * 
@@ -56,6 +57,7 @@ static SnapshotCfgEntry *generateSnapshotCfgEntryList(RedisRaftCtx *rr)
 
         e->id = raft_node_get_id(rnode);
         e->voting = raft_node_is_voting_committed(rnode);
+        e->learner = node ? node->learner : rr->learner;
         e->addr = *na;
 
         entry = &e->next;
@@ -119,53 +121,34 @@ void cancelSnapshot(RedisRaftCtx *rr, SnapshotResult *sr)
 
 RRStatus finalizeSnapshot(RedisRaftCtx *rr, SnapshotResult *sr)
 {
-    RaftLog *new_log = NULL;
-    unsigned long num_log_entries;
-
-    char temp_log_filename[256];
-    snprintf(temp_log_filename, sizeof(temp_log_filename) - 1, "%s.tmp",
-        rr->config->raft_log_filename);
-
     assert(rr->snapshot_in_progress);
 
     TRACE("Finalizing snapshot.");
 
-    /* Rewrite any additional log entries beyond the snapshot to a new
-     * log file.
-     */
-    num_log_entries = RaftLogRewrite(rr, temp_log_filename,
-        rr->last_snapshot_idx, rr->last_snapshot_term);
-
-    new_log = RaftLogOpen(temp_log_filename, rr->config, RAFTLOG_KEEP_INDEX);
-    if (!new_log) {
-        LOG_ERROR("Failed to open log after rewrite: %s", strerror(errno));
-        cancelSnapshot(rr, sr);
-        return -1;
-    }
-
-    LOG_VERBOSE("Log rewrite complete, %lu entries rewritten (from idx %lu).",
-            num_log_entries, raft_get_snapshot_last_idx(rr->raft));
-
-    /* We now have to switch temp files. We need to rename two files in a non-atomic
-     * operation, so order is critical and we must rename the snapshot file first.
-     * This guarantees we lose no data if we fail now before renaming the log -- all
-     * we'll have to do is skip redundant log entries.
+    /* Order is critical: we must rename the snapshot file before compacting
+     * the log.  This guarantees we lose no data if we fail before the log
+     * is compacted -- all we'll have to do is skip redundant log entries.
      */
 
     if (rename(sr->rdb_filename, rr->config->rdb_filename) < 0) {
         LOG_ERROR("Failed to switch snapshot filename (%s to %s): %s",
                 sr->rdb_filename, rr->config->rdb_filename, strerror(errno));
-        RaftLogClose(new_log);
         cancelSnapshot(rr, sr);
         return -1;
     }
 
-    if (RaftLogRewriteSwitch(rr, new_log, num_log_entries) != RR_OK) {
-        RaftLogClose(new_log);
+    /* Compaction only updates the log header and removes segments that hold
+     * no entries beyond the snapshot; remaining entries are not rewritten.
+     */
+    if (RaftLogCompact(rr->log, rr->last_snapshot_idx, rr->last_snapshot_term) != RR_OK) {
+        LOG_ERROR("Failed to compact Raft log: %s", strerror(errno));
         cancelSnapshot(rr, sr);
         return -1;
     }
 
+    LOG_VERBOSE("Log compaction complete, %lu entries remaining (from idx %lu), %d segments.",
+            RaftLogCount(rr->log), rr->last_snapshot_idx, rr->log->num_segments);
+
     /* Finalize snapshot */
     raft_end_snapshot(rr->raft);
     rr->snapshot_in_progress = false;
@@ -335,6 +318,11 @@ static int updateNodeFromSnapshot(RedisRaftCtx *rr, raft_node_t *node, SnapshotC
         ret = 1;
     }
 
+    if (cfg->learner != rr->learner) {
+        rr->learner = cfg->learner;
+        ret = 1;
+    }
+
     /* NOTE: We currently assume address and port cannot be configured on the fly,
      * so they'll always involve a node id change.
      */
@@ -346,6 +334,8 @@ static void createNodeFromSnapshot(RedisRaftCtx *rr, SnapshotCfgEntry *cfg)
     Node *n = NodeCreate(rr, cfg->id, &cfg->addr);
     raft_node_t *rn;
 
+    n->learner = cfg->learner;
+
     if (cfg->voting) {
         rn = raft_add_node(rr->raft, n, cfg->id, 0);
     } else {
@@ -354,11 +344,12 @@ static void createNodeFromSnapshot(RedisRaftCtx *rr, SnapshotCfgEntry *cfg)
 
     assert(rn != NULL);
 
-    LOG_DEBUG("Snapshot Load: adding node %d: %s:%d: voting=%s",
+    LOG_DEBUG("Snapshot Load: adding node %d: %s:%d: voting=%s, learner=%s",
         cfg->id,
         cfg->addr.host,
         cfg->addr.port,
-        cfg->voting ? "yes" : "no");
+        cfg->voting ? "yes" : "no",
+        cfg->learner ? "yes" : "no");
 }
 
 
@@ -450,6 +441,152 @@ static RRStatus storeSnapshotData(RedisRaftCtx *rr, RedisModuleString *data_str)
     return RR_OK;
 }
 
+/* Replies to RAFT.LOADSNAPSHOT, using the reply format that corresponds to
+ * the request format (single blob or chunked).
+ */
+static void replyLoadSnapshot(RaftReq *req, int status, size_t offset)
+{
+    if (!req->r.loadsnapshot.chunked) {
+        RedisModule_ReplyWithLongLong(req->ctx, status);
+        return;
+    }
+
+    RedisModule_ReplyWithArray(req->ctx, 2);
+    RedisModule_ReplyWithLongLong(req->ctx, status);
+    RedisModule_ReplyWithLongLong(req->ctx, offset);
+}
+
+static char *getIncomingSnapshotFilename(RedisRaftCtx *rr)
+{
+    static const char suffix[] = ".incoming";
+    size_t len = strlen(rr->config->rdb_filename) + sizeof(suffix);
+    char *filename = RedisModule_Alloc(len);
+
+    snprintf(filename, len, "%s%s", rr->config->rdb_filename, suffix);
+    return filename;
+}
+
+static void closeIncomingSnapshot(RedisRaftCtx *rr)
+{
+    if (rr->incoming_snapshot_fd != -1) {
+        close(rr->incoming_snapshot_fd);
+        rr->incoming_snapshot_fd = -1;
+    }
+    rr->incoming_snapshot_offset = 0;
+}
+
+/* Stores a received snapshot chunk in a temporary file, and renames it to
+ * the RDB file once the last chunk has been received.
+ *
+ * On return, next_offset holds the offset the leader should send next. It
+ * equals the snapshot size once the snapshot is complete, and may point back
+ * to an earlier offset if a chunk was lost or the transfer was restarted.
+ */
+static RRStatus storeSnapshotChunk(RedisRaftCtx *rr, RaftReq *req, size_t *next_offset)
+{
+    size_t offset = req->r.loadsnapshot.offset;
+    bool same_snapshot = rr->incoming_snapshot_fd != -1 &&
+            rr->incoming_snapshot_term == req->r.loadsnapshot.term &&
+            rr->incoming_snapshot_idx == req->r.loadsnapshot.idx &&
+            rr->incoming_snapshot_size == req->r.loadsnapshot.size;
+    char *filename = getIncomingSnapshotFilename(rr);
+    char *raw = NULL;
+    RRStatus ret = RR_ERROR;
+
+    if (!same_snapshot || !offset) {
+        closeIncomingSnapshot(rr);
+
+        /* We don't have the beginning of this snapshot, ask for it */
+        if (offset) {
+            LOG_VERBOSE("Received snapshot chunk at offset %lu of unknown snapshot, restarting",
+                    offset);
+            *next_offset = 0;
+            ret = RR_OK;
+            goto exit;
+        }
+
+        rr->incoming_snapshot_fd = open(filename, O_CREAT|O_TRUNC|O_WRONLY, 0666);
+        if (rr->incoming_snapshot_fd < 0) {
+            LOG_ERROR("Failed to open snapshot file: %s: %s", filename, strerror(errno));
+            rr->incoming_snapshot_fd = -1;
+            goto exit;
+        }
+
+        rr->incoming_snapshot_term = req->r.loadsnapshot.term;
+        rr->incoming_snapshot_idx = req->r.loadsnapshot.idx;
+        rr->incoming_snapshot_size = req->r.loadsnapshot.size;
+    }
+
+    /* Out of order chunk, ask for the one we expect */
+    if (offset != rr->incoming_snapshot_offset) {
+        *next_offset = rr->incoming_snapshot_offset;
+        ret = RR_OK;
+        goto exit;
+    }
+
+    size_t data_len;
+    const char *data = RedisModule_StringPtrLen(req->r.loadsnapshot.snapshot, &data_len);
+    rr->snapshot_bytes_received += data_len;
+
+    if (req->r.loadsnapshot.raw_len) {
+        raw = RedisModule_Alloc(req->r.loadsnapshot.raw_len);
+        if (lzfDecompress(data, data_len, raw, req->r.loadsnapshot.raw_len) !=
+                req->r.loadsnapshot.raw_len) {
+            LOG_ERROR("Failed to decompress snapshot chunk at offset %lu", offset);
+            closeIncomingSnapshot(rr);
+            goto exit;
+        }
+
+        data = raw;
+        data_len = req->r.loadsnapshot.raw_len;
+    }
+    rr->snapshot_raw_bytes_received += data_len;
+
+    if (!data_len || offset + data_len > rr->incoming_snapshot_size) {
+        LOG_ERROR("Invalid snapshot chunk: offset %lu, length %lu, snapshot size %lu",
+                offset, data_len, rr->incoming_snapshot_size);
+        closeIncomingSnapshot(rr);
+        goto exit;
+    }
+
+    while (data_len > 0) {
+        ssize_t r = write(rr->incoming_snapshot_fd, data, data_len);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Failed to write snapshot file: %s: %s", filename, strerror(errno));
+            closeIncomingSnapshot(rr);
+            goto exit;
+        }
+        data += r;
+        data_len -= r;
+        rr->incoming_snapshot_offset += r;
+    }
+
+    *next_offset = rr->incoming_snapshot_offset;
+    if (*next_offset == rr->incoming_snapshot_size) {
+        closeIncomingSnapshot(rr);
+        if (rename(filename, rr->config->rdb_filename) < 0) {
+            LOG_ERROR("Failed to rename snapshot file: %s to %s: %s",
+                    filename, rr->config->rdb_filename, strerror(errno));
+            goto exit;
+        }
+
+        LOG_DEBUG("Saved received snapshot to file: %s, %lu bytes",
+                rr->config->rdb_filename, rr->incoming_snapshot_size);
+    }
+
+    ret = RR_OK;
+
+exit:
+    if (raw) {
+        RedisModule_Free(raw);
+    }
+    RedisModule_Free(filename);
+    return ret;
+}
+
 void handleLoadSnapshot(RedisRaftCtx *rr, RaftReq *req)
 {
     if (checkRaftState(rr, req) == RR_ERROR) {
@@ -476,7 +613,7 @@ void handleLoadSnapshot(RedisRaftCtx *rr, RaftReq *req)
     if (req->r.loadsnapshot.term < raft_get_current_term(rr->raft)) {
         LOG_VERBOSE("Skipping queued RAFT.LOADSNAPSHOT with old term %ld",
             req->r.loadsnapshot.term);
-        RedisModule_ReplyWithLongLong(req->ctx, 0);
+        replyLoadSnapshot(req, SNAPSHOT_SKIPPED, 0);
         goto exit;
     }
 
@@ -484,14 +621,14 @@ void handleLoadSnapshot(RedisRaftCtx *rr, RaftReq *req)
     if (req->r.loadsnapshot.idx < raft_get_last_applied_idx(rr->raft)) {
         LOG_VERBOSE("Skipping queued RAFT.LOADSNAPSHOT with index %ld, already applied %ld",
             req->r.loadsnapshot.idx, raft_get_last_applied_idx(rr->raft));
-        RedisModule_ReplyWithLongLong(req->ctx, 0);
+        replyLoadSnapshot(req, SNAPSHOT_SKIPPED, 0);
         goto exit;
     }
 
     if (req->r.loadsnapshot.idx < raft_get_current_idx(rr->raft)) {
         LOG_VERBOSE("Skipping queued RAFT.LOADSNAPSHOT with index %ld, current idx is %ld",
             req->r.loadsnapshot.idx, raft_get_current_idx(rr->raft));
-        RedisModule_ReplyWithLongLong(req->ctx, 0);
+        replyLoadSnapshot(req, SNAPSHOT_SKIPPED, 0);
         goto exit;
     }
 
@@ -500,11 +637,24 @@ void handleLoadSnapshot(RedisRaftCtx *rr, RaftReq *req)
             LOG_VERBOSE("Skipping queued RAFT.LOADSNAPSHOT with identical term %ld index %ld",
                 raft_get_snapshot_last_term(rr->raft),
                 raft_get_snapshot_last_idx(rr->raft));
-            RedisModule_ReplyWithLongLong(req->ctx, 0);
+            replyLoadSnapshot(req, SNAPSHOT_SKIPPED, 0);
             goto exit;
     }
 
-    if (storeSnapshotData(rr, req->r.loadsnapshot.snapshot) != RR_OK) {
+    if (req->r.loadsnapshot.chunked) {
+        size_t next_offset;
+
+        if (storeSnapshotChunk(rr, req, &next_offset) != RR_OK) {
+            RedisModule_ReplyWithError(req->ctx, "ERR failed to store snapshot");
+            goto exit;
+        }
+
+        /* More chunks to come */
+        if (next_offset < req->r.loadsnapshot.size) {
+            replyLoadSnapshot(req, SNAPSHOT_CHUNK_ACCEPTED, next_offset);
+            goto exit;
+        }
+    } else if (storeSnapshotData(rr, req->r.loadsnapshot.snapshot) != RR_OK) {
         RedisModule_ReplyWithError(req->ctx, "ERR failed to store snapshot");
         goto exit;
     }
@@ -548,7 +698,7 @@ void handleLoadSnapshot(RedisRaftCtx *rr, RaftReq *req)
     initializeSnapshotInfo(rr);
 
     RedisModule_ThreadSafeContextUnlock(rr->ctx);
-    RedisModule_ReplyWithLongLong(req->ctx, 1);
+    replyLoadSnapshot(req, SNAPSHOT_LOADED, req->r.loadsnapshot.size);
 
     rr->snapshots_loaded++;
 
@@ -613,6 +763,9 @@ void *rdbLoadSnapshotInfo(RedisModuleIO *rdb, int encver)
         /* Populate */
         entry->id = _id;
         entry->voting = RedisModule_LoadUnsigned(rdb);
+        if (encver >= 3) {
+            entry->learner = RedisModule_LoadUnsigned(rdb);
+        }
 
         buf = RedisModule_LoadStringBuffer(rdb, &len);
         entry->addr.port = RedisModule_LoadUnsigned(rdb);
@@ -642,7 +795,7 @@ void *rdbLoadSnapshotInfo(RedisModuleIO *rdb, int encver)
     } while (1);
 
     /* Load ShardingInfo */
-    ShardingInfoRDBLoad(rdb);
+    ShardingInfoRDBLoad(rdb, encver);
 
     info->loaded = true;
 
@@ -665,6 +818,7 @@ void rdbSaveSnapshotInfo(RedisModuleIO *rdb, void *value)
     while (cfg != NULL) {
         RedisModule_SaveUnsigned(rdb, cfg->id);
         RedisModule_SaveUnsigned(rdb, cfg->voting);
+        RedisModule_SaveUnsigned(rdb, cfg->learner);
         RedisModule_SaveStringBuffer(rdb, cfg->addr.host, strlen(cfg->addr.host));
         RedisModule_SaveUnsigned(rdb, cfg->addr.port);
 
@@ -699,8 +853,39 @@ RedisModuleTypeMethods RedisRaftTypeMethods = {
     .free = clearSnapshotInfo
 };
 
-/* TODO -- move this to Raft library header file */
-void raft_node_set_next_idx(raft_node_t* me_, raft_index_t nextIdx);
+/* Snapshots are delivered in chunks of up to snapshot-chunk-size bytes, using
+ * RAFT.LOADSNAPSHOT.  Only a single chunk is in flight at any time; the next
+ * one is read from the file and sent when the previous one is acknowledged.
+ *
+ * If snapshot-compression is enabled, chunks are LZF compressed and sent
+ * along with their decompressed length.  Nodes that don't support this get
+ * uncompressed chunks until they reconnect.  Nodes that don't support chunks
+ * at all get the whole snapshot in a single RAFT.LOADSNAPSHOT, as before.
+ *
+ * The receiving node acknowledges every chunk with the offset it expects
+ * next.  If a transfer is interrupted, it is resumed from the last
+ * acknowledged offset as long as it's still the same snapshot.
+ */
+
+static void snapshotReadChunk(Node *node);
+
+static void cleanSnapshotDelivery(Node *node)
+{
+    if (node->snapshot_buf != NULL) {
+        RedisModule_Free(node->snapshot_buf);
+        node->snapshot_buf = NULL;
+    }
+    if (node->snapshot_zbuf != NULL) {
+        RedisModule_Free(node->snapshot_zbuf);
+        node->snapshot_zbuf = NULL;
+    }
+
+    uv_fs_t close_req;
+    int ret = uv_fs_close(node->rr->loop, &close_req, node->uv_snapshot_file, NULL);
+    assert(ret == 0);
+
+    node->load_snapshot_in_progress = false;
+}
 
 static void handleLoadSnapshotResponse(redisAsyncContext *c, void *r, void *privdata)
 {
@@ -709,35 +894,90 @@ static void handleLoadSnapshotResponse(redisAsyncContext *c, void *r, void *priv
 
     redisReply *reply = r;
 
-    node->load_snapshot_in_progress = false;
-
-    NodeDismissPendingResponse(node);
+    if (node->snapshot_conn == node->bulk_conn) {
+        NodeDismissBulkPendingResponse(node);
+    } else {
+        NodeDismissPendingResponse(node);
+    }
     if (!reply) {
         NODE_LOG_ERROR(node, "RAFT.LOADSNAPSHOT failure: connection dropped");
-        ConnMarkDisconnected(node->conn);
+        ConnMarkDisconnected(node->snapshot_conn);
+        cleanSnapshotDelivery(node);
+        return;
     } else if (reply->type == REDIS_REPLY_ERROR) {
         NODE_LOG_ERROR(node, "RAFT.LOADSNAPSHOT error: %s", reply->str);
-    } else if (reply->type != REDIS_REPLY_INTEGER) {
+        if (strstr(reply->str, "wrong number of arguments")) {
+            if (node->snapshot_zbuf && !node->legacy_snapshot) {
+                NODE_LOG_VERBOSE(node, "Node does not support compressed snapshots, disabling.");
+                node->legacy_snapshot = true;
+            } else if (!node->legacy_snapshot_chunks) {
+                NODE_LOG_VERBOSE(node, "Node does not support snapshot chunks, disabling.");
+                node->legacy_snapshot_chunks = true;
+                node->snapshot_offset = 0;
+            }
+        }
+        cleanSnapshotDelivery(node);
+        return;
+    }
+
+    long long status, offset = 0;
+
+    /* Without chunks, the reply is just whether the snapshot was loaded */
+    if (node->legacy_snapshot_chunks && reply->type == REDIS_REPLY_INTEGER) {
+        status = reply->integer ? SNAPSHOT_LOADED : SNAPSHOT_SKIPPED;
+    } else if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 2 ||
+               reply->element[0]->type != REDIS_REPLY_INTEGER ||
+               reply->element[1]->type != REDIS_REPLY_INTEGER) {
         NODE_LOG_ERROR(node, "RAFT.LOADSNAPSHOT invalid response type");
+        cleanSnapshotDelivery(node);
+        return;
     } else {
-        NODE_LOG_DEBUG(node, "RAFT.LOADSNAPSHOT response %lld",
-                reply->integer);
-        raft_node_t *n = raft_get_node(rr->raft, node->id);
-        if (n != NULL) {
-            raft_node_set_next_idx(n, node->load_snapshot_idx + 1);
-        } else {
-            NODE_LOG_DEBUG(node, "Node %d no longer exists, not updating next_idx",
-                    node->id);
+        status = reply->element[0]->integer;
+        offset = reply->element[1]->integer;
+    }
+
+    if (status == SNAPSHOT_CHUNK_ACCEPTED) {
+        if (!raft_is_leader(rr->raft)) {
+            NODE_LOG_DEBUG(node, "No longer leader, aborting snapshot delivery");
+            cleanSnapshotDelivery(node);
+            return;
         }
+
+        if (offset < 0 || (size_t) offset >= node->snapshot_size) {
+            NODE_LOG_ERROR(node, "RAFT.LOADSNAPSHOT invalid offset %lld", offset);
+            node->snapshot_offset = 0;
+            cleanSnapshotDelivery(node);
+            return;
+        }
+
+        node->snapshot_offset = offset;
+        snapshotReadChunk(node);
+        return;
+    }
+
+    NODE_LOG_DEBUG(node, "RAFT.LOADSNAPSHOT response %lld", status);
+    if (status == SNAPSHOT_LOADED) {
+        rr->snapshots_delivered++;
+        rr->last_snapshot_delivery_time = uv_now(rr->loop) - node->snapshot_start_time;
+        NODE_LOG_VERBOSE(node, "Snapshot delivered: %lu bytes in %lu msec",
+                node->snapshot_size, rr->last_snapshot_delivery_time);
+    }
+    node->snapshot_offset = 0;
+    cleanSnapshotDelivery(node);
+
+    raft_node_t *n = raft_get_node(rr->raft, node->id);
+    if (n != NULL) {
+        raft_node_set_next_idx(n, node->load_snapshot_idx + 1);
+    } else {
+        NODE_LOG_DEBUG(node, "Node %d no longer exists, not updating next_idx",
+                node->id);
     }
 }
 
-static int snapshotSendData(Node *node)
+static int snapshotSendChunk(Node *node, size_t len)
 {
     RedisRaftCtx *rr = node->rr;
-    time_t now = time(NULL);
 
-    /* Load snapshot data */
     char target_node_id[30];
     snprintf(target_node_id, sizeof(target_node_id) - 1, "%d", node->id);
 
@@ -745,75 +985,122 @@ static int snapshotSendData(Node *node)
     snprintf(term, sizeof(term) - 1, "%lu", raft_get_current_term(rr->raft));
 
     char idx[30];
-    snprintf(idx, sizeof(idx) - 1, "%lu", raft_get_snapshot_last_idx(rr->raft));
+    snprintf(idx, sizeof(idx) - 1, "%lu", node->load_snapshot_idx);
+
+    char size[30];
+    snprintf(size, sizeof(size) - 1, "%lu", node->snapshot_size);
+
+    char offset[30];
+    snprintf(offset, sizeof(offset) - 1, "%lu", node->snapshot_offset);
 
-    const char *args[5] = {
+    char raw_len[30];
+    snprintf(raw_len, sizeof(raw_len) - 1, "%lu", len);
+
+    const char *args[9] = {
         "RAFT.LOADSNAPSHOT",
         target_node_id,
         term,
         idx,
-        node->snapshot_buf
+        size,
+        offset,
+        node->snapshot_buf,
+        "LZF",
+        raw_len
     };
-    size_t args_len[5] = {
+    size_t args_len[9] = {
         strlen(args[0]),
         strlen(args[1]),
         strlen(args[2]),
         strlen(args[3]),
-        node->snapshot_size
+        strlen(args[4]),
+        strlen(args[5]),
+        len,
+        strlen(args[7]),
+        strlen(args[8])
     };
+    int argc = 7;
 
-    node->load_snapshot_idx = raft_get_snapshot_last_idx(rr->raft);
-    node->load_snapshot_in_progress = true;
-    node->load_snapshot_last_time = now;
+    /* Nodes that don't support chunks get the whole snapshot as the last
+     * argument, see snapshotOnOpen().
+     */
+    if (node->legacy_snapshot_chunks) {
+        args[4] = node->snapshot_buf;
+        args_len[4] = len;
+        argc = 5;
+    } else if (node->snapshot_zbuf) {
+        /* Send compressed, unless it doesn't save anything */
+        size_t zlen = lzfCompress(node->snapshot_buf, len, node->snapshot_zbuf, len - 1);
+        if (zlen > 0) {
+            args[6] = node->snapshot_zbuf;
+            args_len[6] = zlen;
+            argc = 9;
+        }
+    }
 
-    if (!ConnIsConnected(node->conn)) {
-        node->load_snapshot_in_progress = false;
+    node->load_snapshot_last_time = time(NULL);
+
+    if (!ConnIsConnected(node->snapshot_conn)) {
         return -1;
     }
 
-    if (redisAsyncCommandArgv(ConnGetRedisCtx(node->conn), handleLoadSnapshotResponse, node, 5, args, args_len) != REDIS_OK) {
-        node->load_snapshot_in_progress = false;
+    if (ConnSendCommandArgv(node->snapshot_conn, handleLoadSnapshotResponse, node, argc, args, args_len) != REDIS_OK) {
         return -1;
     }
 
-    NodeAddPendingResponse(node, false);
-
-    NODE_LOG_DEBUG(node, "Sent snapshot: %lu bytes, term %ld, index %ld",
-                node->snapshot_size, raft_get_snapshot_last_term(rr->raft),
-                raft_get_snapshot_last_idx(rr->raft));
-    return 0;
-}
-
-static void cleanSnapshotDelivery(Node *node)
-{
-    if (node->snapshot_buf != NULL) {
-        RedisModule_Free(node->snapshot_buf);
-        node->snapshot_buf = NULL;
+    if (node->snapshot_conn == node->bulk_conn) {
+        NodeAddBulkPendingResponse(node);
+    } else {
+        NodeAddPendingResponse(node, false);
     }
 
-    uv_fs_t close_req;
-    int ret = uv_fs_close(node->rr->loop, &close_req, node->uv_snapshot_file, NULL);
-    assert(ret == 0);
+    size_t wire_len = args_len[argc == 5 ? 4 : 6];
+    rr->snapshot_bytes_sent += wire_len;
+    rr->snapshot_raw_bytes_sent += len;
+
+    NODE_TRACE(node, "Sent snapshot chunk: offset %lu, %lu bytes (%lu on wire) of %lu, term %ld, index %ld",
+                node->snapshot_offset, len, wire_len, node->snapshot_size,
+                raft_get_current_term(rr->raft), node->load_snapshot_idx);
+    return 0;
 }
 
 static void snapshotOnRead(uv_fs_t *req)
 {
     Node *node = uv_req_get_data((uv_req_t *) req);
-    RedisRaftCtx *rr = node->rr;
+    size_t expected = node->uv_snapshot_buf.len;
+    ssize_t result = req->result;
 
     uv_fs_req_cleanup(req);
 
-    if (req->result == node->snapshot_size && snapshotSendData(node) == 0) {
-        NODE_LOG_DEBUG(node, "Loaded snapshot: %s: %lu bytes",
-                rr->config->rdb_filename, node->snapshot_size);
+    if (result != expected) {
+        NODE_LOG_ERROR(node, "Failed to deliver snapshot: read: %s",
+                result < 0 ? uv_strerror(result) : "short read");
+        cleanSnapshotDelivery(node);
+        return;
     }
 
-    cleanSnapshotDelivery(node);
+    if (snapshotSendChunk(node, result) < 0) {
+        cleanSnapshotDelivery(node);
+    }
+}
+
+/* Reads the next chunk to send, starting at the last acknowledged offset */
+static void snapshotReadChunk(Node *node)
+{
+    size_t len = node->snapshot_size - node->snapshot_offset;
+    if (len > node->snapshot_buf_size) {
+        len = node->snapshot_buf_size;
+    }
+
+    node->uv_snapshot_buf = uv_buf_init(node->snapshot_buf, len);
+    int ret = uv_fs_read(node->rr->loop, &node->uv_snapshot_req, node->uv_snapshot_file,
+            &node->uv_snapshot_buf, 1, node->snapshot_offset, snapshotOnRead);
+    assert(ret == 0);
 }
 
 static void snapshotOnOpen(uv_fs_t *req)
 {
     Node *node = uv_req_get_data((uv_req_t *) req);
+    RedisRaftCtx *rr = node->rr;
     uv_fs_t stat_req;
 
     uv_fs_req_cleanup(req);
@@ -826,20 +1113,51 @@ static void snapshotOnOpen(uv_fs_t *req)
     }
 
     node->uv_snapshot_file = req->result;
-    if (uv_fs_fstat(req->loop, (uv_fs_t *) &stat_req, node->uv_snapshot_file, NULL) < 0) {
-        NODE_LOG_DEBUG(node, "Failed to delivery snapshot: open: %s",
-                uv_strerror(req->result));
+    int ret = uv_fs_fstat(req->loop, (uv_fs_t *) &stat_req, node->uv_snapshot_file, NULL);
+    if (ret < 0) {
+        NODE_LOG_DEBUG(node, "Failed to deliver snapshot: fstat: %s",
+                uv_strerror(ret));
         cleanSnapshotDelivery(node);
         return;
     }
 
-    /* prepare buffer and read */
-    node->snapshot_size = uv_fs_get_statbuf(&stat_req)->st_size;
-    node->snapshot_buf = RedisModule_Alloc(node->snapshot_size);
-    node->uv_snapshot_buf = uv_buf_init(node->snapshot_buf, node->snapshot_size);
-    int ret = uv_fs_read(node->rr->loop, &node->uv_snapshot_req, node->uv_snapshot_file,
-            &node->uv_snapshot_buf, 1, 0, snapshotOnRead);
-    assert(ret == 0);
+    /* Resume an interrupted delivery of the same snapshot, or start over */
+    size_t size = uv_fs_get_statbuf(&stat_req)->st_size;
+    uv_fs_req_cleanup(&stat_req);
+
+    if (node->load_snapshot_idx != raft_get_snapshot_last_idx(rr->raft) ||
+        node->snapshot_size != size) {
+        node->load_snapshot_idx = raft_get_snapshot_last_idx(rr->raft);
+        node->snapshot_size = size;
+        node->snapshot_offset = 0;
+    } else if (node->snapshot_offset) {
+        NODE_LOG_VERBOSE(node, "Resuming snapshot delivery at offset %lu of %lu",
+                node->snapshot_offset, node->snapshot_size);
+    }
+
+    if (!node->snapshot_size) {
+        NODE_LOG_ERROR(node, "Failed to deliver snapshot: empty file");
+        cleanSnapshotDelivery(node);
+        return;
+    }
+
+    /* Prepare buffer and read the first chunk; without chunks, the buffer
+     * holds the whole snapshot.
+     */
+    node->snapshot_buf_size = rr->config->snapshot_chunk_size;
+    if (node->snapshot_buf_size > node->snapshot_size || node->legacy_snapshot_chunks) {
+        node->snapshot_buf_size = node->snapshot_size;
+    }
+    if (node->legacy_snapshot_chunks) {
+        node->snapshot_offset = 0;
+    }
+    node->snapshot_buf = RedisModule_Alloc(node->snapshot_buf_size);
+    if (rr->config->snapshot_compression && !node->legacy_snapshot &&
+        !node->legacy_snapshot_chunks) {
+        node->snapshot_zbuf = RedisModule_Alloc(node->snapshot_buf_size);
+    }
+    node->snapshot_start_time = uv_now(rr->loop);
+    snapshotReadChunk(node);
 }
 
 static int snapshotInitiateRead(RedisRaftCtx *rr, Node *node, const char *filename)
@@ -862,10 +1180,8 @@ int raftSendSnapshot(raft_server_t *raft, void *user_data, raft_node_t *raft_nod
         return -1;
     }
 
-    /* We don't attempt to load a snapshot before we receive a response.
-     *
-     * Note: a response in this case only lets us know the operation begun,
-     * but it's not a blocking operation.  See RAFT.LOADSNAPSHOT for more info.
+    /* We don't attempt to send a snapshot before the previous delivery
+     * attempt has completed or failed.
      */
     if (node->load_snapshot_in_progress) {
         return -1;
@@ -876,16 +1192,22 @@ int raftSendSnapshot(raft_server_t *raft, void *user_data, raft_node_t *raft_nod
             raft_get_snapshot_last_term(raft),
             raft_node_get_next_idx(raft_node));
 
-    if (!ConnIsConnected(node->conn)) {
-        NODE_LOG_ERROR(node, "not connected, state=%s", ConnGetStateStr(node->conn));
+    /* The whole snapshot is delivered on the same connection, the bulk one
+     * if it's available.  If it's still being established, we wait for it
+     * rather than fall back to the primary connection.
+     */
+    if (rr->config->bulk_connection && node->bulk_conn &&
+        !ConnIsIdle(node->bulk_conn) && !ConnIsConnected(node->bulk_conn)) {
+        return -1;
+    }
+    node->snapshot_conn = NodeGetBulkConn(node);
+    if (!ConnIsConnected(node->snapshot_conn)) {
+        NODE_LOG_ERROR(node, "not connected, state=%s", ConnGetStateStr(node->snapshot_conn));
         return -1;
     }
 
-    /* Initiate loading of snapshot.  We use libuv to handle loading in the background
-     * and avoid blocking the Raft thread.
-     *
-     * TODO: Refactor hiredis so we can actually stream this directly to the socket
-     * instead of buffering the entire file in memory.
+    /* Initiate delivery of the snapshot.  We use libuv to handle reading the
+     * file in the background and avoid blocking the Raft thread.
      */
     node->load_snapshot_in_progress = true;
     snapshotInitiateRead(rr, node, rr->config->rdb_filename);
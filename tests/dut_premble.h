@@ -37,3 +37,9 @@ static inline struct RedisModuleString *mock_CreateString(const char *s, size_t
 #define RedisModule_StringPtrLen(__s, __len)            mock_StringPtrLen(__s, __len)
 #define RedisModule_CreateString(__ctx, __s, __len)     mock_CreateString(__s, __len)
 #define RedisModule_FreeString(__ctx, __s)              test_free(__s)
+
+static inline void mock_Log(const char *level, const char *fmt, ...)
+{
+}
+
+#define RedisModule_Log(__ctx, __level, ...)            mock_Log(__level, __VA_ARGS__)
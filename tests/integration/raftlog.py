@@ -102,6 +102,9 @@ class LogHeader(RawEntry):
 
 
 class LogEntry(RawEntry):
+    # Binary entry header (version 2 and above): crc, data_len, term, id, type
+    BINARY_HEADER = struct.Struct('=IIqii')
+
     class LogType(Enum):
         NORMAL = 0
         ADD_NONVOTING_NODE = 1
@@ -111,6 +114,23 @@ class LogEntry(RawEntry):
         NO_OP = 5
         ADD_SHARDGROUP = 101
 
+    @classmethod
+    def from_binary_file(cls, _file):
+        hdr = _file.read(cls.BINARY_HEADER.size)
+        if not hdr:
+            raise EOFError('End of file reading binary entry')
+        if len(hdr) < cls.BINARY_HEADER.size:
+            raise RuntimeError('Incomplete binary entry header')
+        _, data_len, term, _id, _type = cls.BINARY_HEADER.unpack(hdr)
+        data = _file.read(data_len)
+        if len(data) < data_len:
+            raise RuntimeError('Incomplete binary entry data')
+        return LogEntry([bytes(cls.ENTRY, encoding='ascii'),
+                         bytes(str(term), encoding='ascii'),
+                         bytes(str(_id), encoding='ascii'),
+                         bytes(str(_type), encoding='ascii'),
+                         data])
+
     def term(self):
         return int(self.args[1])
 
@@ -180,20 +200,53 @@ class LogEntry(RawEntry):
 
 class RaftLog(object):
     def __init__(self, filename):
-        self.logfile = open(filename, 'rb')
+        self.filename = filename
         self.entries = []
 
     def reset(self):
         self.entries = []
-        self.logfile.seek(0, os.SEEK_SET)
 
-    def read(self):
+    def segments(self):
+        """
+        Returns the index of the first entry of every segment, as listed
+        in the manifest.  Sealed segments are listed along with their
+        number of entries, as <first_idx>:<num_entries>.
+        """
+        with open(self.filename + '.manifest', 'rb') as manifest:
+            entry = RawEntry.from_file(manifest)
+        return [int(x.split(b':')[0]) for x in entry.args[1:]]
+
+    def read_entries(self, _file, binary, first_idx=None, snapshot_idx=0):
+        idx = first_idx
         while True:
             try:
-                entry = RawEntry.from_file(self.logfile)
+                if binary:
+                    entry = LogEntry.from_binary_file(_file)
+                else:
+                    entry = RawEntry.from_file(_file)
             except EOFError:
                 break
-            self.entries.append(entry)
+            # Segments may begin with entries that have been compacted
+            if idx is None or idx > snapshot_idx:
+                self.entries.append(entry)
+            if idx is not None:
+                idx += 1
+
+    def read(self):
+        with open(self.filename, 'rb') as logfile:
+            header = RawEntry.from_file(logfile)
+            self.entries.append(header)
+            # Version 3 and above keep entries in segment files
+            if header.version() < 3:
+                self.read_entries(logfile, binary=header.version() >= 2)
+
+        if header.version() >= 3:
+            for first_idx in self.segments():
+                segment = '{}.seg.{}'.format(self.filename, first_idx)
+                with open(segment, 'rb') as segfile:
+                    self.read_entries(segfile, binary=True,
+                                      first_idx=first_idx,
+                                      snapshot_idx=header.snapshot_index())
         self.dump()
 
     def header(self):
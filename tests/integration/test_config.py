@@ -31,10 +31,68 @@ def test_config_sanity(cluster):
     assert (r1.raft_config_get('reconnect-interval') ==
             {'reconnect-interval': '111'})
 
+    r1.raft_config_set('append-entries-window', 8)
+    assert (r1.raft_config_get('append-entries-window') ==
+            {'append-entries-window': '8'})
+
+    r1.raft_config_set('snapshot-chunk-size', '64kb')
+    assert (r1.raft_config_get('snapshot-chunk-size') ==
+            {'snapshot-chunk-size': '64KB'})
+
+    r1.raft_config_set('snapshot-compression', 'no')
+    assert (r1.raft_config_get('snapshot-compression') ==
+            {'snapshot-compression': 'no'})
+
+    r1.raft_config_set('bulk-connection', 'no')
+    assert (r1.raft_config_get('bulk-connection') ==
+            {'bulk-connection': 'no'})
+
+    r1.raft_config_set('follower-proxy-batch-size', 16)
+    assert (r1.raft_config_get('follower-proxy-batch-size') ==
+            {'follower-proxy-batch-size': '16'})
+
+    r1.raft_config_set('write-coalesce-max-requests', 32)
+    assert (r1.raft_config_get('write-coalesce-max-requests') ==
+            {'write-coalesce-max-requests': '32'})
+
+    r1.raft_config_set('follower-reads', 'yes')
+    assert r1.raft_config_get('follower-reads') == {'follower-reads': 'yes'}
+
+    r1.raft_config_set('lease-reads', 'yes')
+    assert r1.raft_config_get('lease-reads') == {'lease-reads': 'yes'}
+
+    r1.raft_config_set('lease-drift-margin', 250)
+    assert (r1.raft_config_get('lease-drift-margin') ==
+            {'lease-drift-margin': '250'})
+
     r1.raft_config_set('raft-log-max-file-size', '64mb')
     assert (r1.raft_config_get('raft-log-max-file-size') ==
             {'raft-log-max-file-size': '64MB'})
 
+    r1.raft_config_set('raft-log-segment-size', '4mb')
+    assert (r1.raft_config_get('raft-log-segment-size') ==
+            {'raft-log-segment-size': '4MB'})
+
+    r1.raft_config_set('raft-log-group-commit-max-entries', 100)
+    assert (r1.raft_config_get('raft-log-group-commit-max-entries') ==
+            {'raft-log-group-commit-max-entries': '100'})
+
+    r1.raft_config_set('raft-log-group-commit-max-delay', 5)
+    assert (r1.raft_config_get('raft-log-group-commit-max-delay') ==
+            {'raft-log-group-commit-max-delay': '5'})
+
+    r1.raft_config_set('raft-log-sync-thread', 'no')
+    assert (r1.raft_config_get('raft-log-sync-thread') ==
+            {'raft-log-sync-thread': 'no'})
+
+    r1.raft_config_set('apply-batch-max-entries', 50)
+    assert (r1.raft_config_get('apply-batch-max-entries') ==
+            {'apply-batch-max-entries': '50'})
+
+    r1.raft_config_set('apply-batch-max-usec', 200)
+    assert (r1.raft_config_get('apply-batch-max-usec') ==
+            {'apply-batch-max-usec': '200'})
+
     r1.raft_config_set('loglevel', 'debug')
     assert r1.raft_config_get('loglevel') == {'loglevel': 'debug'}
 
@@ -69,3 +127,42 @@ def test_invalid_configs(cluster):
 
     with raises(ResponseError, match='.*invalid .*value'):
         r1.raft_config_set('request-timeout', 'nonint')
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('append-entries-window', 0)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('snapshot-chunk-size', 0)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('follower-proxy-batch-size', 0)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('write-coalesce-max-requests', 0)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('follower-reads', 'maybe')
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('lease-reads', 'maybe')
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('lease-drift-margin', -1)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('raft-log-segment-size', 0)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('leader-balance-interval', 'nonint')
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('learner-max-lag', -1)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('append-entries-max-bytes', 'nonsize')
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('max-uncommitted-entries', -1)
+
+    with raises(ResponseError, match='.*invalid .*value'):
+        r1.raft_config_set('max-uncommitted-bytes', 'nonsize')
@@ -10,7 +10,7 @@ RedisRaft is dual licensed under the GNU Affero General Public License version 3
 import time
 from re import match
 from redis import ResponseError
-from .raftlog import RaftLog
+from .raftlog import RaftLog, LogEntry
 
 
 def test_log_rollback(cluster):
@@ -74,6 +74,35 @@ def test_raft_log_max_file_size(cluster):
     assert r1.raft_info()['log_entries'] < 10
 
 
+def test_raft_log_segments(cluster):
+    """
+    Raft log is split into segments, and compaction removes the segments
+    covered by the snapshot.
+    """
+
+    r1 = cluster.add_node()
+    assert r1.raft_config_set('raft-log-segment-size', '1kb')
+    for _ in range(20):
+        assert r1.raft_exec('SET', 'testkey', 'x'*500)
+    assert r1.raft_info()['file_segments'] > 5
+
+    assert r1.client.execute_command('RAFT.DEBUG', 'COMPACT') == b'OK'
+    info = r1.raft_info()
+    assert info['log_entries'] == 0
+    assert info['file_segments'] <= 1
+
+    log = RaftLog(r1.raftlog)
+    log.read()
+    assert log.entry_count(LogEntry.LogType.NORMAL) == 0
+
+    # Log is still usable after restart
+    assert r1.raft_exec('SET', 'testkey', 'y')
+    r1.terminate()
+    r1.start()
+    r1.wait_for_info_param('state', 'up')
+    assert r1.raft_exec('GET', 'testkey') == b'y'
+
+
 def test_raft_log_max_cache_size(cluster):
     """
     Raft log cache configuration in effect.
@@ -171,3 +200,73 @@ def test_stale_reads_on_leader_election(cluster):
         assert val_read is not None
         assert val_written == int(val_read)
         time.sleep(1)
+
+
+def test_log_group_commit(cluster):
+    """
+    Entries appended together are made durable by a single fsync.
+    """
+
+    r1 = cluster.add_node()
+    assert r1.raft_config_set('raft-log-group-commit-max-delay', 50)
+
+    conns = []
+    for i in range(10):
+        conn = r1.client.connection_pool.get_connection('RAFT')
+        conn.send_command('RAFT', 'SET', 'key%s' % i, 'value')
+        conns.append(conn)
+
+    for conn in conns:
+        assert conn.can_read(timeout=1)
+        assert conn.read_response() == b'OK'
+
+    info = r1.raft_info()
+    assert info['fsync_entries'] >= 10
+    assert info['fsyncs'] < info['fsync_entries']
+    assert info['fsync_max_entries'] > 1
+
+
+def test_log_sync_thread(cluster):
+    """
+    Entries are acknowledged and committed once durable, whether synced by
+    the log sync thread or not.
+    """
+
+    cluster.create(3)
+    expected = 0
+    for sync_thread in ('yes', 'no'):
+        cluster.exec_all('RAFT.CONFIG', 'SET', 'raft-log-sync-thread', sync_thread)
+
+        for _ in range(20):
+            expected += 1
+            assert cluster.raft_exec('INCR', 'counter') == expected
+
+        cluster.wait_for_unanimity()
+        info = cluster.leader_node().raft_info()
+        assert info['durable_index'] == info['current_index']
+        assert info['commit_index'] == info['current_index']
+
+    assert cluster.raft_exec('GET', 'counter') == str(expected).encode()
+
+
+def test_catch_up_from_log_files(cluster):
+    """
+    A follower that is far behind catches up with entries read from the
+    leader's log files, in AppendEntries bounded by size.
+    """
+
+    cluster.create(3)
+    assert cluster.node(1).raft_config_set('raft-log-max-cache-size', '1kb')
+    assert cluster.node(1).raft_config_set('append-entries-max-bytes', '4kb')
+
+    cluster.node(3).terminate()
+    for i in range(500):
+        assert cluster.raft_exec('SET', 'key%s' % i, 'x' * (i % 7 * 300)) == b'OK'
+    time.sleep(0.5)
+    assert cluster.node(1).raft_info()['cache_entries'] < 100
+
+    cluster.node(3).start()
+    cluster.wait_for_unanimity()
+    cluster.node(3).wait_for_log_applied()
+    assert cluster.node(3).raft_info()['last_applied_index'] == \
+        cluster.node(1).commit_index()
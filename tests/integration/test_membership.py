@@ -230,3 +230,66 @@ def test_update_self_voting_state_from_snapshot(cluster):
     cluster.node(1).client.execute_command('RAFT.DEBUG', 'SENDSNAPSHOT', '2')
     cluster.node(2).wait_for_info_param('snapshots_loaded', 1)
     assert cluster.node(2).raft_info()['is_voting'] == 'no'
+
+
+def test_learner(cluster):
+    """
+    A learner replicates the log and serves reads, but does not vote and is
+    never promoted.
+    """
+    cluster.create(3)
+    assert cluster.raft_exec('SET', 'key', 'value') == b'OK'
+
+    r4 = cluster.add_node(cluster_setup=False)
+    r4.start()
+    assert r4.cluster('join', 'learner',
+                      'localhost:{}'.format(cluster.node(1).port)) == b'OK'
+    r4.wait_for_election()
+    cluster.node(1).wait_for_num_nodes(4)
+    cluster.wait_for_unanimity()
+
+    # Not promoted, even once caught up
+    time.sleep(1)
+    assert cluster.node(1).raft_info()['num_voting_nodes'] == 3
+    info = r4.raft_info()
+    assert info['is_voting'] == 'no'
+    assert info['is_learner'] == 'yes'
+
+    # Reads are served locally
+    assert r4.raft_exec('GET', 'key') == b'value'
+    assert r4.raft_info()['learner_reads_served'] == 1
+    assert r4.raft_info()['replication_lag'] == 0
+
+    # Survives a restart
+    r4.restart()
+    r4.wait_for_election()
+    assert r4.raft_info()['is_learner'] == 'yes'
+
+    # Quorum is not affected by a learner going down
+    r4.terminate()
+    assert cluster.raft_exec('SET', 'key', 'value2') == b'OK'
+
+
+def test_learner_max_lag(cluster):
+    """
+    A learner that has not heard from the leader for too long does not serve
+    reads locally.
+    """
+    cluster.create(2)
+    assert cluster.raft_exec('SET', 'key', 'value') == b'OK'
+
+    r3 = cluster.add_node(cluster_setup=False)
+    r3.start()
+    assert r3.cluster('join', 'learner',
+                      'localhost:{}'.format(cluster.node(1).port)) == b'OK'
+    r3.wait_for_election()
+    cluster.wait_for_unanimity()
+    r3.raft_config_set('learner-max-lag-msec', 500)
+
+    cluster.node(1).terminate()
+    cluster.node(2).terminate()
+    time.sleep(1)
+
+    with raises(ResponseError, match='MOVED|NOLEADER'):
+        r3.raft_exec('GET', 'key')
+    assert r3.raft_info()['learner_reads_stale'] == 1
@@ -8,6 +8,8 @@ RedisRaft is dual licensed under the GNU Affero General Public License version 3
 """
 
 import time
+import threading
+import redis
 from redis import ResponseError
 from pytest import raises, skip
 from .sandbox import RedisRaft
@@ -63,6 +65,33 @@ def test_reelection_basic_flow(cluster):
     cluster.exec_all('GET', 'key2')
 
 
+def test_transfer_leader(cluster):
+    """
+    RAFT.TRANSFER-LEADER hands leadership over to the specified node, or to
+    any up to date node.
+    """
+    cluster.create(3)
+    assert cluster.leader == 1
+    assert cluster.raft_exec('SET', 'key', 'value') == b'OK'
+
+    with raises(ResponseError, match='invalid node id'):
+        cluster.node(1).client.execute_command('RAFT.TRANSFER-LEADER', 10)
+
+    assert cluster.node(1).client.execute_command(
+        'RAFT.TRANSFER-LEADER', 2) == b'OK'
+    cluster.node(2).wait_for_election()
+    assert cluster.node(2).raft_info()['leader_id'] == 2
+    assert cluster.node(2).raft_info()['role'] == 'leader'
+
+    with raises(ResponseError, match='MOVED'):
+        cluster.node(1).client.execute_command('RAFT.TRANSFER-LEADER', 3)
+
+    assert cluster.node(2).client.execute_command(
+        'RAFT.TRANSFER-LEADER') == b'OK'
+    assert cluster.node(2).raft_info()['role'] == 'follower'
+    assert cluster.raft_exec('GET', 'key') == b'value'
+
+
 def test_proxying(cluster):
     """
     Command proxying from follower to leader works
@@ -93,6 +122,99 @@ def test_proxying(cluster):
         cluster.node(2).raft_exec('INCR', 'myset')
 
 
+def test_proxy_batch(cluster):
+    """
+    A batch of proxied requests is appended as a single entry, and gets a
+    reply for every request.
+    """
+    cluster.create(3)
+    assert cluster.leader == 1
+
+    idx = cluster.node(1).raft_info()['current_index']
+    assert cluster.node(1).client.execute_command(
+        'RAFT.ENTRY',
+        '*1\n*3\n$3\nSET\n$3\nkey\n$5\nvalue\n',
+        '*3\n*1\n$5\nMULTI\n*2\n$4\nINCR\n$7\ncounter\n'
+        '*2\n$4\nINCR\n$7\ncounter\n',
+        '*1\n*2\n$3\nGET\n$3\nkey\n') == [b'OK', [1, 2], b'value']
+    assert cluster.node(1).raft_info()['current_index'] == idx + 1
+
+    cluster.wait_for_unanimity()
+    assert cluster.node(3).client.get('counter') == b'2'
+
+
+def test_proxying_concurrent_clients(cluster):
+    """
+    Concurrent clients of a follower get the replies of their own
+    commands when these are proxied in batches.
+    """
+    cluster.create(3)
+    assert cluster.leader == 1
+    assert cluster.node(2).client.execute_command(
+        'RAFT.CONFIG', 'SET', 'follower-proxy', 'yes') == b'OK'
+
+    errors = []
+
+    def worker(n):
+        client = redis.Redis(host='localhost', port=cluster.node(2).port)
+        for i in range(50):
+            if client.execute_command('RAFT', 'INCR', 'key-{}'.format(n)) != i + 1:
+                errors.append(n)
+            client.execute_command('RAFT', 'INCR', 'total')
+
+    threads = [threading.Thread(target=worker, args=(n,)) for n in range(10)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    assert errors == []
+    assert cluster.node(2).raft_exec('GET', 'total') == b'500'
+    assert cluster.node(2).raft_info()['proxy_outstanding_reqs'] == 0
+
+
+def test_write_coalescing(cluster):
+    """
+    Writes coalesced into a single log entry get their own replies, and
+    MULTI/EXEC transactions keep their semantics.
+    """
+    cluster.create(3, raft_args={'write-coalesce-max-requests': '16'})
+
+    # Send commands on many connections before reading any reply, so they
+    # are likely to be handled together.
+    conns = [redis.Redis(host='localhost', port=cluster.node(1).port,
+                         single_connection_client=True)
+             for _ in range(10)]
+    for n, client in enumerate(conns):
+        client.connection.send_command('RAFT', 'SET', 'key-{}'.format(n), n)
+    for client in conns:
+        assert client.connection.read_response() == b'OK'
+
+    for client in conns:
+        client.connection.send_command('RAFT', 'INCR', 'counter')
+    assert (sorted(client.connection.read_response() for client in conns) ==
+            list(range(1, 11)))
+
+    # Transactions, coalesced with each other
+    for client in conns[:3]:
+        assert client.execute_command('RAFT', 'MULTI')
+        assert client.execute_command('RAFT', 'INCR', 'counter') == b'QUEUED'
+        assert client.execute_command('RAFT', 'INCR', 'counter') == b'QUEUED'
+    for client in conns[:3]:
+        client.connection.send_command('RAFT', 'EXEC')
+    for client in conns[:3]:
+        result = client.connection.read_response()
+        assert result[1] == result[0] + 1
+
+    cluster.wait_for_unanimity()
+    for n in range(10):
+        assert cluster.node(3).client.get('key-{}'.format(n)) == str(n).encode()
+    assert cluster.node(3).client.get('counter') == b'16'
+
+    info = cluster.node(1).raft_info()
+    assert info['coalesced_reqs'] >= info['coalesced_entries']
+
+
 def test_readonly_commands(cluster):
     """
     Test read-only command execution, which does not go through the Raft
@@ -123,6 +245,120 @@ def test_readonly_commands(cluster):
     assert cluster.node(1).raft_exec('GET', 'key') == b'value'
 
 
+def test_lease_reads(cluster):
+    """
+    Reads are served without a quorum round trip while the lease holds,
+    and wait for the quorum once it lapses.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(1).raft_config_set('lease-reads', 'yes')
+    assert cluster.raft_exec('SET', 'key', 'value') == b'OK'
+
+    # Heartbeats keep the lease alive
+    cluster.wait_for_unanimity()
+    assert cluster.raft_exec('GET', 'key') == b'value'
+    assert cluster.node(1).raft_info()['lease_read_hits'] > 0
+
+    # Once followers are gone, the lease lapses and reads hang
+    cluster.node(2).terminate()
+    cluster.node(3).terminate()
+    time.sleep(1)
+    misses = cluster.node(1).raft_info()['lease_read_misses']
+    conn = cluster.node(1).client.connection_pool.get_connection(
+        'RAFT', socket_timeout=1)
+    conn.send_command('RAFT', 'GET', 'key')
+    assert not conn.can_read(timeout=1)
+    assert cluster.node(1).raft_info()['lease_read_misses'] == misses + 1
+
+
+def test_lease_reads_during_transfer(cluster):
+    """
+    The lease does not hold while leadership is being transferred.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(1).raft_config_set('lease-reads', 'yes')
+    assert cluster.raft_exec('SET', 'key', 'value') == b'OK'
+    cluster.wait_for_unanimity()
+    assert cluster.raft_exec('GET', 'key') == b'value'
+
+    # The transfer to a node that's down lasts until it times out
+    cluster.node(3).terminate()
+    conn = cluster.node(1).client.connection_pool.get_connection('RAFT')
+    conn.send_command('RAFT.TRANSFER-LEADER', 3)
+    cluster.node(1).wait_for_info_param('transfer_leader_id', 3)
+
+    info = cluster.node(1).raft_info()
+    assert cluster.node(1).raft_exec('GET', 'key') == b'value'
+    new_info = cluster.node(1).raft_info()
+    assert new_info['lease_read_hits'] == info['lease_read_hits']
+    assert new_info['lease_read_misses'] == info['lease_read_misses'] + 1
+
+    with raises(ResponseError, match='timed out'):
+        conn.read_response()
+
+    # Once heartbeats are acknowledged again, the lease resumes
+    time.sleep(1)
+    assert cluster.node(1).raft_exec('GET', 'key') == b'value'
+    assert cluster.node(1).raft_info()['lease_read_hits'] > \
+        new_info['lease_read_hits']
+
+
+def test_follower_reads(cluster):
+    """
+    Followers serve reads locally, and see writes completed before the read.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    cluster.node(2).raft_config_set('follower-reads', 'yes')
+
+    for i in range(20):
+        assert cluster.node(1).raft_exec('SET', 'key', str(i)) == b'OK'
+        assert cluster.node(2).raft_exec('GET', 'key') == str(i).encode()
+
+    info = cluster.node(2).raft_info()
+    assert info['follower_reads_served'] == 20
+    assert info['read_index_reqs'] > 0
+
+    # Writes are still redirected
+    with raises(ResponseError, match='MOVED'):
+        cluster.node(2).raft_exec('SET', 'key', 'value')
+
+
+def test_admission_control(cluster):
+    """
+    Writes are rejected once too many entries are uncommitted, while reads
+    are still served.
+    """
+
+    cluster.create(3)
+    assert cluster.leader == 1
+    assert cluster.raft_exec('SET', 'key', 'value') == b'OK'
+    cluster.node(1).raft_config_set('max-uncommitted-entries', 1)
+    cluster.node(1).raft_config_set('quorum-reads', 'no')
+
+    # Without followers, the next write is left uncommitted
+    cluster.node(2).terminate()
+    cluster.node(3).terminate()
+    conn = cluster.node(1).client.connection_pool.get_connection('RAFT')
+    conn.send_command('RAFT', 'SET', 'key', 'uncommitted')
+
+    with raises(ResponseError, match='TRYAGAIN'):
+        cluster.node(1).raft_exec('SET', 'key', 'rejected')
+    assert cluster.node(1).raft_exec('GET', 'key') == b'value'
+    assert cluster.node(1).raft_info()['rejected_uncommitted_reqs'] == 1
+
+    # Once committed, writes are accepted again
+    cluster.node(2).start()
+    cluster.node(3).start()
+    assert conn.read_response() == b'OK'
+    assert cluster.raft_exec('SET', 'key', 'accepted') == b'OK'
+
+
 def test_auto_ids(cluster):
     """
     Test automatic assignment of ids.
@@ -343,3 +579,93 @@ def test_rolled_back_read_only_multi_reply(cluster):
 
     with raises(ResponseError, match='TIMEOUT'):
         assert conn.read_response() == None
+
+
+def test_append_entries_pipelining(cluster):
+    """
+    Entries are replicated correctly with multiple AppendEntries in flight.
+    """
+
+    cluster.create(3, raft_args={'append-entries-window': 4})
+    n1 = cluster.node(1)
+
+    conns = []
+    for i in range(100):
+        conn = n1.client.connection_pool.get_connection('RAFT')
+        conn.send_command('RAFT', 'INCR', 'counter')
+        conns.append(conn)
+
+    for conn in conns:
+        assert conn.can_read(timeout=5)
+        conn.read_response()
+        n1.client.connection_pool.release(conn)
+
+    cluster.wait_for_unanimity()
+    cluster.wait_for_replication()
+    for node in cluster.nodes.values():
+        node.wait_for_log_applied()
+        assert node.client.get('counter') == b'100'
+
+    assert 'ae_inflight' in n1.raft_info()['node0']
+
+
+def test_batched_apply(cluster):
+    """
+    Committed entries are applied correctly in small batches, including
+    replies to clients.
+    """
+
+    cluster.create(3, raft_args={'apply-batch-max-entries': 3})
+    n1 = cluster.node(1)
+
+    conns = []
+    for i in range(50):
+        conn = n1.client.connection_pool.get_connection('RAFT')
+        conn.send_command('RAFT', 'INCR', 'counter')
+        conns.append(conn)
+
+    replies = []
+    for conn in conns:
+        assert conn.can_read(timeout=5)
+        replies.append(conn.read_response())
+        n1.client.connection_pool.release(conn)
+    assert sorted(replies) == list(range(1, 51))
+
+    cluster.wait_for_unanimity()
+    for node in cluster.nodes.values():
+        node.wait_for_log_applied()
+        assert node.client.get('counter') == b'50'
+
+
+def test_latency_stats(cluster):
+    """
+    RAFT.INFO latency reports write path latency, and RAFT.DEBUG
+    RESET_LATENCY resets it.
+    """
+
+    cluster.create(3)
+    n1 = cluster.node(1)
+
+    # Not reported by default
+    assert 'latency_total_usec' not in n1.raft_info()
+
+    for i in range(10):
+        assert n1.raft_exec('INCR', 'counter') == i + 1
+
+    info = n1.client.execute_command('RAFT.INFO', 'latency')
+    assert 'node_id' not in info
+    assert info['latency_total_usec']['count'] == 10
+    assert info['latency_commit_usec']['count'] == 10
+    assert info['latency_ae_rtt_usec']['count'] > 0
+    assert info['latency_total_usec']['p50'] <= \
+        info['latency_total_usec']['max']
+
+    info = n1.client.execute_command('RAFT.INFO', 'all')
+    assert 'node_id' in info
+    assert 'latency_total_usec' in info
+
+    assert n1.client.execute_command(
+        'RAFT.DEBUG', 'RESET_LATENCY') == b'OK'
+    info = n1.client.execute_command('RAFT.INFO', 'latency')
+    assert info['latency_total_usec']['count'] == 0
+    assert info['latency_total_usec']['max'] == 0
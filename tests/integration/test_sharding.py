@@ -106,6 +106,49 @@ def test_shard_group_propagation(cluster):
     assert len(cluster_slots) == 2
 
 
+def test_cluster_nodes(cluster):
+    cluster.create(3, raft_args={
+        'cluster-mode': 'yes',
+        'raftize-all-commands': 'yes',
+        'cluster-start-hslot': '0',
+        'cluster-end-hslot': '1000'})
+
+    c = cluster.node(1).client
+    epoch = cluster.node(1).raft_info()['topology_epoch']
+    slots = c.execute_command('CLUSTER', 'SLOTS')
+
+    # Cached reply is reused while the topology doesn't change
+    assert c.execute_command('CLUSTER', 'SLOTS') == slots
+    assert cluster.node(1).raft_info()['topology_epoch'] == epoch
+
+    assert c.execute_command(
+        'RAFT.SHARDGROUP', 'ADD',
+        '1001', '16383',
+        '1234567890123456789012345678901234567890',
+        '1.1.1.1:1111') == b'OK'
+    assert cluster.node(1).raft_info()['topology_epoch'] > epoch
+    assert len(c.execute_command('CLUSTER', 'SLOTS')) == 2
+
+    lines = c.execute_command('CLUSTER', 'NODES').decode().splitlines()
+    assert len(lines) == 4
+    nodes = {line.split()[1].split('@')[0]: line.split() for line in lines}
+
+    leader = nodes['localhost:%s' % cluster.node(1).port]
+    assert leader[2] == 'myself,master'
+    assert leader[3] == '-'
+    assert leader[8] == '0-1000'
+
+    follower = nodes['localhost:%s' % cluster.node(2).port]
+    assert follower[2] == 'slave'
+    assert follower[3] == leader[0]
+    assert len(follower) == 8
+
+    remote = nodes['1.1.1.1:1111']
+    assert remote[0] == '1234567890123456789012345678901234567890'
+    assert remote[2] == 'master'
+    assert remote[8] == '1001-16383'
+
+
 def test_shard_group_snapshot_propagation(cluster):
     # Create a cluster with just a single slot
     cluster.create(1, raft_args={
@@ -222,6 +265,12 @@ def test_shard_group_linking(cluster_factory):
     assert cs[1][1] == 16383
     assert cs[1][2][1] == cluster2.leader_node().port  # first node is leader
 
+    # The update tells us who the leader is, so redirects point at it
+    for _ in range(3):
+        with raises(ResponseError,
+                    match='MOVED [0-9]+ localhost:%s' % cluster2.leader_node().port):
+            cluster1.node(1).client.set('key', 'value')
+
 
 def test_shard_group_linking_checks(cluster_factory):
     # Create clusters with overlapping hash slots,
@@ -242,3 +291,113 @@ def test_shard_group_linking_checks(cluster_factory):
         cluster1.node(1).client.execute_command(
             'RAFT.SHARDGROUP', 'LINK',
             'localhost:%s' % cluster2.node(1).port)
+
+
+def test_slot_migration(cluster_factory):
+    cluster1 = cluster_factory().create(3, raft_args={
+        'cluster-mode': 'yes',
+        'raftize-all-commands': 'yes',
+        'cluster-start-hslot': '0',
+        'cluster-end-hslot': '8191'})
+    cluster2 = cluster_factory().create(3, raft_args={
+        'cluster-mode': 'yes',
+        'raftize-all-commands': 'yes',
+        'cluster-start-hslot': '8192',
+        'cluster-end-hslot': '16383'})
+
+    c1 = cluster1.node(1).client
+    c2 = cluster2.node(1).client
+    assert c1.execute_command(
+        'RAFT.SHARDGROUP', 'LINK',
+        'localhost:%s' % cluster2.node(1).port) == b'OK'
+    assert c2.execute_command(
+        'RAFT.SHARDGROUP', 'LINK',
+        'localhost:%s' % cluster1.node(1).port) == b'OK'
+
+    # Keys with the {b} hash tag map to slot 3300
+    for i in range(50):
+        assert c1.set('{b}key%d' % i, i)
+    assert c1.set('{b}ttl', 'value', px=100000)
+
+    id1 = c1.execute_command('RAFT.SHARDGROUP', 'GET')[2]
+    id2 = c2.execute_command('RAFT.SHARDGROUP', 'GET')[2]
+
+    with raises(ResponseError, match='not owned'):
+        c2.execute_command('RAFT.SHARDGROUP', 'SETSLOT', 3300, 'MIGRATING', id1)
+    with raises(ResponseError, match='not migrating'):
+        c1.execute_command('RAFT.SHARDGROUP', 'MIGRATE', 3300)
+
+    assert c2.execute_command(
+        'RAFT.SHARDGROUP', 'SETSLOT', 3300, 'IMPORTING', id1) == b'OK'
+    assert c1.execute_command(
+        'RAFT.SHARDGROUP', 'SETSLOT', 3300, 'MIGRATING', id2) == b'OK'
+
+    # Keys not migrated yet can be read but not written
+    assert c1.get('{b}key1') == b'1'
+    with raises(ResponseError, match='TRYAGAIN'):
+        c1.set('{b}key1', 'value')
+
+    # New keys are created on the target, which requires ASKING
+    with raises(ResponseError, match='ASK 3300 localhost'):
+        c1.set('{b}new', 'value')
+    with raises(ResponseError, match='MOVED 3300'):
+        c2.set('{b}new', 'value')
+    p = c2.pipeline(transaction=False)
+    p.execute_command('ASKING')
+    p.set('{b}new', 'value')
+    assert p.execute() == [b'OK', True]
+
+    # Migrate keys, until no keys are left
+    migrated = 0
+    for _ in range(100):
+        try:
+            keys, done = c1.execute_command(
+                'RAFT.SHARDGROUP', 'MIGRATE', 3300, 10)
+        except ResponseError as err:
+            assert str(err).startswith('TRYAGAIN')
+            time.sleep(0.1)
+            continue
+        assert keys <= 10
+        migrated += keys
+        if done and not keys:
+            break
+    assert migrated == 51
+
+    # Migrated keys are only available on the target
+    with raises(ResponseError, match='ASK 3300'):
+        c1.get('{b}key1')
+    p = c2.pipeline(transaction=False)
+    p.execute_command('ASKING')
+    p.get('{b}key1')
+    p.execute_command('ASKING')
+    p.pttl('{b}ttl')
+    reply = p.execute()
+    assert reply[1] == b'1'
+    assert 0 < reply[3] <= 100000
+
+    # Flip ownership
+    assert c2.execute_command(
+        'RAFT.SHARDGROUP', 'SETSLOT', 3300, 'NODE', id2) == b'OK'
+    assert c1.execute_command(
+        'RAFT.SHARDGROUP', 'SETSLOT', 3300, 'NODE', id2) == b'OK'
+
+    assert c2.get('{b}key1') == b'1'
+    assert c2.get('{b}new') == b'value'
+    with raises(ResponseError, match='MOVED 3300 localhost'):
+        c1.get('{b}key1')
+
+    def slot_ranges(client):
+        return sorted((r[0], r[1]) for r in
+                      client.execute_command('CLUSTER', 'SLOTS'))
+
+    ranges = [(0, 3299), (3300, 3300), (3301, 8191), (8192, 16383)]
+    assert slot_ranges(c1) == ranges
+    assert slot_ranges(c2) == ranges
+
+    # Slot ownership is persisted in snapshots
+    n2 = cluster1.node(2)
+    n2.client.execute_command('RAFT.DEBUG', 'COMPACT')
+    n2.terminate()
+    n2.start()
+    n2.wait_for_node_voting()
+    assert slot_ranges(n2.client) == ranges
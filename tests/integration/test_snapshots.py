@@ -33,6 +33,93 @@ def test_snapshot_delivery_to_new_node(cluster):
     assert r2.client.get('testkey') == b'4'
 
 
+def test_snapshot_delivery_in_chunks(cluster):
+    """
+    Deliver a snapshot that spans many chunks.
+    """
+
+    r1 = cluster.add_node(raft_args={'snapshot-chunk-size': '64kb'})
+    r1.client.config_set('rdbcompression', 'no')
+    r1.raft_exec('SETRANGE', 'bigkey', '1048576', 'x')
+    r1.raft_exec('INCR', 'testkey')
+    assert r1.client.execute_command('RAFT.DEBUG', 'COMPACT') == b'OK'
+    assert r1.raft_info()['log_entries'] == 0
+
+    r2 = cluster.add_node()
+    cluster.wait_for_unanimity()
+    assert r2.client.get('testkey') == b'1'
+    assert r2.client.strlen('bigkey') == 1048577
+    assert r2.raft_info()['snapshots_loaded'] == 1
+
+    # Chunks are compressed on the wire
+    info = r1.raft_info()
+    assert info['snapshots_delivered'] == 1
+    assert info['snapshot_raw_bytes_sent'] > 1048576
+    assert info['snapshot_bytes_sent'] < info['snapshot_raw_bytes_sent'] / 10
+    assert (r2.raft_info()['snapshot_raw_bytes_received'] ==
+            info['snapshot_raw_bytes_sent'])
+
+
+def test_snapshot_delivery_uncompressed(cluster):
+    """
+    Deliver a snapshot with snapshot-compression disabled.
+    """
+
+    r1 = cluster.add_node(raft_args={'snapshot-compression': 'no'})
+    r1.client.config_set('rdbcompression', 'no')
+    r1.raft_exec('SETRANGE', 'bigkey', '1048576', 'x')
+    assert r1.client.execute_command('RAFT.DEBUG', 'COMPACT') == b'OK'
+
+    r2 = cluster.add_node()
+    cluster.wait_for_unanimity()
+    assert r2.client.strlen('bigkey') == 1048577
+
+    info = r1.raft_info()
+    assert info['snapshot_bytes_sent'] == info['snapshot_raw_bytes_sent']
+    assert info['snapshot_bytes_sent'] > 1048576
+
+
+def test_snapshot_delivery_bulk_connection(cluster):
+    """
+    Snapshots are delivered on the bulk connection, when enabled.
+    """
+
+    r1 = cluster.add_node()
+    r1.raft_exec('SETRANGE', 'bigkey', '1048576', 'x')
+    assert r1.client.execute_command('RAFT.DEBUG', 'COMPACT') == b'OK'
+
+    r2 = cluster.add_node()
+    cluster.wait_for_unanimity()
+    assert r2.client.strlen('bigkey') == 1048577
+
+    node = r1.raft_info()['node0']
+    assert node['bulk_state'] == 'connected'
+    assert node['bulk_sent_bytes'] > 0
+    assert node['bulk_pending_reqs'] == 0
+    assert node['sent_bytes'] > 0
+
+
+def test_snapshot_delivery_no_bulk_connection(cluster):
+    """
+    With bulk-connection disabled, snapshots are delivered on the primary
+    connection.
+    """
+
+    r1 = cluster.add_node(raft_args={'bulk-connection': 'no'})
+    r1.client.config_set('rdbcompression', 'no')
+    r1.raft_exec('SETRANGE', 'bigkey', '1048576', 'x')
+    assert r1.client.execute_command('RAFT.DEBUG', 'COMPACT') == b'OK'
+
+    r2 = cluster.add_node()
+    cluster.wait_for_unanimity()
+    assert r2.client.strlen('bigkey') == 1048577
+
+    node = r1.raft_info()['node0']
+    assert node['bulk_state'] == '-'
+    assert node['bulk_sent_bytes'] == 0
+    assert node['sent_bytes'] > r1.raft_info()['snapshot_bytes_sent']
+
+
 def test_snapshot_delivery(cluster):
     """
     Ability to properly deliver and load a snapshot.
@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 
 #include "cmocka.h"
 
@@ -37,8 +38,7 @@ static int teardown_log(void **state)
 {
     RaftLog *log = (RaftLog *) *state;
     RaftLogClose(log);
-    unlink(LOGNAME);
-    unlink(LOGNAME ".idx");
+    RaftLogRemoveFiles(LOGNAME);
     return 0;
 }
 
@@ -139,7 +139,7 @@ static void test_log_load_entries(void **state)
     expect_value(log_entries_callback, ety_id, 30);
     expect_memory(log_entries_callback, value, "value30", 7);
 
-    assert_int_equal(RaftLogLoadEntries(log, log_entries_callback, NULL), 2);
+    assert_int_equal(RaftLogLoadEntries(log, 0, log_entries_callback, NULL), 2);
 }
 
 static void test_log_index_rebuild(void **state)
@@ -151,11 +151,11 @@ static void test_log_index_rebuild(void **state)
     __append_entry(log, 30);
 
     /* Delete index file */
-    unlink(LOGNAME ".idx");
+    unlink(LOGNAME ".seg.101.idx");
 
     /* Reopen the log */
-    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL, 0);
-    RaftLogLoadEntries(log2, NULL, NULL);
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL);
+    RaftLogLoadEntries(log2, 0, NULL, NULL);
 
     /* Invalid out of bound reads */
     assert_null(RaftLogGet(log, 99));
@@ -191,6 +191,453 @@ static void test_log_write_after_read(void **state)
     raft_entry_release(e);
 }
 
+static void test_log_append_nosync(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    int i;
+
+    for (i = 1; i <= 3; i++) {
+        raft_entry_t *e = __make_entry(i);
+        assert_int_equal(RaftLogAppendNoSync(log, e), RR_OK);
+        raft_entry_release(e);
+    }
+
+    /* Unsynced entries are still readable, but not durable */
+    assert_int_equal(log->unsynced_entries, 3);
+    assert_int_equal(RaftLogCount(log), 3);
+    assert_int_equal(log->durable_idx, 0);
+
+    raft_entry_t *e = RaftLogGet(log, 2);
+    assert_non_null(e);
+    assert_int_equal(e->id, 2);
+    raft_entry_release(e);
+
+    /* Sync and confirm all entries made it to the file */
+    assert_int_equal(RaftLogSync(log), RR_OK);
+    assert_int_equal(log->unsynced_entries, 0);
+    assert_int_equal(log->durable_idx, 3);
+
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogLoadEntries(log2, 0, NULL, NULL), 3);
+    assert_int_equal(log2->durable_idx, 3);
+    RaftLogClose(log2);
+
+    /* Entries written in place of deleted ones are not durable */
+    assert_int_equal(RaftLogDelete(log, 2, NULL, NULL), RR_OK);
+    assert_int_equal(log->durable_idx, 1);
+    e = __make_entry(4);
+    assert_int_equal(RaftLogAppendNoSync(log, e), RR_OK);
+    raft_entry_release(e);
+    assert_int_equal(log->durable_idx, 1);
+}
+
+static void test_log_delete_fails_unsynced_replies(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    RedisRaftCtx rr = { 0 };
+    RaftReq req1 = { .type = RR_APPENDENTRIES };
+    RaftReq req2 = { .type = RR_APPENDENTRIES };
+    int i;
+
+    rr.log = log;
+    rr.logcache = EntryCacheNew(8);
+    rr.raft = raft_new();
+    raft_set_current_term(rr.raft, 2);
+    STAILQ_INIT(&rr.unsynced_appendentries);
+    STAILQ_INIT(&rr.unsynced_ae_responses);
+
+    for (i = 1; i <= 3; i++) {
+        raft_entry_t *e = __make_entry(i);
+        assert_int_equal(RaftLogAppendNoSync(log, e), RR_OK);
+        raft_entry_release(e);
+    }
+
+    /* Replies acknowledging entries 1 and 3, waiting for them to be synced */
+    req1.r.appendentries.response = (msg_appendentries_response_t) {
+        .term = 2, .success = 1, .current_idx = 1
+    };
+    req2.r.appendentries.response = (msg_appendentries_response_t) {
+        .term = 2, .success = 1, .current_idx = 3
+    };
+    STAILQ_INSERT_TAIL(&rr.unsynced_appendentries, &req1, entries);
+    STAILQ_INSERT_TAIL(&rr.unsynced_appendentries, &req2, entries);
+
+    /* Deleting entry 3 fails the reply that acknowledges it */
+    assert_int_equal(RaftLogImpl.pop(&rr, 3, NULL, NULL), 0);
+    assert_int_equal(req1.r.appendentries.response.success, 1);
+    assert_int_equal(req1.r.appendentries.response.current_idx, 1);
+    assert_int_equal(req2.r.appendentries.response.success, 0);
+    assert_int_equal(req2.r.appendentries.response.current_idx, 2);
+    assert_int_equal(req2.r.appendentries.response.term, 2);
+
+    /* A new term fails the rest */
+    RaftFailUnsyncedAppendEntries(&rr, 3, log->index + 1);
+    assert_int_equal(req1.r.appendentries.response.success, 0);
+    assert_int_equal(req1.r.appendentries.response.current_idx, 1);
+    assert_int_equal(req1.r.appendentries.response.term, 3);
+
+    raft_destroy(rr.raft);
+    EntryCacheFree(rr.logcache);
+}
+
+static void test_log_index_grow(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    const int count = 70000;    /* Beyond a single index map chunk */
+    int i;
+
+    log->fsync = false;
+    for (i = 1; i <= count; i++) {
+        raft_entry_t *e = __make_entry(i);
+        assert_int_equal(RaftLogAppendNoSync(log, e), RR_OK);
+        raft_entry_release(e);
+    }
+    struct stat st;
+    assert_int_equal(stat(LOGNAME ".seg.1.idx", &st), 0);
+    assert_true(st.st_size >= sizeof(off_t) * count);
+
+    /* Lookups across the chunk boundary */
+    for (i = 65530; i <= 65540; i++) {
+        raft_entry_t *e = RaftLogGet(log, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        raft_entry_release(e);
+    }
+
+    /* Out of bounds */
+    assert_null(RaftLogGet(log, count + 1));
+
+    /* Delete and append over deleted entries */
+    assert_int_equal(RaftLogDelete(log, 65536, NULL, NULL), RR_OK);
+    assert_int_equal(RaftLogCount(log), 65535);
+    assert_null(RaftLogGet(log, 65536));
+
+    raft_entry_t *e = __make_entry(100000);
+    assert_int_equal(RaftLogAppend(log, e), RR_OK);
+    raft_entry_release(e);
+
+    e = RaftLogGet(log, 65536);
+    assert_non_null(e);
+    assert_int_equal(e->id, 100000);
+    raft_entry_release(e);
+}
+
+static void test_log_segments(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    raft_entry_t *e;
+    int i;
+
+    /* Entries take 74 bytes, so every segment holds 14 of them */
+    log->fsync = false;
+    log->segment_size = 1000;
+    for (i = 1; i <= 100; i++) {
+        __append_entry(log, i);
+    }
+    assert_int_equal(log->num_segments, 8);
+
+    for (i = 1; i <= 100; i++) {
+        e = RaftLogGet(log, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        raft_entry_release(e);
+    }
+
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    assert_int_equal(log2->num_segments, 8);
+    assert_int_equal(RaftLogLoadEntries(log2, 0, NULL, NULL), 100);
+    RaftLogClose(log2);
+
+    /* Deleting entries drops the last segment and truncates the previous one */
+    assert_int_equal(RaftLogDelete(log, 95, NULL, NULL), RR_OK);
+    assert_int_equal(log->num_segments, 7);
+    assert_int_equal(RaftLogCount(log), 94);
+    assert_int_equal(access(LOGNAME ".seg.99", F_OK), -1);
+
+    __append_entry(log, 1000);
+    e = RaftLogGet(log, 95);
+    assert_non_null(e);
+    assert_int_equal(e->id, 1000);
+    raft_entry_release(e);
+
+    /* Compaction removes segments covered by the snapshot */
+    assert_int_equal(RaftLogCompact(log, 30, 1), RR_OK);
+    assert_int_equal(log->num_segments, 5);
+    assert_int_equal(RaftLogCount(log), 65);
+    assert_int_equal(log->file_size, 65 * 74);
+    assert_int_equal(access(LOGNAME ".seg.1", F_OK), -1);
+    assert_int_equal(access(LOGNAME ".seg.15", F_OK), -1);
+    assert_int_equal(access(LOGNAME ".seg.29", F_OK), 0);
+    assert_null(RaftLogGet(log, 30));
+
+    log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogFirstIdx(log2), 30);
+    assert_int_equal(RaftLogLoadEntries(log2, 0, NULL, NULL), 65);
+    assert_int_equal(RaftLogCurrentIdx(log2), 95);
+    assert_int_equal(log2->file_size, 65 * 74);
+    assert_null(RaftLogGet(log2, 30));
+    e = RaftLogGet(log2, 31);
+    assert_non_null(e);
+    assert_int_equal(e->id, 31);
+    raft_entry_release(e);
+    RaftLogClose(log2);
+}
+
+static void test_log_cursor(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    RaftLogCursor *cursor = RaftLogCursorNew(log);
+    raft_entry_t *e;
+    int i;
+
+    log->fsync = false;
+    log->segment_size = 1000;
+    for (i = 1; i <= 100; i++) {
+        __append_entry(log, i);
+    }
+
+    /* Sequential reads, across segments */
+    for (i = 1; i <= 100; i++) {
+        e = RaftLogCursorGet(cursor, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        raft_entry_release(e);
+    }
+    assert_null(RaftLogCursorGet(cursor, 101));
+
+    /* Entries appended after reading ahead */
+    __append_entry(log, 101);
+    e = RaftLogCursorGet(cursor, 101);
+    assert_non_null(e);
+    assert_int_equal(e->id, 101);
+    raft_entry_release(e);
+
+    /* Repositioning */
+    e = RaftLogCursorGet(cursor, 50);
+    assert_non_null(e);
+    assert_int_equal(e->id, 50);
+    raft_entry_release(e);
+    e = RaftLogCursorGet(cursor, 51);
+    assert_non_null(e);
+    assert_int_equal(e->id, 51);
+    raft_entry_release(e);
+
+    /* Deleted entries are not read from the readahead buffer */
+    e = RaftLogCursorGet(cursor, 94);
+    assert_non_null(e);
+    raft_entry_release(e);
+    assert_int_equal(RaftLogDelete(log, 95, NULL, NULL), RR_OK);
+    __append_entry(log, 1000);
+    e = RaftLogCursorGet(cursor, 95);
+    assert_non_null(e);
+    assert_int_equal(e->id, 1000);
+    raft_entry_release(e);
+    assert_null(RaftLogCursorGet(cursor, 96));
+
+    /* Nor are compacted ones */
+    assert_int_equal(RaftLogCompact(log, 30, 1), RR_OK);
+    assert_null(RaftLogCursorGet(cursor, 30));
+    e = RaftLogCursorGet(cursor, 31);
+    assert_non_null(e);
+    assert_int_equal(e->id, 31);
+    raft_entry_release(e);
+
+    RaftLogCursorFree(cursor);
+}
+
+static void test_log_cursor_large_entries(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    RaftLogCursor *cursor = RaftLogCursorNew(log);
+    size_t len = 3 * 1024 * 1024;
+    raft_entry_t *e;
+    int i;
+
+    log->fsync = false;
+    for (i = 1; i <= 3; i++) {
+        e = raft_entry_new(len);
+        e->id = i;
+        memset(e->data, 'a' + i, len);
+        assert_int_equal(RaftLogAppend(log, e), RR_OK);
+        raft_entry_release(e);
+    }
+    __append_entry(log, 4);
+
+    for (i = 1; i <= 3; i++) {
+        e = RaftLogCursorGet(cursor, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        assert_int_equal(e->data_len, len);
+        assert_int_equal(e->data[len - 1], 'a' + i);
+        raft_entry_release(e);
+    }
+    e = RaftLogCursorGet(cursor, 4);
+    assert_non_null(e);
+    assert_int_equal(e->id, 4);
+    raft_entry_release(e);
+
+    RaftLogCursorFree(cursor);
+}
+
+static int count_entries_callback(void *arg, raft_entry_t *entry, raft_index_t idx)
+{
+    raft_index_t *last_idx = (raft_index_t *) arg;
+
+    /* Entries are handed over in order */
+    assert_int_equal(idx, *last_idx + 1);
+    assert_int_equal(entry->id, idx);
+    *last_idx = idx;
+
+    return 0;
+}
+
+static void test_log_load_sealed(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+    raft_index_t last_idx;
+    raft_entry_t *e;
+    int i;
+
+    log->fsync = false;
+    log->segment_size = 1000;
+    for (i = 1; i <= 100; i++) {
+        __append_entry(log, i);
+    }
+    assert_int_equal(log->num_segments, 8);
+
+    /* Applied entries are indexed, but not handed over */
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    last_idx = 50;
+    assert_int_equal(RaftLogLoadEntries(log2, 50, count_entries_callback, &last_idx), 100);
+    assert_int_equal(last_idx, 100);
+    assert_int_equal(RaftLogCurrentIdx(log2), 100);
+    for (i = 1; i <= 100; i++) {
+        e = RaftLogGet(log2, i);
+        assert_non_null(e);
+        assert_int_equal(e->id, i);
+        raft_entry_release(e);
+    }
+    RaftLogClose(log2);
+
+    /* An index that does not match its sealed segment is rebuilt */
+    assert_int_equal(truncate(LOGNAME ".seg.15.idx", 0), 0);
+    log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    last_idx = 0;
+    assert_int_equal(RaftLogLoadEntries(log2, 0, count_entries_callback, &last_idx), 100);
+    assert_int_equal(last_idx, 100);
+    e = RaftLogGet(log2, 20);
+    assert_non_null(e);
+    assert_int_equal(e->id, 20);
+    raft_entry_release(e);
+    RaftLogClose(log2);
+}
+
+static void test_log_torn_tail(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+
+    __append_entry(log, 1);
+    __append_entry(log, 2);
+    size_t good_size = log->file_size;
+    __append_entry(log, 3);
+
+    /* Simulate a partially written last entry */
+    assert_int_equal(truncate(LOGNAME ".seg.1", log->file_size - 5), 0);
+
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogLoadEntries(log2, 0, NULL, NULL), 2);
+    assert_int_equal(log2->file_size, good_size);
+
+    /* Log is usable after truncation */
+    raft_entry_t *e = __make_entry(4);
+    assert_int_equal(RaftLogAppend(log2, e), RR_OK);
+    raft_entry_release(e);
+
+    e = RaftLogGet(log2, 3);
+    assert_non_null(e);
+    assert_int_equal(e->id, 4);
+    raft_entry_release(e);
+    RaftLogClose(log2);
+
+    log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_int_equal(RaftLogLoadEntries(log2, 0, NULL, NULL), 3);
+    RaftLogClose(log2);
+}
+
+static void test_log_corrupt_entry(void **state)
+{
+    RaftLog *log = (RaftLog *) *state;
+
+    __append_entry(log, 1);
+    size_t corrupt_offset = log->file_size + 30;
+    __append_entry(log, 2);
+    __append_entry(log, 3);
+
+    /* Corrupt the data of the second entry */
+    FILE *f = fopen(LOGNAME ".seg.1", "r+");
+    assert_non_null(f);
+    assert_int_equal(fseek(f, corrupt_offset, SEEK_SET), 0);
+    fputc('X', f);
+    fclose(f);
+
+    RaftLog *log2 = RaftLogOpen(LOGNAME, NULL);
+    assert_non_null(log2);
+    assert_int_equal(RaftLogLoadEntries(log2, 0, NULL, NULL), -1);
+    RaftLogClose(log2);
+}
+
+#define V1_LOGNAME "test.log.v1.db"
+
+static void test_log_v1_compat(void **state)
+{
+    /* Write a version 1 log, which is RESP encoded */
+    FILE *f = fopen(V1_LOGNAME, "w");
+    assert_non_null(f);
+    fprintf(f, "*8\r\n$7\r\nRAFTLOG\r\n$4\r\n0001\r\n$32\r\n%s\r\n"
+               "$20\r\n%020u\r\n$20\r\n%020u\r\n$20\r\n%020u\r\n"
+               "$20\r\n%020u\r\n$11\r\n%011d\r\n",
+               DBID, 1, 0, 0, 1, -1);
+    fprintf(f, "*5\r\n$5\r\nENTRY\r\n$1\r\n1\r\n$1\r\n7\r\n$1\r\n0\r\n$6\r\nvalue7\r\n");
+    fclose(f);
+    f = fopen(V1_LOGNAME ".idx", "w");
+    assert_non_null(f);
+    fclose(f);
+
+    /* Opening the log moves its entries into segments, and drops the old index */
+    RaftLog *log = RaftLogOpen(V1_LOGNAME, NULL);
+    assert_non_null(log);
+    assert_int_equal(log->version, RAFTLOG_VERSION);
+    assert_int_equal(log->num_segments, 1);
+    assert_int_equal(access(V1_LOGNAME ".idx", F_OK), -1);
+    assert_int_equal(RaftLogLoadEntries(log, 0, NULL, NULL), 1);
+
+    raft_entry_t *e = RaftLogGet(log, 1);
+    assert_non_null(e);
+    assert_int_equal(e->id, 7);
+    assert_memory_equal(e->data, "value7", 6);
+    raft_entry_release(e);
+
+    __append_entry(log, 8);
+    RaftLogClose(log);
+
+    log = RaftLogOpen(V1_LOGNAME, NULL);
+    assert_int_equal(log->version, RAFTLOG_VERSION);
+    assert_int_equal(RaftLogLoadEntries(log, 0, NULL, NULL), 2);
+    e = RaftLogGet(log, 2);
+    assert_non_null(e);
+    assert_int_equal(e->id, 8);
+    raft_entry_release(e);
+    RaftLogClose(log);
+
+    RaftLogRemoveFiles(V1_LOGNAME);
+}
+
 static void test_log_fuzzer(void **state)
 {
     RaftLog *log = (RaftLog *) *state;
@@ -241,7 +688,7 @@ static void test_log_voting_persistence(void **state)
     assert_int_equal(ety->id, 3);
     raft_entry_release(ety);
 
-    RaftLog *templog = RaftLogOpen(LOGNAME, NULL, 0);
+    RaftLog *templog = RaftLogOpen(LOGNAME, NULL);
     assert_int_equal(templog->term, 0xffffffff);
     assert_int_equal(templog->vote, INT32_MAX);
     RaftLogClose(templog);
@@ -545,6 +992,68 @@ static void test_entry_cache_fuzzer(void **state)
     EntryCacheFree(cache);
 }
 
+static void test_entry_cache_chunks(void **state)
+{
+    EntryCache *cache = EntryCacheNew(4);
+    raft_entry_t *ety, *held;
+    int i;
+
+    for (i = 1; i <= 100; i++) {
+        ety = raft_entry_new(1000);
+        ety->id = i;
+        ety->user_data = (void *) 0x1234;
+        memset(ety->data, i, ety->data_len);
+        EntryCacheAppend(cache, ety, i);
+
+        /* Cache copy takes over user_data */
+        assert_null(ety->user_data);
+        raft_entry_release(ety);
+    }
+
+    /* Entries are accounted for with their headers */
+    assert_true(cache->entries_memsize > 100 * (sizeof(raft_entry_t) + 1000));
+    assert_true(cache->chunks_memsize >= cache->entries_memsize);
+
+    for (i = 1; i <= 100; i++) {
+        ety = EntryCacheGet(cache, i);
+        assert_int_equal(ety->id, i);
+        assert_int_equal(ety->data_len, 1000);
+        assert_int_equal((unsigned char) ety->data[999], i);
+        assert_ptr_equal(ety->user_data, (void *) 0x1234);
+        ety->user_data = NULL;
+        raft_entry_release(ety);
+    }
+
+    /* An entry held elsewhere outlives compaction */
+    held = EntryCacheGet(cache, 50);
+    assert_int_equal(EntryCacheCompact(cache, 0), 100);
+    assert_int_equal(cache->len, 0);
+    assert_int_equal(cache->entries_memsize, 0);
+    assert_int_equal(held->id, 50);
+    assert_int_equal((unsigned char) held->data[0], 50);
+    raft_entry_release(held);
+
+    /* Compaction limits the memory of chunks, not just of entries */
+    for (i = 1; i <= 30; i++) {
+        ety = raft_entry_new(100 * 1000);
+        EntryCacheAppend(cache, ety, i);
+        raft_entry_release(ety);
+    }
+    assert_true(cache->chunks_memsize > 2500000);
+    assert_true(EntryCacheCompact(cache, 2500000) > 0);
+    assert_true(cache->len > 0);
+    assert_true(cache->chunks_memsize <= 2500000);
+    EntryCacheDeleteTail(cache, cache->start_idx);
+
+    /* Entries larger than a chunk */
+    ety = raft_entry_new(4 * 1024 * 1024);
+    EntryCacheAppend(cache, ety, 1);
+    raft_entry_release(ety);
+    assert_true(cache->chunks_memsize > 4 * 1024 * 1024);
+
+    EntryCacheFree(cache);
+}
+
 const struct CMUnitTest log_tests[] = {
     cmocka_unit_test_setup_teardown(
             test_log_load_entries, setup_create_log, teardown_log),
@@ -560,6 +1069,26 @@ const struct CMUnitTest log_tests[] = {
             test_log_delete, setup_create_log, teardown_log),
     cmocka_unit_test_setup_teardown(
             test_log_voting_persistence, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_append_nosync, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_delete_fails_unsynced_replies, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_index_grow, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_segments, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_cursor, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_cursor_large_entries, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_load_sealed, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_torn_tail, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_corrupt_entry, setup_create_log, teardown_log),
+    cmocka_unit_test_setup_teardown(
+            test_log_v1_compat, NULL, NULL),
     cmocka_unit_test_setup_teardown(
             test_log_fuzzer, setup_create_log, teardown_log),
     cmocka_unit_test_setup_teardown(
@@ -572,5 +1101,7 @@ const struct CMUnitTest log_tests[] = {
             test_entry_cache_delete_tail, NULL, NULL),
     cmocka_unit_test_setup_teardown(
             test_entry_cache_fuzzer, NULL, NULL),
+    cmocka_unit_test_setup_teardown(
+            test_entry_cache_chunks, NULL, NULL),
     { .test_func = NULL }
 };
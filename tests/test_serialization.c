@@ -77,6 +77,94 @@ static void test_deserialize_redis_command_array(void **state)
     RaftRedisCommandArrayFree(&cmd_array);
 }
 
+static void test_serialize_long_argument(void **state)
+{
+    const char *cmd_argv[] = { "SET", "key", NULL };
+    size_t value_len = 12345678;
+    char *value = test_malloc(value_len + 1);
+
+    memset(value, 'x', value_len);
+    value[value_len] = '\0';
+    cmd_argv[2] = value;
+
+    RaftRedisCommandArray cmd_array = { 0 };
+    setupRedisCommand(RaftRedisCommandArrayExtend(&cmd_array), cmd_argv, 3);
+
+    /* Entry is sized exactly */
+    raft_entry_t *e = RaftRedisCommandArraySerialize(&cmd_array);
+    assert_non_null(e);
+    assert_int_equal(e->data_len, strlen("*1\n*3\n$3\nSET\n$3\nkey\n$12345678\n\n") + value_len);
+    assert_memory_equal(e->data + e->data_len - value_len - 11, "$12345678\n", 10);
+
+    RaftRedisCommandArray decoded = { 0 };
+    assert_int_equal(RaftRedisCommandArrayDeserialize(&decoded, e->data, e->data_len), RR_OK);
+    assert_int_equal(strlen((char *) decoded.commands[0]->argv[2]), value_len);
+
+    RaftRedisCommandArrayFree(&decoded);
+    raft_entry_release(e);
+    RaftRedisCommandArrayFree(&cmd_array);
+    test_free(value);
+}
+
+static void test_serialize_nine_arguments(void **state)
+{
+    /* argc has one digit less than argc + 1 */
+    const char *cmd_argv[] = { "MSET", "k1", "v1", "k2", "v2", "k3", "v3", "k4", "v4" };
+
+    RaftRedisCommandArray cmd_array = { 0 };
+    setupRedisCommand(RaftRedisCommandArrayExtend(&cmd_array), cmd_argv, 9);
+
+    const char *expected = "*1\n*9\n$4\nMSET\n$2\nk1\n$2\nv1\n$2\nk2\n$2\nv2\n"
+                           "$2\nk3\n$2\nv3\n$2\nk4\n$2\nv4\n";
+
+    raft_entry_t *e = RaftRedisCommandArraySerialize(&cmd_array);
+    assert_non_null(e);
+    assert_int_equal(e->data_len, strlen(expected));
+    assert_memory_equal(e->data, expected, strlen(expected));
+
+    RaftRedisCommandArray decoded = { 0 };
+    assert_int_equal(RaftRedisCommandArrayDeserialize(&decoded, e->data, e->data_len), RR_OK);
+    assert_int_equal(decoded.commands[0]->argc, 9);
+
+    RaftRedisCommandArrayFree(&decoded);
+    raft_entry_release(e);
+    RaftRedisCommandArrayFree(&cmd_array);
+}
+
+static void test_command_array_view(void **state)
+{
+    const char *serialized = "*3\n*3\n$3\nSET\n$3\nkey\n$5\nvalue\n*2\n$3\nGET\n$5\nmykey\n*1\n$4\nPING\n";
+    RaftRedisCommandArrayView view = { 0 };
+
+    assert_int_equal(RaftRedisCommandArrayViewDecode(&view, serialized, strlen(serialized)), RR_OK);
+    assert_int_equal(view.len, 3);
+
+    /* Arguments point into the serialized data */
+    assert_int_equal(view.commands[0].argc, 3);
+    assert_ptr_equal(view.commands[0].argv[0].ptr, serialized + 9);
+    assert_int_equal(view.commands[0].argv[0].len, 3);
+    assert_memory_equal(view.commands[0].argv[2].ptr, "value", 5);
+    assert_int_equal(view.commands[0].argv[2].len, 5);
+    assert_int_equal(view.commands[1].argc, 2);
+    assert_memory_equal(view.commands[1].argv[1].ptr, "mykey", 5);
+    assert_int_equal(view.commands[2].argc, 1);
+    assert_memory_equal(view.commands[2].argv[0].ptr, "PING", 4);
+
+    RaftRedisCommandArrayViewFree(&view);
+    assert_null(view.commands);
+
+    /* Invalid data */
+    const char *d_truncated = "*2\n*1\n$4\nPING\n*1\n$4\nPI";
+    assert_int_equal(RaftRedisCommandArrayViewDecode(&view, d_truncated, strlen(d_truncated)), RR_ERROR);
+    const char *d_zero_array_len = "*0\n";
+    assert_int_equal(RaftRedisCommandArrayViewDecode(&view, d_zero_array_len, strlen(d_zero_array_len)), RR_ERROR);
+    const char *d_array_empty_command = "*1\n*0\n";
+    assert_int_equal(RaftRedisCommandArrayViewDecode(&view, d_array_empty_command, strlen(d_array_empty_command)), RR_ERROR);
+    const char *d_bad_arg_len = "*1\n*1\n$bad\n";
+    assert_int_equal(RaftRedisCommandArrayViewDecode(&view, d_bad_arg_len, strlen(d_bad_arg_len)), RR_ERROR);
+    assert_null(view.commands);
+}
+
 static void test_deserialize_corrupted_data(void **state)
 {
     RaftRedisCommand target = { 0 };
@@ -214,12 +302,80 @@ static void test_deserialize_shardgroup(void **state)
     assert_int_equal(ShardGroupDeserialize(s4, strlen(s4), &sg), RR_ERROR);
 }
 
+static void test_appendentries_binary(void **state)
+{
+    raft_entry_t *entries[2];
+    entries[0] = raft_entry_new(5);
+    memcpy(entries[0]->data, "hello", 5);
+    entries[0]->term = 7;
+    entries[0]->id = -12345;
+    entries[0]->type = RAFT_LOGTYPE_NORMAL;
+    entries[1] = raft_entry_new(0);
+    entries[1]->term = 8;
+    entries[1]->id = 99;
+    entries[1]->type = RAFT_LOGTYPE_ADD_NODE;
+
+    msg_appendentries_t msg = {
+        .term = 8,
+        .prev_log_idx = 0x100000001L,
+        .prev_log_term = 6,
+        .leader_commit = 0x100000000L,
+        .msg_id = 1000,
+        .n_entries = 2,
+        .entries = entries
+    };
+
+    char blob[RAFT_AE2_BLOB_SIZE(2)];
+    assert_int_equal(AppendEntriesEncode(blob, 2, 1, &msg), sizeof(blob));
+
+    /* Little endian encoding */
+    assert_int_equal(blob[0], 2);
+    assert_int_equal(blob[4], 1);
+
+    msg_appendentries_t dec = { 0 };
+    raft_node_id_t target_id, source_id;
+    assert_int_equal(AppendEntriesDecodeHeader(blob, sizeof(blob),
+                &target_id, &source_id, &dec), RR_OK);
+    assert_int_equal(target_id, 2);
+    assert_int_equal(source_id, 1);
+    assert_int_equal(dec.term, msg.term);
+    assert_int_equal(dec.prev_log_idx, msg.prev_log_idx);
+    assert_int_equal(dec.prev_log_term, msg.prev_log_term);
+    assert_int_equal(dec.leader_commit, msg.leader_commit);
+    assert_int_equal(dec.msg_id, msg.msg_id);
+    assert_int_equal(dec.n_entries, 2);
+
+    for (int i = 0; i < 2; i++) {
+        raft_entry_t *e = AppendEntriesDecodeEntry(blob, i,
+                entries[i]->data, entries[i]->data_len);
+        assert_int_equal(e->term, entries[i]->term);
+        assert_int_equal(e->id, entries[i]->id);
+        assert_int_equal(e->type, entries[i]->type);
+        assert_int_equal(e->data_len, entries[i]->data_len);
+        assert_memory_equal(e->data, entries[i]->data, e->data_len);
+        raft_entry_release(e);
+    }
+
+    /* Truncated header or entries */
+    assert_int_equal(AppendEntriesDecodeHeader(blob, RAFT_AE2_HEADER_SIZE - 1,
+                &target_id, &source_id, &dec), RR_ERROR);
+    assert_int_equal(AppendEntriesDecodeHeader(blob, sizeof(blob) - 1,
+                &target_id, &source_id, &dec), RR_ERROR);
+
+    raft_entry_release(entries[0]);
+    raft_entry_release(entries[1]);
+}
+
 const struct CMUnitTest serialization_tests[] = {
     cmocka_unit_test(test_serialize_redis_command),
     cmocka_unit_test(test_deserialize_redis_command),
     cmocka_unit_test(test_deserialize_redis_command_array),
     cmocka_unit_test(test_deserialize_corrupted_data),
+    cmocka_unit_test(test_serialize_long_argument),
+    cmocka_unit_test(test_serialize_nine_arguments),
+    cmocka_unit_test(test_command_array_view),
     cmocka_unit_test(test_serialize_shardgroup),
     cmocka_unit_test(test_deserialize_shardgroup),
+    cmocka_unit_test(test_appendentries_binary),
     { .test_func = NULL }
 };
@@ -16,6 +16,7 @@
 #include "cmocka.h"
 
 #include "../redisraft.h"
+#include "../lzf.h"
 
 static void test_memory_conversion(void **state)
 {
@@ -124,8 +125,146 @@ static void test_redis_info_iterate(void **state)
     assert_int_equal(RedisInfoIterate(&p, &info_len, &key, &keylen, &val, &vallen), -1);
 }
 
+static void test_lzf(void **state)
+{
+    char in[8192];
+    char out[8192];
+    char back[8192];
+
+    /* Compressible data: repeating text with some variation */
+    for (int i = 0; i < sizeof(in); i++) {
+        in[i] = "abcdefgh"[i % 8] + (i / 1024);
+    }
+
+    size_t clen = lzfCompress(in, sizeof(in), out, sizeof(out));
+    assert_true(clen > 0);
+    assert_true(clen < sizeof(in) / 4);
+    assert_int_equal(lzfDecompress(out, clen, back, sizeof(back)), sizeof(in));
+    assert_memory_equal(in, back, sizeof(in));
+
+    /* Output too small for decompressed data */
+    assert_int_equal(lzfDecompress(out, clen, back, sizeof(back) - 1), 0);
+
+    /* Corrupt back reference pointing before start of output */
+    const char bad[] = { 0x20, 0x10 };
+    assert_int_equal(lzfDecompress(bad, sizeof(bad), back, sizeof(back)), 0);
+
+    /* Incompressible data does not fit into an output buffer of equal size */
+    unsigned int seed = 1;
+    for (int i = 0; i < sizeof(in); i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = seed >> 16;
+    }
+    assert_int_equal(lzfCompress(in, sizeof(in), out, sizeof(out) / 2), 0);
+
+    /* But still round trips given enough space */
+    char big[sizeof(in) + sizeof(in) / 32 + 1];
+    clen = lzfCompress(in, sizeof(in), big, sizeof(big));
+    assert_true(clen > 0);
+    assert_int_equal(lzfDecompress(big, clen, back, sizeof(back)), sizeof(in));
+    assert_memory_equal(in, back, sizeof(in));
+}
+
+#define CMD(s) ((RedisModuleString *) (s))
+
+static void test_command_spec(void **state)
+{
+    const CommandSpec *spec;
+    int first, last;
+
+    /* Lookup is case insensitive and exact */
+    spec = CommandSpecGet(CMD("get"));
+    assert_non_null(spec);
+    assert_string_equal(spec->name, "get");
+    assert_ptr_equal(CommandSpecGet(CMD("GeT")), spec);
+    assert_null(CommandSpecGet(CMD("ge")));
+    assert_null(CommandSpecGet(CMD("gett")));
+    assert_null(CommandSpecGet(CMD("nosuchcommand")));
+    assert_null(CommandSpecGet(CMD("")));
+
+    /* First and last entries, to catch an unsorted table */
+    assert_non_null(CommandSpecGet(CMD("APPEND")));
+    assert_non_null(CommandSpecGet(CMD("ZUNIONSTORE")));
+    assert_non_null(CommandSpecGet(CMD("georadius_ro")));
+    assert_non_null(CommandSpecGet(CMD("georadiusbymember")));
+
+    /* Flags */
+    assert_int_equal(CommandSpecGetFlags(CMD("get")), CMD_SPEC_READONLY);
+    assert_int_equal(CommandSpecGetFlags(CMD("set")), 0);
+    assert_int_equal(CommandSpecGetFlags(CMD("nosuchcommand")), 0);
+    assert_int_equal(CommandSpecGetFlags(CMD("MULTI")), CMD_SPEC_MULTI);
+    assert_int_equal(CommandSpecGetFlags(CMD("exec")), CMD_SPEC_EXEC);
+    assert_int_equal(CommandSpecGetFlags(CMD("discard")), CMD_SPEC_DISCARD);
+    assert_int_equal(CommandSpecGetFlags(CMD("cluster")), CMD_SPEC_CLUSTER);
+    assert_int_equal(CommandSpecGetFlags(CMD("ASKING")), CMD_SPEC_ASKING);
+    assert_true(CommandSpecGetFlags(CMD("eval")) & CMD_SPEC_MOVABLE_KEYS);
+
+    /* Key ranges */
+    assert_true(CommandSpecGetKeyRange(CommandSpecGet(CMD("get")), 2, &first, &last));
+    assert_int_equal(first, 1);
+    assert_int_equal(last, 1);
+
+    assert_true(CommandSpecGetKeyRange(CommandSpecGet(CMD("mset")), 5, &first, &last));
+    assert_int_equal(first, 1);
+    assert_int_equal(last, 4);
+
+    assert_true(CommandSpecGetKeyRange(CommandSpecGet(CMD("blpop")), 4, &first, &last));
+    assert_int_equal(first, 1);
+    assert_int_equal(last, 2);
+
+    assert_true(CommandSpecGetKeyRange(CommandSpecGet(CMD("object")), 3, &first, &last));
+    assert_int_equal(first, 2);
+    assert_int_equal(last, 2);
+
+    /* No keys */
+    assert_false(CommandSpecGetKeyRange(CommandSpecGet(CMD("get")), 1, &first, &last));
+    assert_false(CommandSpecGetKeyRange(CommandSpecGet(CMD("xinfo")), 2, &first, &last));
+    assert_false(CommandSpecGetKeyRange(CommandSpecGet(CMD("dbsize")), 1, &first, &last));
+}
+
+static void test_latency_histogram(void **state)
+{
+    static LatencyHistogram h;
+    uint64_t i, v;
+
+    LatencyHistogramReset(&h);
+    assert_int_equal(LatencyHistogramPercentile(&h, 50), 0);
+
+    /* Small values are exact */
+    for (i = 0; i < 10; i++) {
+        LatencyHistogramRecord(&h, i);
+    }
+    assert_int_equal(h.count, 10);
+    assert_int_equal(h.max, 9);
+    assert_int_equal(LatencyHistogramPercentile(&h, 50), 4);
+    assert_int_equal(LatencyHistogramPercentile(&h, 100), 9);
+    assert_int_equal(LatencyHistogramPercentile(&h, 0), 0);
+
+    /* Larger values are within the bucket precision, and never above max */
+    LatencyHistogramReset(&h);
+    assert_int_equal(h.count, 0);
+    for (i = 1; i <= 100000; i++) {
+        LatencyHistogramRecord(&h, i);
+    }
+    v = LatencyHistogramPercentile(&h, 50);
+    assert_true(v >= 50000 && v <= 50000 + 50000 / 32);
+    v = LatencyHistogramPercentile(&h, 99.9);
+    assert_true(v >= 99900 && v <= 100000);
+    assert_int_equal(LatencyHistogramPercentile(&h, 100), 100000);
+
+    /* Huge values are counted in the last bucket, but max is exact */
+    LatencyHistogramReset(&h);
+    LatencyHistogramRecord(&h, UINT64_MAX);
+    assert_int_equal(h.buckets[LATENCY_HIST_BUCKETS - 1], 1);
+    assert_true(h.max == UINT64_MAX);
+    assert_true(LatencyHistogramPercentile(&h, 50) == (1ULL << LATENCY_HIST_MAX_BITS) - 1);
+}
+
 const struct CMUnitTest util_tests[] = {
     cmocka_unit_test(test_redis_info_iterate),
     cmocka_unit_test(test_memory_conversion),
+    cmocka_unit_test(test_lzf),
+    cmocka_unit_test(test_command_spec),
+    cmocka_unit_test(test_latency_histogram),
     { .test_func = NULL }
 };
@@ -371,3 +371,80 @@ RRStatus formatExactMemorySize(unsigned long value, char *buf, size_t buf_size)
 
     return RR_OK;
 }
+
+/* Latency histograms.
+ *
+ * Values are counted in log-linear buckets, similar to HDR histograms:
+ * values below LATENCY_HIST_SUB_BUCKETS get a bucket each, and every
+ * power of two above is split into LATENCY_HIST_SUB_BUCKETS buckets, so
+ * values are kept with a relative error of about 3%.  Recording a value is
+ * cheap and does not allocate.
+ */
+
+static int latencyHistogramIndex(uint64_t value)
+{
+    if (value < LATENCY_HIST_SUB_BUCKETS) {
+        return (int) value;
+    }
+    if (value >= (1ULL << LATENCY_HIST_MAX_BITS)) {
+        value = (1ULL << LATENCY_HIST_MAX_BITS) - 1;
+    }
+
+    int shift = 63 - __builtin_clzll(value) - LATENCY_HIST_SUB_BITS;
+    return (shift + 1) * LATENCY_HIST_SUB_BUCKETS +
+           (int) ((value >> shift) - LATENCY_HIST_SUB_BUCKETS);
+}
+
+/* Returns the highest value counted in a bucket */
+static uint64_t latencyHistogramBucketValue(int idx)
+{
+    if (idx < LATENCY_HIST_SUB_BUCKETS) {
+        return idx;
+    }
+
+    int shift = idx / LATENCY_HIST_SUB_BUCKETS - 1;
+    uint64_t sub = idx % LATENCY_HIST_SUB_BUCKETS;
+    return ((LATENCY_HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogramRecord(LatencyHistogram *h, uint64_t value)
+{
+    h->buckets[latencyHistogramIndex(value)]++;
+    h->count++;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/* Returns the value at the specified percentile, i.e. the lowest value no
+ * more than @percentile percent of values are larger than.  This is rounded
+ * up to the highest value of its bucket, but never beyond the max value.
+ */
+uint64_t LatencyHistogramPercentile(LatencyHistogram *h, double percentile)
+{
+    uint64_t rank = (uint64_t) (percentile / 100.0 * h->count + 0.5);
+    uint64_t seen = 0;
+    int i;
+
+    if (!h->count) {
+        return 0;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = latencyHistogramBucketValue(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+void LatencyHistogramReset(LatencyHistogram *h)
+{
+    memset(h, 0, sizeof(LatencyHistogram));
+}